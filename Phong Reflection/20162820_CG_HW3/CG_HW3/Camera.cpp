@@ -3,15 +3,20 @@
 
 const Camera::vec3 Camera::center_position() const
 {
-	return  vec3(position_[0] + front_dir_[0],
-		position_[1] + front_dir_[1],
-		position_[2] + front_dir_[2]);
+	return  vec3((float)position_[0] + front_dir_[0],
+		(float)position_[1] + front_dir_[1],
+		(float)position_[2] + front_dir_[2]);
+}
+
+void Camera::move(float delta, const vec3& dir)
+{
+	for (unsigned int i = 0; i < 3; ++i)
+		position_(i) += (double)delta * dir(i);
 }
 
-// TODO: fill up the following functions properly 
 void Camera::move_forward(float delta)
 {
-	position_ += delta * front_dir_;
+	move(delta, front_dir_);
 }
 
 void Camera::move_backward(float delta)
@@ -21,7 +26,7 @@ void Camera::move_backward(float delta)
 
 void Camera::move_left(float delta)
 {
-	position_ -= delta * right_dir_;
+	move(-delta, right_dir_);
 }
 
 void Camera::move_right(float delta)
@@ -31,7 +36,7 @@ void Camera::move_right(float delta)
 
 void Camera::move_up(float delta)
 {
-	position_ += delta * up_dir_;
+	move(delta, up_dir_);
 }
 
 void Camera::move_down(float delta)
@@ -39,17 +44,72 @@ void Camera::move_down(float delta)
 	move_up(-delta);
 }
 
+// rotations about the camera's own axes (degree): compose in the camera frame
 void Camera::pitch(float delta)
 {
-	// TODO: fill up this function properly 
+	rotate_local(delta, vec3(1, 0, 0));
 }
 
 void Camera::yaw(float delta)
 {
-	// TODO: fill up this function properly 
+	rotate_local(delta, vec3(0, 1, 0));
 }
 
 void Camera::roll(float delta)
 {
-	// TODO: fill up this function properly 
-}
\ No newline at end of file
+	rotate_local(delta, vec3(0, 0, -1));
+}
+
+void Camera::rotate_local(float angle, const vec3& axis)
+{
+	set_orientation(orientation_ * quat::axis_angle(angle, axis));
+}
+
+void Camera::set_orientation(const quat& _orientation)
+{
+	// renormalize, so the error of many small rotations does not accumulate
+	orientation_ = _orientation.normalized();
+
+	front_dir_ = orientation_.rotate(vec3(0, 0, -1));
+	up_dir_ = orientation_.rotate(vec3(0, 1, 0));
+	right_dir_ = orientation_.rotate(vec3(1, 0, 0));
+
+	view_dirty_ = true;
+}
+
+void Camera::set_aspect(float _aspect)
+{
+	if (_aspect == aspect_)
+		return;
+
+	aspect_ = _aspect;
+	if (mode_ == kPerspective)
+		proj_dirty_ = true;
+}
+
+// view = R^T, R = rotation of orientation_ (lookAt(0, front, up)); the scene is
+// translated by -world_position() in double instead, so moves keep the cache
+const Camera::mat4& Camera::relative_view_matrix()
+{
+	if (!view_dirty_)
+		return view_;
+
+	view_ = orientation_.conjugate().to_mat4();
+
+	view_dirty_ = false;
+	return view_;
+}
+
+const Camera::mat4& Camera::projection_matrix()
+{
+	if (!proj_dirty_)
+		return proj_;
+
+	if (mode_ == kOrtho)
+		proj_ = kmuvcl::math::ortho(left_, right_, bottom_, top_, near_, far_);
+	else
+		proj_ = kmuvcl::math::perspective(fovy_, aspect_, near_, far_);
+
+	proj_dirty_ = false;
+	return proj_;
+}
@@ -1,5 +1,14 @@
 #pragma once
 #include "../common/vec.hpp"
+#include "../common/mat.hpp"
+#include "../common/quat.hpp"
+
+// orientation_ rotates the camera frame (right +x, up +y, front -z) into the world.
+// The view and projection matrices are cached and rebuilt only after a change
+// (dirty flags), so per-frame queries and high rate mouse input stay cheap.
+// The position is kept in double for large worlds: the view is
+// relative_view_matrix(), the rotation only, and models are made relative to
+// world_position() (kmuvcl::math::camera_relative).
 
 class Camera
 {
@@ -7,6 +16,8 @@ public:
 	typedef typename  kmuvcl::math::vec3f     vec3;
 	typedef typename  kmuvcl::math::vec4f     vec4;
 	typedef typename  kmuvcl::math::mat4x4f   mat4;
+	typedef typename  kmuvcl::math::quatf     quat;
+	typedef typename  kmuvcl::math::vec3d     dvec3;
 
 public:
 	enum Mode { kOrtho, kPerspective };
@@ -24,12 +35,28 @@ public:
 		near_(-1),
 		far_(1),
 		fovy_(45),
-		mode_(kOrtho)
+		aspect_(1),
+		mode_(kOrtho),
+		view_dirty_(true),
+		proj_dirty_(true)
 	{}
 	Camera(const vec3& _position, const vec3& _front_dir, const vec3& _up_dir, float _fovy)
-		: position_(_position), front_dir_(_front_dir), up_dir_(_up_dir), fovy_(_fovy)
+		: position_(_position(0), _position(1), _position(2)),
+		left_(-1),
+		right_(1),
+		bottom_(-1),
+		top_(1),
+		near_(-1),
+		far_(1),
+		fovy_(_fovy),
+		aspect_(1),
+		mode_(kOrtho),
+		view_dirty_(true),
+		proj_dirty_(true)
 	{
-		right_dir_ = kmuvcl::math::cross(front_dir_, up_dir_);
+		vec3 right = kmuvcl::math::cross(_front_dir, _up_dir);
+		vec3 up = kmuvcl::math::cross(right, _front_dir);
+		set_orientation(quat::from_basis(right, up, -1.0f * _front_dir));
 	}
 
 	void move_forward(float delta);
@@ -43,7 +70,13 @@ public:
 	void yaw(float delta);
 	void roll(float delta);
 
-	const vec3  position() const { return  position_; }
+	const quat  orientation() const { return orientation_; }
+	void        set_orientation(const quat& _orientation);
+	void        set_position(const vec3& _position) { set_world_position(dvec3(_position(0), _position(1), _position(2))); }
+	void        set_world_position(const dvec3& _position) { position_ = _position; }
+
+	const vec3  position() const { return  vec3((float)position_(0), (float)position_(1), (float)position_(2)); }
+	const dvec3 world_position() const { return  position_; }
 	const vec3  front_direction() const { return  front_dir_; }
 	const vec3  up_direction() const { return  up_dir_; }
 	const vec3  right_direction() const { return  right_dir_; }
@@ -56,24 +89,34 @@ public:
 	const float		  near() const { return near_; }
 	const float       far() const { return far_; }
 
-	void              set_left(float _left) { left_ = _left; }
-	void              set_right(float _right) { right_ = _right; }
-	void              set_bottom(float _bottom) { bottom_ = _bottom; }
-	void              set_top(float _top) { top_ = _top; }
-	void			  set_near(float _near) { near_ = _near; }
-	void							set_far(float _far) { far_ = _far; }
+	void              set_left(float _left) { left_ = _left; proj_dirty_ = true; }
+	void              set_right(float _right) { right_ = _right; proj_dirty_ = true; }
+	void              set_bottom(float _bottom) { bottom_ = _bottom; proj_dirty_ = true; }
+	void              set_top(float _top) { top_ = _top; proj_dirty_ = true; }
+	void			  set_near(float _near) { near_ = _near; proj_dirty_ = true; }
+	void							set_far(float _far) { far_ = _far; proj_dirty_ = true; }
 
 	const float				fovy() const { return fovy_; }
-	void							set_fovy(float _fovy) { fovy_ = _fovy; }
+	void							set_fovy(float _fovy) { fovy_ = _fovy; proj_dirty_ = true; }
+
+	const float       aspect() const { return aspect_; }
+	void              set_aspect(float _aspect);
 
 	Camera::Mode      mode() const { return mode_; }
-	void              set_mode(Camera::Mode _mode) { mode_ = _mode; }
+	void              set_mode(Camera::Mode _mode) { mode_ = _mode; proj_dirty_ = true; }
+
+	const mat4&       relative_view_matrix();  // view of a camera at the origin, rebuilt only after a rotation
+	const mat4&       projection_matrix();   // rebuilt only after a projection parameter changed
 
 private:
-	vec3  position_;    // position of the camera  
-	vec3  front_dir_;   // front direction of the camera    (it should be a unit vector whose length is 1)
-	vec3  up_dir_;      // up direction of the camera       (it should be a unit vector whose length is 1)
-	vec3  right_dir_;   // right direction of the camera    (it should be a unit vector whose length is 1)
+	void  rotate_local(float angle, const vec3& axis);
+	void  move(float delta, const vec3& dir);
+
+	dvec3 position_;    // position of the camera (double: stays exact kilometers away from the origin)
+	quat  orientation_; // camera frame -> world
+	vec3  front_dir_;   // front direction of the camera    (orientation_ applied to -z)
+	vec3  up_dir_;      // up direction of the camera       (orientation_ applied to +y)
+	vec3  right_dir_;   // right direction of the camera    (orientation_ applied to +x)
 
 	// clipping parameter for orthographic camera
 	float left_, right_, bottom_, top_;
@@ -83,6 +126,12 @@ private:
 	float far_;
 
 	float fovy_;
+	float aspect_;
 
 	Mode  mode_;
+
+	mat4  view_;
+	mat4  proj_;
+	bool  view_dirty_;  // the rotation changed
+	bool  proj_dirty_;
 };
\ No newline at end of file
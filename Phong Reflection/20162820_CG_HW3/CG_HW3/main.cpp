@@ -5,9 +5,12 @@
 #include <iostream>
 #include <fstream>
 #include <cassert>
+#include <cstdlib>
 #include <vector>
 #include <map>
 #include <chrono>
+#include <cmath>
+#include <algorithm>
 
 /* assimp include files. These three are usually needed. */
 // #include <assimp/Importer.hpp>   // C++ importer interface
@@ -16,8 +19,12 @@
 #include <assimp/postprocess.h>
 
 #include "Camera.h"
+#include "ply.hpp"
 #include "../common/vec.hpp"
 #include "../common/transform.hpp"
+#include "../common/quat.hpp"
+#include "../common/inverse.hpp"
+#include "../common/world.hpp"
 
 namespace kmuvcl
 {
@@ -51,6 +58,7 @@ GLint   loc_a_normal;     // attribute 변수 a_normal 위치
 
 GLint   loc_u_PVM;        // uniform 변수 u_PVM 위치
 GLint   loc_u_M;          // uniform 변수 u_M 위치
+GLint   loc_u_N;          // uniform 변수 u_N 위치
 
 GLint   loc_u_view_position_wc;       // uniform 변수 u_view_position_wc 위치
 GLint   loc_u_light_position_wc;      // uniform 변수 u_light_postion_wc 위치
@@ -79,6 +87,14 @@ void init_shader_program();
 ////////////////////////////////////////////////////////////////////////////////
 kmuvcl::math::mat4x4f     mat_model, mat_view, mat_proj;
 kmuvcl::math::mat4x4f     mat_PVM;
+kmuvcl::math::mat3x3f     mat_normal;     // normals: transpose(inverse(model 3x3)), once per object
+
+// large worlds: the model's world transform is kept in double and every frame
+// made relative to the camera before it is rounded to float for the upload, so
+// nothing jitters kilometers away from the origin. mat_model / mat_view above
+// are those camera relative matrices (the camera sits at the origin).
+kmuvcl::math::mat4x4d     mat_model_world;
+kmuvcl::math::vec3d       g_world_offset;   // --world-offset: the scene moved this far away (meters)
 
 float   g_angle = 0.0;
 bool    g_is_animation = false;
@@ -94,6 +110,9 @@ void set_transform();
 // ////////////////////////////////////////////////////////////////////////////////
 const aiScene* scene;
 
+bool g_native_ply = true;           // .ply files: kmuvcl::load_ply() instead of assimp
+kmuvcl::PlyMesh g_ply_mesh;
+
 kmuvcl::math::vec3f view_position_wc;
 
 kmuvcl::math::vec3f light_position_wc;
@@ -108,10 +127,14 @@ kmuvcl::math::vec4f material_specular  = kmuvcl::math::vec4f(1.0f, 1.0f, 1.0f, 1
 float               material_shininess = 60.0f;
 
 bool load_asset(const std::string& filename);
+bool load_ply_asset(const std::string& filename);
+bool is_ply_file(const std::string& filename);
+void run_ply_benchmark(const std::vector<std::string>& filepaths);
 void print_scene_info(const aiScene* scene);
 void print_mesh_info(const aiMesh* mesh);
 
 void init_buffer_objects();     
+void init_ply_buffer_objects(const kmuvcl::PlyMesh& ply);
 void render_object();           // rendering 함수: 물체(삼각형)를 렌더링하는 함수.
 ////////////////////////////////////////////////////////////////////////////////
 
@@ -119,7 +142,22 @@ void render_object();           // rendering 함수: 물체(삼각형)를 렌더
 /// 카메라 및 뷰포트 관련 변수
 ////////////////////////////////////////////////////////////////////////////////
 Camera  camera;
-float   g_aspect = 1.0f;
+
+// mouse-look: 오른쪽 버튼을 누른 채 마우스를 움직이면 카메라가 회전함.
+// The cursor callback may fire many times per frame (high polling rate mice),
+// so it only accumulates the motion; update_camera() turns it into a target
+// orientation once per frame and the camera follows it (slerp).
+const float kLookSensitivity = 0.15f;    // degree per pixel
+const float kLookSmoothing   = 20.0f;    // 1/s, 0: no smoothing
+const float kKeyRotation     = 5.0f;     // degree per arrow/Z/X key press
+
+bool    g_is_looking = false;
+double  g_cursor_x = 0.0, g_cursor_y = 0.0;
+double  g_look_dx = 0.0, g_look_dy = 0.0;   // pixels since the last frame
+Camera::quat  g_look_target;
+bool    g_look_pending = false;             // camera has not reached g_look_target yet
+
+void update_camera(float elapsed_seconds);
 
 void init()
 {
@@ -127,6 +165,8 @@ void init()
 
   camera.set_near(0.1f);
   camera.set_far(100.0f);
+  camera.set_world_position(g_world_offset + camera.world_position());   // same view of the moved scene
+  g_look_target = camera.orientation();
 }
 
 // GLSL 파일을 읽어서 컴파일한 후 쉐이더 객체를 생성하는 함수
@@ -175,6 +215,7 @@ void init_shader_program()
 
   loc_u_PVM = glGetUniformLocation(program, "u_PVM");  
   loc_u_M   = glGetUniformLocation(program, "u_M");
+  loc_u_N   = glGetUniformLocation(program, "u_N");
 
 
   loc_u_view_position_wc = glGetUniformLocation(program, "u_view_position_wc");
@@ -211,6 +252,64 @@ bool load_asset(const std::string& filename)
   }
 }
 
+bool is_ply_file(const std::string& filename)
+{
+  return filename.size() >= 4 && (filename.compare(filename.size() - 4, 4, ".ply") == 0 
+                               || filename.compare(filename.size() - 4, 4, ".PLY") == 0);
+}
+
+// native PLY loader, straight into g_ply_mesh (no aiScene)
+bool load_ply_asset(const std::string& filename)
+{
+  kmuvcl::PlyStats stats;
+  if (!kmuvcl::load_ply(filename, g_ply_mesh, 0, &stats))
+    return false;
+
+  std::cout << filename << ": " << stats.format << ", " << g_ply_mesh.num_vertices() << " vertices, " 
+            << g_ply_mesh.indices.size()/3 << " triangles, " << stats.total_ms << " ms (" 
+            << stats.mb_per_s() << " MB/s, " << stats.threads << " threads)" << std::endl;
+  return true;
+}
+
+// load throughput of kmuvcl::load_ply() and aiImportFile() on the same files (no window)
+void run_ply_benchmark(const std::vector<std::string>& filepaths)
+{
+  const int kruns = 20;
+
+  std::cout << "file\tbytes\tnative (ms)\tnative (MB/s)\tassimp (ms)\tassimp (MB/s)\tspeedup" << std::endl;
+  for (int i = 0; i < filepaths.size(); ++i)
+  {
+    const std::string& filename = filepaths[i];
+    kmuvcl::PlyStats stats;
+    double native_ms = 0.0, assimp_ms = 0.0;
+
+    for (int r = 0; r < kruns; ++r)
+    {
+      kmuvcl::PlyMesh ply;
+      if (!kmuvcl::load_ply(filename, ply, 0, &stats))
+        return;
+      native_ms += stats.total_ms;
+
+      std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+      const aiScene* s = aiImportFile(filename.c_str(), aiProcessPreset_TargetRealtime_MaxQuality);
+      assimp_ms += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+      if (!s)
+      {
+        std::cerr << filename << ": assimp import failed" << std::endl;
+        return;
+      }
+      aiReleaseImport(s);
+    }
+
+    native_ms /= kruns;
+    assimp_ms /= kruns;
+    const double mb = stats.bytes / (1024.0*1024.0);
+
+    std::cout << filename << "\t" << stats.bytes << "\t" << native_ms << "\t" << mb/(native_ms/1000.0) << "\t"
+              << assimp_ms << "\t" << mb/(assimp_ms/1000.0) << "\t" << assimp_ms/native_ms << "x" << std::endl;
+  }
+}
+
 void print_mesh_info(const aiMesh* mesh)
 {
   std::cout << "print mesh info" << std::endl;
@@ -312,39 +411,59 @@ void init_buffer_objects()
   }  
 }
 
-void set_transform()
+// one mesh, all triangles in one index buffer
+void init_ply_buffer_objects(const kmuvcl::PlyMesh& ply)
 {
-  kmuvcl::math::vec3f eye     = camera.position();
-  kmuvcl::math::vec3f up      = camera.up_direction();
-  kmuvcl::math::vec3f center  = eye + camera.front_direction();
-
-  mat_view = kmuvcl::math::lookAt(eye[0], eye[1], eye[2],
-                                  center[0], center[1], center[2],
-                                  up[0], up[1], up[2]);
+  kmuvcl::Mesh mesh_object;
 
-  float n = camera.near();
-  float f = camera.far();
+  glGenBuffers(1, &mesh_object.position_buffer);
+  glBindBuffer(GL_ARRAY_BUFFER, mesh_object.position_buffer);
+  glBufferData(GL_ARRAY_BUFFER, sizeof(GLfloat) * ply.positions.size(), ply.positions.data(), GL_STATIC_DRAW);
 
-  if (camera.mode() == Camera::kOrtho)
-  {
-    float l = camera.left();
-    float r = camera.right();
-    float b = camera.bottom();
-    float t = camera.top();
+  glGenBuffers(1, &mesh_object.normal_buffer);
+  glBindBuffer(GL_ARRAY_BUFFER, mesh_object.normal_buffer);
+  glBufferData(GL_ARRAY_BUFFER, sizeof(GLfloat) * ply.normals.size(), ply.normals.data(), GL_STATIC_DRAW);
 
-    mat_proj = kmuvcl::math::ortho(l, r, b, t, n, f);
-  }
-  else if (camera.mode() == Camera::kPerspective)
+  glGenBuffers(1, &mesh_object.color_buffer);
+  glBindBuffer(GL_ARRAY_BUFFER, mesh_object.color_buffer);
+  mesh_object.is_color = !ply.colors.empty();
+  if (mesh_object.is_color)
   {
-    mat_proj = kmuvcl::math::perspective(camera.fovy(), g_aspect, n, f);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(GLfloat) * ply.colors.size(), ply.colors.data(), GL_STATIC_DRAW);
   }
 
+  kmuvcl::Face face_object;
+  face_object.num_indices = ply.indices.size();
+
+  glGenBuffers(1, &face_object.index_buffer);
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, face_object.index_buffer);
+  glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(GLuint) * ply.indices.size(), ply.indices.data(), GL_STATIC_DRAW);
+
+  mesh_object.faces.push_back(face_object);
+  meshes.push_back(mesh_object);
+}
+
+void set_transform()
+{
+  // cached by the camera: rebuilt only after it rotated or changed projection
+  mat_view = camera.relative_view_matrix();
+  mat_proj = camera.projection_matrix();
+
   // set object transformation
 
-  mat_model = kmuvcl::math::rotate(g_angle*0.7f, 0.0f, 0.0f, 1.0f);
-  mat_model = kmuvcl::math::rotate(g_angle*1.0f, 0.0f, 1.0f, 0.0f)*mat_model;
-  mat_model = kmuvcl::math::rotate(g_angle*0.5f, 1.0f, 0.0f, 0.0f)*mat_model;
-  mat_model = kmuvcl::math::translate(0.0f, 0.0f, -4.0f)*mat_model;
+  // Rx(0.5a)*Ry(a)*Rz(0.7a) composed as quaternions: one 4x4 instead of three rotate() products
+  kmuvcl::math::quatd rotation = kmuvcl::math::quatd::axis_angle(g_angle*0.5, kmuvcl::math::vec3d(1.0, 0.0, 0.0))
+                               * kmuvcl::math::quatd::axis_angle(g_angle*1.0, kmuvcl::math::vec3d(0.0, 1.0, 0.0))
+                               * kmuvcl::math::quatd::axis_angle(g_angle*0.7, kmuvcl::math::vec3d(0.0, 0.0, 1.0));
+  mat_model_world = rotation.to_mat4();
+  mat_model_world(0, 3) = g_world_offset(0);
+  mat_model_world(1, 3) = g_world_offset(1);
+  mat_model_world(2, 3) = g_world_offset(2) - 4.0;    // translate(0, 0, -4)
+
+  mat_model = kmuvcl::math::camera_relative(mat_model_world, camera.world_position());
+
+  // per object, not per vertex: stays correct if the model ever scales non-uniformly
+  mat_normal = kmuvcl::math::normal_matrix(mat_model);
   
 }
 /*
@@ -399,12 +518,81 @@ if (key == GLFW_KEY_B && action == GLFW_PRESS){
         camera.set_mode(camera.mode() == Camera::kOrtho ? Camera::kPerspective : Camera::kOrtho);
 }
 
+  // 방향키: yaw/pitch, Z/X: roll (camera 좌표계 기준)
+  if (action == GLFW_PRESS || action == GLFW_REPEAT)
+  {
+    kmuvcl::math::vec3f axis;
+    float angle = kKeyRotation;
+
+    if (key == GLFW_KEY_LEFT)       axis = kmuvcl::math::vec3f(0.0f, 1.0f, 0.0f);
+    else if (key == GLFW_KEY_RIGHT) axis = kmuvcl::math::vec3f(0.0f, -1.0f, 0.0f);
+    else if (key == GLFW_KEY_UP)    axis = kmuvcl::math::vec3f(1.0f, 0.0f, 0.0f);
+    else if (key == GLFW_KEY_DOWN)  axis = kmuvcl::math::vec3f(-1.0f, 0.0f, 0.0f);
+    else if (key == GLFW_KEY_Z)     axis = kmuvcl::math::vec3f(0.0f, 0.0f, -1.0f);
+    else if (key == GLFW_KEY_X)     axis = kmuvcl::math::vec3f(0.0f, 0.0f, 1.0f);
+    else                            angle = 0.0f;
+
+    if (angle != 0.0f)
+    {
+      g_look_target = (g_look_target * Camera::quat::axis_angle(angle, axis)).normalized();
+      g_look_pending = true;
+    }
+  }
+}
+
+void mouse_button_callback(GLFWwindow* window, int button, int action, int mods)
+{
+  if (button != GLFW_MOUSE_BUTTON_RIGHT)
+    return;
+
+  g_is_looking = (action == GLFW_PRESS);
+  if (g_is_looking)
+    glfwGetCursorPos(window, &g_cursor_x, &g_cursor_y);
 }
+
+// called for every mouse report: no matrix or quaternion work here
+void cursor_pos_callback(GLFWwindow* window, double x, double y)
+{
+  if (g_is_looking)
+  {
+    g_look_dx += x - g_cursor_x;
+    g_look_dy += y - g_cursor_y;
+  }
+  g_cursor_x = x;
+  g_cursor_y = y;
+}
+
+// once per frame: accumulated mouse motion -> target orientation -> camera
+void update_camera(float elapsed_seconds)
+{
+  if (g_look_dx != 0.0 || g_look_dy != 0.0)
+  {
+    Camera::quat yaw = Camera::quat::axis_angle(-kLookSensitivity*(float)g_look_dx, kmuvcl::math::vec3f(0.0f, 1.0f, 0.0f));
+    Camera::quat pitch = Camera::quat::axis_angle(-kLookSensitivity*(float)g_look_dy, kmuvcl::math::vec3f(1.0f, 0.0f, 0.0f));
+    g_look_target = (g_look_target * yaw * pitch).normalized();
+    g_look_dx = g_look_dy = 0.0;
+    g_look_pending = true;
+  }
+
+  if (!g_look_pending)
+    return;     // nothing changed: the view matrix stays cached
+
+  const Camera::quat current = camera.orientation();
+  if (kLookSmoothing <= 0.0f || std::fabs(kmuvcl::math::dot(current, g_look_target)) > 0.999999f)
+  {
+    camera.set_orientation(g_look_target);
+    g_look_pending = false;
+  }
+  else
+    camera.set_orientation(kmuvcl::math::slerp(current, g_look_target, std::min(1.0f, kLookSmoothing*elapsed_seconds)));
+}
+
 void frambuffer_size_callback(GLFWwindow* window, int width, int height)
 {
   glViewport(0, 0, width, height);
 
-  g_aspect = (float)width / (float)height;
+  if (height > 0)
+    camera.set_aspect((float)width / (float)height);
 }
 
 // object rendering: 현재 scene은 삼각형 하나로 구성되어 있음.
@@ -418,11 +606,12 @@ void render_object()
   mat_PVM = mat_proj * mat_view * mat_model;
   glUniformMatrix4fv(loc_u_PVM, 1, GL_FALSE, mat_PVM);
   glUniformMatrix4fv(loc_u_M, 1, GL_FALSE, mat_model);
+  glUniformMatrix3fv(loc_u_N, 1, GL_FALSE, mat_normal);
 
-  glUniform3fv(loc_u_view_position_wc, 1, camera.position());
-
-
-  glUniform3f(loc_u_light_position_wc, g_translatelight_x, g_translatelight_y, g_translatelight_z);
+  // lighting in the same camera relative space: the viewer at the origin, the light moved with the scene
+  kmuvcl::math::vec3d light_position = g_world_offset + kmuvcl::math::vec3d(g_translatelight_x, g_translatelight_y, g_translatelight_z);
+  glUniform3f(loc_u_view_position_wc, 0.0f, 0.0f, 0.0f);
+  glUniform3fv(loc_u_light_position_wc, 1, kmuvcl::math::camera_relative(light_position, camera.world_position()));
   glUniform4f(loc_u_light_ambient, 1.0f, 1.0f, 1.0f, 1.0f);
   glUniform4f(loc_u_light_diffuse, 1.0f, 1.0f, 1.0f, 1.0f);
   glUniform4f(loc_u_light_specular, 1.0f, 1.0f, 1.0f, 1.0f);
@@ -475,13 +664,41 @@ void render_object()
 
 int main(int argc, char* argv[])
 {
-  if (argc < 2)
+  std::vector<std::string> filepaths;
+  bool ply_bench = false;
+
+  for (int i = 1; i < argc; ++i)
+  {
+    std::string arg = argv[i];
+
+    if (arg == "--assimp")
+      g_native_ply = false;
+    else if (arg == "--ply-bench")
+      ply_bench = true;
+    else if (arg == "--world-offset" && i + 1 < argc)
+    {
+      double meters = std::atof(argv[++i]);
+      g_world_offset = kmuvcl::math::vec3d(meters, 0.0, meters);
+    }
+    else
+      filepaths.push_back(arg);
+  }
+
+  if (filepaths.empty())
   {
     std::cerr << "neeed model filepath!" << std::endl;
-    std::cerr << "usage: Phongassimp [model_filepath]" << std::endl;
+    std::cerr << "usage: Phongassimp [--assimp] [--world-offset meters] [model_filepath]" << std::endl;
+    std::cerr << "       Phongassimp --ply-bench [model_filepath ...]" << std::endl;
     return -1;
   }
 
+  // PLY 로딩 성능 비교 (no window)
+  if (ply_bench)
+  {
+    run_ply_benchmark(filepaths);
+    return 0;
+  }
+
   GLFWwindow* window;
 
   // Initialize GLFW library
@@ -510,33 +727,49 @@ int main(int argc, char* argv[])
   init();
   init_shader_program();
 
-  if (!load_asset(argv[1]))
+  if (g_native_ply && is_ply_file(filepaths[0]))
   {
-    std::cout << "Failed to load a asset file" << std::endl;
-    return -1;
+    if (!load_ply_asset(filepaths[0]))
+    {
+      std::cout << "Failed to load a asset file" << std::endl;
+      return -1;
+    }
+    init_ply_buffer_objects(g_ply_mesh);
   }
+  else
+  {
+    if (!load_asset(filepaths[0]))
+    {
+      std::cout << "Failed to load a asset file" << std::endl;
+      return -1;
+    }
 
-  print_scene_info(scene);
+    print_scene_info(scene);
 
-  init_buffer_objects();
+    init_buffer_objects();
+  }
 
   glfwSetKeyCallback(window, key_callback);
 
   glfwSetFramebufferSizeCallback(window, frambuffer_size_callback);
 
+  glfwSetMouseButtonCallback(window, mouse_button_callback);
+  glfwSetCursorPosCallback(window, cursor_pos_callback);
+
   // Loop until the user closes the window
   while (!glfwWindowShouldClose(window))
   {
     glClearColor(0.5f, 0.5f, 0.5f, 1.0f);
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-    set_transform();
-    render_object();
-
     curr = std::chrono::system_clock::now();
     std::chrono::duration<float> elaped_seconds = (curr - prev);
     prev = curr;
 
+    update_camera(std::min(elaped_seconds.count(), 0.1f));
+    set_transform();
+    render_object();
+
     if (g_is_animation)
     {
       g_angle += 30.0f * elaped_seconds.count();
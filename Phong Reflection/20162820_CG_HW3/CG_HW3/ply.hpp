@@ -0,0 +1,908 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <iostream>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <algorithm>
+#include <cstring>
+#include <cstdlib>
+#include <cstdint>
+#include <cmath>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <emmintrin.h>
+
+#include <GL/glew.h>
+
+////////////////////////////////////////////////////////////////////////////////
+/// PLY 로더 (native, streaming)
+///
+/// Reads ascii, binary_little_endian and binary_big_endian PLY files straight
+/// into GPU ready arrays, without going through aiScene:
+///
+///   positions  3 x float per vertex
+///   normals    3 x float per vertex (from the file, or area weighted)
+///   colors     4 x float per vertex in [0,1], empty if the file has none
+///   indices    triangles, polygons split into fans
+///
+/// The file is memory mapped. ASCII bodies are split into lines with SSE2
+/// (16 bytes per compare) and the lines are parsed in parallel chunks;
+/// numbers go through a SWAR parser that converts 8 digits at once. Binary
+/// vertices are fixed size records and are converted in parallel chunks too;
+/// binary faces have variable size and are read in one pass.
+////////////////////////////////////////////////////////////////////////////////
+namespace kmuvcl
+{
+  // read only mapping of a whole file
+  class MappedFile
+  {
+  public:
+    ~MappedFile() { close(); }
+
+    bool open(const std::string& filename)
+    {
+      close();
+
+      int fd = ::open(filename.c_str(), O_RDONLY);
+      if (fd < 0)
+        return false;
+
+      struct stat st;
+      if (fstat(fd, &st) != 0 || st.st_size == 0)
+      {
+        ::close(fd);
+        return false;
+      }
+
+      void* p = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+      ::close(fd);
+      if (p == MAP_FAILED)
+        return false;
+
+      // read front to back
+      madvise(p, st.st_size, MADV_SEQUENTIAL);
+      madvise(p, st.st_size, MADV_WILLNEED);
+
+      data_ = (const char*)p;
+      size_ = st.st_size;
+      return true;
+    }
+
+    void close()
+    {
+      if (data_)
+        munmap((void*)data_, size_);
+      data_ = NULL;
+      size_ = 0;
+    }
+
+    const char* data() const { return data_; }
+    size_t      size() const { return size_; }
+
+  private:
+    const char* data_ = NULL;
+    size_t      size_ = 0;
+  };
+
+  struct PlyMesh
+  {
+    std::vector<GLfloat> positions;
+    std::vector<GLfloat> normals;
+    std::vector<GLfloat> colors;
+    std::vector<GLuint>  indices;
+
+    size_t num_vertices() const { return positions.size()/3; }
+  };
+
+  struct PlyStats
+  {
+    std::string   format;
+    size_t        bytes = 0;
+    unsigned int  threads = 1;
+    double        parse_ms = 0.0;     // header and body
+    double        normal_ms = 0.0;    // generated normals
+    double        total_ms = 0.0;     // including the mapping
+
+    double mb_per_s() const { return total_ms > 0.0 ? bytes / (1024.0*1024.0) / (total_ms / 1000.0) : 0.0; }
+  };
+
+  //////////////////////////////////////////////////////////////////////////////
+  // number parsing
+  //////////////////////////////////////////////////////////////////////////////
+
+  inline bool ply_is_space(char c) { return c == ' ' || c == '\t' || c == '\r' || c == '\n'; }
+  inline bool ply_is_digit(char c) { return (unsigned char)(c - '0') < 10; }
+
+  // the 8 bytes at p are all ascii digits
+  inline bool ply_is_eight_digits(const char* p, const char* end)
+  {
+    if (end - p < 8)
+      return false;
+    uint64_t v;
+    std::memcpy(&v, p, 8);
+    return (((v & 0xF0F0F0F0F0F0F0F0ull) | (((v + 0x0606060606060606ull) & 0xF0F0F0F0F0F0F0F0ull) >> 4))
+            == 0x3333333333333333ull);
+  }
+
+  // 8 ascii digits -> value, 3 multiplies instead of 8 (little endian)
+  inline uint32_t ply_parse_eight_digits(const char* p)
+  {
+    uint64_t v;
+    std::memcpy(&v, p, 8);
+    v -= 0x3030303030303030ull;
+    v = (v * 10) + (v >> 8);
+    v = (((v & 0x000000FF000000FFull) * (100 + (1000000ull << 32)))
+       + (((v >> 16) & 0x000000FF000000FFull) * (1 + (10000ull << 32)))) >> 32;
+    return (uint32_t)v;
+  }
+
+  // digits at p into m; at most 19 significant digits are kept, the number of dropped ones is returned
+  inline int ply_parse_digits(const char*& p, const char* end, uint64_t& m, int& digits)
+  {
+    int dropped = 0;
+    while (digits <= 11 && ply_is_eight_digits(p, end))
+    {
+      m = m*100000000ull + ply_parse_eight_digits(p);
+      p += 8;
+      digits += 8;
+    }
+    while (p < end && ply_is_digit(*p))
+    {
+      if (digits < 19)
+      {
+        m = m*10 + (*p - '0');
+        digits += (m != 0);   // leading zeros do not count
+      }
+      else
+      {
+        dropped++;
+      }
+      ++p;
+    }
+    return dropped;
+  }
+
+  // number at p (after white space), p is moved past it; false if there is none
+  inline bool ply_parse_double(const char*& p, const char* end, double& value)
+  {
+    static const double kpow10[] = {
+      1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+      1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+    };
+
+    while (p < end && ply_is_space(*p))
+      ++p;
+    if (p == end)
+      return false;
+
+    const char* start = p;
+    bool negative = (*p == '-');
+    p += (*p == '-' || *p == '+');
+
+    uint64_t m = 0;
+    int digits = 0, exponent = 0;
+    const char* first_digit = p;
+
+    exponent += ply_parse_digits(p, end, m, digits);
+    if (p < end && *p == '.')
+    {
+      ++p;
+      const char* fraction = p;
+      int dropped = ply_parse_digits(p, end, m, digits);
+      exponent -= (int)(p - fraction) - dropped;
+    }
+
+    // "." alone, nan, inf, ...: leave it to strtod
+    if (p == first_digit || (p == first_digit + 1 && *first_digit == '.'))
+    {
+      char* e;
+      value = std::strtod(start, &e);
+      p = e;
+      return e != start;
+    }
+
+    if (p < end && (*p == 'e' || *p == 'E'))
+    {
+      const char* e = p + 1;
+      bool e_negative = (e < end && *e == '-');
+      e += (e < end && (*e == '-' || *e == '+'));
+      int x = 0;
+      while (e < end && ply_is_digit(*e))
+      {
+        x = std::min(x*10 + (*e - '0'), 100000);
+        ++e;
+      }
+      if (e > p + 1 && ply_is_digit(e[-1]))
+      {
+        exponent += e_negative ? -x : x;
+        p = e;
+      }
+    }
+
+    // exact in double (m < 2^53, |exponent| <= 22), else strtod on the token
+    if (m < (1ull << 53) && exponent >= -22 && exponent <= 22)
+    {
+      double d = (double)m;
+      d = (exponent < 0) ? d / kpow10[-exponent] : d * kpow10[exponent];
+      value = negative ? -d : d;
+    }
+    else
+    {
+      value = std::strtod(start, NULL);
+    }
+    return true;
+  }
+
+  inline bool ply_parse_uint(const char*& p, const char* end, uint32_t& value)
+  {
+    while (p < end && ply_is_space(*p))
+      ++p;
+
+    const char* start = p;
+    uint32_t v = 0;
+    while (p < end && ply_is_digit(*p))
+    {
+      v = v*10 + (*p - '0');
+      ++p;
+    }
+    value = v;
+    return p != start;
+  }
+
+  // offsets of the line starts in [begin, end), 16 bytes per step
+  inline void ply_find_lines(const char* begin, const char* end, std::vector<size_t>& lines)
+  {
+    lines.clear();
+    lines.push_back(0);
+
+    const __m128i newline = _mm_set1_epi8('\n');
+    const char* p = begin;
+    for (; p + 16 <= end; p += 16)
+    {
+      __m128i chunk = _mm_loadu_si128((const __m128i*)p);
+      unsigned int mask = _mm_movemask_epi8(_mm_cmpeq_epi8(chunk, newline));
+      while (mask)
+      {
+        int bit = __builtin_ctz(mask);
+        lines.push_back(p - begin + bit + 1);
+        mask &= mask - 1;
+      }
+    }
+    for (; p < end; ++p)
+    {
+      if (*p == '\n')
+        lines.push_back(p - begin + 1);
+    }
+  }
+
+  //////////////////////////////////////////////////////////////////////////////
+  // header
+  //////////////////////////////////////////////////////////////////////////////
+
+  enum ply_type {kply_none, kply_int8, kply_uint8, kply_int16, kply_uint16,
+                 kply_int32, kply_uint32, kply_float32, kply_float64};
+
+  inline ply_type ply_parse_type(const std::string& s)
+  {
+    if (s == "char"   || s == "int8")     return kply_int8;
+    if (s == "uchar"  || s == "uint8")    return kply_uint8;
+    if (s == "short"  || s == "int16")    return kply_int16;
+    if (s == "ushort" || s == "uint16")   return kply_uint16;
+    if (s == "int"    || s == "int32")    return kply_int32;
+    if (s == "uint"   || s == "uint32")   return kply_uint32;
+    if (s == "float"  || s == "float32")  return kply_float32;
+    if (s == "double" || s == "float64")  return kply_float64;
+    return kply_none;
+  }
+
+  inline size_t ply_type_size(ply_type t)
+  {
+    static const size_t sizes[] = { 0, 1, 1, 2, 2, 4, 4, 4, 8 };
+    return sizes[t];
+  }
+
+  // scale to [0,1] for colors stored as integers
+  inline double ply_type_unorm(ply_type t)
+  {
+    switch (t)
+    {
+      case kply_uint8:  return 1.0/255.0;
+      case kply_uint16: return 1.0/65535.0;
+      default:          return 1.0;
+    }
+  }
+
+  // destination of a vertex property
+  enum ply_slot {kply_skip = -1, kply_x, kply_y, kply_z, kply_nx, kply_ny, kply_nz,
+                 kply_red, kply_green, kply_blue, kply_alpha, knum_ply_slots};
+
+  struct PlyProperty
+  {
+    std::string name;
+    ply_type    type = kply_none;
+    ply_type    count_type = kply_none;   // list properties only
+    int         slot = kply_skip;
+
+    bool is_list() const { return count_type != kply_none; }
+  };
+
+  struct PlyElement
+  {
+    std::string name;
+    size_t      count = 0;
+    std::vector<PlyProperty> properties;
+
+    // bytes per record in binary files, 0 if it has list properties
+    size_t record_size() const
+    {
+      size_t size = 0;
+      for (unsigned int i = 0; i < properties.size(); ++i)
+      {
+        if (properties[i].is_list())
+          return 0;
+        size += ply_type_size(properties[i].type);
+      }
+      return size;
+    }
+  };
+
+  enum ply_format {kply_ascii, kply_binary_le, kply_binary_be};
+
+  struct PlyHeader
+  {
+    ply_format  format = kply_ascii;
+    std::vector<PlyElement> elements;
+    size_t      body = 0;             // offset of the first byte after end_header
+  };
+
+  inline int ply_vertex_slot(const std::string& name)
+  {
+    const char* names[knum_ply_slots] = { "x", "y", "z", "nx", "ny", "nz", "red", "green", "blue", "alpha" };
+    for (int i = 0; i < knum_ply_slots; ++i)
+      if (name == names[i])
+        return i;
+
+    if (name == "r") return kply_red;
+    if (name == "g") return kply_green;
+    if (name == "b") return kply_blue;
+    if (name == "a") return kply_alpha;
+    return kply_skip;
+  }
+
+  inline bool ply_parse_header(const char* data, size_t size, PlyHeader& header, std::string& error)
+  {
+    const char* p = data;
+    const char* end = data + size;
+
+    if (size < 4 || std::strncmp(p, "ply", 3) != 0 || (p[3] != '\n' && p[3] != '\r'))
+    {
+      error = "not a ply file";
+      return false;
+    }
+
+    while (p < end)
+    {
+      const char* eol = (const char*)std::memchr(p, '\n', end - p);
+      if (!eol)
+        eol = end;
+
+      std::string line(p, eol);
+      if (!line.empty() && line[line.size() - 1] == '\r')
+        line.erase(line.size() - 1);
+      p = (eol < end) ? eol + 1 : end;
+
+      std::vector<std::string> words;
+      size_t i = 0;
+      while (i < line.size())
+      {
+        while (i < line.size() && ply_is_space(line[i]))
+          ++i;
+        size_t j = i;
+        while (j < line.size() && !ply_is_space(line[j]))
+          ++j;
+        if (j > i)
+          words.push_back(line.substr(i, j - i));
+        i = j;
+      }
+
+      if (words.empty() || words[0] == "ply" || words[0] == "comment" || words[0] == "obj_info")
+        continue;
+
+      if (words[0] == "format" && words.size() >= 2)
+      {
+        if (words[1] == "ascii")                      header.format = kply_ascii;
+        else if (words[1] == "binary_little_endian")  header.format = kply_binary_le;
+        else if (words[1] == "binary_big_endian")     header.format = kply_binary_be;
+        else
+        {
+          error = "unknown format " + words[1];
+          return false;
+        }
+      }
+      else if (words[0] == "element" && words.size() >= 3)
+      {
+        PlyElement e;
+        e.name  = words[1];
+        e.count = std::strtoull(words[2].c_str(), NULL, 10);
+        header.elements.push_back(e);
+      }
+      else if (words[0] == "property" && !header.elements.empty())
+      {
+        PlyElement& e = header.elements.back();
+        PlyProperty prop;
+
+        if (words.size() >= 5 && words[1] == "list")
+        {
+          prop.count_type = ply_parse_type(words[2]);
+          prop.type       = ply_parse_type(words[3]);
+          prop.name       = words[4];
+        }
+        else if (words.size() >= 3)
+        {
+          prop.type = ply_parse_type(words[1]);
+          prop.name = words[2];
+        }
+
+        if (prop.type == kply_none || (words[1] == "list" && prop.count_type == kply_none))
+        {
+          error = "bad property: " + line;
+          return false;
+        }
+
+        if (e.name == "vertex" && !prop.is_list())
+          prop.slot = ply_vertex_slot(prop.name);
+        e.properties.push_back(prop);
+      }
+      else if (words[0] == "end_header")
+      {
+        header.body = p - data;
+        return true;
+      }
+    }
+
+    error = "no end_header";
+    return false;
+  }
+
+  //////////////////////////////////////////////////////////////////////////////
+  // body
+  //////////////////////////////////////////////////////////////////////////////
+
+  // what the vertex properties fill in
+  struct PlyVertexLayout
+  {
+    bool    has_normals = false;
+    bool    has_colors = false;
+    double  scale[knum_ply_slots];      // unorm scale of the colors
+
+    explicit PlyVertexLayout(const PlyElement& e)
+    {
+      std::fill(scale, scale + knum_ply_slots, 1.0);
+      for (unsigned int i = 0; i < e.properties.size(); ++i)
+      {
+        const PlyProperty& prop = e.properties[i];
+        if (prop.slot >= kply_nx && prop.slot <= kply_nz)
+          has_normals = true;
+        if (prop.slot >= kply_red)
+        {
+          has_colors = true;
+          scale[prop.slot] = ply_type_unorm(prop.type);
+        }
+      }
+    }
+  };
+
+  inline void ply_store_vertex(const double* v, size_t i, const PlyVertexLayout& layout, PlyMesh& mesh)
+  {
+    GLfloat* pos = &mesh.positions[3*i];
+    pos[0] = (GLfloat)v[kply_x];
+    pos[1] = (GLfloat)v[kply_y];
+    pos[2] = (GLfloat)v[kply_z];
+
+    if (layout.has_normals)
+    {
+      GLfloat* n = &mesh.normals[3*i];
+      n[0] = (GLfloat)v[kply_nx];
+      n[1] = (GLfloat)v[kply_ny];
+      n[2] = (GLfloat)v[kply_nz];
+    }
+    if (layout.has_colors)
+    {
+      GLfloat* c = &mesh.colors[4*i];
+      for (int k = 0; k < 4; ++k)
+        c[k] = (GLfloat)(v[kply_red + k] * layout.scale[kply_red + k]);
+    }
+  }
+
+  // polygon (n indices) -> triangle fan
+  inline void ply_append_polygon(const uint32_t* ids, uint32_t n, std::vector<GLuint>& indices)
+  {
+    for (uint32_t k = 2; k < n; ++k)
+    {
+      indices.push_back(ids[0]);
+      indices.push_back(ids[k - 1]);
+      indices.push_back(ids[k]);
+    }
+  }
+
+  // calls job(first, last) for [0, n) split into at most threads chunks of at least min_chunk
+  template <typename Job>
+  void ply_parallel_for(size_t n, unsigned int threads, size_t min_chunk, Job job)
+  {
+    size_t chunks = std::max<size_t>(1, std::min<size_t>(threads, n / std::max<size_t>(1, min_chunk)));
+    if (chunks == 1)
+    {
+      job(0, n, 0);
+      return;
+    }
+
+    std::vector<std::thread> workers;
+    for (size_t c = 0; c < chunks; ++c)
+      workers.push_back(std::thread(job, n*c/chunks, n*(c + 1)/chunks, c));
+    for (unsigned int c = 0; c < workers.size(); ++c)
+      workers[c].join();
+  }
+
+  const size_t kply_min_chunk = 4096;   // lines / records per thread
+
+  inline bool ply_read_ascii(const char* body, const char* end, const PlyHeader& header,
+                             unsigned int threads, PlyMesh& mesh, std::string& error)
+  {
+    std::vector<size_t> lines;
+    ply_find_lines(body, end, lines);
+
+    size_t line = 0;
+    for (unsigned int ei = 0; ei < header.elements.size(); ++ei)
+    {
+      const PlyElement& e = header.elements[ei];
+      if (line + e.count > lines.size())
+      {
+        error = "file ends inside element " + e.name;
+        return false;
+      }
+
+      const size_t first_line = line;
+      line += e.count;
+
+      if (e.name == "vertex")
+      {
+        PlyVertexLayout layout(e);
+        std::atomic<bool> ok(true);
+
+        ply_parallel_for(e.count, threads, kply_min_chunk, [&](size_t first, size_t last, size_t)
+        {
+          double v[knum_ply_slots] = { 0, 0, 0, 0, 0, 0, 0, 0, 0, 1.0 };
+          for (size_t i = first; i < last; ++i)
+          {
+            const char* p = body + lines[first_line + i];
+            for (unsigned int k = 0; k < e.properties.size(); ++k)
+            {
+              double value;
+              if (!ply_parse_double(p, end, value))
+              {
+                ok = false;
+                return;
+              }
+              if (e.properties[k].slot != kply_skip)
+                v[e.properties[k].slot] = value;
+            }
+            ply_store_vertex(v, i, layout, mesh);
+          }
+        });
+
+        if (!ok)
+        {
+          error = "bad vertex data";
+          return false;
+        }
+      }
+      else if (e.name == "face")
+      {
+        std::vector<std::vector<GLuint> > parts(std::max(1u, threads));
+        std::atomic<bool> ok(true);
+
+        ply_parallel_for(e.count, threads, kply_min_chunk, [&](size_t first, size_t last, size_t c)
+        {
+          std::vector<GLuint>& out = parts[c];
+          out.reserve((last - first)*3);
+
+          std::vector<uint32_t> ids;
+          for (size_t i = first; i < last; ++i)
+          {
+            const char* p = body + lines[first_line + i];
+            for (unsigned int k = 0; k < e.properties.size(); ++k)
+            {
+              const PlyProperty& prop = e.properties[k];
+              double value;
+
+              if (!prop.is_list())
+              {
+                if (!ply_parse_double(p, end, value))
+                  ok = false;
+                continue;
+              }
+
+              uint32_t n;
+              if (!ply_parse_uint(p, end, n))
+              {
+                ok = false;
+                return;
+              }
+
+              const bool is_indices = (prop.name == "vertex_indices" || prop.name == "vertex_index");
+              ids.resize(n);
+              for (uint32_t j = 0; j < n; ++j)
+              {
+                if (is_indices ? !ply_parse_uint(p, end, ids[j]) : !ply_parse_double(p, end, value))
+                  ok = false;
+              }
+              if (is_indices)
+                ply_append_polygon(ids.data(), n, out);
+            }
+          }
+        });
+
+        if (!ok)
+        {
+          error = "bad face data";
+          return false;
+        }
+
+        for (unsigned int c = 0; c < parts.size(); ++c)
+          mesh.indices.insert(mesh.indices.end(), parts[c].begin(), parts[c].end());
+      }
+    }
+    return true;
+  }
+
+  inline void ply_swap(char* p, size_t size)
+  {
+    std::reverse(p, p + size);
+  }
+
+  // one binary value as double, byte order of the file
+  inline double ply_read_binary(const char* p, ply_type t, bool swap)
+  {
+    char b[8];
+    size_t size = ply_type_size(t);
+    std::memcpy(b, p, size);
+    if (swap)
+      ply_swap(b, size);
+
+    switch (t)
+    {
+      case kply_int8:    { int8_t v;   std::memcpy(&v, b, 1); return v; }
+      case kply_uint8:   { uint8_t v;  std::memcpy(&v, b, 1); return v; }
+      case kply_int16:   { int16_t v;  std::memcpy(&v, b, 2); return v; }
+      case kply_uint16:  { uint16_t v; std::memcpy(&v, b, 2); return v; }
+      case kply_int32:   { int32_t v;  std::memcpy(&v, b, 4); return v; }
+      case kply_uint32:  { uint32_t v; std::memcpy(&v, b, 4); return v; }
+      case kply_float32: { float v;    std::memcpy(&v, b, 4); return v; }
+      case kply_float64: { double v;   std::memcpy(&v, b, 8); return v; }
+      default:           return 0.0;
+    }
+  }
+
+  inline bool ply_read_binary_body(const char* body, const char* end, const PlyHeader& header,
+                                   unsigned int threads, PlyMesh& mesh, std::string& error)
+  {
+    const bool swap = (header.format == kply_binary_be);
+    const char* p = body;
+
+    for (unsigned int ei = 0; ei < header.elements.size(); ++ei)
+    {
+      const PlyElement& e = header.elements[ei];
+      const size_t record = e.record_size();
+
+      // fixed size records: chunks in parallel
+      if (record > 0)
+      {
+        if ((size_t)(end - p) / record < e.count)
+        {
+          error = "file ends inside element " + e.name;
+          return false;
+        }
+
+        if (e.name == "vertex")
+        {
+          PlyVertexLayout layout(e);
+          const char* records = p;
+
+          ply_parallel_for(e.count, threads, kply_min_chunk, [&](size_t first, size_t last, size_t)
+          {
+            double v[knum_ply_slots] = { 0, 0, 0, 0, 0, 0, 0, 0, 0, 1.0 };
+            for (size_t i = first; i < last; ++i)
+            {
+              const char* r = records + i*record;
+              for (unsigned int k = 0; k < e.properties.size(); ++k)
+              {
+                const PlyProperty& prop = e.properties[k];
+                if (prop.slot != kply_skip)
+                  v[prop.slot] = ply_read_binary(r, prop.type, swap);
+                r += ply_type_size(prop.type);
+              }
+              ply_store_vertex(v, i, layout, mesh);
+            }
+          });
+        }
+        p += e.count*record;
+        continue;
+      }
+
+      // records with lists: one pass
+      double v[knum_ply_slots] = { 0, 0, 0, 0, 0, 0, 0, 0, 0, 1.0 };
+      PlyVertexLayout layout(e);
+      std::vector<uint32_t> ids;
+
+      for (size_t i = 0; i < e.count; ++i)
+      {
+        for (unsigned int k = 0; k < e.properties.size(); ++k)
+        {
+          const PlyProperty& prop = e.properties[k];
+          const size_t size = ply_type_size(prop.type);
+
+          if (!prop.is_list())
+          {
+            if (end - p < (ptrdiff_t)size)
+            {
+              error = "file ends inside element " + e.name;
+              return false;
+            }
+            if (prop.slot != kply_skip)
+              v[prop.slot] = ply_read_binary(p, prop.type, swap);
+            p += size;
+            continue;
+          }
+
+          const size_t count_size = ply_type_size(prop.count_type);
+          if (end - p < (ptrdiff_t)count_size)
+          {
+            error = "file ends inside element " + e.name;
+            return false;
+          }
+          uint32_t n = (uint32_t)ply_read_binary(p, prop.count_type, swap);
+          p += count_size;
+
+          if ((size_t)(end - p) / size < n)
+          {
+            error = "file ends inside element " + e.name;
+            return false;
+          }
+
+          if (e.name == "face" && (prop.name == "vertex_indices" || prop.name == "vertex_index"))
+          {
+            ids.resize(n);
+            for (uint32_t j = 0; j < n; ++j)
+              ids[j] = (uint32_t)ply_read_binary(p + j*size, prop.type, swap);
+            ply_append_polygon(ids.data(), n, mesh.indices);
+          }
+          p += n*size;
+        }
+
+        if (e.name == "vertex")
+          ply_store_vertex(v, i, layout, mesh);
+      }
+    }
+    return true;
+  }
+
+  // area weighted vertex normals (the cross products are not normalized per face)
+  inline void ply_generate_normals(PlyMesh& mesh)
+  {
+    const size_t n = mesh.num_vertices();
+    mesh.normals.assign(3*n, 0.0f);
+
+    const GLfloat* pos = mesh.positions.data();
+    GLfloat* nrm = mesh.normals.data();
+
+    for (size_t t = 0; t + 2 < mesh.indices.size(); t += 3)
+    {
+      const GLuint a = mesh.indices[t], b = mesh.indices[t + 1], c = mesh.indices[t + 2];
+      if (a >= n || b >= n || c >= n)
+        continue;
+
+      const GLfloat e1[3] = { pos[3*b] - pos[3*a], pos[3*b + 1] - pos[3*a + 1], pos[3*b + 2] - pos[3*a + 2] };
+      const GLfloat e2[3] = { pos[3*c] - pos[3*a], pos[3*c + 1] - pos[3*a + 1], pos[3*c + 2] - pos[3*a + 2] };
+      const GLfloat f[3]  = { e1[1]*e2[2] - e1[2]*e2[1], e1[2]*e2[0] - e1[0]*e2[2], e1[0]*e2[1] - e1[1]*e2[0] };
+
+      for (int k = 0; k < 3; ++k)
+      {
+        nrm[3*a + k] += f[k];
+        nrm[3*b + k] += f[k];
+        nrm[3*c + k] += f[k];
+      }
+    }
+
+    for (size_t i = 0; i < n; ++i)
+    {
+      GLfloat* v = nrm + 3*i;
+      GLfloat len = std::sqrt(v[0]*v[0] + v[1]*v[1] + v[2]*v[2]);
+      if (len > 0.0f)
+      {
+        v[0] /= len; v[1] /= len; v[2] /= len;
+      }
+      else
+      {
+        v[2] = 1.0f;
+      }
+    }
+  }
+
+  // threads == 0: all cores; the reason of a failure is printed to std::cerr
+  inline bool load_ply(const std::string& filename, PlyMesh& mesh, unsigned int threads = 0, PlyStats* stats = NULL)
+  {
+    typedef std::chrono::steady_clock clock;
+    clock::time_point start = clock::now();
+
+    if (threads == 0)
+      threads = std::max(1u, std::thread::hardware_concurrency());
+
+    MappedFile file;
+    if (!file.open(filename))
+    {
+      std::cerr << filename << ": cannot map the file" << std::endl;
+      return false;
+    }
+
+    clock::time_point parse_start = clock::now();
+
+    PlyHeader header;
+    std::string error;
+    if (!ply_parse_header(file.data(), file.size(), header, error))
+    {
+      std::cerr << filename << ": " << error << std::endl;
+      return false;
+    }
+
+    mesh = PlyMesh();
+    for (unsigned int i = 0; i < header.elements.size(); ++i)
+    {
+      const PlyElement& e = header.elements[i];
+      if (e.name != "vertex")
+        continue;
+
+      PlyVertexLayout layout(e);
+      mesh.positions.resize(3*e.count);
+      if (layout.has_normals)
+        mesh.normals.resize(3*e.count);
+      if (layout.has_colors)
+        mesh.colors.resize(4*e.count);
+    }
+
+    const char* body = file.data() + header.body;
+    const char* end  = file.data() + file.size();
+
+    bool ok = (header.format == kply_ascii)
+      ? ply_read_ascii(body, end, header, threads, mesh, error)
+      : ply_read_binary_body(body, end, header, threads, mesh, error);
+    if (!ok)
+    {
+      std::cerr << filename << ": " << error << std::endl;
+      return false;
+    }
+
+    clock::time_point normal_start = clock::now();
+    if (mesh.normals.empty())
+      ply_generate_normals(mesh);
+    clock::time_point done = clock::now();
+
+    if (stats)
+    {
+      const char* formats[3] = { "ascii", "binary_little_endian", "binary_big_endian" };
+      stats->format    = formats[header.format];
+      stats->bytes     = file.size();
+      stats->threads   = threads;
+      stats->parse_ms  = std::chrono::duration<double, std::milli>(normal_start - parse_start).count();
+      stats->normal_ms = std::chrono::duration<double, std::milli>(done - normal_start).count();
+      stats->total_ms  = std::chrono::duration<double, std::milli>(done - start).count();
+    }
+    return true;
+  }
+}
@@ -2,6 +2,7 @@
 
 uniform mat4 u_PVM;           // Proj * View * Model
 uniform mat4 u_M;             // Model
+uniform mat3 u_N;             // normal matrix, transpose(inverse(Model 3x3))
 
 attribute vec3 a_position;    // per-vertex position (per-vertex input)
 attribute vec3 a_normal;      // per-vertex normal 
@@ -12,7 +13,7 @@ varying vec3 v_normal_wc;     // per-vertex normal in the world coordinate syste
 void main()
 {
   v_position_wc = (u_M * vec4(a_position, 1.0f)).xyz;
-  v_normal_wc   = normalize((u_M * vec4(a_normal, 0.0f)).xyz);
+  v_normal_wc   = normalize(u_N * a_normal);
 
   gl_Position = u_PVM * vec4(a_position, 1.0f);
 }
\ No newline at end of file
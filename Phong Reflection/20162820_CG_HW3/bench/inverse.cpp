@@ -0,0 +1,347 @@
+#include <iostream>
+#include <vector>
+#include <string>
+#include <chrono>
+#include <cstdlib>
+#include <cmath>
+#include <algorithm>
+
+#include "../common/vec.hpp"
+#include "../common/mat.hpp"
+#include "../common/transform.hpp"
+#include "../common/quat.hpp"
+#include "../common/inverse.hpp"
+
+////////////////////////////////////////////////////////////////////////////////
+/// 역행렬 연산 비용 비교: Gauss-Jordan vs cofactor (inverse.hpp)
+///
+/// mat3        generic Gauss-Jordan vs inverse(mat3)
+/// mat4        generic Gauss-Jordan vs scalar cofactor inverse<T>() vs the SSE
+///             float overload, and on affine model matrices also inverse_affine()
+///             (scalar and SSE)
+/// det         determinant by Gauss elimination vs determinant()
+/// normal      normal_matrix() of a model matrix with non-uniform scale
+///
+/// Every case also reports the largest |A*inverse(A) - I| over the inputs.
+///
+/// usage: InverseBench [matrix count] (default 1000)
+////////////////////////////////////////////////////////////////////////////////
+using namespace kmuvcl::math;
+
+typedef std::chrono::steady_clock bench_clock;
+
+// keeps the optimizer from dropping the benchmarked work
+volatile float g_sink;
+
+double elapsed_ns(bench_clock::time_point start, unsigned int count)
+{
+  return std::chrono::duration<double, std::nano>(bench_clock::now() - start).count() / count;
+}
+
+void print_row(const std::string& name, double ns, double baseline_ns, float error)
+{
+  std::cout << name << "\t" << ns << "\t" << baseline_ns / ns << "x\t" << error << std::endl;
+}
+
+/// reference: Gauss-Jordan elimination with partial pivoting on [A | I]
+template <unsigned int N, typename T>
+mat<N, N, T> gauss_jordan_inverse(const mat<N, N, T>& A)
+{
+  mat<N, N, T> a = A, b;
+  b.set_to_identity();
+
+  for (unsigned int c = 0; c < N; ++c)
+  {
+    unsigned int pivot = c;
+    for (unsigned int r = c + 1; r < N; ++r)
+      if (std::fabs(a(r, c)) > std::fabs(a(pivot, c)))
+        pivot = r;
+    if (a(pivot, c) == 0)
+      return  mat<N, N, T>();
+
+    if (pivot != c)
+    {
+      for (unsigned int j = 0; j < N; ++j)
+      {
+        std::swap(a(c, j), a(pivot, j));
+        std::swap(b(c, j), b(pivot, j));
+      }
+    }
+
+    T inv_pivot = 1 / a(c, c);
+    for (unsigned int j = 0; j < N; ++j)
+    {
+      a(c, j) *= inv_pivot;
+      b(c, j) *= inv_pivot;
+    }
+
+    for (unsigned int r = 0; r < N; ++r)
+    {
+      if (r == c || a(r, c) == 0)
+        continue;
+      T f = a(r, c);
+      for (unsigned int j = 0; j < N; ++j)
+      {
+        a(r, j) -= f*a(c, j);
+        b(r, j) -= f*b(c, j);
+      }
+    }
+  }
+
+  return  b;
+}
+
+/// reference: product of the pivots of Gauss elimination with partial pivoting
+template <unsigned int N, typename T>
+T gauss_determinant(const mat<N, N, T>& A)
+{
+  mat<N, N, T> a = A;
+  T det = 1;
+
+  for (unsigned int c = 0; c < N; ++c)
+  {
+    unsigned int pivot = c;
+    for (unsigned int r = c + 1; r < N; ++r)
+      if (std::fabs(a(r, c)) > std::fabs(a(pivot, c)))
+        pivot = r;
+    if (a(pivot, c) == 0)
+      return  0;
+
+    if (pivot != c)
+    {
+      for (unsigned int j = 0; j < N; ++j)
+        std::swap(a(c, j), a(pivot, j));
+      det = -det;
+    }
+
+    det *= a(c, c);
+    for (unsigned int r = c + 1; r < N; ++r)
+    {
+      T f = a(r, c) / a(c, c);
+      for (unsigned int j = c; j < N; ++j)
+        a(r, j) -= f*a(c, j);
+    }
+  }
+
+  return  det;
+}
+
+template <unsigned int N, typename T>
+float identity_error(const mat<N, N, T>& A, const mat<N, N, T>& inv)
+{
+  mat<N, N, T> P = A*inv;
+  float error = 0.0f;
+  for (unsigned int i = 0; i < N; ++i)
+    for (unsigned int j = 0; j < N; ++j)
+      error = std::max(error, (float)std::fabs(P(i, j) - (i == j ? 1 : 0)));
+
+  return  error;
+}
+
+/// model matrices like the ones of CG_HW3: rotation, non-uniform scale, translation
+std::vector<mat4x4f> make_models(unsigned int n)
+{
+  std::vector<mat4x4f> models(n);
+  for (unsigned int i = 0; i < n; ++i)
+  {
+    quatf q = quatf::axis_angle((float)(i % 360), vec3f(1.0f, 2.0f, -1.0f));
+    models[i] = translate((float)(i % 7) - 3.0f, (float)(i % 5), -4.0f)
+              * q.to_mat4()
+              * scale(1.0f + (i % 3), 0.5f + 0.25f*(i % 4), 1.0f);
+  }
+
+  return  models;
+}
+
+/// general matrices: the models with a perspective-like last row
+std::vector<mat4x4f> make_general(const std::vector<mat4x4f>& models)
+{
+  std::vector<mat4x4f> general = models;
+  for (unsigned int i = 0; i < general.size(); ++i)
+  {
+    general[i](3, 0) = 0.1f*(i % 3);
+    general[i](3, 2) = -1.0f;
+    general[i](3, 3) = 2.0f;
+  }
+
+  return  general;
+}
+
+template <typename Inverse>
+double time_inverse(const std::vector<mat4x4f>& in, std::vector<mat4x4f>& out, unsigned int runs, Inverse inverse_fn)
+{
+  bench_clock::time_point start = bench_clock::now();
+  for (unsigned int r = 0; r < runs; ++r)
+    for (unsigned int i = 0; i < in.size(); ++i)
+      out[i] = inverse_fn(in[i]);
+  double ns = elapsed_ns(start, runs*in.size());
+  g_sink = out[in.size()/2](0, 0);
+
+  return  ns;
+}
+
+float max_error(const std::vector<mat4x4f>& in, const std::vector<mat4x4f>& out)
+{
+  float error = 0.0f;
+  for (unsigned int i = 0; i < in.size(); ++i)
+    error = std::max(error, identity_error(in[i], out[i]));
+
+  return  error;
+}
+
+void bench_mat3(const std::vector<mat4x4f>& models, unsigned int runs)
+{
+  std::vector<mat3x3f> in(models.size()), out(models.size());
+  for (unsigned int i = 0; i < models.size(); ++i)
+    in[i] = upper3x3(models[i]);
+
+  bench_clock::time_point start = bench_clock::now();
+  for (unsigned int r = 0; r < runs; ++r)
+    for (unsigned int i = 0; i < in.size(); ++i)
+      out[i] = gauss_jordan_inverse(in[i]);
+  double gj_ns = elapsed_ns(start, runs*in.size());
+  g_sink = out[in.size()/2](0, 0);
+
+  float gj_error = 0.0f;
+  for (unsigned int i = 0; i < in.size(); ++i)
+    gj_error = std::max(gj_error, identity_error(in[i], out[i]));
+
+  start = bench_clock::now();
+  for (unsigned int r = 0; r < runs; ++r)
+    for (unsigned int i = 0; i < in.size(); ++i)
+      out[i] = inverse(in[i]);
+  double cofactor_ns = elapsed_ns(start, runs*in.size());
+  g_sink = out[in.size()/2](0, 0);
+
+  float cofactor_error = 0.0f;
+  for (unsigned int i = 0; i < in.size(); ++i)
+    cofactor_error = std::max(cofactor_error, identity_error(in[i], out[i]));
+
+  print_row("mat3 gauss-jordan", gj_ns, gj_ns, gj_error);
+  print_row("mat3 cofactor", cofactor_ns, gj_ns, cofactor_error);
+}
+
+void bench_mat4(const std::vector<mat4x4f>& models, unsigned int runs)
+{
+  std::vector<mat4x4f> general = make_general(models);
+  std::vector<mat4x4f> out(models.size());
+
+  double gj_ns = time_inverse(general, out, runs, gauss_jordan_inverse<4, float>);
+  float gj_error = max_error(general, out);
+
+  double scalar_ns = time_inverse(general, out, runs, [](const mat4x4f& A) { return inverse<float>(A); });
+  float scalar_error = max_error(general, out);
+
+  double simd_ns = time_inverse(general, out, runs, [](const mat4x4f& A) { return inverse(A); });
+  float simd_error = max_error(general, out);
+
+  print_row("mat4 gauss-jordan", gj_ns, gj_ns, gj_error);
+  print_row("mat4 cofactor", scalar_ns, gj_ns, scalar_error);
+  print_row("mat4 cofactor (overload)", simd_ns, gj_ns, simd_error);
+
+  // affine inputs: the general inverses against the affine fast path
+  gj_ns = time_inverse(models, out, runs, gauss_jordan_inverse<4, float>);
+  gj_error = max_error(models, out);
+
+  simd_ns = time_inverse(models, out, runs, [](const mat4x4f& A) { return inverse(A); });
+  simd_error = max_error(models, out);
+
+  double affine_ns = time_inverse(models, out, runs, [](const mat4x4f& A) { return inverse_affine<float>(A); });
+  float affine_error = max_error(models, out);
+
+  double affine_simd_ns = time_inverse(models, out, runs, [](const mat4x4f& A) { return inverse_affine(A); });
+  float affine_simd_error = max_error(models, out);
+
+  print_row("affine gauss-jordan", gj_ns, gj_ns, gj_error);
+  print_row("affine cofactor (overload)", simd_ns, gj_ns, simd_error);
+  print_row("affine inverse_affine", affine_ns, gj_ns, affine_error);
+  print_row("affine inverse_affine (overload)", affine_simd_ns, gj_ns, affine_simd_error);
+}
+
+void bench_determinant(const std::vector<mat4x4f>& models, unsigned int runs)
+{
+  std::vector<mat4x4f> general = make_general(models);
+  bench_clock::time_point start;
+  float sum;
+
+  sum = 0.0f;
+  start = bench_clock::now();
+  for (unsigned int r = 0; r < runs; ++r)
+    for (unsigned int i = 0; i < general.size(); ++i)
+      sum += gauss_determinant(general[i]);
+  double gauss_ns = elapsed_ns(start, runs*general.size());
+  g_sink = sum;
+
+  sum = 0.0f;
+  start = bench_clock::now();
+  for (unsigned int r = 0; r < runs; ++r)
+    for (unsigned int i = 0; i < general.size(); ++i)
+      sum += determinant(general[i]);
+  double det_ns = elapsed_ns(start, runs*general.size());
+  g_sink = sum;
+
+  // relative difference to the reference
+  float error = 0.0f;
+  for (unsigned int i = 0; i < general.size(); ++i)
+  {
+    float d = gauss_determinant(general[i]);
+    error = std::max(error, std::fabs(determinant(general[i]) - d) / std::max(1.0f, std::fabs(d)));
+  }
+
+  print_row("det4 gauss", gauss_ns, gauss_ns, 0.0f);
+  print_row("det4 determinant", det_ns, gauss_ns, error);
+}
+
+void bench_normal(const std::vector<mat4x4f>& models, unsigned int runs)
+{
+  std::vector<mat3x3f> out(models.size());
+
+  bench_clock::time_point start = bench_clock::now();
+  for (unsigned int r = 0; r < runs; ++r)
+    for (unsigned int i = 0; i < models.size(); ++i)
+      out[i] = gauss_jordan_inverse(upper3x3(models[i])).transpose();
+  double gj_ns = elapsed_ns(start, runs*models.size());
+  g_sink = out[models.size()/2](0, 0);
+
+  start = bench_clock::now();
+  for (unsigned int r = 0; r < runs; ++r)
+    for (unsigned int i = 0; i < models.size(); ++i)
+      out[i] = normal_matrix(models[i]);
+  double normal_ns = elapsed_ns(start, runs*models.size());
+  g_sink = out[models.size()/2](0, 0);
+
+  // transpose(N) * L = I
+  float error = 0.0f;
+  for (unsigned int i = 0; i < models.size(); ++i)
+    error = std::max(error, identity_error(out[i].transpose(), upper3x3(models[i])));
+
+  print_row("normal gauss-jordan", gj_ns, gj_ns, 0.0f);
+  print_row("normal normal_matrix", normal_ns, gj_ns, error);
+}
+
+int main(int argc, char* argv[])
+{
+  unsigned int n = (argc > 1) ? std::atoi(argv[1]) : 1000;
+  if (n == 0)
+  {
+    std::cerr << "usage: InverseBench [matrix count]" << std::endl;
+    return -1;
+  }
+
+#if defined(__SSE2__)
+  std::cout << "inverse(mat4x4f), determinant(mat4x4f): SSE2" << std::endl;
+#else
+  std::cout << "inverse(mat4x4f), determinant(mat4x4f): scalar" << std::endl;
+#endif
+  std::cout << "case\tns/op\tspeedup (vs gauss)\tmax error" << std::endl;
+
+  std::vector<mat4x4f> models = make_models(n);
+  unsigned int runs = std::max(1u, 2000000u / n);
+
+  bench_mat3(models, runs);
+  bench_mat4(models, runs);
+  bench_determinant(models, runs);
+  bench_normal(models, runs);
+
+  return 0;
+}
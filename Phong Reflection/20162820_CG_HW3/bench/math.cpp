@@ -0,0 +1,553 @@
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <vector>
+#include <map>
+#include <string>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <atomic>
+
+#include <benchmark/benchmark.h>
+
+#include "../common/vec.hpp"
+#include "../common/mat.hpp"
+#include "../common/operator.hpp"
+#include "../common/transform.hpp"
+
+////////////////////////////////////////////////////////////////////////////////
+/// kmuvcl::math 기본 연산 벤치마크 (Google Benchmark)
+///
+/// vec + - s*v, dot, cross, mat*vec, mat*mat, transpose over vec<N, T> and
+/// mat<N, N, T> (N = 2, 3, 4; T = float, double), and translate, rotate,
+/// lookAt, perspective, ortho in float and double.
+///
+/// Time is ns/op. allocs/op counts the global operator new calls inside the
+/// timed loop; every kmuvcl::math type lives on the stack, so anything but 0
+/// is a regression too.
+///
+/// Regression comparison against a baseline recorded on the same machine
+/// (make baseline, then make compare after a change). Both run every
+/// benchmark 5 times and compare the medians:
+///   MathBench --benchmark_repetitions=5 --benchmark_out=math_baseline.json
+///             --benchmark_out_format=json
+///   MathBench --benchmark_repetitions=5 --baseline=math_baseline.json [--threshold=20]
+/// Exit status 1 when a benchmark got slower than threshold percent
+/// (default 20) or started to allocate. Single runs are compared as they are.
+///
+/// usage: MathBench [--baseline=file] [--threshold=percent] [--benchmark_...]
+////////////////////////////////////////////////////////////////////////////////
+using namespace kmuvcl::math;
+
+////////////////////////////////////////////////////////////////////////////////
+// allocation counting
+
+std::atomic<size_t> g_allocations(0);
+
+// these replace the library operators, so malloc / free is the matching pair;
+// gcc inlines operator delete into a caller of operator new and still sees a
+// new / free mismatch there (-Wmismatched-new-delete)
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#endif
+
+void* operator new(std::size_t size)
+{
+  g_allocations.fetch_add(1, std::memory_order_relaxed);
+  void* p = std::malloc(size ? size : 1);
+  if (!p)
+    throw std::bad_alloc();
+
+  return  p;
+}
+
+void operator delete(void* p) noexcept
+{
+  std::free(p);
+}
+
+void operator delete(void* p, std::size_t) noexcept
+{
+  std::free(p);
+}
+
+void* operator new[](std::size_t size)
+{
+  return  operator new(size);
+}
+
+void operator delete[](void* p) noexcept
+{
+  operator delete(p);
+}
+
+void operator delete[](void* p, std::size_t) noexcept
+{
+  operator delete(p);
+}
+
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic pop
+#endif
+
+/// call after the timed loop; allocations is g_allocations before the loop
+void report_allocations(benchmark::State& state, size_t allocations)
+{
+  state.counters["allocs/op"] = benchmark::Counter((double)(g_allocations - allocations),
+                                                   benchmark::Counter::kAvgIterations);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// inputs
+
+template <unsigned int N, typename T>
+vec<N, T> make_vec(T seed)
+{
+  vec<N, T> v;
+  for (unsigned int i = 0; i < N; ++i)
+    v(i) = seed + static_cast<T>(i)*static_cast<T>(0.5);
+
+  return  v;
+}
+
+template <unsigned int N, typename T>
+mat<N, N, T> make_mat(T seed)
+{
+  mat<N, N, T> A;
+  for (unsigned int r = 0; r < N; ++r)
+    for (unsigned int c = 0; c < N; ++c)
+      A(r, c) = seed + static_cast<T>(r*N + c)*static_cast<T>(0.25);
+
+  return  A;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// vec
+
+template <unsigned int N, typename T>
+void BM_vec_add(benchmark::State& state)
+{
+  vec<N, T> u = make_vec<N, T>(1), v = make_vec<N, T>(2);
+  size_t allocations = g_allocations;
+  for (auto _ : state)
+  {
+    benchmark::DoNotOptimize(u);
+    benchmark::DoNotOptimize(v);
+    vec<N, T> w = u + v;
+    benchmark::DoNotOptimize(w);
+  }
+  report_allocations(state, allocations);
+}
+
+template <unsigned int N, typename T>
+void BM_vec_sub(benchmark::State& state)
+{
+  vec<N, T> u = make_vec<N, T>(1), v = make_vec<N, T>(2);
+  size_t allocations = g_allocations;
+  for (auto _ : state)
+  {
+    benchmark::DoNotOptimize(u);
+    benchmark::DoNotOptimize(v);
+    vec<N, T> w = u - v;
+    benchmark::DoNotOptimize(w);
+  }
+  report_allocations(state, allocations);
+}
+
+template <unsigned int N, typename T>
+void BM_vec_scale(benchmark::State& state)
+{
+  vec<N, T> u = make_vec<N, T>(1);
+  T s = static_cast<T>(1.5);
+  size_t allocations = g_allocations;
+  for (auto _ : state)
+  {
+    benchmark::DoNotOptimize(s);
+    benchmark::DoNotOptimize(u);
+    vec<N, T> w = s*u;
+    benchmark::DoNotOptimize(w);
+  }
+  report_allocations(state, allocations);
+}
+
+template <unsigned int N, typename T>
+void BM_dot(benchmark::State& state)
+{
+  vec<N, T> u = make_vec<N, T>(1), v = make_vec<N, T>(2);
+  size_t allocations = g_allocations;
+  for (auto _ : state)
+  {
+    benchmark::DoNotOptimize(u);
+    benchmark::DoNotOptimize(v);
+    T d = dot(u, v);
+    benchmark::DoNotOptimize(d);
+  }
+  report_allocations(state, allocations);
+}
+
+template <typename T>
+void BM_cross(benchmark::State& state)
+{
+  vec<3, T> u = make_vec<3, T>(1), v = make_vec<3, T>(2);
+  size_t allocations = g_allocations;
+  for (auto _ : state)
+  {
+    benchmark::DoNotOptimize(u);
+    benchmark::DoNotOptimize(v);
+    vec<3, T> w = cross(u, v);
+    benchmark::DoNotOptimize(w);
+  }
+  report_allocations(state, allocations);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// mat
+
+template <unsigned int N, typename T>
+void BM_mat_vec(benchmark::State& state)
+{
+  mat<N, N, T> A = make_mat<N, T>(1);
+  vec<N, T> x = make_vec<N, T>(2);
+  size_t allocations = g_allocations;
+  for (auto _ : state)
+  {
+    benchmark::DoNotOptimize(A);
+    benchmark::DoNotOptimize(x);
+    vec<N, T> y = A*x;
+    benchmark::DoNotOptimize(y);
+  }
+  report_allocations(state, allocations);
+}
+
+template <unsigned int N, typename T>
+void BM_mat_mat(benchmark::State& state)
+{
+  mat<N, N, T> A = make_mat<N, T>(1), B = make_mat<N, T>(2);
+  size_t allocations = g_allocations;
+  for (auto _ : state)
+  {
+    benchmark::DoNotOptimize(A);
+    benchmark::DoNotOptimize(B);
+    mat<N, N, T> C = A*B;
+    benchmark::DoNotOptimize(C);
+  }
+  report_allocations(state, allocations);
+}
+
+template <unsigned int N, typename T>
+void BM_transpose(benchmark::State& state)
+{
+  mat<N, N, T> A = make_mat<N, T>(1);
+  size_t allocations = g_allocations;
+  for (auto _ : state)
+  {
+    benchmark::DoNotOptimize(A);
+    mat<N, N, T> B = A.transpose();
+    benchmark::DoNotOptimize(B);
+  }
+  report_allocations(state, allocations);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// transform
+
+template <typename T>
+void BM_translate(benchmark::State& state)
+{
+  vec<3, T> d = make_vec<3, T>(1);
+  size_t allocations = g_allocations;
+  for (auto _ : state)
+  {
+    benchmark::DoNotOptimize(d);
+    mat<4, 4, T> M = translate(d(0), d(1), d(2));
+    benchmark::DoNotOptimize(M);
+  }
+  report_allocations(state, allocations);
+}
+
+template <typename T>
+void BM_rotate(benchmark::State& state)
+{
+  vec<3, T> axis = make_vec<3, T>(1);
+  T angle = static_cast<T>(33);
+  size_t allocations = g_allocations;
+  for (auto _ : state)
+  {
+    benchmark::DoNotOptimize(angle);
+    benchmark::DoNotOptimize(axis);
+    mat<4, 4, T> M = rotate(angle, axis(0), axis(1), axis(2));
+    benchmark::DoNotOptimize(M);
+  }
+  report_allocations(state, allocations);
+}
+
+template <typename T>
+void BM_lookAt(benchmark::State& state)
+{
+  vec<3, T> eye = make_vec<3, T>(4), center = make_vec<3, T>(0), up(0, 1, 0);
+  size_t allocations = g_allocations;
+  for (auto _ : state)
+  {
+    benchmark::DoNotOptimize(eye);
+    benchmark::DoNotOptimize(center);
+    benchmark::DoNotOptimize(up);
+    mat<4, 4, T> M = lookAt(eye(0), eye(1), eye(2), center(0), center(1), center(2), up(0), up(1), up(2));
+    benchmark::DoNotOptimize(M);
+  }
+  report_allocations(state, allocations);
+}
+
+template <typename T>
+void BM_perspective(benchmark::State& state)
+{
+  T fovy = static_cast<T>(60), aspect = static_cast<T>(4.0/3.0);
+  T zNear = static_cast<T>(0.1), zFar = static_cast<T>(1000);
+  size_t allocations = g_allocations;
+  for (auto _ : state)
+  {
+    benchmark::DoNotOptimize(fovy);
+    benchmark::DoNotOptimize(aspect);
+    benchmark::DoNotOptimize(zNear);
+    benchmark::DoNotOptimize(zFar);
+    mat<4, 4, T> M = perspective(fovy, aspect, zNear, zFar);
+    benchmark::DoNotOptimize(M);
+  }
+  report_allocations(state, allocations);
+}
+
+template <typename T>
+void BM_ortho(benchmark::State& state)
+{
+  vec<3, T> lo(-4, -3, 0), hi(4, 3, 100);
+  size_t allocations = g_allocations;
+  for (auto _ : state)
+  {
+    benchmark::DoNotOptimize(lo);
+    benchmark::DoNotOptimize(hi);
+    mat<4, 4, T> M = ortho(lo(0), hi(0), lo(1), hi(1), lo(2), hi(2));
+    benchmark::DoNotOptimize(M);
+  }
+  report_allocations(state, allocations);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// registration
+
+#define BENCHMARK_SIZES(f)                \
+  BENCHMARK_TEMPLATE(f, 2, float);        \
+  BENCHMARK_TEMPLATE(f, 3, float);        \
+  BENCHMARK_TEMPLATE(f, 4, float);        \
+  BENCHMARK_TEMPLATE(f, 2, double);       \
+  BENCHMARK_TEMPLATE(f, 3, double);       \
+  BENCHMARK_TEMPLATE(f, 4, double)
+
+#define BENCHMARK_TYPES(f)                \
+  BENCHMARK_TEMPLATE(f, float);           \
+  BENCHMARK_TEMPLATE(f, double)
+
+BENCHMARK_SIZES(BM_vec_add);
+BENCHMARK_SIZES(BM_vec_sub);
+BENCHMARK_SIZES(BM_vec_scale);
+BENCHMARK_SIZES(BM_dot);
+BENCHMARK_TYPES(BM_cross);
+
+BENCHMARK_SIZES(BM_mat_vec);
+BENCHMARK_SIZES(BM_mat_mat);
+BENCHMARK_SIZES(BM_transpose);
+
+BENCHMARK_TYPES(BM_translate);
+BENCHMARK_TYPES(BM_rotate);
+BENCHMARK_TYPES(BM_lookAt);
+BENCHMARK_TYPES(BM_perspective);
+BENCHMARK_TYPES(BM_ortho);
+
+////////////////////////////////////////////////////////////////////////////////
+// baseline comparison
+
+struct Result
+{
+  double  ns;
+  double  allocations;
+  bool    median;
+};
+
+/// keeps one result per benchmark: the median of repeated runs replaces the
+/// single runs, the other aggregates (mean, stddev, cv) are ignored
+void record(std::map<std::string, Result>& results, const std::string& name,
+            const std::string& aggregate, Result r)
+{
+  r.median = (aggregate == "median");
+  if (!aggregate.empty() && !r.median)
+    return;
+
+  std::map<std::string, Result>::const_iterator it = results.find(name);
+  if (r.median || it == results.end() || !it->second.median)
+    results[name] = r;
+}
+
+/// console output as usual, and every run kept for the comparison
+class RecordingReporter : public benchmark::ConsoleReporter
+{
+public:
+  RecordingReporter() : benchmark::ConsoleReporter(OO_Tabular) {}
+
+  void ReportRuns(const std::vector<Run>& runs) override
+  {
+    benchmark::ConsoleReporter::ReportRuns(runs);
+    for (size_t i = 0; i < runs.size(); ++i)
+    {
+      if (runs[i].error_occurred)
+        continue;
+
+      Result r;
+      r.ns = runs[i].GetAdjustedCPUTime();
+      benchmark::UserCounters::const_iterator it = runs[i].counters.find("allocs/op");
+      r.allocations = (it != runs[i].counters.end()) ? it->second.value : 0.0;
+      record(results_, runs[i].run_name.str(),
+             (runs[i].run_type == Run::RT_Aggregate) ? runs[i].aggregate_name : std::string(), r);
+    }
+  }
+
+  const std::map<std::string, Result>& results() const { return  results_; }
+
+private:
+  std::map<std::string, Result> results_;
+};
+
+/// value of "key": on a line of the JSON written by --benchmark_out_format=json
+/// (one field per line), false when the line holds another key
+bool json_field(const std::string& line, const std::string& key, std::string& value)
+{
+  std::string quoted = "\"" + key + "\":";
+  size_t pos = line.find(quoted);
+  if (pos == std::string::npos)
+    return  false;
+
+  value = line.substr(pos + quoted.size());
+  size_t first = value.find_first_not_of(" \"");
+  size_t last = value.find_last_not_of(" \",");
+  value = (first == std::string::npos) ? std::string() : value.substr(first, last - first + 1);
+  return  true;
+}
+
+/// run name -> cpu time (ns) and allocs/op of every benchmark in a baseline file
+bool load_baseline(const std::string& path, std::map<std::string, Result>& baseline)
+{
+  std::ifstream in(path.c_str());
+  if (!in)
+    return  false;
+
+  std::string line, value, name, aggregate, time_unit;
+  Result r = { 0.0, 0.0, false };
+  while (std::getline(in, line))
+  {
+    if (json_field(line, "library_build_type", value) && value != "release")
+      std::cerr << "warning: the baseline was recorded with a " << value
+                << " build of Google Benchmark" << std::endl;
+    else if (json_field(line, "run_name", value))
+    {
+      name = value;
+      aggregate.clear();
+      time_unit = "ns";
+      r.ns = 0.0;
+      r.allocations = 0.0;
+    }
+    else if (json_field(line, "aggregate_name", value))
+      aggregate = value;
+    else if (json_field(line, "cpu_time", value))
+      r.ns = std::atof(value.c_str());
+    else if (json_field(line, "time_unit", value))
+      time_unit = value;
+    else if (json_field(line, "allocs/op", value))
+      r.allocations = std::atof(value.c_str());
+    else if (!name.empty() && line.find('}') != std::string::npos)
+    {
+      if (time_unit == "us")      r.ns *= 1e3;
+      else if (time_unit == "ms") r.ns *= 1e6;
+      else if (time_unit == "s")  r.ns *= 1e9;
+      record(baseline, name, aggregate, r);
+      name.clear();
+    }
+  }
+
+  return  true;
+}
+
+/// prints current vs baseline, returns the number of regressions
+int compare(const std::map<std::string, Result>& results,
+            const std::map<std::string, Result>& baseline, double threshold)
+{
+  int regressions = 0;
+  std::cout << std::endl << "benchmark\tbaseline ns\tns\tchange\tallocs/op" << std::endl;
+  for (std::map<std::string, Result>::const_iterator cur = results.begin(); cur != results.end(); ++cur)
+  {
+    const std::string& name = cur->first;
+    const Result& r = cur->second;
+    std::map<std::string, Result>::const_iterator it = baseline.find(name);
+    if (it == baseline.end())
+    {
+      std::cout << name << "\t-\t" << r.ns << "\t(new)\t" << r.allocations << std::endl;
+      continue;
+    }
+
+    double change = (it->second.ns > 0.0) ? 100.0*(r.ns - it->second.ns) / it->second.ns : 0.0;
+    bool slower = change > threshold;
+    bool allocates = r.allocations > it->second.allocations;
+    std::ostringstream row;
+    row << name << "\t" << it->second.ns << "\t" << r.ns << "\t"
+        << (change >= 0.0 ? "+" : "") << change << "%\t" << r.allocations;
+    if (slower || allocates)
+    {
+      row << "\tREGRESSION";
+      ++regressions;
+    }
+    std::cout << row.str() << std::endl;
+  }
+
+  std::cout << regressions << " regression(s) over " << threshold << "%" << std::endl;
+  return  regressions;
+}
+
+int main(int argc, char* argv[])
+{
+  // our own flags, the rest goes to Google Benchmark
+  std::string baseline_path;
+  double threshold = 20.0;
+  int count = 1;
+  for (int i = 1; i < argc; ++i)
+  {
+    if (std::strncmp(argv[i], "--baseline=", 11) == 0)
+      baseline_path = argv[i] + 11;
+    else if (std::strncmp(argv[i], "--threshold=", 12) == 0)
+      threshold = std::atof(argv[i] + 12);
+    else
+      argv[count++] = argv[i];
+  }
+  argc = count;
+
+  benchmark::Initialize(&argc, argv);
+  if (benchmark::ReportUnrecognizedArguments(argc, argv))
+    return 1;
+
+  if (baseline_path.empty())
+  {
+    benchmark::RunSpecifiedBenchmarks();
+    benchmark::Shutdown();
+    return 0;
+  }
+
+  std::map<std::string, Result> baseline;
+  if (!load_baseline(baseline_path, baseline))
+  {
+    std::cerr << "cannot read baseline " << baseline_path << std::endl;
+    return -1;
+  }
+
+  RecordingReporter reporter;
+  benchmark::RunSpecifiedBenchmarks(&reporter);
+  benchmark::Shutdown();
+
+  return (compare(reporter.results(), baseline, threshold) > 0) ? 1 : 0;
+}
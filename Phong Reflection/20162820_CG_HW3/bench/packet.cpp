@@ -0,0 +1,192 @@
+#include <iostream>
+#include <vector>
+#include <string>
+#include <chrono>
+#include <cstdlib>
+#include <cmath>
+#include <algorithm>
+
+#include "../common/vec.hpp"
+#include "../common/mat.hpp"
+#include "../common/transform.hpp"
+#include "../common/quat.hpp"
+#include "../common/inverse.hpp"
+#include "../common/packet.hpp"
+
+////////////////////////////////////////////////////////////////////////////////
+/// 패킷 (SoA) 연산 비용 비교: vec3f 배열 (AoS) vs vec3x4f / vec3x8f
+///
+/// The kernel is per vertex shading set up the way a CPU culling or raster
+/// pass would do it, over arrays of packed xyz floats (the layout of the
+/// aiVector3D arrays of an aiMesh):
+///   world  = Model * position
+///   normal = normalize(N * normal)
+///   normal = dot(normal, eye - world) < 0 ? -normal : normal   (masked select)
+///
+/// aos     vec<3, float> and mat<4, 4, float> operators, one vertex at a time
+/// x4, x8  load 4 / 8 vertices, compute every lane at once, store back
+///
+/// usage: PacketBench [vertex count] (default 100000)
+////////////////////////////////////////////////////////////////////////////////
+using namespace kmuvcl::math;
+
+typedef std::chrono::steady_clock bench_clock;
+
+// keeps the optimizer from dropping the benchmarked work
+volatile float g_sink;
+
+double elapsed_ns(bench_clock::time_point start, unsigned int count)
+{
+  return std::chrono::duration<double, std::nano>(bench_clock::now() - start).count() / count;
+}
+
+void print_row(const std::string& name, double ns, double baseline_ns)
+{
+  std::cout << name << "\t" << ns << "\t" << baseline_ns / ns << "x" << std::endl;
+}
+
+struct Kernel
+{
+  mat4x4f   model;
+  mat4x4f   normal;     // normal_matrix(model) in the upper 3x3
+  vec3f     eye;
+};
+
+void run_aos(const Kernel& k, const std::vector<vec3f>& positions, const std::vector<vec3f>& normals,
+             std::vector<vec3f>& out_positions, std::vector<vec3f>& out_normals)
+{
+  for (size_t i = 0; i < positions.size(); ++i)
+  {
+    vec4f w = k.model*vec4f(positions[i](0), positions[i](1), positions[i](2), 1.0f);
+    vec4f n = k.normal*vec4f(normals[i](0), normals[i](1), normals[i](2), 0.0f);
+
+    vec3f world(w(0), w(1), w(2));
+    vec3f normal(n(0), n(1), n(2));
+    float len2 = dot(normal, normal);
+    if (len2 > 0.0f)
+      normal = (1.0f / std::sqrt(len2))*normal;
+    if (dot(normal, k.eye - world) < 0.0f)
+      normal = -1.0f*normal;
+
+    out_positions[i] = world;
+    out_normals[i] = normal;
+  }
+}
+
+template <typename F>
+void run_packet(const Kernel& k, const std::vector<vec3f>& positions, const std::vector<vec3f>& normals,
+                std::vector<vec3f>& out_positions, std::vector<vec3f>& out_normals)
+{
+  const unsigned int width = F::width;
+  const mat4_packet<F> model(k.model);
+  const mat4_packet<F> normal_matrix(k.normal);
+  const vec3_packet<F> eye(k.eye);
+
+  size_t n = positions.size();
+  for (size_t i = 0; i < n; i += width)
+  {
+    unsigned int count = (n - i < width) ? (unsigned int)(n - i) : width;
+    vec3_packet<F> p, nrm;
+    if (count == width)
+    {
+      p = vec3_packet<F>::load(&positions[i]);
+      nrm = vec3_packet<F>::load(&normals[i]);
+    }
+    else
+    {
+      p = vec3_packet<F>::load(&positions[i], count);
+      nrm = vec3_packet<F>::load(&normals[i], count);
+    }
+
+    vec3_packet<F> world = transform_point(model, p);
+    vec3_packet<F> normal = normalize(transform_vector(normal_matrix, nrm));
+    normal = select(dot(normal, eye - world) < F(0.0f), F(-1.0f)*normal, normal);
+
+    if (count == width)
+    {
+      world.store(&out_positions[i]);
+      normal.store(&out_normals[i]);
+    }
+    else
+    {
+      world.store(&out_positions[i], count);
+      normal.store(&out_normals[i], count);
+    }
+  }
+}
+
+float max_difference(const std::vector<vec3f>& a, const std::vector<vec3f>& b)
+{
+  float error = 0.0f;
+  for (size_t i = 0; i < a.size(); ++i)
+    for (unsigned int c = 0; c < 3; ++c)
+      error = std::max(error, std::fabs(a[i](c) - b[i](c)));
+
+  return  error;
+}
+
+int main(int argc, char* argv[])
+{
+  unsigned int n = (argc > 1) ? std::atoi(argv[1]) : 100000;
+  if (n == 0)
+  {
+    std::cerr << "usage: PacketBench [vertex count]" << std::endl;
+    return -1;
+  }
+
+#if defined(__AVX__)
+  std::cout << "vec3x8f: AVX" << std::endl;
+#else
+  std::cout << "vec3x8f: 2 x SSE" << std::endl;
+#endif
+  std::cout << "case\tns/vertex\tspeedup (vs aos)" << std::endl;
+
+  // n + 3: the packet loops also run their partial tail
+  n += 3;
+  std::vector<vec3f> positions(n), normals(n);
+  for (unsigned int i = 0; i < n; ++i)
+  {
+    positions[i] = vec3f((float)(i % 17) - 8.0f, (float)(i % 5), (float)(i % 11)*0.5f);
+    normals[i] = vec3f((float)(i % 3) - 1.0f, (float)(i % 7)*0.25f, 1.0f - (float)(i % 2));
+  }
+
+  Kernel k;
+  k.model = translate(1.0f, -2.0f, -4.0f)*quatf::axis_angle(33.0f, vec3f(1.0f, 2.0f, -1.0f)).to_mat4()
+          * scale(2.0f, 1.0f, 0.5f);
+  mat3x3f nm = normal_matrix(k.model);
+  for (unsigned int r = 0; r < 3; ++r)
+    for (unsigned int c = 0; c < 3; ++c)
+      k.normal(r, c) = nm(r, c);
+  k.eye = vec3f(0.0f, 0.0f, 5.0f);
+
+  std::vector<vec3f> aos_p(n), aos_n(n), out_p(n), out_n(n);
+  unsigned int runs = std::max(1u, 20000000u / n);
+  bench_clock::time_point start;
+
+  start = bench_clock::now();
+  for (unsigned int r = 0; r < runs; ++r)
+    run_aos(k, positions, normals, aos_p, aos_n);
+  double aos_ns = elapsed_ns(start, runs*n);
+  g_sink = aos_n[n/2](0);
+  print_row("aos vec3f", aos_ns, aos_ns);
+
+  start = bench_clock::now();
+  for (unsigned int r = 0; r < runs; ++r)
+    run_packet<simd4f>(k, positions, normals, out_p, out_n);
+  double x4_ns = elapsed_ns(start, runs*n);
+  g_sink = out_n[n/2](0);
+  print_row("packet vec3x4f", x4_ns, aos_ns);
+  float x4_error = std::max(max_difference(aos_p, out_p), max_difference(aos_n, out_n));
+
+  start = bench_clock::now();
+  for (unsigned int r = 0; r < runs; ++r)
+    run_packet<simd8f>(k, positions, normals, out_p, out_n);
+  double x8_ns = elapsed_ns(start, runs*n);
+  g_sink = out_n[n/2](0);
+  print_row("packet vec3x8f", x8_ns, aos_ns);
+  float x8_error = std::max(max_difference(aos_p, out_p), max_difference(aos_n, out_n));
+
+  std::cout << "(max difference x4 " << x4_error << ", x8 " << x8_error << ")" << std::endl;
+
+  return 0;
+}
@@ -0,0 +1,184 @@
+#include <iostream>
+#include <vector>
+#include <string>
+#include <chrono>
+#include <cstdlib>
+
+#include "../common/vec.hpp"
+#include "../common/mat.hpp"
+#include "../common/transform.hpp"
+#include "../common/quat.hpp"
+#include "../common/dualquat.hpp"
+
+////////////////////////////////////////////////////////////////////////////////
+/// 회전 연산 비용 비교: mat4 (transform.hpp) vs quat / dualquat
+///
+/// chain   the model rotation of CG_HW3 set_transform(): Rx(0.5a)*Ry(a)*Rz(0.7a)
+///         built as three rotate() 4x4 matrices vs three axis-angle quaternions
+///         composed and converted with to_mat4()
+/// rigid   the same chain followed by a translation: mat4 product vs dualquat
+/// batch   rotating n vectors: mat4*vec4 per vector vs quat::rotate per vector
+///         vs rotate_vectors() (SSE for float)
+///
+/// usage: RotationBench [vector count] (default 100000)
+////////////////////////////////////////////////////////////////////////////////
+using namespace kmuvcl::math;
+
+typedef std::chrono::steady_clock bench_clock;
+
+// keeps the optimizer from dropping the benchmarked work
+volatile float g_sink;
+
+double elapsed_ns(bench_clock::time_point start, unsigned int count)
+{
+  return std::chrono::duration<double, std::nano>(bench_clock::now() - start).count() / count;
+}
+
+void print_row(const std::string& name, double ns, double baseline_ns)
+{
+  std::cout << name << "\t" << ns << "\t" << baseline_ns / ns << "x" << std::endl;
+}
+
+void bench_chain(unsigned int runs)
+{
+  bench_clock::time_point start;
+  float sum = 0.0f;
+
+  start = bench_clock::now();
+  for (unsigned int i = 0; i < runs; ++i)
+  {
+    float a = (float)(i % 360);
+    mat4x4f m = rotate(a*0.7f, 0.0f, 0.0f, 1.0f);
+    m = rotate(a*1.0f, 0.0f, 1.0f, 0.0f)*m;
+    m = rotate(a*0.5f, 1.0f, 0.0f, 0.0f)*m;
+    sum += m(0, 1);
+  }
+  double mat_ns = elapsed_ns(start, runs);
+
+  start = bench_clock::now();
+  for (unsigned int i = 0; i < runs; ++i)
+  {
+    float a = (float)(i % 360);
+    quatf q = quatf::axis_angle(a*0.5f, vec3f(1.0f, 0.0f, 0.0f))
+            * quatf::axis_angle(a*1.0f, vec3f(0.0f, 1.0f, 0.0f))
+            * quatf::axis_angle(a*0.7f, vec3f(0.0f, 0.0f, 1.0f));
+    mat4x4f m = q.to_mat4();
+    sum += m(0, 1);
+  }
+  double quat_ns = elapsed_ns(start, runs);
+
+  g_sink = sum;
+  print_row("chain mat4", mat_ns, mat_ns);
+  print_row("chain quat", quat_ns, mat_ns);
+}
+
+void bench_rigid(unsigned int runs)
+{
+  bench_clock::time_point start;
+  float sum = 0.0f;
+
+  std::vector<mat4x4f> mats(360);
+  std::vector<dualquatf> dqs(360);
+  for (unsigned int a = 0; a < 360; ++a)
+  {
+    quatf q = quatf::axis_angle((float)a, vec3f(1.0f, 2.0f, -1.0f));
+    mats[a] = translate(0.0f, 0.0f, -4.0f)*q.to_mat4();
+    dqs[a] = dualquatf(q, vec3f(0.0f, 0.0f, -4.0f));
+  }
+
+  // composition of two rigid transforms
+  start = bench_clock::now();
+  for (unsigned int i = 0; i < runs; ++i)
+  {
+    mat4x4f m = mats[i % 360]*mats[(i*7) % 360];
+    sum += m(0, 3);
+  }
+  double mat_ns = elapsed_ns(start, runs);
+
+  start = bench_clock::now();
+  for (unsigned int i = 0; i < runs; ++i)
+  {
+    dualquatf dq = dqs[i % 360]*dqs[(i*7) % 360];
+    sum += dq.dual.x;
+  }
+  double dq_ns = elapsed_ns(start, runs);
+
+  g_sink = sum;
+  print_row("rigid compose mat4", mat_ns, mat_ns);
+  print_row("rigid compose dualquat", dq_ns, mat_ns);
+}
+
+void bench_batch(unsigned int n, unsigned int runs)
+{
+  bench_clock::time_point start;
+
+  std::vector<vec3f> in(n), out(n);
+  for (unsigned int i = 0; i < n; ++i)
+    in[i] = vec3f((float)(i % 17) - 8.0f, (float)(i % 5), (float)(i % 11)*0.5f);
+
+  quatf q = quatf::axis_angle(33.0f, vec3f(1.0f, 2.0f, -1.0f));
+  mat4x4f m = q.to_mat4();
+
+  start = bench_clock::now();
+  for (unsigned int r = 0; r < runs; ++r)
+  {
+    for (unsigned int i = 0; i < n; ++i)
+    {
+      vec4f v = m*vec4f(in[i](0), in[i](1), in[i](2), 0.0f);
+      out[i] = vec3f(v(0), v(1), v(2));
+    }
+  }
+  double mat_ns = elapsed_ns(start, runs*n);
+  g_sink = out[n/2](0);
+
+  start = bench_clock::now();
+  for (unsigned int r = 0; r < runs; ++r)
+  {
+    for (unsigned int i = 0; i < n; ++i)
+      out[i] = q.rotate(in[i]);
+  }
+  double quat_ns = elapsed_ns(start, runs*n);
+  g_sink = out[n/2](0);
+
+  start = bench_clock::now();
+  for (unsigned int r = 0; r < runs; ++r)
+    rotate_vectors(q, &in[0], &out[0], n);
+  double batch_ns = elapsed_ns(start, runs*n);
+  g_sink = out[n/2](0);
+
+  // the kernels agree
+  float error = 0.0f;
+  for (unsigned int i = 0; i < n; ++i)
+  {
+    vec3f d = out[i] - q.rotate(in[i]);
+    error = std::max(error, std::max(std::fabs(d(0)), std::max(std::fabs(d(1)), std::fabs(d(2)))));
+  }
+
+  print_row("batch mat4*vec4", mat_ns, mat_ns);
+  print_row("batch quat::rotate", quat_ns, mat_ns);
+  print_row("batch rotate_vectors", batch_ns, mat_ns);
+  std::cout << "(max difference " << error << ")" << std::endl;
+}
+
+int main(int argc, char* argv[])
+{
+  unsigned int n = (argc > 1) ? std::atoi(argv[1]) : 100000;
+  if (n == 0)
+  {
+    std::cerr << "usage: RotationBench [vector count]" << std::endl;
+    return -1;
+  }
+
+#if defined(__SSE2__)
+  std::cout << "rotate_vectors: SSE2" << std::endl;
+#else
+  std::cout << "rotate_vectors: scalar" << std::endl;
+#endif
+  std::cout << "case\tns/op\tspeedup (vs mat4)" << std::endl;
+
+  bench_chain(1000000);
+  bench_rigid(1000000);
+  bench_batch(n, std::max(1u, 20000000u / n));
+
+  return 0;
+}
@@ -0,0 +1,165 @@
+#include <iostream>
+#include <vector>
+#include <string>
+#include <chrono>
+#include <cstdlib>
+#include <cmath>
+#include <algorithm>
+
+#include "../common/vec.hpp"
+#include "../common/mat.hpp"
+#include "../common/quat.hpp"
+#include "../common/world.hpp"
+
+////////////////////////////////////////////////////////////////////////////////
+/// 대규모 월드 좌표: float world transforms vs double + camera relative float
+///
+/// A scene of n nodes: 100 root objects on a 10 km grid, every one the root of
+/// a 4-ary subtree of parts a few meters apart. Per frame:
+///
+/// float         world transforms accumulated in float (generic mat4 product),
+///               uploaded as they are
+/// float affine  the same with mul_affine()
+/// double        world transforms accumulated in double (mul_affine), then
+///               camera_relative() to float for the upload
+///
+/// Precision: a point on every part of the farthest object, seen by a camera
+/// a few meters away, relative to the camera: float world - float eye (what a
+/// float model and view matrix compute) vs the camera relative float matrix,
+/// both against the exact double result.
+///
+/// usage: WorldBench [node count] (default 100000)
+////////////////////////////////////////////////////////////////////////////////
+using namespace kmuvcl::math;
+
+typedef std::chrono::steady_clock bench_clock;
+
+// keeps the optimizer from dropping the benchmarked work
+volatile float g_sink;
+
+const unsigned int kroots = 100;
+const double       kroot_spacing = 10000.0;     // meters
+
+double elapsed_ms(bench_clock::time_point start, unsigned int count)
+{
+  return std::chrono::duration<double, std::milli>(bench_clock::now() - start).count() / count;
+}
+
+void print_row(const std::string& name, double ms, double baseline_ms)
+{
+  std::cout << name << "\t" << ms << "\t" << baseline_ms / ms << "x" << std::endl;
+}
+
+/// node i; roots (r >= 0: root r) on the grid, parts a few meters from their parent
+mat4x4d make_local(unsigned int i, int r)
+{
+  mat4x4d m = quatd::axis_angle((double)(i % 360), vec3d(1.0, 2.0, -1.0)).to_mat4();
+  if (r >= 0)
+  {
+    m(0, 3) = (r % 10)*kroot_spacing;
+    m(2, 3) = (r / 10)*kroot_spacing;
+  }
+  else
+  {
+    m(0, 3) = 1.0 + (i % 3);
+    m(1, 3) = 0.5*(i % 5);
+    m(2, 3) = -1.0 - 0.25*(i % 4);
+  }
+
+  return  m;
+}
+
+int main(int argc, char* argv[])
+{
+  unsigned int n = (argc > 1) ? std::atoi(argv[1]) : 100000;
+  if (n < kroots)
+  {
+    std::cerr << "usage: WorldBench [node count >= " << kroots << "]" << std::endl;
+    return -1;
+  }
+
+  // roots first, then every subtree in order (parents before their children)
+  transform_tree<double> tree;
+  std::vector<int> parents;
+  unsigned int per_root = n / kroots;
+  for (unsigned int r = 0; r < kroots; ++r)
+  {
+    unsigned int first = tree.size();
+    for (unsigned int k = 0; k < per_root; ++k)
+    {
+      int parent = (k == 0) ? -1 : (int)(first + (k - 1)/4);
+      tree.add(parent, make_local(first + k, (k == 0) ? (int)r : -1));
+      parents.push_back(parent);
+    }
+  }
+  n = tree.size();
+
+  std::vector<mat4x4f> local_f(n), world_f(n), upload(n);
+  for (unsigned int i = 0; i < n; ++i)
+    local_f[i] = mat_cast<float>(tree.local(i));
+
+  // the camera a few meters from the farthest object
+  const unsigned int target = (kroots - 1)*per_root;
+  tree.update();
+  vec3d eye(tree.world(target)(0, 3) + 2.0, tree.world(target)(1, 3) + 1.5, tree.world(target)(2, 3) + 3.0);
+
+  const unsigned int frames = std::max(1u, 2000000u / n);
+  bench_clock::time_point start;
+
+  std::cout << n << " nodes, " << frames << " frames" << std::endl;
+  std::cout << "case\tms/frame\tspeedup (vs float)" << std::endl;
+
+  start = bench_clock::now();
+  for (unsigned int f = 0; f < frames; ++f)
+    for (unsigned int i = 0; i < n; ++i)
+      world_f[i] = (parents[i] < 0) ? local_f[i] : world_f[parents[i]]*local_f[i];
+  double float_ms = elapsed_ms(start, frames);
+  g_sink = world_f[n - 1](0, 3);
+
+  start = bench_clock::now();
+  for (unsigned int f = 0; f < frames; ++f)
+    for (unsigned int i = 0; i < n; ++i)
+      world_f[i] = (parents[i] < 0) ? local_f[i] : mul_affine(world_f[parents[i]], local_f[i]);
+  double float_affine_ms = elapsed_ms(start, frames);
+  g_sink = world_f[n - 1](0, 3);
+
+  start = bench_clock::now();
+  for (unsigned int f = 0; f < frames; ++f)
+    tree.update();
+  double update_ms = elapsed_ms(start, frames);
+  g_sink = (float)tree.world(n - 1)(0, 3);
+
+  start = bench_clock::now();
+  for (unsigned int f = 0; f < frames; ++f)
+    tree.camera_relative_matrices(eye, &upload[0]);
+  double relative_ms = elapsed_ms(start, frames);
+  g_sink = upload[n - 1](0, 3);
+
+  print_row("float", float_ms, float_ms);
+  print_row("float affine", float_affine_ms, float_ms);
+  print_row("double update", update_ms, float_ms);
+  print_row("double update + relative", update_ms + relative_ms, float_ms);
+  std::cout << "(camera relative conversion alone " << relative_ms << " ms)" << std::endl;
+
+  // precision on the farthest object
+  const vec3f p(0.1f, 0.2f, 0.3f);
+  const vec4d pd(0.1f, 0.2f, 0.3f, 1.0f);
+  const vec3f eye_f = vec_cast<float>(eye);
+  double float_error = 0.0, relative_error = 0.0;
+  for (unsigned int i = target; i < target + per_root; ++i)
+  {
+    vec4d exact = tree.world(i)*pd;
+    vec4f wf = world_f[i]*vec4f(p(0), p(1), p(2), 1.0f);
+    vec4f rf = upload[i]*vec4f(p(0), p(1), p(2), 1.0f);
+    for (unsigned int c = 0; c < 3; ++c)
+    {
+      double ref = exact(c) - eye(c);
+      float_error = std::max(float_error, std::fabs((double)(wf(c) - eye_f(c)) - ref));
+      relative_error = std::max(relative_error, std::fabs((double)rf(c) - ref));
+    }
+  }
+  std::cout << "max error " << std::sqrt(2.0)*(kroots/10 - 1)*kroot_spacing/1000.0 << " km away: float "
+            << float_error*1000.0 << " mm, camera relative " << relative_error*1000.0 << " mm" << std::endl;
+
+  return 0;
+}
@@ -0,0 +1,141 @@
+#ifndef KMUVCL_GRAPHICS_DUALQUAT_HPP
+#define KMUVCL_GRAPHICS_DUALQUAT_HPP
+
+#include <iostream>
+#include <cmath>
+#include <cstddef>
+#include "vec.hpp"
+#include "mat.hpp"
+#include "operator.hpp"
+#include "quat.hpp"
+
+namespace kmuvcl {
+  namespace math {
+
+    /// unit dual quaternion real + e*dual for rigid transforms (rotation, then translation)
+    template <typename T>
+    class dualquat
+    {
+    public:
+      dualquat() : real(), dual(0, 0, 0, 0) {}
+
+      dualquat(const quat<T>& _real, const quat<T>& _dual) : real(_real), dual(_dual) {}
+
+      /// rotate by r, then translate by t
+      dualquat(const quat<T>& r, const vec<3, T>& t)
+        : real(r), dual(quat<T>(0, t(0)/2, t(1)/2, t(2)/2) * r)
+      {
+      }
+
+      static dualquat translation(const vec<3, T>& t)
+      {
+        return  dualquat(quat<T>(), t);
+      }
+
+      static dualquat rotation(const quat<T>& r)
+      {
+        return  dualquat(r, quat<T>(0, 0, 0, 0));
+      }
+
+      vec<3, T> translation() const
+      {
+        // t = 2 * dual * conjugate(real)
+        quat<T> t = dual * real.conjugate();
+        return  vec<3, T>(2*t.x, 2*t.y, 2*t.z);
+      }
+
+      dualquat normalized() const
+      {
+        T len = real.norm();
+        if (len <= 0)
+          return  dualquat();
+
+        quat<T> r(real.w/len, real.x/len, real.y/len, real.z/len);
+        quat<T> d(dual.w/len, dual.x/len, dual.y/len, dual.z/len);
+
+        // keep dual orthogonal to real
+        T rd = dot(r, d);
+        return  dualquat(r, quat<T>(d.w - rd*r.w, d.x - rd*r.x, d.y - rd*r.y, d.z - rd*r.z));
+      }
+
+      /// inverse transform (for unit dual quaternions)
+      dualquat conjugate() const
+      {
+        return  dualquat(real.conjugate(), dual.conjugate());
+      }
+
+      vec<3, T> transform_point(const vec<3, T>& p) const
+      {
+        return  real.rotate(p) + translation();
+      }
+
+      vec<3, T> transform_vector(const vec<3, T>& v) const
+      {
+        return  real.rotate(v);
+      }
+
+      mat<4, 4, T> to_mat4() const
+      {
+        mat<4, 4, T> m = real.to_mat4();
+        vec<3, T> t = translation();
+        m(0, 3) = t(0);
+        m(1, 3) = t(1);
+        m(2, 3) = t(2);
+
+        return  m;
+      }
+
+    public:
+      quat<T> real, dual;
+    };
+
+    /// r = p * q (apply q, then p)
+    template <typename T>
+    dualquat<T> operator* (const dualquat<T>& p, const dualquat<T>& q)
+    {
+      quat<T> a = p.real * q.dual, b = p.dual * q.real;
+      return  dualquat<T>(p.real * q.real, quat<T>(a.w + b.w, a.x + b.x, a.y + b.y, a.z + b.z));
+    }
+
+    /// dual quaternion linear blend of two transforms, shortest arc
+    template <typename T>
+    dualquat<T> nlerp(const dualquat<T>& p, const dualquat<T>& q, T t)
+    {
+      T b = (dot(p.real, q.real) < 0) ? -t : t;
+      T a = 1 - t;
+
+      return  dualquat<T>(
+        quat<T>(a*p.real.w + b*q.real.w, a*p.real.x + b*q.real.x, a*p.real.y + b*q.real.y, a*p.real.z + b*q.real.z),
+        quat<T>(a*p.dual.w + b*q.dual.w, a*p.dual.x + b*q.dual.x, a*p.dual.y + b*q.dual.y, a*p.dual.z + b*q.dual.z)).normalized();
+    }
+
+    /// out[i] = dq applied to the point in[i], i < n (in and out may be the same array)
+    template <typename T>
+    void transform_points(const dualquat<T>& dq, const vec<3, T>* in, vec<3, T>* out, size_t n)
+    {
+      rotate_vectors(dq.real, in, out, n);
+
+      vec<3, T> t = dq.translation();
+      for (size_t i = 0; i < n; ++i)
+      {
+        out[i](0) += t(0);
+        out[i](1) += t(1);
+        out[i](2) += t(2);
+      }
+    }
+
+    /// ostream for dualquat class
+    template <typename T>
+    std::ostream& operator << (std::ostream& os, const dualquat<T>& dq)
+    {
+      os << dq.real << " + e" << dq.dual;
+      return  os;
+    }
+
+    typedef dualquat<float>     dualquatf;
+    typedef dualquat<double>    dualquatd;
+
+  } // math
+} // kmuvcl
+
+#endif // KMUVCL_GRAPHICS_DUALQUAT_HPP
@@ -0,0 +1,333 @@
+#ifndef KMUVCL_GRAPHICS_INVERSE_HPP
+#define KMUVCL_GRAPHICS_INVERSE_HPP
+
+#include <cmath>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+#include "vec.hpp"
+#include "mat.hpp"
+#include "operator.hpp"
+
+namespace kmuvcl {
+  namespace math {
+
+    /// upper left 3x3 block of A (the linear part of an affine transform)
+    template <typename T>
+    mat<3, 3, T> upper3x3(const mat<4, 4, T>& A)
+    {
+      mat<3, 3, T> B;
+      for (unsigned int i = 0; i < 3; ++i)
+        for (unsigned int j = 0; j < 3; ++j)
+          B(i, j) = A(i, j);
+
+      return  B;
+    }
+
+    template <typename T>
+    T determinant(const mat<3, 3, T>& A)
+    {
+      return  A(0, 0)*(A(1, 1)*A(2, 2) - A(1, 2)*A(2, 1))
+            - A(0, 1)*(A(1, 0)*A(2, 2) - A(1, 2)*A(2, 0))
+            + A(0, 2)*(A(1, 0)*A(2, 1) - A(1, 1)*A(2, 0));
+    }
+
+    /// Laplace expansion by the 2x2 minors of the upper and lower two rows
+    template <typename T>
+    T determinant(const mat<4, 4, T>& A)
+    {
+      T s0 = A(0, 0)*A(1, 1) - A(1, 0)*A(0, 1);
+      T s1 = A(0, 0)*A(1, 2) - A(1, 0)*A(0, 2);
+      T s2 = A(0, 0)*A(1, 3) - A(1, 0)*A(0, 3);
+      T s3 = A(0, 1)*A(1, 2) - A(1, 1)*A(0, 2);
+      T s4 = A(0, 1)*A(1, 3) - A(1, 1)*A(0, 3);
+      T s5 = A(0, 2)*A(1, 3) - A(1, 2)*A(0, 3);
+
+      T c5 = A(2, 2)*A(3, 3) - A(3, 2)*A(2, 3);
+      T c4 = A(2, 1)*A(3, 3) - A(3, 1)*A(2, 3);
+      T c3 = A(2, 1)*A(3, 2) - A(3, 1)*A(2, 2);
+      T c2 = A(2, 0)*A(3, 3) - A(3, 0)*A(2, 3);
+      T c1 = A(2, 0)*A(3, 2) - A(3, 0)*A(2, 2);
+      T c0 = A(2, 0)*A(3, 1) - A(3, 0)*A(2, 1);
+
+      return  s0*c5 - s1*c4 + s2*c3 + s3*c2 - s4*c1 + s5*c0;
+    }
+
+    /// adjugate / determinant; zero matrix if A is singular
+    template <typename T>
+    mat<3, 3, T> inverse(const mat<3, 3, T>& A)
+    {
+      mat<3, 3, T> B;
+      B(0, 0) = A(1, 1)*A(2, 2) - A(1, 2)*A(2, 1);
+      B(0, 1) = A(0, 2)*A(2, 1) - A(0, 1)*A(2, 2);
+      B(0, 2) = A(0, 1)*A(1, 2) - A(0, 2)*A(1, 1);
+      B(1, 0) = A(1, 2)*A(2, 0) - A(1, 0)*A(2, 2);
+      B(1, 1) = A(0, 0)*A(2, 2) - A(0, 2)*A(2, 0);
+      B(1, 2) = A(0, 2)*A(1, 0) - A(0, 0)*A(1, 2);
+      B(2, 0) = A(1, 0)*A(2, 1) - A(1, 1)*A(2, 0);
+      B(2, 1) = A(0, 1)*A(2, 0) - A(0, 0)*A(2, 1);
+      B(2, 2) = A(0, 0)*A(1, 1) - A(0, 1)*A(1, 0);
+
+      // the first column of the adjugate holds the cofactors of the first row
+      T det = A(0, 0)*B(0, 0) + A(0, 1)*B(1, 0) + A(0, 2)*B(2, 0);
+      if (det == 0)
+        return  mat<3, 3, T>();
+
+      T inv_det = 1 / det;
+      for (unsigned int i = 0; i < 3; ++i)
+        for (unsigned int j = 0; j < 3; ++j)
+          B(i, j) *= inv_det;
+
+      return  B;
+    }
+
+    /// adjugate / determinant from the same 2x2 minors as determinant(); zero matrix if A is singular
+    template <typename T>
+    mat<4, 4, T> inverse(const mat<4, 4, T>& A)
+    {
+      T s0 = A(0, 0)*A(1, 1) - A(1, 0)*A(0, 1);
+      T s1 = A(0, 0)*A(1, 2) - A(1, 0)*A(0, 2);
+      T s2 = A(0, 0)*A(1, 3) - A(1, 0)*A(0, 3);
+      T s3 = A(0, 1)*A(1, 2) - A(1, 1)*A(0, 2);
+      T s4 = A(0, 1)*A(1, 3) - A(1, 1)*A(0, 3);
+      T s5 = A(0, 2)*A(1, 3) - A(1, 2)*A(0, 3);
+
+      T c5 = A(2, 2)*A(3, 3) - A(3, 2)*A(2, 3);
+      T c4 = A(2, 1)*A(3, 3) - A(3, 1)*A(2, 3);
+      T c3 = A(2, 1)*A(3, 2) - A(3, 1)*A(2, 2);
+      T c2 = A(2, 0)*A(3, 3) - A(3, 0)*A(2, 3);
+      T c1 = A(2, 0)*A(3, 2) - A(3, 0)*A(2, 2);
+      T c0 = A(2, 0)*A(3, 1) - A(3, 0)*A(2, 1);
+
+      T det = s0*c5 - s1*c4 + s2*c3 + s3*c2 - s4*c1 + s5*c0;
+      if (det == 0)
+        return  mat<4, 4, T>();
+
+      T inv_det = 1 / det;
+
+      mat<4, 4, T> B;
+      B(0, 0) = ( A(1, 1)*c5 - A(1, 2)*c4 + A(1, 3)*c3)*inv_det;
+      B(0, 1) = (-A(0, 1)*c5 + A(0, 2)*c4 - A(0, 3)*c3)*inv_det;
+      B(0, 2) = ( A(3, 1)*s5 - A(3, 2)*s4 + A(3, 3)*s3)*inv_det;
+      B(0, 3) = (-A(2, 1)*s5 + A(2, 2)*s4 - A(2, 3)*s3)*inv_det;
+
+      B(1, 0) = (-A(1, 0)*c5 + A(1, 2)*c2 - A(1, 3)*c1)*inv_det;
+      B(1, 1) = ( A(0, 0)*c5 - A(0, 2)*c2 + A(0, 3)*c1)*inv_det;
+      B(1, 2) = (-A(3, 0)*s5 + A(3, 2)*s2 - A(3, 3)*s1)*inv_det;
+      B(1, 3) = ( A(2, 0)*s5 - A(2, 2)*s2 + A(2, 3)*s1)*inv_det;
+
+      B(2, 0) = ( A(1, 0)*c4 - A(1, 1)*c2 + A(1, 3)*c0)*inv_det;
+      B(2, 1) = (-A(0, 0)*c4 + A(0, 1)*c2 - A(0, 3)*c0)*inv_det;
+      B(2, 2) = ( A(3, 0)*s4 - A(3, 1)*s2 + A(3, 3)*s0)*inv_det;
+      B(2, 3) = (-A(2, 0)*s4 + A(2, 1)*s2 - A(2, 3)*s0)*inv_det;
+
+      B(3, 0) = (-A(1, 0)*c3 + A(1, 1)*c1 - A(1, 2)*c0)*inv_det;
+      B(3, 1) = ( A(0, 0)*c3 - A(0, 1)*c1 + A(0, 2)*c0)*inv_det;
+      B(3, 2) = (-A(3, 0)*s3 + A(3, 1)*s1 - A(3, 2)*s0)*inv_det;
+      B(3, 3) = ( A(2, 0)*s3 - A(2, 1)*s1 + A(2, 2)*s0)*inv_det;
+
+      return  B;
+    }
+
+#if defined(__SSE2__)
+    /// float versions: A split into the 2x2 blocks [X Y; Z W], one SSE register each.
+    ///   |A|     = |X||W| + |Y||Z| - tr(adj(X) Y adj(W) Z)
+    ///   inverse = 1/|A| [adj(|W|X - Y adj(W) Z)  adj(|Y|Z - W adj(adj(X) Y)); ...]
+    /// They read the stored columns as rows: inverse(transpose(A)) = transpose(inverse(A)),
+    /// so the column major result comes out without transposing.
+    namespace detail {
+
+      // 2x2 blocks stored row major as (m00, m01, m10, m11)
+      inline __m128 swizzle(__m128 v, int mask)
+      {
+        return  _mm_castsi128_ps(_mm_shuffle_epi32(_mm_castps_si128(v), mask));
+      }
+
+      // A * B
+      inline __m128 mat2_mul(__m128 a, __m128 b)
+      {
+        return  _mm_add_ps(_mm_mul_ps(a, swizzle(b, _MM_SHUFFLE(3, 0, 3, 0))),
+                           _mm_mul_ps(swizzle(a, _MM_SHUFFLE(2, 3, 0, 1)), swizzle(b, _MM_SHUFFLE(1, 2, 1, 2))));
+      }
+
+      // adj(A) * B
+      inline __m128 mat2_adj_mul(__m128 a, __m128 b)
+      {
+        return  _mm_sub_ps(_mm_mul_ps(swizzle(a, _MM_SHUFFLE(0, 0, 3, 3)), b),
+                           _mm_mul_ps(swizzle(a, _MM_SHUFFLE(2, 2, 1, 1)), swizzle(b, _MM_SHUFFLE(1, 0, 3, 2))));
+      }
+
+      // A * adj(B)
+      inline __m128 mat2_mul_adj(__m128 a, __m128 b)
+      {
+        return  _mm_sub_ps(_mm_mul_ps(a, swizzle(b, _MM_SHUFFLE(0, 3, 0, 3))),
+                           _mm_mul_ps(swizzle(a, _MM_SHUFFLE(2, 3, 0, 1)), swizzle(b, _MM_SHUFFLE(1, 2, 1, 2))));
+      }
+
+      // sum of the 4 lanes in every lane
+      inline __m128 horizontal_sum(__m128 v)
+      {
+        v = _mm_add_ps(v, swizzle(v, _MM_SHUFFLE(2, 3, 0, 1)));
+        return  _mm_add_ps(v, swizzle(v, _MM_SHUFFLE(1, 0, 3, 2)));
+      }
+
+    } // detail
+
+    inline float determinant(const mat<4, 4, float>& A)
+    {
+      const float* m = A;
+      __m128 r0 = _mm_loadu_ps(m), r1 = _mm_loadu_ps(m + 4), r2 = _mm_loadu_ps(m + 8), r3 = _mm_loadu_ps(m + 12);
+
+      __m128 x = _mm_movelh_ps(r0, r1), y = _mm_movehl_ps(r1, r0);
+      __m128 z = _mm_movelh_ps(r2, r3), w = _mm_movehl_ps(r3, r2);
+
+      // (|X|, |Y|, |Z|, |W|)
+      __m128 dets = _mm_sub_ps(
+        _mm_mul_ps(_mm_shuffle_ps(r0, r2, _MM_SHUFFLE(2, 0, 2, 0)), _mm_shuffle_ps(r1, r3, _MM_SHUFFLE(3, 1, 3, 1))),
+        _mm_mul_ps(_mm_shuffle_ps(r0, r2, _MM_SHUFFLE(3, 1, 3, 1)), _mm_shuffle_ps(r1, r3, _MM_SHUFFLE(2, 0, 2, 0))));
+
+      __m128 wz = detail::mat2_adj_mul(w, z);
+      __m128 xy = detail::mat2_adj_mul(x, y);
+      __m128 tr = detail::horizontal_sum(_mm_mul_ps(xy, detail::swizzle(wz, _MM_SHUFFLE(3, 1, 2, 0))));
+
+      float d[4];
+      _mm_storeu_ps(d, dets);
+      return  d[0]*d[3] + d[1]*d[2] - _mm_cvtss_f32(tr);
+    }
+
+    inline mat<4, 4, float> inverse(const mat<4, 4, float>& A)
+    {
+      const float* m = A;
+      __m128 r0 = _mm_loadu_ps(m), r1 = _mm_loadu_ps(m + 4), r2 = _mm_loadu_ps(m + 8), r3 = _mm_loadu_ps(m + 12);
+
+      __m128 x = _mm_movelh_ps(r0, r1), y = _mm_movehl_ps(r1, r0);
+      __m128 z = _mm_movelh_ps(r2, r3), w = _mm_movehl_ps(r3, r2);
+
+      __m128 dets = _mm_sub_ps(
+        _mm_mul_ps(_mm_shuffle_ps(r0, r2, _MM_SHUFFLE(2, 0, 2, 0)), _mm_shuffle_ps(r1, r3, _MM_SHUFFLE(3, 1, 3, 1))),
+        _mm_mul_ps(_mm_shuffle_ps(r0, r2, _MM_SHUFFLE(3, 1, 3, 1)), _mm_shuffle_ps(r1, r3, _MM_SHUFFLE(2, 0, 2, 0))));
+      __m128 det_x = detail::swizzle(dets, _MM_SHUFFLE(0, 0, 0, 0));
+      __m128 det_y = detail::swizzle(dets, _MM_SHUFFLE(1, 1, 1, 1));
+      __m128 det_z = detail::swizzle(dets, _MM_SHUFFLE(2, 2, 2, 2));
+      __m128 det_w = detail::swizzle(dets, _MM_SHUFFLE(3, 3, 3, 3));
+
+      __m128 wz = detail::mat2_adj_mul(w, z);
+      __m128 xy = detail::mat2_adj_mul(x, y);
+
+      // adjugates of the blocks of the inverse, times |A|
+      __m128 bx = _mm_sub_ps(_mm_mul_ps(det_w, x), detail::mat2_mul(y, wz));
+      __m128 bw = _mm_sub_ps(_mm_mul_ps(det_x, w), detail::mat2_mul(z, xy));
+      __m128 by = _mm_sub_ps(_mm_mul_ps(det_y, z), detail::mat2_mul_adj(w, xy));
+      __m128 bz = _mm_sub_ps(_mm_mul_ps(det_z, y), detail::mat2_mul_adj(x, wz));
+
+      __m128 tr = detail::horizontal_sum(_mm_mul_ps(xy, detail::swizzle(wz, _MM_SHUFFLE(3, 1, 2, 0))));
+      __m128 det = _mm_sub_ps(_mm_add_ps(_mm_mul_ps(det_x, det_w), _mm_mul_ps(det_y, det_z)), tr);
+      if (_mm_cvtss_f32(det) == 0.0f)
+        return  mat<4, 4, float>();
+
+      // the adjugate of a 2x2 block swaps the diagonal and negates the rest
+      __m128 inv_det = _mm_div_ps(_mm_setr_ps(1.0f, -1.0f, -1.0f, 1.0f), det);
+      bx = _mm_mul_ps(bx, inv_det);
+      by = _mm_mul_ps(by, inv_det);
+      bz = _mm_mul_ps(bz, inv_det);
+      bw = _mm_mul_ps(bw, inv_det);
+
+      mat<4, 4, float> B;
+      float* dst = B;
+      _mm_storeu_ps(dst,      _mm_shuffle_ps(bx, by, _MM_SHUFFLE(1, 3, 1, 3)));
+      _mm_storeu_ps(dst + 4,  _mm_shuffle_ps(bx, by, _MM_SHUFFLE(0, 2, 0, 2)));
+      _mm_storeu_ps(dst + 8,  _mm_shuffle_ps(bz, bw, _MM_SHUFFLE(1, 3, 1, 3)));
+      _mm_storeu_ps(dst + 12, _mm_shuffle_ps(bz, bw, _MM_SHUFFLE(0, 2, 0, 2)));
+
+      return  B;
+    }
+#endif
+
+    /// inverse of an affine transform [L t; 0 1]: [inverse(L) -inverse(L)t; 0 1], straight from the
+    /// 3x3 cofactors of L. The last row of A is assumed to be (0, 0, 0, 1); zero matrix if L is singular
+    template <typename T>
+    mat<4, 4, T> inverse_affine(const mat<4, 4, T>& A)
+    {
+      T b00 = A(1, 1)*A(2, 2) - A(1, 2)*A(2, 1);
+      T b10 = A(1, 2)*A(2, 0) - A(1, 0)*A(2, 2);
+      T b20 = A(1, 0)*A(2, 1) - A(1, 1)*A(2, 0);
+
+      T det = A(0, 0)*b00 + A(0, 1)*b10 + A(0, 2)*b20;
+      if (det == 0)
+        return  mat<4, 4, T>();
+
+      T inv_det = 1 / det;
+
+      mat<4, 4, T> B;
+      B(0, 0) = b00*inv_det;
+      B(0, 1) = (A(0, 2)*A(2, 1) - A(0, 1)*A(2, 2))*inv_det;
+      B(0, 2) = (A(0, 1)*A(1, 2) - A(0, 2)*A(1, 1))*inv_det;
+      B(1, 0) = b10*inv_det;
+      B(1, 1) = (A(0, 0)*A(2, 2) - A(0, 2)*A(2, 0))*inv_det;
+      B(1, 2) = (A(0, 2)*A(1, 0) - A(0, 0)*A(1, 2))*inv_det;
+      B(2, 0) = b20*inv_det;
+      B(2, 1) = (A(0, 1)*A(2, 0) - A(0, 0)*A(2, 1))*inv_det;
+      B(2, 2) = (A(0, 0)*A(1, 1) - A(0, 1)*A(1, 0))*inv_det;
+
+      for (unsigned int i = 0; i < 3; ++i)
+        B(i, 3) = -(B(i, 0)*A(0, 3) + B(i, 1)*A(1, 3) + B(i, 2)*A(2, 3));
+      B(3, 3) = 1;
+
+      return  B;
+    }
+
+#if defined(__SSE2__)
+    /// float version: the rows of adj(L) are the cross products of its columns,
+    /// (c1 x c2, c2 x c0, c0 x c1), transposed into the columns of the result
+    inline mat<4, 4, float> inverse_affine(const mat<4, 4, float>& A)
+    {
+      const float* m = A;
+      __m128 c0 = _mm_loadu_ps(m), c1 = _mm_loadu_ps(m + 4), c2 = _mm_loadu_ps(m + 8), t = _mm_loadu_ps(m + 12);
+
+      // a x b = (a * b.yzx - a.yzx * b).yzx; w stays 0
+      const int yzxw = _MM_SHUFFLE(3, 0, 2, 1);
+      __m128 c0_yzx = detail::swizzle(c0, yzxw), c1_yzx = detail::swizzle(c1, yzxw), c2_yzx = detail::swizzle(c2, yzxw);
+      __m128 r0 = detail::swizzle(_mm_sub_ps(_mm_mul_ps(c1, c2_yzx), _mm_mul_ps(c1_yzx, c2)), yzxw);
+      __m128 r1 = detail::swizzle(_mm_sub_ps(_mm_mul_ps(c2, c0_yzx), _mm_mul_ps(c2_yzx, c0)), yzxw);
+      __m128 r2 = detail::swizzle(_mm_sub_ps(_mm_mul_ps(c0, c1_yzx), _mm_mul_ps(c0_yzx, c1)), yzxw);
+
+      __m128 det = detail::horizontal_sum(_mm_mul_ps(c0, r0));
+      if (_mm_cvtss_f32(det) == 0.0f)
+        return  mat<4, 4, float>();
+
+      __m128 inv_det = _mm_div_ps(_mm_set1_ps(1.0f), det);
+      r0 = _mm_mul_ps(r0, inv_det);
+      r1 = _mm_mul_ps(r1, inv_det);
+      r2 = _mm_mul_ps(r2, inv_det);
+      __m128 r3 = _mm_setzero_ps();
+      _MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+
+      // -inverse(L) t, then w = 1
+      __m128 it = _mm_add_ps(_mm_add_ps(_mm_mul_ps(r0, detail::swizzle(t, _MM_SHUFFLE(0, 0, 0, 0))),
+                                        _mm_mul_ps(r1, detail::swizzle(t, _MM_SHUFFLE(1, 1, 1, 1)))),
+                             _mm_mul_ps(r2, detail::swizzle(t, _MM_SHUFFLE(2, 2, 2, 2))));
+      it = _mm_sub_ps(_mm_setr_ps(0.0f, 0.0f, 0.0f, 1.0f), it);
+
+      mat<4, 4, float> B;
+      float* dst = B;
+      _mm_storeu_ps(dst,      r0);
+      _mm_storeu_ps(dst + 4,  r1);
+      _mm_storeu_ps(dst + 8,  r2);
+      _mm_storeu_ps(dst + 12, it);
+
+      return  B;
+    }
+#endif
+
+    /// transforms normals by the model transform: transpose(inverse(upper 3x3 of model)).
+    /// Needed whenever the model scales non-uniformly; normals still have to be renormalized
+    template <typename T>
+    mat<3, 3, T> normal_matrix(const mat<4, 4, T>& model)
+    {
+      return  inverse(upper3x3(model)).transpose();
+    }
+
+  } // math
+} // kmuvcl
+
+#endif // KMUVCL_GRAPHICS_INVERSE_HPP
@@ -0,0 +1,445 @@
+#ifndef KMUVCL_GRAPHICS_PACKET_HPP
+#define KMUVCL_GRAPHICS_PACKET_HPP
+
+#include <cstddef>
+#include <algorithm>
+#include <emmintrin.h>
+#if defined(__AVX__)
+#include <immintrin.h>
+#endif
+#include "vec.hpp"
+#include "mat.hpp"
+
+namespace kmuvcl {
+  namespace math {
+
+    /// 4 float lanes in an SSE register. Comparisons return lane masks
+    /// (all bits set where true) in the same type, for select() and any()/all()
+    class simd4f
+    {
+    public:
+      static const unsigned int width = 4;
+
+      simd4f() : v(_mm_setzero_ps()) {}
+      simd4f(__m128 _v) : v(_v) {}
+      simd4f(float s) : v(_mm_set1_ps(s)) {}
+
+      static simd4f load(const float* src)  { return  _mm_loadu_ps(src); }
+      void store(float* dst) const          { _mm_storeu_ps(dst, v); }
+
+      /// bit i set if lane i of the mask is set
+      int movemask() const                  { return  _mm_movemask_ps(v); }
+
+    public:
+      __m128 v;
+    };
+
+    inline simd4f operator+ (simd4f a, simd4f b)  { return  _mm_add_ps(a.v, b.v); }
+    inline simd4f operator- (simd4f a, simd4f b)  { return  _mm_sub_ps(a.v, b.v); }
+    inline simd4f operator* (simd4f a, simd4f b)  { return  _mm_mul_ps(a.v, b.v); }
+    inline simd4f operator/ (simd4f a, simd4f b)  { return  _mm_div_ps(a.v, b.v); }
+    inline simd4f operator- (simd4f a)            { return  _mm_xor_ps(a.v, _mm_set1_ps(-0.0f)); }
+
+    inline simd4f operator< (simd4f a, simd4f b)  { return  _mm_cmplt_ps(a.v, b.v); }
+    inline simd4f operator<=(simd4f a, simd4f b)  { return  _mm_cmple_ps(a.v, b.v); }
+    inline simd4f operator> (simd4f a, simd4f b)  { return  _mm_cmpgt_ps(a.v, b.v); }
+    inline simd4f operator>=(simd4f a, simd4f b)  { return  _mm_cmpge_ps(a.v, b.v); }
+    inline simd4f operator==(simd4f a, simd4f b)  { return  _mm_cmpeq_ps(a.v, b.v); }
+
+    inline simd4f operator& (simd4f a, simd4f b)  { return  _mm_and_ps(a.v, b.v); }
+    inline simd4f operator| (simd4f a, simd4f b)  { return  _mm_or_ps(a.v, b.v); }
+
+    inline simd4f min(simd4f a, simd4f b)         { return  _mm_min_ps(a.v, b.v); }
+    inline simd4f max(simd4f a, simd4f b)         { return  _mm_max_ps(a.v, b.v); }
+    inline simd4f sqrt(simd4f a)                  { return  _mm_sqrt_ps(a.v); }
+
+    /// 1/sqrt(a): the 12 bit estimate refined by one Newton step (~22 bits)
+    inline simd4f rsqrt(simd4f a)
+    {
+      __m128 y = _mm_rsqrt_ps(a.v);
+      __m128 yya = _mm_mul_ps(_mm_mul_ps(y, y), a.v);
+      return  _mm_mul_ps(_mm_mul_ps(_mm_set1_ps(0.5f), y), _mm_sub_ps(_mm_set1_ps(3.0f), yya));
+    }
+
+    /// mask ? a : b, per lane
+    inline simd4f select(simd4f mask, simd4f a, simd4f b)
+    {
+      return  _mm_or_ps(_mm_and_ps(mask.v, a.v), _mm_andnot_ps(mask.v, b.v));
+    }
+
+    inline bool any(simd4f mask)  { return  mask.movemask() != 0; }
+    inline bool all(simd4f mask)  { return  mask.movemask() == 0xf; }
+
+    /// 8 float lanes: one AVX register, or two SSE registers without AVX
+    class simd8f
+    {
+    public:
+      static const unsigned int width = 8;
+
+#if defined(__AVX__)
+      simd8f() : v(_mm256_setzero_ps()) {}
+      simd8f(__m256 _v) : v(_v) {}
+      simd8f(float s) : v(_mm256_set1_ps(s)) {}
+
+      static simd8f load(const float* src)  { return  _mm256_loadu_ps(src); }
+      void store(float* dst) const          { _mm256_storeu_ps(dst, v); }
+      int movemask() const                  { return  _mm256_movemask_ps(v); }
+
+    public:
+      __m256 v;
+#else
+      simd8f() {}
+      simd8f(simd4f _lo, simd4f _hi) : lo(_lo), hi(_hi) {}
+      simd8f(float s) : lo(s), hi(s) {}
+
+      static simd8f load(const float* src)  { return  simd8f(simd4f::load(src), simd4f::load(src + 4)); }
+      void store(float* dst) const          { lo.store(dst); hi.store(dst + 4); }
+      int movemask() const                  { return  lo.movemask() | (hi.movemask() << 4); }
+
+    public:
+      simd4f lo, hi;
+#endif
+    };
+
+#if defined(__AVX__)
+    inline simd8f operator+ (simd8f a, simd8f b)  { return  _mm256_add_ps(a.v, b.v); }
+    inline simd8f operator- (simd8f a, simd8f b)  { return  _mm256_sub_ps(a.v, b.v); }
+    inline simd8f operator* (simd8f a, simd8f b)  { return  _mm256_mul_ps(a.v, b.v); }
+    inline simd8f operator/ (simd8f a, simd8f b)  { return  _mm256_div_ps(a.v, b.v); }
+    inline simd8f operator- (simd8f a)            { return  _mm256_xor_ps(a.v, _mm256_set1_ps(-0.0f)); }
+
+    inline simd8f operator< (simd8f a, simd8f b)  { return  _mm256_cmp_ps(a.v, b.v, _CMP_LT_OQ); }
+    inline simd8f operator<=(simd8f a, simd8f b)  { return  _mm256_cmp_ps(a.v, b.v, _CMP_LE_OQ); }
+    inline simd8f operator> (simd8f a, simd8f b)  { return  _mm256_cmp_ps(a.v, b.v, _CMP_GT_OQ); }
+    inline simd8f operator>=(simd8f a, simd8f b)  { return  _mm256_cmp_ps(a.v, b.v, _CMP_GE_OQ); }
+    inline simd8f operator==(simd8f a, simd8f b)  { return  _mm256_cmp_ps(a.v, b.v, _CMP_EQ_OQ); }
+
+    inline simd8f operator& (simd8f a, simd8f b)  { return  _mm256_and_ps(a.v, b.v); }
+    inline simd8f operator| (simd8f a, simd8f b)  { return  _mm256_or_ps(a.v, b.v); }
+
+    inline simd8f min(simd8f a, simd8f b)         { return  _mm256_min_ps(a.v, b.v); }
+    inline simd8f max(simd8f a, simd8f b)         { return  _mm256_max_ps(a.v, b.v); }
+    inline simd8f sqrt(simd8f a)                  { return  _mm256_sqrt_ps(a.v); }
+
+    inline simd8f rsqrt(simd8f a)
+    {
+      __m256 y = _mm256_rsqrt_ps(a.v);
+      __m256 yya = _mm256_mul_ps(_mm256_mul_ps(y, y), a.v);
+      return  _mm256_mul_ps(_mm256_mul_ps(_mm256_set1_ps(0.5f), y), _mm256_sub_ps(_mm256_set1_ps(3.0f), yya));
+    }
+
+    inline simd8f select(simd8f mask, simd8f a, simd8f b)
+    {
+      return  _mm256_blendv_ps(b.v, a.v, mask.v);
+    }
+#else
+    inline simd8f operator+ (simd8f a, simd8f b)  { return  simd8f(a.lo + b.lo, a.hi + b.hi); }
+    inline simd8f operator- (simd8f a, simd8f b)  { return  simd8f(a.lo - b.lo, a.hi - b.hi); }
+    inline simd8f operator* (simd8f a, simd8f b)  { return  simd8f(a.lo * b.lo, a.hi * b.hi); }
+    inline simd8f operator/ (simd8f a, simd8f b)  { return  simd8f(a.lo / b.lo, a.hi / b.hi); }
+    inline simd8f operator- (simd8f a)            { return  simd8f(-a.lo, -a.hi); }
+
+    inline simd8f operator< (simd8f a, simd8f b)  { return  simd8f(a.lo < b.lo, a.hi < b.hi); }
+    inline simd8f operator<=(simd8f a, simd8f b)  { return  simd8f(a.lo <= b.lo, a.hi <= b.hi); }
+    inline simd8f operator> (simd8f a, simd8f b)  { return  simd8f(a.lo > b.lo, a.hi > b.hi); }
+    inline simd8f operator>=(simd8f a, simd8f b)  { return  simd8f(a.lo >= b.lo, a.hi >= b.hi); }
+    inline simd8f operator==(simd8f a, simd8f b)  { return  simd8f(a.lo == b.lo, a.hi == b.hi); }
+
+    inline simd8f operator& (simd8f a, simd8f b)  { return  simd8f(a.lo & b.lo, a.hi & b.hi); }
+    inline simd8f operator| (simd8f a, simd8f b)  { return  simd8f(a.lo | b.lo, a.hi | b.hi); }
+
+    inline simd8f min(simd8f a, simd8f b)         { return  simd8f(min(a.lo, b.lo), min(a.hi, b.hi)); }
+    inline simd8f max(simd8f a, simd8f b)         { return  simd8f(max(a.lo, b.lo), max(a.hi, b.hi)); }
+    inline simd8f sqrt(simd8f a)                  { return  simd8f(sqrt(a.lo), sqrt(a.hi)); }
+    inline simd8f rsqrt(simd8f a)                 { return  simd8f(rsqrt(a.lo), rsqrt(a.hi)); }
+
+    inline simd8f select(simd8f mask, simd8f a, simd8f b)
+    {
+      return  simd8f(select(mask.lo, a.lo, b.lo), select(mask.hi, a.hi, b.hi));
+    }
+#endif
+
+    inline bool any(simd8f mask)  { return  mask.movemask() != 0; }
+    inline bool all(simd8f mask)  { return  mask.movemask() == 0xff; }
+
+    /// F::width independent 3D vectors, one lane each, stored as structure of arrays
+    /// (all x, all y, all z), so per-vector math runs on every lane at once.
+    /// Loads and stores convert from / to arrays of 3 packed floats (aiVector3D, vec3f)
+    template <typename F>
+    class vec3_packet
+    {
+    public:
+      static const unsigned int width = F::width;
+
+      vec3_packet() {}
+
+      vec3_packet(F _x, F _y, F _z) : x(_x), y(_y), z(_z) {}
+
+      /// v in every lane
+      explicit vec3_packet(const vec<3, float>& v) : x(v(0)), y(v(1)), z(v(2)) {}
+
+      /// width consecutive vectors of src (V: 3 packed floats, e.g. aiVector3D or vec3f)
+      template <typename V>
+      static vec3_packet load(const V* src)
+      {
+        static_assert(sizeof(V) == 3*sizeof(float), "vec3_packet::load needs 3 packed floats");
+        return  load_xyz(reinterpret_cast<const float*>(src));
+      }
+
+      /// the first n (< width) vectors of src, the other lanes 0
+      template <typename V>
+      static vec3_packet load(const V* src, unsigned int n)
+      {
+        static_assert(sizeof(V) == 3*sizeof(float), "vec3_packet::load needs 3 packed floats");
+        float buf[3*width] = { 0 };
+        const float* f = reinterpret_cast<const float*>(src);
+        std::copy(f, f + 3*(n < width ? n : width), buf);
+        return  load_xyz(buf);
+      }
+
+      template <typename V>
+      void store(V* dst) const
+      {
+        static_assert(sizeof(V) == 3*sizeof(float), "vec3_packet::store needs 3 packed floats");
+        store_xyz(reinterpret_cast<float*>(dst));
+      }
+
+      /// the first n (< width) lanes
+      template <typename V>
+      void store(V* dst, unsigned int n) const
+      {
+        static_assert(sizeof(V) == 3*sizeof(float), "vec3_packet::store needs 3 packed floats");
+        float buf[3*width];
+        store_xyz(buf);
+        std::copy(buf, buf + 3*(n < width ? n : width), reinterpret_cast<float*>(dst));
+      }
+
+      /// lane i as a vec3f
+      vec<3, float> lane(unsigned int i) const
+      {
+        float bx[width], by[width], bz[width];
+        x.store(bx);
+        y.store(by);
+        z.store(bz);
+        return  vec<3, float>(bx[i], by[i], bz[i]);
+      }
+
+      /// from / to 3*width packed floats x0 y0 z0 x1 ...
+      static vec3_packet load_xyz(const float* src);
+      void store_xyz(float* dst) const;
+
+    public:
+      F x, y, z;
+    };
+
+    /// x0 y0 z0 x1 | y1 z1 x2 y2 | z2 x3 y3 z3 -> x0..x3, y0..y3, z0..z3
+    template <>
+    inline vec3_packet<simd4f> vec3_packet<simd4f>::load_xyz(const float* src)
+    {
+      __m128 a = _mm_loadu_ps(src);
+      __m128 b = _mm_loadu_ps(src + 4);
+      __m128 c = _mm_loadu_ps(src + 8);
+
+      __m128 px = _mm_shuffle_ps(a, _mm_shuffle_ps(b, c, _MM_SHUFFLE(1, 1, 2, 2)), _MM_SHUFFLE(2, 0, 3, 0));
+      __m128 py = _mm_shuffle_ps(_mm_shuffle_ps(a, b, _MM_SHUFFLE(0, 0, 1, 1)),
+                                 _mm_shuffle_ps(b, c, _MM_SHUFFLE(2, 2, 3, 3)), _MM_SHUFFLE(2, 0, 2, 0));
+      __m128 pz = _mm_shuffle_ps(_mm_shuffle_ps(a, b, _MM_SHUFFLE(1, 1, 2, 2)),
+                                 _mm_shuffle_ps(c, c, _MM_SHUFFLE(3, 3, 0, 0)), _MM_SHUFFLE(2, 0, 2, 0));
+
+      return  vec3_packet<simd4f>(px, py, pz);
+    }
+
+    template <>
+    inline void vec3_packet<simd4f>::store_xyz(float* dst) const
+    {
+      __m128 a = _mm_shuffle_ps(_mm_shuffle_ps(x.v, y.v, _MM_SHUFFLE(0, 0, 0, 0)),
+                                _mm_shuffle_ps(z.v, x.v, _MM_SHUFFLE(1, 1, 0, 0)), _MM_SHUFFLE(2, 0, 2, 0));
+      __m128 b = _mm_shuffle_ps(_mm_shuffle_ps(y.v, z.v, _MM_SHUFFLE(1, 1, 1, 1)),
+                                _mm_shuffle_ps(x.v, y.v, _MM_SHUFFLE(2, 2, 2, 2)), _MM_SHUFFLE(2, 0, 2, 0));
+      __m128 c = _mm_shuffle_ps(_mm_shuffle_ps(z.v, x.v, _MM_SHUFFLE(3, 3, 2, 2)),
+                                _mm_shuffle_ps(y.v, z.v, _MM_SHUFFLE(3, 3, 3, 3)), _MM_SHUFFLE(2, 0, 2, 0));
+
+      _mm_storeu_ps(dst, a);
+      _mm_storeu_ps(dst + 4, b);
+      _mm_storeu_ps(dst + 8, c);
+    }
+
+    /// two 4 wide halves
+    template <>
+    inline vec3_packet<simd8f> vec3_packet<simd8f>::load_xyz(const float* src)
+    {
+      vec3_packet<simd4f> lo = vec3_packet<simd4f>::load_xyz(src);
+      vec3_packet<simd4f> hi = vec3_packet<simd4f>::load_xyz(src + 12);
+
+#if defined(__AVX__)
+      return  vec3_packet<simd8f>(_mm256_insertf128_ps(_mm256_castps128_ps256(lo.x.v), hi.x.v, 1),
+                                  _mm256_insertf128_ps(_mm256_castps128_ps256(lo.y.v), hi.y.v, 1),
+                                  _mm256_insertf128_ps(_mm256_castps128_ps256(lo.z.v), hi.z.v, 1));
+#else
+      return  vec3_packet<simd8f>(simd8f(lo.x, hi.x), simd8f(lo.y, hi.y), simd8f(lo.z, hi.z));
+#endif
+    }
+
+    template <>
+    inline void vec3_packet<simd8f>::store_xyz(float* dst) const
+    {
+#if defined(__AVX__)
+      vec3_packet<simd4f> lo(_mm256_castps256_ps128(x.v), _mm256_castps256_ps128(y.v), _mm256_castps256_ps128(z.v));
+      vec3_packet<simd4f> hi(_mm256_extractf128_ps(x.v, 1), _mm256_extractf128_ps(y.v, 1), _mm256_extractf128_ps(z.v, 1));
+#else
+      vec3_packet<simd4f> lo(x.lo, y.lo, z.lo);
+      vec3_packet<simd4f> hi(x.hi, y.hi, z.hi);
+#endif
+      lo.store_xyz(dst);
+      hi.store_xyz(dst + 12);
+    }
+
+    template <typename F>
+    vec3_packet<F> operator+ (const vec3_packet<F>& u, const vec3_packet<F>& v)
+    {
+      return  vec3_packet<F>(u.x + v.x, u.y + v.y, u.z + v.z);
+    }
+
+    template <typename F>
+    vec3_packet<F> operator- (const vec3_packet<F>& u, const vec3_packet<F>& v)
+    {
+      return  vec3_packet<F>(u.x - v.x, u.y - v.y, u.z - v.z);
+    }
+
+    /// per lane scale
+    template <typename F>
+    vec3_packet<F> operator* (F s, const vec3_packet<F>& v)
+    {
+      return  vec3_packet<F>(s*v.x, s*v.y, s*v.z);
+    }
+
+    template <typename F>
+    F dot(const vec3_packet<F>& u, const vec3_packet<F>& v)
+    {
+      return  u.x*v.x + u.y*v.y + u.z*v.z;
+    }
+
+    template <typename F>
+    vec3_packet<F> cross(const vec3_packet<F>& u, const vec3_packet<F>& v)
+    {
+      return  vec3_packet<F>(u.y*v.z - u.z*v.y, u.z*v.x - u.x*v.z, u.x*v.y - u.y*v.x);
+    }
+
+    template <typename F>
+    F length(const vec3_packet<F>& v)
+    {
+      return  sqrt(dot(v, v));
+    }
+
+    /// unit length lanes (rsqrt with a Newton step); zero vectors stay zero
+    template <typename F>
+    vec3_packet<F> normalize(const vec3_packet<F>& v)
+    {
+      F len2 = dot(v, v);
+      F inv_len = select(len2 > F(0.0f), rsqrt(len2), F(0.0f));
+      return  inv_len*v;
+    }
+
+    /// mask ? a : b, per lane
+    template <typename F>
+    vec3_packet<F> select(F mask, const vec3_packet<F>& a, const vec3_packet<F>& b)
+    {
+      return  vec3_packet<F>(select(mask, a.x, b.x), select(mask, a.y, b.y), select(mask, a.z, b.z));
+    }
+
+    /// F::width homogeneous vectors, structure of arrays
+    template <typename F>
+    class vec4_packet
+    {
+    public:
+      static const unsigned int width = F::width;
+
+      vec4_packet() {}
+
+      vec4_packet(F _x, F _y, F _z, F _w) : x(_x), y(_y), z(_z), w(_w) {}
+
+      /// points (w = 1) or directions (w = 0)
+      vec4_packet(const vec3_packet<F>& v, float _w) : x(v.x), y(v.y), z(v.z), w(_w) {}
+
+      /// xyz / w
+      vec3_packet<F> project() const
+      {
+        F inv_w = F(1.0f) / w;
+        return  vec3_packet<F>(x*inv_w, y*inv_w, z*inv_w);
+      }
+
+      vec3_packet<F> xyz() const
+      {
+        return  vec3_packet<F>(x, y, z);
+      }
+
+    public:
+      F x, y, z, w;
+    };
+
+    /// the 16 elements of a mat<4, 4, float> broadcast to every lane once,
+    /// for transforming many packets by the same matrix
+    template <typename F>
+    class mat4_packet
+    {
+    public:
+      explicit mat4_packet(const mat<4, 4, float>& A)
+      {
+        for (unsigned int i = 0; i < 16; ++i)
+          val[i] = F(((const float*)A)[i]);
+      }
+
+      F operator()(unsigned int r, unsigned int c) const
+      {
+        return  val[r + c*4];   // column major
+      }
+
+    private:
+      F val[16];
+    };
+
+    template <typename F>
+    vec4_packet<F> operator* (const mat4_packet<F>& A, const vec4_packet<F>& v)
+    {
+      return  vec4_packet<F>(A(0, 0)*v.x + A(0, 1)*v.y + A(0, 2)*v.z + A(0, 3)*v.w,
+                             A(1, 0)*v.x + A(1, 1)*v.y + A(1, 2)*v.z + A(1, 3)*v.w,
+                             A(2, 0)*v.x + A(2, 1)*v.y + A(2, 2)*v.z + A(2, 3)*v.w,
+                             A(3, 0)*v.x + A(3, 1)*v.y + A(3, 2)*v.z + A(3, 3)*v.w);
+    }
+
+    /// broadcasts A on every call: prefer a mat4_packet in loops
+    template <typename F>
+    vec4_packet<F> operator* (const mat<4, 4, float>& A, const vec4_packet<F>& v)
+    {
+      return  mat4_packet<F>(A)*v;
+    }
+
+    /// points (w = 1) by an affine matrix, the last row of A ignored
+    template <typename F>
+    vec3_packet<F> transform_point(const mat4_packet<F>& A, const vec3_packet<F>& p)
+    {
+      return  vec3_packet<F>(A(0, 0)*p.x + A(0, 1)*p.y + A(0, 2)*p.z + A(0, 3),
+                             A(1, 0)*p.x + A(1, 1)*p.y + A(1, 2)*p.z + A(1, 3),
+                             A(2, 0)*p.x + A(2, 1)*p.y + A(2, 2)*p.z + A(2, 3));
+    }
+
+    /// directions (w = 0): the upper 3x3 of A only
+    template <typename F>
+    vec3_packet<F> transform_vector(const mat4_packet<F>& A, const vec3_packet<F>& v)
+    {
+      return  vec3_packet<F>(A(0, 0)*v.x + A(0, 1)*v.y + A(0, 2)*v.z,
+                             A(1, 0)*v.x + A(1, 1)*v.y + A(1, 2)*v.z,
+                             A(2, 0)*v.x + A(2, 1)*v.y + A(2, 2)*v.z);
+    }
+
+    typedef vec3_packet<simd4f>   vec3x4f;
+    typedef vec3_packet<simd8f>   vec3x8f;
+    typedef vec4_packet<simd4f>   vec4x4f;
+    typedef vec4_packet<simd8f>   vec4x8f;
+    typedef mat4_packet<simd4f>   mat4x4x4f;
+    typedef mat4_packet<simd8f>   mat4x4x8f;
+
+  } // math
+} // kmuvcl
+
+#endif // KMUVCL_GRAPHICS_PACKET_HPP
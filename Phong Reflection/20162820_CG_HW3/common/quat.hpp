@@ -0,0 +1,264 @@
+#ifndef KMUVCL_GRAPHICS_QUAT_HPP
+#define KMUVCL_GRAPHICS_QUAT_HPP
+
+#include <iostream>
+#include <cmath>
+#include <cstddef>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+#include "vec.hpp"
+#include "mat.hpp"
+#include "operator.hpp"
+
+namespace kmuvcl {
+  namespace math {
+
+    /// unit quaternion w + xi + yj + zk for rotations
+    template <typename T>
+    class quat
+    {
+    public:
+      quat() : w(1), x(0), y(0), z(0) {}
+
+      quat(const T _w, const T _x, const T _y, const T _z) : w(_w), x(_x), y(_y), z(_z) {}
+
+      /// rotation of angle (degree) around axis
+      static quat axis_angle(T angle, const vec<3, T>& axis)
+      {
+        T half = angle * static_cast<T>(3.14159265358979323846 / 360.0);
+        T len = std::sqrt(dot(axis, axis));
+        T s = (len > 0) ? std::sin(half) / len : 0;
+
+        return  quat(std::cos(half), axis(0)*s, axis(1)*s, axis(2)*s);
+      }
+
+      /// rotation whose columns are the orthonormal basis (x_axis, y_axis, z_axis)
+      static quat from_basis(const vec<3, T>& x_axis, const vec<3, T>& y_axis, const vec<3, T>& z_axis)
+      {
+        T m00 = x_axis(0), m01 = y_axis(0), m02 = z_axis(0);
+        T m10 = x_axis(1), m11 = y_axis(1), m12 = z_axis(1);
+        T m20 = x_axis(2), m21 = y_axis(2), m22 = z_axis(2);
+
+        T trace = m00 + m11 + m22;
+        quat q;
+        if (trace > 0)
+        {
+          T s = std::sqrt(trace + 1) * 2;
+          q = quat(s/4, (m21 - m12)/s, (m02 - m20)/s, (m10 - m01)/s);
+        }
+        else if (m00 > m11 && m00 > m22)
+        {
+          T s = std::sqrt(1 + m00 - m11 - m22) * 2;
+          q = quat((m21 - m12)/s, s/4, (m01 + m10)/s, (m02 + m20)/s);
+        }
+        else if (m11 > m22)
+        {
+          T s = std::sqrt(1 + m11 - m00 - m22) * 2;
+          q = quat((m02 - m20)/s, (m01 + m10)/s, s/4, (m12 + m21)/s);
+        }
+        else
+        {
+          T s = std::sqrt(1 + m22 - m00 - m11) * 2;
+          q = quat((m10 - m01)/s, (m02 + m20)/s, (m12 + m21)/s, s/4);
+        }
+
+        return  q.normalized();
+      }
+
+      T norm() const
+      {
+        return  std::sqrt(w*w + x*x + y*y + z*z);
+      }
+
+      quat normalized() const
+      {
+        T len = norm();
+        return  (len > 0) ? quat(w/len, x/len, y/len, z/len) : quat();
+      }
+
+      /// inverse rotation (for unit quaternions)
+      quat conjugate() const
+      {
+        return  quat(w, -x, -y, -z);
+      }
+
+      /// v rotated by this quaternion
+      vec<3, T> rotate(const vec<3, T>& v) const
+      {
+        // v + 2w(u x v) + 2u x (u x v), u = (x, y, z)
+        vec<3, T> u(x, y, z);
+        vec<3, T> t = static_cast<T>(2) * cross(u, v);
+
+        return  v + w*t + cross(u, t);
+      }
+
+      mat<3, 3, T> to_mat3() const
+      {
+        mat<3, 3, T> m;
+        m(0, 0) = 1 - 2*(y*y + z*z);
+        m(0, 1) = 2*(x*y - w*z);
+        m(0, 2) = 2*(x*z + w*y);
+        m(1, 0) = 2*(x*y + w*z);
+        m(1, 1) = 1 - 2*(x*x + z*z);
+        m(1, 2) = 2*(y*z - w*x);
+        m(2, 0) = 2*(x*z - w*y);
+        m(2, 1) = 2*(y*z + w*x);
+        m(2, 2) = 1 - 2*(x*x + y*y);
+
+        return  m;
+      }
+
+      mat<4, 4, T> to_mat4() const
+      {
+        mat<3, 3, T> r = to_mat3();
+        mat<4, 4, T> m;
+        for (unsigned int i = 0; i < 3; ++i)
+          for (unsigned int j = 0; j < 3; ++j)
+            m(i, j) = r(i, j);
+        m(3, 3) = static_cast<T>(1);
+
+        return  m;
+      }
+
+    public:
+      T w, x, y, z;
+    };
+
+    /// r = p * q (rotate by q, then by p)
+    template <typename T>
+    quat<T> operator* (const quat<T>& p, const quat<T>& q)
+    {
+      return  quat<T>(p.w*q.w - p.x*q.x - p.y*q.y - p.z*q.z,
+                      p.w*q.x + p.x*q.w + p.y*q.z - p.z*q.y,
+                      p.w*q.y - p.x*q.z + p.y*q.w + p.z*q.x,
+                      p.w*q.z + p.x*q.y - p.y*q.x + p.z*q.w);
+    }
+
+    template <typename T>
+    T dot(const quat<T>& p, const quat<T>& q)
+    {
+      return  p.w*q.w + p.x*q.x + p.y*q.y + p.z*q.z;
+    }
+
+    /// spherical linear interpolation from p (t = 0) to q (t = 1), shortest arc
+    template <typename T>
+    quat<T> slerp(const quat<T>& p, const quat<T>& q, T t)
+    {
+      T cos_theta = dot(p, q);
+      quat<T> r = q;
+      if (cos_theta < 0)
+      {
+        cos_theta = -cos_theta;
+        r = quat<T>(-q.w, -q.x, -q.y, -q.z);
+      }
+
+      T a, b;
+      if (cos_theta > static_cast<T>(0.9995))
+      {
+        // nearly the same rotation: lerp (and normalize) is exact enough
+        a = 1 - t;
+        b = t;
+      }
+      else
+      {
+        T theta = std::acos(cos_theta);
+        T sin_theta = std::sin(theta);
+        a = std::sin((1 - t)*theta) / sin_theta;
+        b = std::sin(t*theta) / sin_theta;
+      }
+
+      return  quat<T>(a*p.w + b*r.w, a*p.x + b*r.x, a*p.y + b*r.y, a*p.z + b*r.z).normalized();
+    }
+
+    /// normalized linear interpolation, shortest arc: cheaper than slerp, not constant speed
+    template <typename T>
+    quat<T> nlerp(const quat<T>& p, const quat<T>& q, T t)
+    {
+      T b = (dot(p, q) < 0) ? -t : t;
+      T a = 1 - t;
+
+      return  quat<T>(a*p.w + b*q.w, a*p.x + b*q.x, a*p.y + b*q.y, a*p.z + b*q.z).normalized();
+    }
+
+    /// out[i] = q rotates in[i], i < n (in and out may be the same array)
+    template <typename T>
+    void rotate_vectors(const quat<T>& q, const vec<3, T>* in, vec<3, T>* out, size_t n)
+    {
+      mat<3, 3, T> m = q.to_mat3();
+      for (size_t i = 0; i < n; ++i)
+      {
+        T x = in[i](0), y = in[i](1), z = in[i](2);
+        out[i](0) = m(0, 0)*x + m(0, 1)*y + m(0, 2)*z;
+        out[i](1) = m(1, 0)*x + m(1, 1)*y + m(1, 2)*z;
+        out[i](2) = m(2, 0)*x + m(2, 1)*y + m(2, 2)*z;
+      }
+    }
+
+#if defined(__SSE2__)
+    /// float version: 4 vectors per step, deinterleaved (x0..x3, y0..y3, z0..z3) in SSE registers
+    inline void rotate_vectors(const quat<float>& q, const vec<3, float>* in, vec<3, float>* out, size_t n)
+    {
+      mat<3, 3, float> m = q.to_mat3();
+      const __m128 m00 = _mm_set1_ps(m(0, 0)), m01 = _mm_set1_ps(m(0, 1)), m02 = _mm_set1_ps(m(0, 2));
+      const __m128 m10 = _mm_set1_ps(m(1, 0)), m11 = _mm_set1_ps(m(1, 1)), m12 = _mm_set1_ps(m(1, 2));
+      const __m128 m20 = _mm_set1_ps(m(2, 0)), m21 = _mm_set1_ps(m(2, 1)), m22 = _mm_set1_ps(m(2, 2));
+
+      size_t i = 0;
+      for (; i + 4 <= n; i += 4)
+      {
+        // a = x0 y0 z0 x1, b = y1 z1 x2 y2, c = z2 x3 y3 z3
+        const float* src = (const float*)(in + i);
+        __m128 a = _mm_loadu_ps(src);
+        __m128 b = _mm_loadu_ps(src + 4);
+        __m128 c = _mm_loadu_ps(src + 8);
+
+        __m128 x = _mm_shuffle_ps(a, _mm_shuffle_ps(b, c, _MM_SHUFFLE(1, 1, 2, 2)), _MM_SHUFFLE(2, 0, 3, 0));
+        __m128 y = _mm_shuffle_ps(_mm_shuffle_ps(a, b, _MM_SHUFFLE(0, 0, 1, 1)),
+                                  _mm_shuffle_ps(b, c, _MM_SHUFFLE(2, 2, 3, 3)), _MM_SHUFFLE(2, 0, 2, 0));
+        __m128 z = _mm_shuffle_ps(_mm_shuffle_ps(a, b, _MM_SHUFFLE(1, 1, 2, 2)),
+                                  _mm_shuffle_ps(c, c, _MM_SHUFFLE(3, 3, 0, 0)), _MM_SHUFFLE(2, 0, 2, 0));
+
+        __m128 rx = _mm_add_ps(_mm_add_ps(_mm_mul_ps(m00, x), _mm_mul_ps(m01, y)), _mm_mul_ps(m02, z));
+        __m128 ry = _mm_add_ps(_mm_add_ps(_mm_mul_ps(m10, x), _mm_mul_ps(m11, y)), _mm_mul_ps(m12, z));
+        __m128 rz = _mm_add_ps(_mm_add_ps(_mm_mul_ps(m20, x), _mm_mul_ps(m21, y)), _mm_mul_ps(m22, z));
+
+        // back to x y z x y z ...
+        a = _mm_shuffle_ps(_mm_shuffle_ps(rx, ry, _MM_SHUFFLE(0, 0, 0, 0)),
+                           _mm_shuffle_ps(rz, rx, _MM_SHUFFLE(1, 1, 0, 0)), _MM_SHUFFLE(2, 0, 2, 0));
+        b = _mm_shuffle_ps(_mm_shuffle_ps(ry, rz, _MM_SHUFFLE(1, 1, 1, 1)),
+                           _mm_shuffle_ps(rx, ry, _MM_SHUFFLE(2, 2, 2, 2)), _MM_SHUFFLE(2, 0, 2, 0));
+        c = _mm_shuffle_ps(_mm_shuffle_ps(rz, rx, _MM_SHUFFLE(3, 3, 2, 2)),
+                           _mm_shuffle_ps(ry, rz, _MM_SHUFFLE(3, 3, 3, 3)), _MM_SHUFFLE(2, 0, 2, 0));
+
+        float* dst = (float*)(out + i);
+        _mm_storeu_ps(dst, a);
+        _mm_storeu_ps(dst + 4, b);
+        _mm_storeu_ps(dst + 8, c);
+      }
+
+      for (; i < n; ++i)
+      {
+        float x = in[i](0), y = in[i](1), z = in[i](2);
+        out[i](0) = m(0, 0)*x + m(0, 1)*y + m(0, 2)*z;
+        out[i](1) = m(1, 0)*x + m(1, 1)*y + m(1, 2)*z;
+        out[i](2) = m(2, 0)*x + m(2, 1)*y + m(2, 2)*z;
+      }
+    }
+#endif
+
+    /// ostream for quat class
+    template <typename T>
+    std::ostream& operator << (std::ostream& os, const quat<T>& q)
+    {
+      os << "[" << q.w << ", " << q.x << ", " << q.y << ", " << q.z << "]";
+      return  os;
+    }
+
+    typedef quat<float>     quatf;
+    typedef quat<double>    quatd;
+
+  } // math
+} // kmuvcl
+
+#endif // KMUVCL_GRAPHICS_QUAT_HPP
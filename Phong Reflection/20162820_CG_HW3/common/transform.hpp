@@ -41,15 +41,19 @@ namespace kmuvcl
             y /= len;
             z /= len;
 
-            rotateMat(0, 0) = cos(radianAngle) + x * x * (1 - cos(radianAngle));
-            rotateMat(0, 1) = x * y * (1 - cos(radianAngle)) - z * sin(radianAngle);
-            rotateMat(0, 2) = x * z * (1 - cos(radianAngle)) + y * sin(radianAngle);
-            rotateMat(1, 0) = y * x * (1 - cos(radianAngle)) + z * sin(radianAngle);
-            rotateMat(1, 1) = cos(radianAngle) + y * y * (1 - cos(radianAngle));
-            rotateMat(1, 2) = y * z * (1 - cos(radianAngle)) - x * sin(radianAngle);
-            rotateMat(2, 0) = z * x * (1 - cos(radianAngle)) - y * sin(radianAngle);
-            rotateMat(2, 1) = z * y * (1 - cos(radianAngle)) + x * sin(radianAngle);
-            rotateMat(2, 2) = cos(radianAngle) + z * z * (1 - cos(radianAngle));
+            T c = std::cos(radianAngle);
+            T s = std::sin(radianAngle);
+            T t = 1 - c;
+
+            rotateMat(0, 0) = c + x * x * t;
+            rotateMat(0, 1) = x * y * t - z * s;
+            rotateMat(0, 2) = x * z * t + y * s;
+            rotateMat(1, 0) = y * x * t + z * s;
+            rotateMat(1, 1) = c + y * y * t;
+            rotateMat(1, 2) = y * z * t - x * s;
+            rotateMat(2, 0) = z * x * t - y * s;
+            rotateMat(2, 1) = z * y * t + x * s;
+            rotateMat(2, 2) = c + z * z * t;
             rotateMat(3, 3) = static_cast<T>(1);
 
             return rotateMat;
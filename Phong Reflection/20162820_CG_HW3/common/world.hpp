@@ -0,0 +1,140 @@
+#ifndef KMUVCL_GRAPHICS_WORLD_HPP
+#define KMUVCL_GRAPHICS_WORLD_HPP
+
+#include <vector>
+#include <cstddef>
+#include <cassert>
+#include "vec.hpp"
+#include "mat.hpp"
+#include "operator.hpp"
+
+namespace kmuvcl {
+  namespace math {
+
+    /// element-wise conversion, e.g. mat_cast<float>(mat4x4d) and mat_cast<double>(mat4x4f)
+    template <typename U, unsigned int M, unsigned int N, typename T>
+    mat<M, N, U> mat_cast(const mat<M, N, T>& A)
+    {
+      mat<M, N, U> B;
+      const T* src = A;
+      U* dst = B;
+      for (unsigned int i = 0; i < M*N; ++i)
+        dst[i] = static_cast<U>(src[i]);
+
+      return  B;
+    }
+
+    template <typename U, unsigned int N, typename T>
+    vec<N, U> vec_cast(const vec<N, T>& v)
+    {
+      vec<N, U> w;
+      for (unsigned int i = 0; i < N; ++i)
+        w(i) = static_cast<U>(v(i));
+
+      return  w;
+    }
+
+    /// A * B for affine transforms (last rows (0, 0, 0, 1)): 36 multiplications instead of 64
+    template <typename T>
+    mat<4, 4, T> mul_affine(const mat<4, 4, T>& A, const mat<4, 4, T>& B)
+    {
+      mat<4, 4, T> C;
+      for (unsigned int j = 0; j < 4; ++j)
+      {
+        for (unsigned int i = 0; i < 3; ++i)
+          C(i, j) = A(i, 0)*B(0, j) + A(i, 1)*B(1, j) + A(i, 2)*B(2, j);
+      }
+      for (unsigned int i = 0; i < 3; ++i)
+        C(i, 3) += A(i, 3);
+      C(3, 3) = 1;
+
+      return  C;
+    }
+
+    /// out = translate(-eye) * world, rounded to float. The large world and eye
+    /// coordinates cancel in double, so the result keeps float precision near the eye
+    template <typename T>
+    void camera_relative(const mat<4, 4, T>& world, const vec<3, T>& eye, mat<4, 4, float>& out)
+    {
+      const T* src = world;
+      float* dst = out;
+      for (unsigned int j = 0; j < 4; ++j)
+      {
+        const T w = src[4*j + 3];
+        dst[4*j + 0] = static_cast<float>(src[4*j + 0] - eye(0)*w);
+        dst[4*j + 1] = static_cast<float>(src[4*j + 1] - eye(1)*w);
+        dst[4*j + 2] = static_cast<float>(src[4*j + 2] - eye(2)*w);
+        dst[4*j + 3] = static_cast<float>(w);
+      }
+    }
+
+    template <typename T>
+    mat<4, 4, float> camera_relative(const mat<4, 4, T>& world, const vec<3, T>& eye)
+    {
+      mat<4, 4, float> B;
+      camera_relative(world, eye, B);
+
+      return  B;
+    }
+
+    /// position - eye, rounded to float
+    template <typename T>
+    vec<3, float> camera_relative(const vec<3, T>& position, const vec<3, T>& eye)
+    {
+      return  vec<3, float>(static_cast<float>(position(0) - eye(0)),
+                            static_cast<float>(position(1) - eye(1)),
+                            static_cast<float>(position(2) - eye(2)));
+    }
+
+    /// node graph whose world transforms are accumulated in T (double for large worlds).
+    /// Nodes are added parents first, so update() is one pass in index order.
+    /// The transforms are affine (mul_affine).
+    template <typename T>
+    class transform_tree
+    {
+    public:
+      /// new node under parent (-1: root), returns its index
+      int add(int parent, const mat<4, 4, T>& local)
+      {
+        assert(parent < (int)parents_.size());
+
+        parents_.push_back(parent);
+        local_.push_back(local);
+        world_.push_back(local);
+        return  parents_.size() - 1;
+      }
+
+      void set_local(unsigned int node, const mat<4, 4, T>& local) { local_[node] = local; }
+
+      /// world[i] = world[parent[i]] * local[i]
+      void update()
+      {
+        for (size_t i = 0; i < parents_.size(); ++i)
+        {
+          int p = parents_[i];
+          world_[i] = (p < 0) ? local_[i] : mul_affine(world_[p], local_[i]);
+        }
+      }
+
+      /// float matrices for upload, relative to eye: out[i] = camera_relative(world[i], eye)
+      void camera_relative_matrices(const vec<3, T>& eye, mat<4, 4, float>* out) const
+      {
+        for (size_t i = 0; i < world_.size(); ++i)
+          camera_relative(world_[i], eye, out[i]);
+      }
+
+      size_t size() const                                 { return  parents_.size(); }
+      int parent(unsigned int node) const                 { return  parents_[node]; }
+      const mat<4, 4, T>& local(unsigned int node) const  { return  local_[node]; }
+      const mat<4, 4, T>& world(unsigned int node) const  { return  world_[node]; }
+
+    private:
+      std::vector<int>          parents_;
+      std::vector<mat<4, 4, T> > local_;
+      std::vector<mat<4, 4, T> > world_;
+    };
+
+  } // math
+} // kmuvcl
+
+#endif // KMUVCL_GRAPHICS_WORLD_HPP
@@ -0,0 +1,603 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <map>
+#include <iostream>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <thread>
+
+#include <GL/glew.h>
+
+#include <assimp/scene.h>
+
+#include "textparse.hpp"
+#include "scenecompose.hpp"
+
+////////////////////////////////////////////////////////////////////////////////
+/// 스켈레탈 애니메이션 (aiScene 애니메이션 재생, GPU 스키닝)
+///
+/// Skeleton keeps what playback needs after the aiScene is released:
+///   - the node graph flattened in depth first order (parents before their
+///     children, every subtree a contiguous range) with the bind transforms
+///   - the animations, each channel resolved to the flattened nodes of its
+///     name in the subtrees of the animation's own file (kmuvcl::SceneFiles of
+///     a composite scene: every copy of that file follows it, other files with
+///     the same node names do not); the nodes of one file form a group
+///   - one skin per mesh instance (the instances of kmuvcl::SceneMirror, same
+///     order): the bone nodes of the mesh, looked up in the nearest enclosing
+///     subtree of the instance's node, and their offset matrices
+///
+/// AnimationState is one animated copy of the scene: per group its clip, clip
+/// time and a key cursor per channel (playback moves forward, so sampling
+/// continues from the last key instead of searching), the global node
+/// transforms of the pose and the skinning matrices of its skinned instances.
+/// AnimationPlayer advances and evaluates many states in parallel.
+///
+/// Skinning matrix of bone b of an instance on node m:
+///   inverse(global[m]) * global[bone b] * offset b
+/// i.e. mesh space -> mesh space; the draw keeps its model * global[m].
+////////////////////////////////////////////////////////////////////////////////
+namespace kmuvcl
+{
+  const unsigned int kmax_bone_influences = 4;
+  const unsigned int kmax_skin_bones = 256;     // bone indices are bytes
+
+  struct AnimationChannel
+  {
+    std::vector<aiVectorKey>  positions;
+    std::vector<aiQuatKey>    rotations;
+    std::vector<aiVectorKey>  scalings;
+  };
+
+  struct AnimationClip
+  {
+    std::string   name;
+    double        duration = 0.0;           // ticks
+    double        ticks_per_second = 25.0;
+    unsigned int  group = 0;                  // the nodes it drives (Skeleton::node_group())
+    std::vector<AnimationChannel> channels;
+    std::vector<int>              node_channel;   // per flattened node, -1: bind transform
+  };
+
+  struct Skin
+  {
+    std::vector<unsigned int> bone_nodes;
+    std::vector<aiMatrix4x4>  offsets;
+    unsigned int              first_matrix = 0;   // in AnimationState::skin_matrices
+  };
+
+  // per vertex: 4 bone indices and 4 unorm8 weights summing to 255, interleaved (8 bytes);
+  // false if the mesh has no bones or more than kmax_skin_bones
+  inline bool build_vertex_bones(const aiMesh* mesh, std::vector<GLubyte>& bones)
+  {
+    if (mesh->mNumBones == 0)
+      return false;
+    if (mesh->mNumBones > kmax_skin_bones)
+    {
+      std::cerr << "mesh " << mesh->mName.C_Str() << ": " << mesh->mNumBones << " bones, at most "
+                << kmax_skin_bones << " are skinned (split with --pp split-by-bone-count)" << std::endl;
+      return false;
+    }
+
+    // strongest kmax_bone_influences influences per vertex
+    std::vector<unsigned char> index(kmax_bone_influences*mesh->mNumVertices, 0);
+    std::vector<float> weight(kmax_bone_influences*mesh->mNumVertices, 0.0f);
+    for (unsigned int b = 0; b < mesh->mNumBones; ++b)
+    {
+      const aiBone* bone = mesh->mBones[b];
+      for (unsigned int i = 0; i < bone->mNumWeights; ++i)
+      {
+        const aiVertexWeight& vw = bone->mWeights[i];
+        if (vw.mVertexId >= mesh->mNumVertices)
+          continue;
+
+        float* w = &weight[kmax_bone_influences*vw.mVertexId];
+        unsigned char* k = &index[kmax_bone_influences*vw.mVertexId];
+        unsigned int weakest = std::min_element(w, w + kmax_bone_influences) - w;
+        if (vw.mWeight > w[weakest])
+        {
+          w[weakest] = vw.mWeight;
+          k[weakest] = (unsigned char)b;
+        }
+      }
+    }
+
+    bones.resize(2*kmax_bone_influences*mesh->mNumVertices);
+    for (unsigned int v = 0; v < mesh->mNumVertices; ++v)
+    {
+      const float* w = &weight[kmax_bone_influences*v];
+      const unsigned char* k = &index[kmax_bone_influences*v];
+      GLubyte* dst = &bones[2*kmax_bone_influences*v];
+
+      float sum = 0.0f;
+      for (unsigned int i = 0; i < kmax_bone_influences; ++i)
+        sum += w[i];
+
+      // unweighted vertices follow bone 0
+      int total = 0;
+      unsigned int strongest = std::max_element(w, w + kmax_bone_influences) - w;
+      for (unsigned int i = 0; i < kmax_bone_influences; ++i)
+      {
+        dst[i] = k[i];
+        dst[kmax_bone_influences + i] = (sum > 0.0f) ? (GLubyte)(255.0f*w[i]/sum + 0.5f) : (i == 0 ? 255 : 0);
+        total += dst[kmax_bone_influences + i];
+      }
+      // rounding goes to the strongest influence, the weights sum to exactly 1
+      if (sum > 0.0f)
+        dst[kmax_bone_influences + strongest] += 255 - total;
+    }
+    return true;
+  }
+
+  // texels of the palette of a skinned draw (see shader/vertex.glsl)
+  inline size_t skin_palette_texels(unsigned int num_bones)
+  {
+    return 2 + 3*num_bones;
+  }
+
+  // position dequantization (scale, bias) and the 3 rows of every skinning matrix
+  inline float* write_skin_palette(float* dst, const aiMatrix4x4& mat_dequant,
+                                   const aiMatrix4x4* skin, unsigned int num_bones)
+  {
+    *dst++ = mat_dequant.a1; *dst++ = mat_dequant.b2; *dst++ = mat_dequant.c3; *dst++ = 0.0f;
+    *dst++ = mat_dequant.a4; *dst++ = mat_dequant.b4; *dst++ = mat_dequant.c4; *dst++ = 0.0f;
+
+    for (unsigned int b = 0; b < num_bones; ++b)
+    {
+      for (int r = 0; r < 3; ++r)
+        for (int c = 0; c < 4; ++c)
+          *dst++ = skin[b][r][c];
+    }
+    return dst;
+  }
+
+  class Skeleton
+  {
+  public:
+    // files: the files of a composite scene (compose_scenes()), NULL or empty: one group
+    void build(const aiScene* scene, const SceneFiles* files = NULL)
+    {
+      parents_.clear();
+      subtree_end_.clear();
+      bind_local_.clear();
+      names_.clear();
+      instance_nodes_.clear();
+      clips_.clear();
+      skins_.clear();
+      num_skin_matrices_ = 0;
+
+      flatten(scene->mRootNode, -1);
+
+      const bool grouped = files && !files->entry_file.empty();
+      assign_groups(grouped ? files : NULL);
+      for (unsigned int a = 0; a < scene->mNumAnimations; ++a)
+        add_clip(scene->mAnimations[a], grouped ? files->animation_file[a] : 0);
+
+      // skin of every mesh instance (SceneMirror order)
+      skins_.resize(instance_nodes_.size());
+      for (unsigned int i = 0; i < instance_nodes_.size(); ++i)
+      {
+        const aiMesh* mesh = scene->mMeshes[instance_meshes_[i]];
+        if (mesh->mNumBones == 0 || mesh->mNumBones > kmax_skin_bones)
+          continue;
+
+        Skin& skin = skins_[i];
+        skin.first_matrix = num_skin_matrices_;
+        for (unsigned int b = 0; b < mesh->mNumBones; ++b)
+        {
+          int node = find_node(mesh->mBones[b]->mName.C_Str(), instance_nodes_[i]);
+          if (node < 0)
+          {
+            std::cerr << "mesh " << mesh->mName.C_Str() << ": no node for bone "
+                      << mesh->mBones[b]->mName.C_Str() << std::endl;
+            node = instance_nodes_[i];
+          }
+          skin.bone_nodes.push_back(node);
+          skin.offsets.push_back(mesh->mBones[b]->mOffsetMatrix);
+        }
+        num_skin_matrices_ += mesh->mNumBones;
+      }
+      instance_meshes_.clear();
+    }
+
+    unsigned int num_nodes() const          { return parents_.size(); }
+    unsigned int num_clips() const          { return clips_.size(); }
+    unsigned int num_groups() const         { return group_clips_.size(); }
+    unsigned int num_skin_matrices() const  { return num_skin_matrices_; }
+    unsigned int instance_count() const     { return instance_nodes_.size(); }
+
+    const AnimationClip& clip(unsigned int i) const     { return clips_[i]; }
+    const std::vector<unsigned int>& group_clips(unsigned int group) const { return group_clips_[group]; }
+    int node_group(unsigned int node) const             { return node_group_[node]; }
+    const Skin& skin(unsigned int instance) const       { return skins_[instance]; }
+    bool skinned(unsigned int instance) const           { return !skins_[instance].bone_nodes.empty(); }
+    unsigned int instance_node(unsigned int instance) const { return instance_nodes_[instance]; }
+
+    int parent(unsigned int node) const                 { return parents_[node]; }
+    const aiMatrix4x4& bind_local(unsigned int node) const { return bind_local_[node]; }
+
+    size_t bytes() const
+    {
+      size_t b = num_nodes()*(2*sizeof(int) + sizeof(unsigned int) + sizeof(aiMatrix4x4));
+      for (unsigned int i = 0; i < clips_.size(); ++i)
+      {
+        b += clips_[i].node_channel.size()*sizeof(int);
+        for (unsigned int c = 0; c < clips_[i].channels.size(); ++c)
+        {
+          const AnimationChannel& ch = clips_[i].channels[c];
+          b += (ch.positions.size() + ch.scalings.size())*sizeof(aiVectorKey) + ch.rotations.size()*sizeof(aiQuatKey);
+        }
+      }
+      for (unsigned int i = 0; i < skins_.size(); ++i)
+        b += skins_[i].bone_nodes.size()*(sizeof(unsigned int) + sizeof(aiMatrix4x4));
+      return b;
+    }
+
+  private:
+    void flatten(const aiNode* node, int parent)
+    {
+      const unsigned int index = parents_.size();
+      parents_.push_back(parent);
+      subtree_end_.push_back(0);
+      bind_local_.push_back(node->mTransformation);
+      names_.push_back(node->mName.C_Str());
+
+      for (unsigned int i = 0; i < node->mNumMeshes; ++i)
+      {
+        instance_nodes_.push_back(index);
+        instance_meshes_.push_back(node->mMeshes[i]);
+      }
+
+      for (unsigned int i = 0; i < node->mNumChildren; ++i)
+        flatten(node->mChildren[i], index);
+
+      subtree_end_[index] = parents_.size();
+    }
+
+    // node of that name in the smallest subtree around from that has one, -1 if none
+    int find_node(const std::string& name, int from) const
+    {
+      for (int root = from; root >= 0; root = parents_[root])
+      {
+        for (unsigned int i = root; i < subtree_end_[root]; ++i)
+          if (names_[i] == name)
+            return i;
+      }
+      return -1;
+    }
+
+    // one group over the whole scene, or the subtree of entry i (child i of the
+    // root) in the group of its file; the root and the entry nodes are in none
+    void assign_groups(const SceneFiles* files)
+    {
+      node_group_.assign(num_nodes(), files ? -1 : 0);
+      unsigned int num_groups = 1;
+      if (files)
+      {
+        num_groups = 0;
+        unsigned int node = 1;      // first child of the root, the subtrees follow each other
+        for (unsigned int i = 0; i < files->entry_file.size() && node < num_nodes(); ++i)
+        {
+          for (unsigned int k = node; k < subtree_end_[node]; ++k)
+            node_group_[k] = files->entry_file[i];
+          num_groups = std::max(num_groups, files->entry_file[i] + 1);
+          node = subtree_end_[node];
+        }
+        for (unsigned int a = 0; a < files->animation_file.size(); ++a)
+          num_groups = std::max(num_groups, files->animation_file[a] + 1);
+      }
+      group_clips_.assign(num_groups, std::vector<unsigned int>());
+    }
+
+    // channels bound by name to the nodes of the clip's group only
+    void add_clip(const aiAnimation* animation, unsigned int group)
+    {
+      AnimationClip clip;
+      clip.name = animation->mName.C_Str();
+      clip.duration = animation->mDuration;
+      if (animation->mTicksPerSecond > 0.0)
+        clip.ticks_per_second = animation->mTicksPerSecond;
+      clip.group = group;
+      clip.node_channel.assign(num_nodes(), -1);
+
+      std::map<std::string, std::vector<unsigned int> > nodes_by_name;
+      for (unsigned int i = 0; i < num_nodes(); ++i)
+      {
+        if (node_group_[i] == (int)group)
+          nodes_by_name[names_[i]].push_back(i);
+      }
+
+      for (unsigned int c = 0; c < animation->mNumChannels; ++c)
+      {
+        const aiNodeAnim* anim = animation->mChannels[c];
+        std::map<std::string, std::vector<unsigned int> >::const_iterator it = nodes_by_name.find(anim->mNodeName.C_Str());
+        if (it == nodes_by_name.end())
+          continue;
+
+        AnimationChannel channel;
+        channel.positions.assign(anim->mPositionKeys, anim->mPositionKeys + anim->mNumPositionKeys);
+        channel.rotations.assign(anim->mRotationKeys, anim->mRotationKeys + anim->mNumRotationKeys);
+        channel.scalings.assign(anim->mScalingKeys, anim->mScalingKeys + anim->mNumScalingKeys);
+
+        // a missing track keeps the bind value
+        const aiMatrix4x4& bind = bind_local_[it->second[0]];
+        aiVector3D scaling, position;
+        aiQuaternion rotation;
+        bind.Decompose(scaling, rotation, position);
+        if (channel.positions.empty())
+          channel.positions.push_back(make_key(position));
+        if (channel.rotations.empty())
+        {
+          aiQuatKey key;
+          key.mTime = 0.0;
+          key.mValue = rotation;
+          channel.rotations.push_back(key);
+        }
+        if (channel.scalings.empty())
+          channel.scalings.push_back(make_key(scaling));
+
+        for (unsigned int i = 0; i < it->second.size(); ++i)
+          clip.node_channel[it->second[i]] = clip.channels.size();
+        clip.channels.push_back(channel);
+      }
+
+      group_clips_[group].push_back(clips_.size());
+      clips_.push_back(clip);
+    }
+
+    static aiVectorKey make_key(const aiVector3D& value)
+    {
+      aiVectorKey key;
+      key.mTime = 0.0;
+      key.mValue = value;
+      return key;
+    }
+
+    std::vector<int>          parents_;
+    std::vector<unsigned int> subtree_end_;     // one past the last node of the subtree
+    std::vector<aiMatrix4x4>  bind_local_;
+    std::vector<std::string>  names_;
+    std::vector<int>          node_group_;      // -1: no group (the entry nodes of a composite)
+
+    std::vector<unsigned int> instance_nodes_;
+    std::vector<unsigned int> instance_meshes_; // only during build()
+
+    std::vector<AnimationClip> clips_;
+    std::vector<std::vector<unsigned int> > group_clips_;   // clips of every group
+    std::vector<Skin>          skins_;
+    unsigned int               num_skin_matrices_ = 0;
+  };
+
+  // key index of the last key at or before t, continuing from cursor (reset when time went back)
+  template <typename Key>
+  inline unsigned int find_key(const std::vector<Key>& keys, double t, unsigned int& cursor)
+  {
+    if (cursor >= keys.size() || keys[cursor].mTime > t)
+      cursor = 0;
+    while (cursor + 1 < keys.size() && keys[cursor + 1].mTime <= t)
+      ++cursor;
+    return cursor;
+  }
+
+  inline aiVector3D sample(const std::vector<aiVectorKey>& keys, double t, unsigned int& cursor)
+  {
+    unsigned int k = find_key(keys, t, cursor);
+    if (k + 1 >= keys.size())
+      return keys[k].mValue;
+
+    const aiVectorKey& a = keys[k];
+    const aiVectorKey& b = keys[k + 1];
+    float f = (float)((t - a.mTime) / (b.mTime - a.mTime));
+    return a.mValue + (b.mValue - a.mValue)*std::max(0.0f, std::min(1.0f, f));
+  }
+
+  inline aiQuaternion sample(const std::vector<aiQuatKey>& keys, double t, unsigned int& cursor)
+  {
+    unsigned int k = find_key(keys, t, cursor);
+    if (k + 1 >= keys.size())
+      return keys[k].mValue;
+
+    const aiQuatKey& a = keys[k];
+    const aiQuatKey& b = keys[k + 1];
+    float f = (float)((t - a.mTime) / (b.mTime - a.mTime));
+
+    aiQuaternion q;
+    aiQuaternion::Interpolate(q, a.mValue, b.mValue, std::max(0.0f, std::min(1.0f, f)));
+    return q.Normalize();
+  }
+
+  struct KeyCursor
+  {
+    unsigned int position = 0, rotation = 0, scaling = 0;
+  };
+
+  class AnimationState
+  {
+  public:
+    // clips: per group of the skeleton the clip it plays, -1: bind pose
+    void init(const Skeleton& skeleton, const std::vector<int>& clips, double start_seconds)
+    {
+      groups_.assign(clips.size(), Playback());
+      for (unsigned int g = 0; g < clips.size(); ++g)
+      {
+        if (clips[g] < 0)
+          continue;
+        groups_[g].clip = &skeleton.clip(clips[g]);
+        groups_[g].cursors.assign(groups_[g].clip->channels.size(), KeyCursor());
+      }
+      global.assign(skeleton.num_nodes(), aiMatrix4x4());
+      skin_matrices.assign(skeleton.num_skin_matrices(), aiMatrix4x4());
+      advance(start_seconds);
+    }
+
+    // clip times, looping
+    void advance(double seconds)
+    {
+      for (unsigned int g = 0; g < groups_.size(); ++g)
+      {
+        Playback& p = groups_[g];
+        if (!p.clip)
+          continue;
+
+        p.time += seconds*p.clip->ticks_per_second;
+        if (p.clip->duration > 0.0)
+          p.time = std::fmod(p.time, p.clip->duration);
+      }
+    }
+
+    // global node transforms, then skinning matrices
+    void evaluate(const Skeleton& skeleton)
+    {
+      for (unsigned int i = 0; i < skeleton.num_nodes(); ++i)
+      {
+        int g = skeleton.node_group(i);
+        Playback* p = (g >= 0) ? &groups_[g] : NULL;
+        int c = (p && p->clip) ? p->clip->node_channel[i] : -1;
+
+        aiMatrix4x4 local;
+        if (c < 0)
+          local = skeleton.bind_local(i);
+        else
+        {
+          const AnimationChannel& channel = p->clip->channels[c];
+          KeyCursor& cursor = p->cursors[c];
+          local = aiMatrix4x4(sample(channel.scalings, p->time, cursor.scaling),
+                              sample(channel.rotations, p->time, cursor.rotation),
+                              sample(channel.positions, p->time, cursor.position));
+        }
+
+        // parents come first in the flattened order
+        int parent = skeleton.parent(i);
+        global[i] = (parent < 0) ? local : global[parent]*local;
+      }
+
+      for (unsigned int s = 0; s < skin_instances_.size(); ++s)
+      {
+        const unsigned int instance = skin_instances_[s];
+        const Skin& skin = skeleton.skin(instance);
+
+        aiMatrix4x4 mesh_inverse = global[skeleton.instance_node(instance)];
+        mesh_inverse.Inverse();
+        for (unsigned int b = 0; b < skin.bone_nodes.size(); ++b)
+          skin_matrices[skin.first_matrix + b] = mesh_inverse*global[skin.bone_nodes[b]]*skin.offsets[b];
+      }
+    }
+
+    void set_skin_instances(const std::vector<unsigned int>& instances) { skin_instances_ = instances; }
+
+    // clip time of a group in ticks
+    double time(unsigned int group) const { return groups_[group].time; }
+
+    std::vector<aiMatrix4x4>  global;           // per flattened node
+    std::vector<aiMatrix4x4>  skin_matrices;    // Skin::first_matrix + bone
+
+  private:
+    struct Playback
+    {
+      const AnimationClip*    clip = NULL;      // NULL: bind pose
+      double                  time = 0.0;       // ticks
+      std::vector<KeyCursor>  cursors;          // per channel of the clip
+    };
+
+    std::vector<Playback>     groups_;          // per group of the skeleton
+    std::vector<unsigned int> skin_instances_;
+  };
+
+  class AnimationPlayer
+  {
+  public:
+    // count animated copies of the skeleton, their clips started stagger seconds apart
+    void init(const Skeleton* skeleton, unsigned int count, double stagger = 0.0)
+    {
+      skeleton_ = skeleton;
+      clips_.assign(skeleton->num_groups(), 0);
+      stagger_ = stagger;
+
+      skin_instances_.clear();
+      for (unsigned int i = 0; i < skeleton->instance_count(); ++i)
+        if (skeleton->skinned(i))
+          skin_instances_.push_back(i);
+
+      states_.resize(std::max(1u, count));
+      restart();
+    }
+
+    bool animated() const { return skeleton_ && (skeleton_->num_clips() > 0); }
+
+    // next clip of every group, every state from its start
+    void next_clip()
+    {
+      if (!animated())
+        return;
+      for (unsigned int g = 0; g < clips_.size(); ++g)
+      {
+        if (!skeleton_->group_clips(g).empty())
+          clips_[g] = (clips_[g] + 1) % skeleton_->group_clips(g).size();
+      }
+      restart();
+    }
+
+    // advances and evaluates every state, in parallel when there are many
+    void update(double seconds, unsigned int threads = 0)
+    {
+      std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+      if (threads == 0)
+        threads = std::max(1u, std::thread::hardware_concurrency());
+
+      const Skeleton& skeleton = *skeleton_;
+      std::vector<AnimationState>& states = states_;
+      parallel_chunks(states.size(), threads, kmin_states_per_thread,
+        [&skeleton, &states, seconds](size_t first, size_t last, size_t)
+        {
+          for (size_t i = first; i < last; ++i)
+          {
+            states[i].advance(seconds);
+            states[i].evaluate(skeleton);
+          }
+        });
+
+      update_ms_ = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    unsigned int count() const                        { return states_.size(); }
+    const AnimationState& state(unsigned int i) const { return states_[i]; }
+    const Skeleton& skeleton() const                  { return *skeleton_; }
+    unsigned int num_groups() const                   { return clips_.size(); }
+    double update_ms() const                          { return update_ms_; }
+
+    // clip played by a group (Skeleton::clip()), -1 if the group has none
+    int clip(unsigned int group) const
+    {
+      const std::vector<unsigned int>& clips = skeleton_->group_clips(group);
+      return clips.empty() ? -1 : (int)clips[clips_[group]];
+    }
+
+  private:
+    static const size_t kmin_states_per_thread = 4;
+
+    void restart()
+    {
+      std::vector<int> clips(clips_.size());
+      for (unsigned int g = 0; g < clips_.size(); ++g)
+        clips[g] = clip(g);
+
+      for (unsigned int i = 0; i < states_.size(); ++i)
+      {
+        states_[i].set_skin_instances(skin_instances_);
+        states_[i].init(*skeleton_, clips, i*stagger_);
+        states_[i].evaluate(*skeleton_);
+      }
+    }
+
+    const Skeleton*             skeleton_ = NULL;
+    std::vector<AnimationState> states_;
+    std::vector<unsigned int>   skin_instances_;
+    std::vector<unsigned int>   clips_;         // per group, into Skeleton::group_clips()
+    double                      stagger_ = 0.0;
+    double                      update_ms_ = 0.0;
+  };
+}
@@ -0,0 +1,192 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <map>
+#include <iostream>
+#include <thread>
+#include <chrono>
+#include <algorithm>
+#include <cctype>
+
+/* assimp include files. These three are usually needed. */
+#include <assimp/cimport.h>
+#include <assimp/scene.h>        
+#include <assimp/postprocess.h>
+
+#include "objloader.hpp"
+#include "importprofile.hpp"
+#include "scenecompose.hpp"
+
+////////////////////////////////////////////////////////////////////////////////
+/// 모델 로딩 (viewer 와 pathtrace 에서 공유)
+////////////////////////////////////////////////////////////////////////////////
+const aiScene* scene;
+
+std::string basepath;
+
+kmuvcl::SceneFiles scene_files;       // files of a composite scene, empty for a single file
+
+kmuvcl::LoadOptions g_load_options;   // --pp, --import-report, --assimp
+
+bool is_obj_file(const std::string& filename)
+{
+  size_t dot = filename.rfind('.');
+  if (dot == std::string::npos)
+    return false;
+
+  std::string ext = filename.substr(dot + 1);
+  for (size_t i = 0; i < ext.size(); ++i)
+    ext[i] = std::tolower(ext[i]);
+  return ext == "obj";
+}
+
+// both loaders hand over a scene we own (load_obj(), Importer::GetOrphanedScene())
+void release_asset()
+{
+  delete scene;
+  scene = NULL;
+}
+
+// one file into a scene we own; touches no globals, so files can be imported on several threads
+aiScene* import_scene(const std::string& filename, const kmuvcl::LoadOptions& options, kmuvcl::ImportReport& report)
+{
+  if (options.native_obj && is_obj_file(filename))
+  {
+    kmuvcl::ObjStats stats;
+    aiScene* s = kmuvcl::load_obj(filename, options.threads, &stats);
+    if (s != NULL)
+    {
+      report = kmuvcl::ImportReport();
+      report.filename = filename;
+      report.importer = "native obj";
+      report.total_ms = stats.total_ms;
+      report.count(s);
+      return s;
+    }
+    std::cerr << filename << ": native obj loader failed, falling back to assimp" << std::endl;
+  }
+
+  Assimp::Importer importer;
+  if (!kmuvcl::import_asset(importer, filename, options, report))
+    return NULL;
+  return importer.GetOrphanedScene();
+}
+
+void print_import_summary(const kmuvcl::ImportReport& report, const kmuvcl::LoadOptions& options)
+{
+  if (options.report)
+    report.print(std::cout);
+  else
+    std::cout << report.importer << ": " << report.meshes << " meshes, " << report.vertices << " vertices, "
+              << report.faces << " faces in " << report.total_ms << " ms" << std::endl;
+}
+
+bool load_asset(const std::string& filename, const kmuvcl::LoadOptions& options = g_load_options)
+{
+  std::cout << "load asset: " << filename << std::endl;
+
+  size_t pos = filename.rfind("/");
+  basepath = filename.substr(0, pos + 1);
+
+  kmuvcl::ImportReport report;
+  scene_files = kmuvcl::SceneFiles();
+  scene = import_scene(filename, options, report);
+  if (scene == NULL)
+    return false;
+
+  print_import_summary(report, options);
+  return true;
+}
+
+// model files and *.scene manifests -> one composite scene (see scenecompose.hpp);
+// each distinct file is imported once, all of them concurrently
+bool load_assets(const std::vector<std::string>& paths, const kmuvcl::LoadOptions& options = g_load_options)
+{
+  if (paths.size() == 1 && !kmuvcl::is_scene_manifest(paths[0]))
+    return load_asset(paths[0], options);
+
+  std::vector<kmuvcl::SceneEntry> entries;
+  for (unsigned int i = 0; i < paths.size(); ++i)
+  {
+    if (kmuvcl::is_scene_manifest(paths[i]))
+    {
+      if (!kmuvcl::read_scene_manifest(paths[i], entries))
+        return false;
+    }
+    else
+    {
+      kmuvcl::SceneEntry entry;
+      entry.filename = paths[i];
+      entries.push_back(entry);
+    }
+  }
+  if (entries.empty())
+    return false;
+
+  std::vector<std::string> files;
+  std::vector<unsigned int> file_of(entries.size());
+  std::map<std::string, unsigned int> file_index;
+  for (unsigned int i = 0; i < entries.size(); ++i)
+  {
+    std::map<std::string, unsigned int>::iterator it = file_index.find(entries[i].filename);
+    if (it == file_index.end())
+    {
+      it = file_index.insert(std::make_pair(entries[i].filename, (unsigned int)files.size())).first;
+      files.push_back(entries[i].filename);
+    }
+    file_of[i] = it->second;
+  }
+
+  std::cout << "load assets: " << entries.size() << " entries, " << files.size() << " files" << std::endl;
+
+  // the native obj loader splits the cores between the files
+  kmuvcl::LoadOptions file_options = options;
+  if (file_options.threads == 0)
+    file_options.threads = std::max<size_t>(1, std::max(1u, std::thread::hardware_concurrency()) / files.size());
+
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+  std::vector<aiScene*> scenes(files.size(), NULL);
+  std::vector<kmuvcl::ImportReport> reports(files.size());
+  std::vector<std::thread> workers;
+  for (unsigned int f = 0; f < files.size(); ++f)
+  {
+    workers.push_back(std::thread([&, f]()
+    {
+      scenes[f] = import_scene(files[f], file_options, reports[f]);
+    }));
+  }
+  for (unsigned int f = 0; f < workers.size(); ++f)
+    workers[f].join();
+
+  bool ok = true;
+  for (unsigned int f = 0; f < files.size(); ++f)
+  {
+    if (scenes[f] == NULL)
+    {
+      std::cerr << files[f] << ": import failed" << std::endl;
+      ok = false;
+      continue;
+    }
+    print_import_summary(reports[f], options);
+  }
+  if (!ok)
+  {
+    for (unsigned int f = 0; f < files.size(); ++f)
+      delete scenes[f];
+    return false;
+  }
+
+  kmuvcl::layout_scene_entries(entries, file_of, scenes);
+  aiScene* composite = kmuvcl::compose_scenes(entries, file_of, files, scenes, scene_files);
+
+  std::cout << "composite scene: " << composite->mNumMeshes << " meshes, " << composite->mNumMaterials 
+            << " materials, imported in " 
+            << std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() 
+            << " ms" << std::endl;
+
+  scene = composite;
+  basepath = "";    // texture paths of the composite include their directory
+  return true;
+}
@@ -0,0 +1,587 @@
+#pragma once
+
+#include <vector>
+#include <cmath>
+#include <cfloat>
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <chrono>
+
+#include <xmmintrin.h>
+
+#include <assimp/scene.h>
+
+////////////////////////////////////////////////////////////////////////////////
+/// BVH (bounding volume hierarchy) over every triangle of an aiScene
+///
+///  - world space triangles, transformed by the aiNode hierarchy
+///  - binned SAH build, subtrees are built on separate threads
+///  - 32 byte nodes, leaves hold up to 4 triangles in one SIMD packet
+///  - SSE ray/AABB slab test and 4-wide ray/triangle (Moller-Trumbore) test
+////////////////////////////////////////////////////////////////////////////////
+namespace kmuvcl
+{
+  // interior: left_first = left child (right child = left_first + 1), count = 0
+  // leaf    : left_first = triangle packet index, count = number of triangles
+  struct BVHNode
+  {
+    float         bmin[3];
+    unsigned int  left_first;
+    float         bmax[3];
+    unsigned int  count;
+  };
+  static_assert(sizeof(BVHNode) == 32, "BVHNode must be 32 bytes");
+
+  // 4 triangles in SoA layout, unused lanes are degenerate (e1 = e2 = 0)
+  struct TriPacket
+  {
+    __m128        v0[3];
+    __m128        e1[3];
+    __m128        e2[3];
+    unsigned int  mesh_index[4];
+    unsigned int  face_index[4];
+    unsigned int  instance_index[4];
+  };
+
+  struct RayHit
+  {
+    bool          hit = false;
+    float         t = FLT_MAX;
+    float         u = 0.0f, v = 0.0f;   // barycentric coordinates
+    unsigned int  mesh_index = 0;
+    unsigned int  face_index = 0;
+    unsigned int  instance_index = 0;   // aiNode instance, see BVH::instance_transform()
+  };
+
+  class BVH
+  {
+  public:
+    static const unsigned int kmax_leaf_size = 4;
+    static const unsigned int knum_bins = 16;
+    static const unsigned int kmax_sah_depth = 48;    // median splits below, keeps the stack bounded
+
+    void build(const aiScene* scene);
+    bool intersect(const aiVector3D& origin, const aiVector3D& dir, RayHit& hit,
+                   float tmax = FLT_MAX) const;
+    bool occluded(const aiVector3D& origin, const aiVector3D& dir, float tmax) const;
+
+    // world transform of the aiNode that placed the hit triangle
+    const aiMatrix4x4& instance_transform(unsigned int instance_index) const
+    { return instances_[instance_index]; }
+
+    void    bounds(aiVector3D& bmin, aiVector3D& bmax) const;   // scene space AABB
+    size_t  num_instances() const { return instances_.size(); }
+    size_t  num_nodes() const     { return nodes_.size(); }
+    size_t  num_triangles() const { return num_tris_; }
+    double  build_time() const    { return build_ms_; }     // milliseconds
+
+  private:
+    struct BuildTri
+    {
+      aiVector3D    v[3];
+      aiVector3D    bmin, bmax, centroid;
+      unsigned int  mesh_index, face_index, instance_index;
+    };
+
+    void collect(const aiScene* scene, const aiNode* node, const aiMatrix4x4& mat_parent);
+    void subdivide(unsigned int node_index, unsigned int depth);
+    void update_bounds(BVHNode& node) const;
+    void make_packets();
+    bool traverse(const aiVector3D& origin, const aiVector3D& dir, RayHit& hit, bool any_hit) const;
+
+    std::vector<BuildTri>     tris_;
+    std::vector<unsigned int> order_;       // triangle indices, leaves refer to ranges
+    std::vector<BVHNode>      nodes_;
+    std::vector<TriPacket>    packets_;
+    std::vector<aiMatrix4x4>  instances_;
+    std::atomic<unsigned int> nodes_used_;
+    unsigned int              spawn_depth_ = 0;
+    size_t                    num_tris_ = 0;
+    double                    build_ms_ = 0.0;
+  };
+
+  inline void BVH::bounds(aiVector3D& bmin, aiVector3D& bmax) const
+  {
+    if (nodes_.empty())
+    {
+      bmin = bmax = aiVector3D(0.0f, 0.0f, 0.0f);
+      return;
+    }
+    bmin = aiVector3D(nodes_[0].bmin[0], nodes_[0].bmin[1], nodes_[0].bmin[2]);
+    bmax = aiVector3D(nodes_[0].bmax[0], nodes_[0].bmax[1], nodes_[0].bmax[2]);
+  }
+
+  inline void BVH::collect(const aiScene* scene, const aiNode* node, const aiMatrix4x4& mat_parent)
+  {
+    aiMatrix4x4 mat_curr = mat_parent*node->mTransformation;
+
+    const unsigned int instance_index = instances_.size();
+    if (node->mNumMeshes > 0)
+      instances_.push_back(mat_curr);
+
+    for (unsigned int i = 0; i < node->mNumMeshes; ++i)
+    {
+      unsigned int mesh_index = node->mMeshes[i];
+      const aiMesh* mesh = scene->mMeshes[mesh_index];
+
+      for (unsigned int f = 0; f < mesh->mNumFaces; ++f)
+      {
+        const aiFace& face = mesh->mFaces[f];
+        if (face.mNumIndices != 3)
+          continue;
+
+        BuildTri t;
+        for (unsigned int k = 0; k < 3; ++k)
+          t.v[k] = mat_curr * mesh->mVertices[face.mIndices[k]];
+
+        for (unsigned int a = 0; a < 3; ++a)
+        {
+          t.bmin[a] = std::min(t.v[0][a], std::min(t.v[1][a], t.v[2][a]));
+          t.bmax[a] = std::max(t.v[0][a], std::max(t.v[1][a], t.v[2][a]));
+        }
+        t.centroid = (t.v[0] + t.v[1] + t.v[2]) / 3.0f;
+        t.mesh_index = mesh_index;
+        t.face_index = f;
+        t.instance_index = instance_index;
+
+        tris_.push_back(t);
+      }
+    }
+
+    for (unsigned int i = 0; i < node->mNumChildren; ++i)
+      collect(scene, node->mChildren[i], mat_curr);
+  }
+
+  inline void BVH::update_bounds(BVHNode& node) const
+  {
+    for (unsigned int a = 0; a < 3; ++a)
+    {
+      node.bmin[a] =  FLT_MAX;
+      node.bmax[a] = -FLT_MAX;
+    }
+
+    for (unsigned int i = 0; i < node.count; ++i)
+    {
+      const BuildTri& t = tris_[order_[node.left_first + i]];
+      for (unsigned int a = 0; a < 3; ++a)
+      {
+        node.bmin[a] = std::min(node.bmin[a], t.bmin[a]);
+        node.bmax[a] = std::max(node.bmax[a], t.bmax[a]);
+      }
+    }
+  }
+
+  inline float half_area(const float bmin[3], const float bmax[3])
+  {
+    float ex = bmax[0] - bmin[0], ey = bmax[1] - bmin[1], ez = bmax[2] - bmin[2];
+    return ex*ey + ey*ez + ez*ex;
+  }
+
+  // node.left_first/count describe the triangle range while the node is built
+  inline void BVH::subdivide(unsigned int node_index, unsigned int depth)
+  {
+    BVHNode& node = nodes_[node_index];
+    update_bounds(node);
+
+    if (node.count <= kmax_leaf_size)
+      return;
+
+    const unsigned int first = node.left_first;
+    const unsigned int count = node.count;
+
+    // centroid bounds
+    float cmin[3] = {  FLT_MAX,  FLT_MAX,  FLT_MAX };
+    float cmax[3] = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+    for (unsigned int i = 0; i < count; ++i)
+    {
+      const aiVector3D& c = tris_[order_[first + i]].centroid;
+      for (unsigned int a = 0; a < 3; ++a)
+      {
+        cmin[a] = std::min(cmin[a], c[a]);
+        cmax[a] = std::max(cmax[a], c[a]);
+      }
+    }
+
+    // binned SAH over all three axes
+    int   best_axis = -1;
+    int   best_split = 0;
+    float best_cost = FLT_MAX;
+
+    for (unsigned int a = 0; a < 3 && depth < kmax_sah_depth; ++a)
+    {
+      if (cmax[a] <= cmin[a])
+        continue;
+
+      struct Bin { float bmin[3], bmax[3]; unsigned int count; };
+      Bin bins[knum_bins];
+      for (unsigned int b = 0; b < knum_bins; ++b)
+      {
+        bins[b].count = 0;
+        for (unsigned int k = 0; k < 3; ++k)
+        {
+          bins[b].bmin[k] =  FLT_MAX;
+          bins[b].bmax[k] = -FLT_MAX;
+        }
+      }
+
+      float scale = knum_bins / (cmax[a] - cmin[a]);
+      for (unsigned int i = 0; i < count; ++i)
+      {
+        const BuildTri& t = tris_[order_[first + i]];
+        unsigned int b = std::min(knum_bins - 1, (unsigned int)((t.centroid[a] - cmin[a]) * scale));
+        bins[b].count++;
+        for (unsigned int k = 0; k < 3; ++k)
+        {
+          bins[b].bmin[k] = std::min(bins[b].bmin[k], t.bmin[k]);
+          bins[b].bmax[k] = std::max(bins[b].bmax[k], t.bmax[k]);
+        }
+      }
+
+      // sweep: area and count left of each plane, then right of it
+      float left_area[knum_bins - 1], right_area[knum_bins - 1];
+      unsigned int left_count[knum_bins - 1], right_count[knum_bins - 1];
+
+      float lmin[3] = {  FLT_MAX,  FLT_MAX,  FLT_MAX }, lmax[3] = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+      float rmin[3] = {  FLT_MAX,  FLT_MAX,  FLT_MAX }, rmax[3] = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+      unsigned int lsum = 0, rsum = 0;
+
+      for (unsigned int b = 0; b < knum_bins - 1; ++b)
+      {
+        const Bin& l = bins[b];
+        const Bin& r = bins[knum_bins - 1 - b];
+
+        lsum += l.count;
+        rsum += r.count;
+        for (unsigned int k = 0; k < 3; ++k)
+        {
+          lmin[k] = std::min(lmin[k], l.bmin[k]); lmax[k] = std::max(lmax[k], l.bmax[k]);
+          rmin[k] = std::min(rmin[k], r.bmin[k]); rmax[k] = std::max(rmax[k], r.bmax[k]);
+        }
+
+        left_count[b] = lsum;
+        left_area[b]  = lsum ? half_area(lmin, lmax) : 0.0f;
+        right_count[knum_bins - 2 - b] = rsum;
+        right_area[knum_bins - 2 - b]  = rsum ? half_area(rmin, rmax) : 0.0f;
+      }
+
+      for (unsigned int b = 0; b < knum_bins - 1; ++b)
+      {
+        if (left_count[b] == 0 || right_count[b] == 0)
+          continue;
+
+        float cost = left_area[b]*left_count[b] + right_area[b]*right_count[b];
+        if (cost < best_cost)
+        {
+          best_cost = cost;
+          best_axis = a;
+          best_split = b;
+        }
+      }
+    }
+
+    // partition the triangle range
+    unsigned int mid;
+    if (best_axis >= 0)
+    {
+      float scale = knum_bins / (cmax[best_axis] - cmin[best_axis]);
+      unsigned int* begin = &order_[first];
+      unsigned int* split = std::partition(begin, begin + count, [&](unsigned int t) {
+        unsigned int b = std::min(knum_bins - 1,
+                                  (unsigned int)((tris_[t].centroid[best_axis] - cmin[best_axis]) * scale));
+        return b <= (unsigned int)best_split;
+      });
+      mid = first + (split - begin);
+    }
+    else
+    {
+      // too deep, or every centroid is at the same point: object median split
+      unsigned int axis = 0;
+      for (unsigned int a = 1; a < 3; ++a)
+        if (cmax[a] - cmin[a] > cmax[axis] - cmin[axis])
+          axis = a;
+
+      mid = first + count/2;
+      std::nth_element(order_.begin() + first, order_.begin() + mid, order_.begin() + first + count,
+                       [&](unsigned int l, unsigned int r) {
+                         return tris_[l].centroid[axis] < tris_[r].centroid[axis];
+                       });
+    }
+
+    unsigned int left = nodes_used_.fetch_add(2);
+
+    nodes_[left].left_first     = first;
+    nodes_[left].count          = mid - first;
+    nodes_[left + 1].left_first = mid;
+    nodes_[left + 1].count      = first + count - mid;
+
+    node.left_first = left;
+    node.count      = 0;
+
+    // the two halves touch disjoint parts of order_ and nodes_
+    if (depth < spawn_depth_ && count > 4096)
+    {
+      std::thread worker(&BVH::subdivide, this, left, depth + 1);
+      subdivide(left + 1, depth + 1);
+      worker.join();
+    }
+    else
+    {
+      subdivide(left, depth + 1);
+      subdivide(left + 1, depth + 1);
+    }
+  }
+
+  inline void BVH::make_packets()
+  {
+    packets_.clear();
+
+    for (unsigned int n = 0; n < nodes_.size(); ++n)
+    {
+      BVHNode& node = nodes_[n];
+      if (node.count == 0)
+        continue;
+
+      TriPacket p;
+      float v0[3][4], e1[3][4], e2[3][4];
+      for (unsigned int lane = 0; lane < 4; ++lane)
+      {
+        unsigned int i = std::min(lane, node.count - 1);
+        const BuildTri& t = tris_[order_[node.left_first + i]];
+        bool valid = lane < node.count;
+
+        for (unsigned int k = 0; k < 3; ++k)
+        {
+          v0[k][lane] = t.v[0][k];
+          e1[k][lane] = valid ? t.v[1][k] - t.v[0][k] : 0.0f;
+          e2[k][lane] = valid ? t.v[2][k] - t.v[0][k] : 0.0f;
+        }
+        p.mesh_index[lane] = t.mesh_index;
+        p.face_index[lane] = t.face_index;
+        p.instance_index[lane] = t.instance_index;
+      }
+      for (unsigned int k = 0; k < 3; ++k)
+      {
+        p.v0[k] = _mm_loadu_ps(v0[k]);
+        p.e1[k] = _mm_loadu_ps(e1[k]);
+        p.e2[k] = _mm_loadu_ps(e2[k]);
+      }
+
+      node.left_first = packets_.size();
+      packets_.push_back(p);
+    }
+  }
+
+  inline void BVH::build(const aiScene* scene)
+  {
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+    tris_.clear();
+    instances_.clear();
+    collect(scene, scene->mRootNode, aiMatrix4x4());
+
+    const unsigned int n = tris_.size();
+    num_tris_ = n;
+
+    order_.resize(n);
+    for (unsigned int i = 0; i < n; ++i)
+      order_[i] = i;
+
+    nodes_.assign(std::max(1u, 2*n), BVHNode());
+    nodes_[0].left_first = 0;
+    nodes_[0].count      = n;
+    nodes_used_ = 2;        // node 1 is left unused so that siblings share a cache line
+
+    unsigned int threads = std::max(1u, std::thread::hardware_concurrency());
+    spawn_depth_ = 0;
+    while ((1u << spawn_depth_) < threads)
+      spawn_depth_++;
+
+    if (n > 0)
+      subdivide(0, 0);
+
+    nodes_.resize(nodes_used_);
+    make_packets();
+
+    tris_.clear();
+    tris_.shrink_to_fit();
+    order_.clear();
+    order_.shrink_to_fit();
+
+    build_ms_ = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+  }
+
+  // horizontal min/max of the x, y, z lanes
+  inline float hmax3(__m128 v)
+  {
+    __m128 m = _mm_max_ps(v, _mm_shuffle_ps(v, v, _MM_SHUFFLE(3, 0, 2, 1)));
+    m = _mm_max_ps(m, _mm_shuffle_ps(v, v, _MM_SHUFFLE(3, 1, 0, 2)));
+    return _mm_cvtss_f32(m);
+  }
+
+  inline float hmin3(__m128 v)
+  {
+    __m128 m = _mm_min_ps(v, _mm_shuffle_ps(v, v, _MM_SHUFFLE(3, 0, 2, 1)));
+    m = _mm_min_ps(m, _mm_shuffle_ps(v, v, _MM_SHUFFLE(3, 1, 0, 2)));
+    return _mm_cvtss_f32(m);
+  }
+
+  // slab test, returns the entry distance or FLT_MAX on a miss
+  inline float intersect_aabb(const BVHNode& node, __m128 origin, __m128 inv_dir, float tmax)
+  {
+    __m128 t1 = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(node.bmin), origin), inv_dir);
+    __m128 t2 = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(node.bmax), origin), inv_dir);
+
+    float tnear = hmax3(_mm_min_ps(t1, t2));
+    float tfar  = hmin3(_mm_max_ps(t1, t2));
+
+    if (tfar >= tnear && tnear < tmax && tfar > 0.0f)
+      return tnear;
+    return FLT_MAX;
+  }
+
+  // 4-wide Moller-Trumbore, updates hit if a closer triangle is found
+  inline bool intersect_packet(const TriPacket& p, const __m128 o[3], const __m128 d[3], RayHit& hit)
+  {
+    const __m128 eps  = _mm_set1_ps(1e-8f);
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 one  = _mm_set1_ps(1.0f);
+    const __m128 abs_mask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+
+    // pvec = d x e2
+    __m128 px = _mm_sub_ps(_mm_mul_ps(d[1], p.e2[2]), _mm_mul_ps(d[2], p.e2[1]));
+    __m128 py = _mm_sub_ps(_mm_mul_ps(d[2], p.e2[0]), _mm_mul_ps(d[0], p.e2[2]));
+    __m128 pz = _mm_sub_ps(_mm_mul_ps(d[0], p.e2[1]), _mm_mul_ps(d[1], p.e2[0]));
+
+    __m128 det = _mm_add_ps(_mm_add_ps(_mm_mul_ps(p.e1[0], px), _mm_mul_ps(p.e1[1], py)),
+                            _mm_mul_ps(p.e1[2], pz));
+    __m128 mask = _mm_cmpgt_ps(_mm_and_ps(det, abs_mask), eps);
+    __m128 inv_det = _mm_div_ps(one, det);
+
+    // tvec = o - v0
+    __m128 sx = _mm_sub_ps(o[0], p.v0[0]);
+    __m128 sy = _mm_sub_ps(o[1], p.v0[1]);
+    __m128 sz = _mm_sub_ps(o[2], p.v0[2]);
+
+    __m128 u = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(sx, px), _mm_mul_ps(sy, py)),
+                                     _mm_mul_ps(sz, pz)), inv_det);
+    mask = _mm_and_ps(mask, _mm_cmpge_ps(u, zero));
+
+    // qvec = tvec x e1
+    __m128 qx = _mm_sub_ps(_mm_mul_ps(sy, p.e1[2]), _mm_mul_ps(sz, p.e1[1]));
+    __m128 qy = _mm_sub_ps(_mm_mul_ps(sz, p.e1[0]), _mm_mul_ps(sx, p.e1[2]));
+    __m128 qz = _mm_sub_ps(_mm_mul_ps(sx, p.e1[1]), _mm_mul_ps(sy, p.e1[0]));
+
+    __m128 v = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(d[0], qx), _mm_mul_ps(d[1], qy)),
+                                     _mm_mul_ps(d[2], qz)), inv_det);
+    mask = _mm_and_ps(mask, _mm_cmpge_ps(v, zero));
+    mask = _mm_and_ps(mask, _mm_cmple_ps(_mm_add_ps(u, v), one));
+
+    __m128 t = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(p.e2[0], qx), _mm_mul_ps(p.e2[1], qy)),
+                                     _mm_mul_ps(p.e2[2], qz)), inv_det);
+    mask = _mm_and_ps(mask, _mm_cmpgt_ps(t, eps));
+    mask = _mm_and_ps(mask, _mm_cmplt_ps(t, _mm_set1_ps(hit.t)));
+
+    int bits = _mm_movemask_ps(mask);
+    if (bits == 0)
+      return false;
+
+    float ts[4], us[4], vs[4];
+    _mm_storeu_ps(ts, t);
+    _mm_storeu_ps(us, u);
+    _mm_storeu_ps(vs, v);
+
+    for (unsigned int lane = 0; lane < 4; ++lane)
+    {
+      if ((bits & (1 << lane)) && ts[lane] < hit.t)
+      {
+        hit.hit = true;
+        hit.t = ts[lane];
+        hit.u = us[lane];
+        hit.v = vs[lane];
+        hit.mesh_index = p.mesh_index[lane];
+        hit.face_index = p.face_index[lane];
+        hit.instance_index = p.instance_index[lane];
+      }
+    }
+    return true;
+  }
+
+  inline bool BVH::intersect(const aiVector3D& origin, const aiVector3D& dir, RayHit& hit,
+                             float tmax) const
+  {
+    hit = RayHit();
+    hit.t = tmax;
+    return traverse(origin, dir, hit, false);
+  }
+
+  // shadow rays: stops at the first triangle closer than tmax
+  inline bool BVH::occluded(const aiVector3D& origin, const aiVector3D& dir, float tmax) const
+  {
+    RayHit hit;
+    hit.t = tmax;
+    return traverse(origin, dir, hit, true);
+  }
+
+  inline bool BVH::traverse(const aiVector3D& origin, const aiVector3D& dir, RayHit& hit,
+                            bool any_hit) const
+  {
+    if (nodes_.empty() || packets_.empty())
+      return false;
+
+    // 1/0 = inf is fine for the slab test; avoid -0 producing -inf for +0 directions
+    float inv[3];
+    for (unsigned int a = 0; a < 3; ++a)
+      inv[a] = 1.0f / (dir[a] == 0.0f ? 1e-30f : dir[a]);
+
+    const __m128 o_v   = _mm_set_ps(0.0f, origin.z, origin.y, origin.x);
+    const __m128 inv_v = _mm_set_ps(0.0f, inv[2], inv[1], inv[0]);
+
+    const __m128 o[3] = { _mm_set1_ps(origin.x), _mm_set1_ps(origin.y), _mm_set1_ps(origin.z) };
+    const __m128 d[3] = { _mm_set1_ps(dir.x),    _mm_set1_ps(dir.y),    _mm_set1_ps(dir.z) };
+
+    unsigned int stack[kmax_sah_depth + 64];
+    unsigned int sp = 0;
+    unsigned int n = 0;
+
+    if (intersect_aabb(nodes_[0], o_v, inv_v, hit.t) == FLT_MAX)
+      return false;
+
+    while (true)
+    {
+      const BVHNode& node = nodes_[n];
+
+      if (node.count > 0)
+      {
+        if (intersect_packet(packets_[node.left_first], o, d, hit) && any_hit)
+          return true;
+      }
+      else
+      {
+        unsigned int c0 = node.left_first, c1 = node.left_first + 1;
+        float t0 = intersect_aabb(nodes_[c0], o_v, inv_v, hit.t);
+        float t1 = intersect_aabb(nodes_[c1], o_v, inv_v, hit.t);
+
+        if (t0 > t1)
+        {
+          std::swap(t0, t1);
+          std::swap(c0, c1);
+        }
+
+        if (t0 != FLT_MAX)
+        {
+          if (t1 != FLT_MAX)
+            stack[sp++] = c1;
+          n = c0;
+          continue;
+        }
+      }
+
+      if (sp == 0)
+        break;
+      n = stack[--sp];
+    }
+
+    return hit.hit;
+  }
+}
@@ -0,0 +1,377 @@
+#pragma once
+
+#include <vector>
+#include <cmath>
+#include <cfloat>
+#include <algorithm>
+#include <thread>
+#include <chrono>
+
+#include <xmmintrin.h>
+
+#include <GL/glew.h>
+
+#include <assimp/scene.h>
+
+#include "workerpool.hpp"
+
+////////////////////////////////////////////////////////////////////////////////
+/// 클러스터 기반 다중 광원 (clustered forward shading)
+///
+/// The view frustum is split into kcluster_x * kcluster_y screen tiles and
+/// kcluster_z exponential depth slices (froxels). Every frame the lights are
+/// binned into the froxels on the CPU: the depth slices are distributed over
+/// the worker pool and each light sphere is tested against 4 froxel AABBs at once with
+/// SSE. The result is a compact light index list plus (offset, count) per
+/// cluster, uploaded as texture buffers for the fragment shader.
+////////////////////////////////////////////////////////////////////////////////
+namespace kmuvcl
+{
+  const unsigned int kcluster_x = 16;
+  const unsigned int kcluster_y = 16;
+  const unsigned int kcluster_z = 24;
+  const unsigned int knum_clusters = kcluster_x * kcluster_y * kcluster_z;
+  const unsigned int kmax_cluster_lights = 256;    // per cluster, further lights are dropped
+
+  // radius <= 0: no falloff, the light reaches every cluster
+  struct PointLight
+  {
+    aiVector3D  position;       // world space
+    float       radius;
+    aiColor4D   diffuse;
+    aiColor4D   specular;
+  };
+
+  struct ClusterStats
+  {
+    unsigned int  lights = 0;
+    unsigned int  references = 0;     // light indices over all clusters
+    unsigned int  max_lights = 0;     // in one cluster
+    unsigned int  overflow = 0;       // dropped references
+    double        build_ms = 0.0;
+
+    float average_lights() const { return (float)references / knum_clusters; }
+  };
+
+  // random lights in the box, radius relative to the box diagonal
+  inline void generate_lights(unsigned int count, const aiVector3D& bmin, const aiVector3D& bmax,
+                              float radius_scale, std::vector<PointLight>& lights)
+  {
+    unsigned int seed = 12345;
+    auto rnd = [&seed]() {
+      seed = seed*1664525u + 1013904223u;
+      return (seed >> 8) * (1.0f / 16777216.0f);
+    };
+
+    const aiVector3D extent = bmax - bmin;
+    const float radius = extent.Length() * radius_scale;
+
+    for (unsigned int i = 0; i < count; ++i)
+    {
+      PointLight l;
+      l.position = aiVector3D(bmin.x + extent.x*rnd(), bmin.y + extent.y*rnd(), bmin.z + extent.z*rnd());
+      l.radius   = radius * (0.5f + rnd());
+      l.diffuse  = aiColor4D(0.2f + 0.8f*rnd(), 0.2f + 0.8f*rnd(), 0.2f + 0.8f*rnd(), 1.0f);
+      l.specular = l.diffuse;
+      lights.push_back(l);
+    }
+  }
+
+  class ClusterGrid
+  {
+  public:
+    // mat_view/mat_proj: the camera of the frame, near/far: its clip planes
+    void build(const std::vector<PointLight>& lights, const aiMatrix4x4& mat_view,
+               const aiMatrix4x4& mat_proj, float near, float far, unsigned int threads = 0);
+
+    // slice = log(depth) * z_scale + z_bias
+    float z_scale() const { return z_scale_; }
+    float z_bias() const  { return z_bias_; }
+
+    const std::vector<GLuint>&    clusters() const { return clusters_; }   // (offset, count) pairs
+    const std::vector<GLushort>&  indices() const  { return indices_; }
+    const ClusterStats&           stats() const    { return stats_; }
+
+  private:
+    struct Sphere
+    {
+      float x, y, z, r;
+    };
+
+    // froxel AABBs of one depth slice in SoA layout, view space
+    struct Slice
+    {
+      float minx[kcluster_x*kcluster_y], miny[kcluster_x*kcluster_y], minz[kcluster_x*kcluster_y];
+      float maxx[kcluster_x*kcluster_y], maxy[kcluster_x*kcluster_y], maxz[kcluster_x*kcluster_y];
+    };
+
+    void build_froxels(const aiMatrix4x4& mat_proj);
+    void bin_slice(unsigned int z);
+
+    float                     near_ = 0.1f, far_ = 100.0f;
+    float                     z_scale_ = 0.0f, z_bias_ = 0.0f;
+
+    std::vector<Slice>        slices_;
+    std::vector<Sphere>       spheres_;       // view space
+    std::vector<unsigned int> light_slices_;  // first and last slice of every light
+
+    std::vector<unsigned int> counts_;        // per cluster
+    std::vector<GLushort>     lists_;         // kmax_cluster_lights per cluster
+    std::vector<GLuint>       clusters_;
+    std::vector<GLushort>     indices_;
+    ClusterStats              stats_;
+  };
+
+  inline void ClusterGrid::build_froxels(const aiMatrix4x4& mat_proj)
+  {
+    aiMatrix4x4 inv = mat_proj;
+    inv.Inverse();
+
+    // tile corners on the near and far plane; the depth of a point on the
+    // line between them is linear in both orthographic and perspective views
+    const unsigned int cx = kcluster_x + 1, cy = kcluster_y + 1;
+    std::vector<aiVector3D> pn(cx*cy), pf(cx*cy);
+    for (unsigned int j = 0; j < cy; ++j)
+    {
+      for (unsigned int i = 0; i < cx; ++i)
+      {
+        float x = -1.0f + 2.0f*i/kcluster_x;
+        float y = -1.0f + 2.0f*j/kcluster_y;
+        for (int k = 0; k < 2; ++k)
+        {
+          float z = (k == 0) ? -1.0f : 1.0f;
+          float w = inv.d1*x + inv.d2*y + inv.d3*z + inv.d4;
+          aiVector3D p = (inv * aiVector3D(x, y, z)) / w;
+          (k == 0 ? pn : pf)[j*cx + i] = p;
+        }
+      }
+    }
+
+    slices_.resize(kcluster_z);
+    for (unsigned int z = 0; z < kcluster_z; ++z)
+    {
+      float d[2] = { near_ * std::pow(far_/near_, (float)z/kcluster_z),
+                     near_ * std::pow(far_/near_, (float)(z + 1)/kcluster_z) };
+      Slice& s = slices_[z];
+
+      for (unsigned int j = 0; j < kcluster_y; ++j)
+      {
+        for (unsigned int i = 0; i < kcluster_x; ++i)
+        {
+          aiVector3D bmin( FLT_MAX,  FLT_MAX,  FLT_MAX);
+          aiVector3D bmax(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+
+          for (unsigned int c = 0; c < 4; ++c)
+          {
+            unsigned int corner = (j + c/2)*cx + (i + c%2);
+            for (unsigned int k = 0; k < 2; ++k)
+            {
+              float t = (d[k] - near_) / (far_ - near_);
+              aiVector3D p = pn[corner] + (pf[corner] - pn[corner])*t;
+              for (unsigned int a = 0; a < 3; ++a)
+              {
+                bmin[a] = std::min(bmin[a], p[a]);
+                bmax[a] = std::max(bmax[a], p[a]);
+              }
+            }
+          }
+
+          unsigned int t = j*kcluster_x + i;
+          s.minx[t] = bmin.x; s.miny[t] = bmin.y; s.minz[t] = bmin.z;
+          s.maxx[t] = bmax.x; s.maxy[t] = bmax.y; s.maxz[t] = bmax.z;
+        }
+      }
+    }
+  }
+
+  // sphere vs froxel AABB, 4 froxels per iteration
+  inline void ClusterGrid::bin_slice(unsigned int z)
+  {
+    const Slice& s = slices_[z];
+    const __m128 zero = _mm_setzero_ps();
+    const unsigned int num_tiles = kcluster_x*kcluster_y;
+
+    unsigned int* counts = &counts_[z*num_tiles];
+    GLushort* lists = &lists_[z*num_tiles*kmax_cluster_lights];
+
+    for (unsigned int l = 0; l < spheres_.size(); ++l)
+    {
+      if (z < light_slices_[2*l] || z > light_slices_[2*l + 1])
+        continue;
+
+      const Sphere& sp = spheres_[l];
+      const __m128 cx = _mm_set1_ps(sp.x), cy = _mm_set1_ps(sp.y), cz = _mm_set1_ps(sp.z);
+      const __m128 r2 = _mm_set1_ps(sp.r > 0.0f ? sp.r*sp.r : FLT_MAX);
+
+      for (unsigned int t = 0; t < num_tiles; t += 4)
+      {
+        // distance from the center to the box: max(min - c, 0, c - max) per axis
+        __m128 dx = _mm_max_ps(_mm_max_ps(_mm_sub_ps(_mm_loadu_ps(s.minx + t), cx), zero),
+                               _mm_sub_ps(cx, _mm_loadu_ps(s.maxx + t)));
+        __m128 dy = _mm_max_ps(_mm_max_ps(_mm_sub_ps(_mm_loadu_ps(s.miny + t), cy), zero),
+                               _mm_sub_ps(cy, _mm_loadu_ps(s.maxy + t)));
+        __m128 dz = _mm_max_ps(_mm_max_ps(_mm_sub_ps(_mm_loadu_ps(s.minz + t), cz), zero),
+                               _mm_sub_ps(cz, _mm_loadu_ps(s.maxz + t)));
+        __m128 d2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz));
+
+        int bits = _mm_movemask_ps(_mm_cmple_ps(d2, r2));
+        while (bits)
+        {
+          unsigned int lane = __builtin_ctz(bits);
+          bits &= bits - 1;
+
+          unsigned int& n = counts[t + lane];
+          if (n < kmax_cluster_lights)
+            lists[(t + lane)*kmax_cluster_lights + n] = l;
+          n++;
+        }
+      }
+    }
+  }
+
+  inline void ClusterGrid::build(const std::vector<PointLight>& lights, const aiMatrix4x4& mat_view,
+                                 const aiMatrix4x4& mat_proj, float near, float far, unsigned int threads)
+  {
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+    near_ = near;
+    far_  = far;
+    z_scale_ = kcluster_z / std::log(far_/near_);
+    z_bias_  = -std::log(near_) * z_scale_;
+
+    build_froxels(mat_proj);
+
+    // light spheres in view space and the range of depth slices they touch
+    spheres_.resize(lights.size());
+    light_slices_.resize(2*lights.size());
+    for (unsigned int l = 0; l < lights.size(); ++l)
+    {
+      aiVector3D c = mat_view * lights[l].position;
+      float r = lights[l].radius;
+      Sphere sp = { c.x, c.y, c.z, r };
+      spheres_[l] = sp;
+
+      unsigned int first = 0, last = kcluster_z - 1;
+      if (r > 0.0f)
+      {
+        float d0 = -c.z - r, d1 = -c.z + r;       // view space depth range
+        if (d1 < near_ || d0 > far_)
+        {
+          first = 1; last = 0;                    // outside of the depth range
+        }
+        else
+        {
+          float s0 = std::floor(std::log(std::max(d0, near_)) * z_scale_ + z_bias_);
+          float s1 = std::floor(std::log(std::min(d1, far_)) * z_scale_ + z_bias_);
+          first = (unsigned int)std::min(std::max(s0, 0.0f), (float)(kcluster_z - 1));
+          last  = (unsigned int)std::min(std::max(s1, 0.0f), (float)(kcluster_z - 1));
+        }
+      }
+      light_slices_[2*l]     = first;
+      light_slices_[2*l + 1] = last;
+    }
+
+    counts_.assign(knum_clusters, 0);
+    lists_.resize(knum_clusters * kmax_cluster_lights);
+
+    if (threads == 0)
+      threads = std::max(1u, std::thread::hardware_concurrency());
+    // handing out the slices costs more than binning a few lights
+    if (lights.size() < 32)
+      threads = 1;
+    threads = std::min(threads, kcluster_z);
+
+    // interleaved slices, the near slices are smaller but hold more lights
+    parallel_chunks(threads, threads, 1, [this, threads](size_t first, size_t last, size_t) {
+      for (size_t i = first; i < last; ++i)
+        for (unsigned int z = i; z < kcluster_z; z += threads)
+          bin_slice(z);
+    });
+
+    // compact the fixed size lists
+    stats_ = ClusterStats();
+    stats_.lights = lights.size();
+
+    clusters_.resize(2*knum_clusters);
+    indices_.clear();
+    for (unsigned int c = 0; c < knum_clusters; ++c)
+    {
+      unsigned int n = std::min(counts_[c], kmax_cluster_lights);
+
+      clusters_[2*c]     = indices_.size();
+      clusters_[2*c + 1] = n;
+      indices_.insert(indices_.end(), &lists_[c*kmax_cluster_lights], &lists_[c*kmax_cluster_lights] + n);
+
+      stats_.references += n;
+      stats_.max_lights = std::max(stats_.max_lights, counts_[c]);
+      stats_.overflow  += counts_[c] - n;
+    }
+    if (indices_.empty())
+      indices_.push_back(0);    // empty texture buffers are not allowed
+
+    stats_.build_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+  }
+
+  // texture buffers read by the fragment shader
+  //   lights  : GL_RGBA32F, 3 texels per light (position + radius, diffuse, specular)
+  //   clusters: GL_RG32UI, (offset, count) per cluster
+  //   indices : GL_R16UI, light indices
+  class ClusterBuffers
+  {
+  public:
+    void init()
+    {
+      glGenBuffers(3, buffers_);
+      glGenTextures(3, textures_);
+
+      const GLenum formats[3] = { GL_RGBA32F, GL_RG32UI, GL_R16UI };
+      for (unsigned int i = 0; i < 3; ++i)
+      {
+        glBindBuffer(GL_TEXTURE_BUFFER, buffers_[i]);
+        glBufferData(GL_TEXTURE_BUFFER, 16, NULL, GL_STREAM_DRAW);
+        glBindTexture(GL_TEXTURE_BUFFER, textures_[i]);
+        glTexBuffer(GL_TEXTURE_BUFFER, formats[i], buffers_[i]);
+      }
+      glBindTexture(GL_TEXTURE_BUFFER, 0);
+      glBindBuffer(GL_TEXTURE_BUFFER, 0);
+    }
+
+    void upload(const std::vector<PointLight>& lights, const ClusterGrid& grid)
+    {
+      light_data_.resize(12 * std::max<size_t>(1, lights.size()));
+      for (unsigned int i = 0; i < lights.size(); ++i)
+      {
+        const PointLight& l = lights[i];
+        float* p = &light_data_[12*i];
+        p[0] = l.position.x; p[1] = l.position.y; p[2] = l.position.z; p[3] = l.radius;
+        p[4] = l.diffuse.r;  p[5] = l.diffuse.g;  p[6] = l.diffuse.b;  p[7] = l.diffuse.a;
+        p[8] = l.specular.r; p[9] = l.specular.g; p[10] = l.specular.b; p[11] = l.specular.a;
+      }
+
+      // glBufferData with a new store every frame: the driver orphans the old one
+      glBindBuffer(GL_TEXTURE_BUFFER, buffers_[0]);
+      glBufferData(GL_TEXTURE_BUFFER, sizeof(float)*light_data_.size(), light_data_.data(), GL_STREAM_DRAW);
+      glBindBuffer(GL_TEXTURE_BUFFER, buffers_[1]);
+      glBufferData(GL_TEXTURE_BUFFER, sizeof(GLuint)*grid.clusters().size(), grid.clusters().data(), GL_STREAM_DRAW);
+      glBindBuffer(GL_TEXTURE_BUFFER, buffers_[2]);
+      glBufferData(GL_TEXTURE_BUFFER, sizeof(GLushort)*grid.indices().size(), grid.indices().data(), GL_STREAM_DRAW);
+      glBindBuffer(GL_TEXTURE_BUFFER, 0);
+    }
+
+    // binds the three texture buffers to the units first_unit .. first_unit + 2
+    void bind(GLenum first_unit) const
+    {
+      for (unsigned int i = 0; i < 3; ++i)
+      {
+        glActiveTexture(first_unit + i);
+        glBindTexture(GL_TEXTURE_BUFFER, textures_[i]);
+      }
+      glActiveTexture(GL_TEXTURE0);
+    }
+
+  private:
+    GLuint              buffers_[3];
+    GLuint              textures_[3];
+    std::vector<float>  light_data_;
+  };
+}
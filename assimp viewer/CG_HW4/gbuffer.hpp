@@ -0,0 +1,115 @@
+#pragma once
+
+#include <iostream>
+
+#include <GL/glew.h>
+
+////////////////////////////////////////////////////////////////////////////////
+/// G-buffer (deferred shading)
+///
+///  0: GL_RGBA32F  position (wc), view space depth
+///  1: GL_RGBA16F  normal (wc), coverage (0 = background)
+///  2: GL_RGBA8    diffuse albedo
+///  3: GL_RGBA16F  specular color, shininess
+///
+/// The attachments follow the window size; resize() is cheap when the size
+/// did not change, so it can be called every frame.
+////////////////////////////////////////////////////////////////////////////////
+namespace kmuvcl
+{
+  class GBuffer
+  {
+  public:
+    static const unsigned int knum_targets = 4;
+
+    bool init(GLsizei width, GLsizei height)
+    {
+      glGenFramebuffers(1, &fbo_);
+      glGenTextures(knum_targets, textures_);
+      glGenRenderbuffers(1, &depth_);
+
+      return resize(width, height);
+    }
+
+    bool resize(GLsizei width, GLsizei height)
+    {
+      if (width == width_ && height == height_)
+        return true;
+
+      width_  = width;
+      height_ = height;
+
+      const GLenum formats[knum_targets] = { GL_RGBA32F, GL_RGBA16F, GL_RGBA8, GL_RGBA16F };
+
+      glBindFramebuffer(GL_FRAMEBUFFER, fbo_);
+
+      for (unsigned int i = 0; i < knum_targets; ++i)
+      {
+        glBindTexture(GL_TEXTURE_2D, textures_[i]);
+        glTexImage2D(GL_TEXTURE_2D, 0, formats[i], width_, height_, 0, GL_RGBA, GL_FLOAT, NULL);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0 + i, GL_TEXTURE_2D, textures_[i], 0);
+      }
+      glBindTexture(GL_TEXTURE_2D, 0);
+
+      glBindRenderbuffer(GL_RENDERBUFFER, depth_);
+      glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width_, height_);
+      glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, depth_);
+
+      GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+      glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+      if (status != GL_FRAMEBUFFER_COMPLETE)
+      {
+        std::cerr << "G-buffer: incomplete framebuffer (0x" << std::hex << status << std::dec << ")" << std::endl;
+        return false;
+      }
+      return true;
+    }
+
+    // binds and clears the G-buffer, the caller draws the geometry
+    void begin()
+    {
+      const GLenum targets[knum_targets] = {
+        GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1, GL_COLOR_ATTACHMENT2, GL_COLOR_ATTACHMENT3
+      };
+
+      glBindFramebuffer(GL_FRAMEBUFFER, fbo_);
+      glDrawBuffers(knum_targets, targets);
+
+      GLfloat clear_color[4];
+      glGetFloatv(GL_COLOR_CLEAR_VALUE, clear_color);
+      glClearColor(0.0f, 0.0f, 0.0f, 0.0f);     // coverage 0
+      glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+      glClearColor(clear_color[0], clear_color[1], clear_color[2], clear_color[3]);
+    }
+
+    void end()
+    {
+      glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    }
+
+    // binds the targets to the texture units first_unit .. first_unit + 3
+    void bind(GLenum first_unit) const
+    {
+      for (unsigned int i = 0; i < knum_targets; ++i)
+      {
+        glActiveTexture(first_unit + i);
+        glBindTexture(GL_TEXTURE_2D, textures_[i]);
+      }
+      glActiveTexture(GL_TEXTURE0);
+    }
+
+    GLsizei width() const  { return width_; }
+    GLsizei height() const { return height_; }
+
+  private:
+    GLuint  fbo_ = 0;
+    GLuint  textures_[knum_targets];
+    GLuint  depth_ = 0;
+    GLsizei width_ = 0, height_ = 0;
+  };
+}
@@ -0,0 +1,260 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <iostream>
+#include <chrono>
+
+#include <assimp/Importer.hpp>
+#include <assimp/ProgressHandler.hpp>
+#include <assimp/scene.h>
+#include <assimp/postprocess.h>
+#include <assimp/config.h>
+
+#include "mmapio.hpp"
+
+////////////////////////////////////////////////////////////////////////////////
+/// assimp 후처리 프로파일 및 단계별 시간 측정
+///
+/// A profile names the set of assimp post processing steps a load runs:
+///   fast      triangles, shared vertices, flat normals where missing
+///   balanced  + smooth normals, cache locality, degenerate/invalid data
+///             removal, redundant materials (the default)
+///   quality   aiProcessPreset_TargetRealtime_MaxQuality (the old behaviour:
+///             tangents, SplitLargeMeshes, FindInstances, OptimizeMeshes, ...)
+/// or an explicit list of step names ("triangulate,join-vertices,...").
+///
+/// import_asset() reads the file without post processing and then applies
+/// the selected steps one at a time, in the order assimp runs them, so each
+/// step gets its own time in the ImportReport. The progress handler splits
+/// ReadFile() into parsing and assimp's scene preprocessing. Files are read
+/// through MappedIOSystem unless LoadOptions::mapped_io is off.
+////////////////////////////////////////////////////////////////////////////////
+namespace kmuvcl
+{
+  struct PostProcessStep
+  {
+    unsigned int  flag;
+    const char*   name;
+  };
+
+  // the order of assimp's post processing step list (PostStepRegistry.cpp)
+  static const PostProcessStep kpost_process_steps[] = {
+    { aiProcess_MakeLeftHanded,           "make-left-handed" },
+    { aiProcess_FlipUVs,                  "flip-uvs" },
+    { aiProcess_FlipWindingOrder,         "flip-winding" },
+    { aiProcess_RemoveComponent,          "remove-component" },
+    { aiProcess_RemoveRedundantMaterials, "remove-redundant-materials" },
+    { aiProcess_FindInstances,            "find-instances" },
+    { aiProcess_OptimizeGraph,            "optimize-graph" },
+    { aiProcess_FindDegenerates,          "find-degenerates" },
+    { aiProcess_GenUVCoords,              "gen-uv-coords" },
+    { aiProcess_TransformUVCoords,        "transform-uv-coords" },
+    { aiProcess_PreTransformVertices,     "pretransform-vertices" },
+    { aiProcess_Triangulate,              "triangulate" },
+    { aiProcess_SortByPType,              "sort-by-ptype" },
+    { aiProcess_FindInvalidData,          "find-invalid-data" },
+    { aiProcess_OptimizeMeshes,           "optimize-meshes" },
+    { aiProcess_FixInfacingNormals,       "fix-infacing-normals" },
+    { aiProcess_SplitByBoneCount,         "split-by-bone-count" },
+    { aiProcess_SplitLargeMeshes,         "split-large-meshes" },
+    { aiProcess_GenNormals,               "gen-normals" },
+    { aiProcess_GenSmoothNormals,         "gen-smooth-normals" },
+    { aiProcess_CalcTangentSpace,         "calc-tangent-space" },
+    { aiProcess_JoinIdenticalVertices,    "join-vertices" },
+    { aiProcess_Debone,                   "debone" },
+    { aiProcess_LimitBoneWeights,         "limit-bone-weights" },
+    { aiProcess_ImproveCacheLocality,     "improve-cache-locality" },
+    { aiProcess_GenBoundingBoxes,         "gen-bounding-boxes" },
+    { aiProcess_ValidateDataStructure,    "validate" },
+  };
+
+  static const unsigned int kpost_process_fast =
+    aiProcess_Triangulate | aiProcess_JoinIdenticalVertices | aiProcess_GenNormals | aiProcess_SortByPType;
+
+  static const unsigned int kpost_process_balanced =
+    aiProcess_Triangulate | aiProcess_JoinIdenticalVertices | aiProcess_GenSmoothNormals | aiProcess_SortByPType |
+    aiProcess_ImproveCacheLocality | aiProcess_RemoveRedundantMaterials | aiProcess_FindDegenerates |
+    aiProcess_FindInvalidData;
+
+  static const unsigned int kpost_process_quality = aiProcessPreset_TargetRealtime_MaxQuality;
+
+  struct LoadOptions
+  {
+    std::string   profile = "balanced";
+    unsigned int  flags = kpost_process_balanced;
+    bool          native_obj = true;    // .obj files: kmuvcl::load_obj() instead of assimp
+    unsigned int  threads = 0;          // threads of the native obj loader, 0: all cores
+    bool          mapped_io = true;     // assimp reads through MappedIOSystem
+    bool          report = false;       // print the ImportReport after each load
+
+    // "fast", "balanced", "quality" or a comma separated list of step names
+    bool set_profile(const std::string& value)
+    {
+      if (value == "fast")
+        flags = kpost_process_fast;
+      else if (value == "balanced")
+        flags = kpost_process_balanced;
+      else if (value == "quality")
+        flags = kpost_process_quality;
+      else
+      {
+        unsigned int f = 0;
+        size_t begin = 0;
+        while (begin <= value.size())
+        {
+          size_t end = value.find(',', begin);
+          if (end == std::string::npos)
+            end = value.size();
+
+          std::string name = value.substr(begin, end - begin);
+          bool found = false;
+          for (unsigned int i = 0; i < sizeof(kpost_process_steps)/sizeof(kpost_process_steps[0]); ++i)
+          {
+            if (name == kpost_process_steps[i].name)
+            {
+              f |= kpost_process_steps[i].flag;
+              found = true;
+            }
+          }
+          if (!found && !name.empty())
+          {
+            std::cerr << "unknown post processing step: " << name << std::endl;
+            return false;
+          }
+          begin = end + 1;
+        }
+        flags = f;
+      }
+
+      profile = value;
+      return true;
+    }
+  };
+
+  inline void print_post_process_steps(std::ostream& out)
+  {
+    out << "profiles: fast, balanced, quality; steps:";
+    for (unsigned int i = 0; i < sizeof(kpost_process_steps)/sizeof(kpost_process_steps[0]); ++i)
+      out << (i % 6 == 0 ? "\n  " : " ") << kpost_process_steps[i].name;
+    out << std::endl;
+  }
+
+  struct ImportReport
+  {
+    std::string   filename;
+    std::string   profile;
+    std::string   importer = "assimp";
+    double        parse_ms = 0.0;         // ReadFile() up to the end of the format importer
+    double        preprocess_ms = 0.0;    // rest of ReadFile() (assimp's scene preprocessing)
+    double        total_ms = 0.0;
+    std::vector<std::pair<const char*, double> > passes;
+    unsigned int  meshes = 0, vertices = 0, faces = 0, materials = 0;
+
+    void count(const aiScene* scene)
+    {
+      meshes = scene->mNumMeshes;
+      materials = scene->mNumMaterials;
+      vertices = faces = 0;
+      for (unsigned int i = 0; i < scene->mNumMeshes; ++i)
+      {
+        vertices += scene->mMeshes[i]->mNumVertices;
+        faces += scene->mMeshes[i]->mNumFaces;
+      }
+    }
+
+    void print(std::ostream& out) const
+    {
+      out << "import report: " << filename << " (" << importer;
+      if (importer == "assimp")
+        out << ", profile " << profile;
+      out << ")" << std::endl;
+
+      if (importer == "assimp")
+      {
+        out << "  " << "read" << "\t" << parse_ms << " ms" << std::endl;
+        out << "  " << "preprocess" << "\t" << preprocess_ms << " ms" << std::endl;
+        for (unsigned int i = 0; i < passes.size(); ++i)
+          out << "  " << passes[i].first << "\t" << passes[i].second << " ms\t("
+              << (total_ms > 0.0 ? 100.0*passes[i].second/total_ms : 0.0) << "%)" << std::endl;
+      }
+      out << "  total\t" << total_ms << " ms: " << meshes << " meshes, " << vertices << " vertices, "
+          << faces << " faces, " << materials << " materials" << std::endl;
+    }
+  };
+
+  // time stamps of the file read progress: the last one ends the format importer
+  class ImportProgress : public Assimp::ProgressHandler
+  {
+  public:
+    typedef std::chrono::steady_clock clock;
+
+    bool Update(float = -1.f) { return true; }
+
+    void UpdateFileRead(int current, int total)
+    {
+      if (current >= total)
+        parsed_ = clock::now();
+    }
+
+    clock::time_point parsed() const { return parsed_; }
+
+  private:
+    clock::time_point parsed_;
+  };
+
+  // importer keeps the scene; the steps of options.flags are timed one by one
+  inline const aiScene* import_asset(Assimp::Importer& importer, const std::string& filename,
+                                     const LoadOptions& options, ImportReport& report)
+  {
+    typedef std::chrono::steady_clock clock;
+
+    // the viewer draws triangles only
+    importer.SetPropertyInteger(AI_CONFIG_PP_SBP_REMOVE, aiPrimitiveType_POINT | aiPrimitiveType_LINE);
+
+    // the importer owns the handlers
+    if (options.mapped_io)
+      importer.SetIOHandler(new MappedIOSystem());
+
+    ImportProgress* progress = new ImportProgress();
+    importer.SetProgressHandler(progress);
+
+    report = ImportReport();
+    report.filename = filename;
+    report.profile = options.profile;
+
+    clock::time_point start = clock::now();
+    const aiScene* scene = importer.ReadFile(filename, 0);
+    clock::time_point read = clock::now();
+    if (!scene)
+    {
+      std::cerr << filename << ": " << importer.GetErrorString() << std::endl;
+      return NULL;
+    }
+
+    clock::time_point parsed = std::max(start, std::min(progress->parsed(), read));
+    report.parse_ms = std::chrono::duration<double, std::milli>(parsed - start).count();
+    report.preprocess_ms = std::chrono::duration<double, std::milli>(read - parsed).count();
+
+    for (unsigned int i = 0; i < sizeof(kpost_process_steps)/sizeof(kpost_process_steps[0]); ++i)
+    {
+      if (!(options.flags & kpost_process_steps[i].flag))
+        continue;
+
+      clock::time_point step_start = clock::now();
+      scene = importer.ApplyPostProcessing(kpost_process_steps[i].flag);
+      report.passes.push_back(std::make_pair(kpost_process_steps[i].name,
+        std::chrono::duration<double, std::milli>(clock::now() - step_start).count()));
+
+      if (!scene)
+      {
+        std::cerr << filename << ": " << kpost_process_steps[i].name << ": " << importer.GetErrorString() << std::endl;
+        return NULL;
+      }
+    }
+
+    report.total_ms = std::chrono::duration<double, std::milli>(clock::now() - start).count();
+    report.count(scene);
+    return scene;
+  }
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <cmath>
+#include <algorithm>
+
+#include <assimp/scene.h>
+
+////////////////////////////////////////////////////////////////////////////////
+/// 조명 및 재질 파라미터 (u_light_*, u_material_* 로 업로드되는 값)
+////////////////////////////////////////////////////////////////////////////////
+aiVector3D light_position_wc = aiVector3D(1.0f, 10.0f, 10.0f);
+
+aiColor4D light_ambient      = aiColor4D(1.0f, 1.0f, 1.0f, 1.0f);
+aiColor4D light_diffuse      = aiColor4D(1.0f, 1.0f, 1.0f, 1.0f);
+aiColor4D light_specular     = aiColor4D(1.0f, 1.0f, 1.0f, 1.0f);
+
+aiColor4D material_ambient   = aiColor4D(0.0f, 0.0f, 0.0f, 1.0f);
+aiColor4D material_specular  = aiColor4D(1.0f, 1.0f, 1.0f, 1.0f);
+float     material_shininess = 100.0f;
+
+namespace kmuvcl
+{
+  inline aiColor4D operator*(const aiColor4D& a, const aiColor4D& b)
+  {
+    return aiColor4D(a.r*b.r, a.g*b.g, a.b*b.b, a.a*b.a);
+  }
+
+  inline aiColor4D scale(const aiColor4D& c, float s)
+  {
+    return aiColor4D(c.r*s, c.g*s, c.b*s, c.a*s);
+  }
+
+  // diffuse and specular terms of calc_color() in shader/fragment.glsl.
+  //  n, l, v: unit normal, unit direction to the light, unit direction to the viewer
+  inline aiColor4D phong_direct(const aiVector3D& n, const aiVector3D& l, const aiVector3D& v,
+                                const aiColor4D& material_diffuse)
+  {
+    float ndotl = std::max(0.0f, n * l);
+
+    aiVector3D r = n * (2.0f * (n * l)) - l;      // reflect(-l, n)
+    float rdotv = std::max(0.0f, r * v);
+    float spec  = std::pow(rdotv, material_shininess);
+
+    aiColor4D c = scale(light_diffuse * material_diffuse, ndotl);
+    aiColor4D s = scale(light_specular * material_specular, spec);
+    return aiColor4D(c.r + s.r, c.g + s.g, c.b + s.b, 1.0f);
+  }
+}
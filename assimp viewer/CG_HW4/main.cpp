@@ -7,7 +7,10 @@
 #include <cassert>
 #include <vector>
 #include <map>
+#include <algorithm>
+#include <thread>
 #include <cmath>
+#include <cstdlib>
 #include <chrono>
 
 /* assimp include files. These three are usually needed. */
@@ -16,67 +19,205 @@
 #include <assimp/scene.h>        
 #include <assimp/postprocess.h>
 
+#include "asset.hpp"
+#include "lighting.hpp"
 #include "projection.hpp"
+#include "quantize.hpp"
+#include "meshlet.hpp"
+#include "bvh.hpp"
+#include "shadow.hpp"
+#include "cluster.hpp"
+#include "gbuffer.hpp"
+#include "occlusion.hpp"
+#include "renderqueue.hpp"
+#include "streambuffer.hpp"
+#include "multidraw.hpp"
+#include "meshpool.hpp"
+#include "scenemirror.hpp"
+#include "animation.hpp"
+#include "timer.hpp"
 
 #define STB_IMAGE_IMPLEMENTATION
 #include "./stb_image.h"
 
+#include "texturecache.hpp"
+
 namespace kmuvcl 
 {
-  struct Face
-  {    
-    GLuint index_buffer = 0;
-    GLuint num_indices = 0;
-  };
-
+  // vertices and indices are a range of g_mesh_pool (kmuvcl::MeshPool)
   struct Mesh
   {
-    GLuint  position_buffer;
-    GLuint  texcoord_buffer;
-    GLuint  normal_buffer;
-    bool    has_texture;  
-    std::vector<Face> faces;
+    bool    has_texture = false;
     unsigned int material_index;    
+    GLuint  texture = 0;        // diffuse texture of the material (g_texture_cache)
+
+    unsigned int pool_range;    // handle of the range in the pool
+    GLint   base_vertex;        // copy of the range, refreshed after defragmentation
+    GLuint  first_index;
+
+    GLsizei num_indices;        // triangles, ordered meshlet by meshlet, mesh local indices
+    std::vector<Meshlet> meshlets;
+
+    bool    skinned = false;    // bone indices/weights in the pool, positions move per frame
+
+    aiMatrix4x4 mat_dequant;          // quantized position -> object space
+    GLfloat     texcoord_dequant[4];  // (scale.u, scale.v, bias.u, bias.v)
   };  
 }
 
-struct texture
- {
-    GLfloat texture[100000];
- };
-
 const float pi = 3.14159265358979323846;
 
-texture texture1;
-
 ////////////////////////////////////////////////////////////////////////////////
 /// 쉐이더 관련 변수 및 함수
 ////////////////////////////////////////////////////////////////////////////////
-GLuint  program;          // 쉐이더 프로그램 객체의 레퍼런스 값
-
-GLint   loc_a_position;   // attribute 변수 a_position 위치
-GLint   loc_a_normal;     // attribute 변수 a_normal 위치
-GLint   loc_a_texcoord;   // attribute 변수 a_texcoord 위치
-GLuint  tex_id;           // GPU 메모리에서 texid 위치
-GLint   loc_u_PVM;        // uniform 변수 u_PVM 위치
-GLint   loc_u_M;          // uniform 변수 u_M 위치
+// 메쉬를 그리는 program (forward, G-buffer) 의 변수 위치
+struct MeshProgram
+{
+  GLuint  program;                  // 쉐이더 프로그램 객체의 레퍼런스 값
 
-GLint   loc_u_view_position_wc;       // uniform 변수 u_view_position_wc 위치
-GLint   loc_u_light_position_wc;      // uniform 변수 u_light_postion_wc 위치
+  GLint   loc_a_position;           // attribute 변수 a_position 위치
+  GLint   loc_a_normal;             // attribute 변수 a_normal 위치
+  GLint   loc_a_texcoord;           // attribute 변수 a_texcoord 위치
+  GLint   loc_a_draw_id;            // attribute 변수 a_draw_id 위치 (multi draw indirect)
+  GLint   loc_a_bone_indices;       // attribute 변수 a_bone_indices 위치 (skinning)
+  GLint   loc_a_bone_weights;       // attribute 변수 a_bone_weights 위치
 
-GLint   loc_u_light_ambient;
-GLint   loc_u_light_diffuse;          // uniform 변수 u_light_diffuse 위치
-GLint   loc_u_light_specular;         // uniform 변수 u_light_specular 위치
+  GLint   loc_u_draw_buffer;        // uniform 변수 u_draw_buffer 위치 (per-draw matrices)
+  GLint   loc_u_draw_offset;        // uniform 변수 u_draw_offset 위치
 
-GLint   loc_u_material_ambient;
-GLint   loc_u_material_specular;      // uniform 변수 u_material_specular 위치
-GLint   loc_u_material_shininess;     // uniform 변수 u_material_shininess 위치
+  GLint   loc_u_diffuse_texture;
+  GLint   loc_u_material_specular;  // uniform 변수 u_material_specular 위치
+  GLint   loc_u_material_shininess; // uniform 변수 u_material_shininess 위치
+};
 
-GLint   loc_u_diffuse_texture;
+// shader/lighting.glsl 을 포함하는 program (forward, deferred) 의 조명 변수 위치
+struct LightingProgram
+{
+  GLint   loc_u_view_position_wc;   // uniform 변수 u_view_position_wc 위치
+
+  GLint   loc_u_light_ambient;
+  GLint   loc_u_material_ambient;
+
+  GLint   loc_u_light_buffer;       // uniform 변수 u_light_buffer 위치 (texture buffer)
+  GLint   loc_u_cluster_buffer;
+  GLint   loc_u_light_index_buffer;
+  GLint   loc_u_cluster_dims;
+  GLint   loc_u_cluster_z;
+  GLint   loc_u_viewport_size;
+
+  GLint   loc_u_shadow_map;
+  GLint   loc_u_shadow_enabled;
+  GLint   loc_u_shadow_texel_size;
+};
+
+MeshProgram     forward_program;      // vertex.glsl + lighting.glsl/fragment.glsl
+LightingProgram forward_lighting;
+MeshProgram     gbuffer_program;      // vertex.glsl + gbuffer_fragment.glsl
+MeshProgram     overdraw_program;     // vertex.glsl + overdraw_fragment.glsl
+MeshProgram     depth_program;        // vertex.glsl + shadow_fragment.glsl (depth pre-pass)
+
+GLuint  deferred_program;             // deferred_vertex.glsl + lighting.glsl/deferred_fragment.glsl
+LightingProgram deferred_lighting;
+GLint   loc_deferred_a_position;
+GLint   loc_deferred_u_gbuffer[kmuvcl::GBuffer::knum_targets];
+GLint   loc_deferred_u_shadow_matrix;
+
+kmuvcl::TextureCache g_texture_cache;   // GPU 메모리의 텍스처 (이미지당 하나, 모델 간 공유)
+
+GLuint  shadow_program;               // depth only program of the shadow pass
+GLint   loc_shadow_u_draw_buffer;
+GLint   loc_shadow_u_draw_offset;
+GLint   loc_shadow_a_position;
+GLint   loc_shadow_a_bone_indices;
+GLint   loc_shadow_a_bone_weights;
 
 std::vector<kmuvcl::Mesh> meshes;
+kmuvcl::MeshPool g_mesh_pool;         // vertex and index buffers of every mesh
+
+kmuvcl::SceneMirror g_scene_mirror;   // mesh instances of the scene graph (the aiScene is released after upload)
+bool  g_keep_scene = false;           // keep the aiScene resident after the upload
+
+kmuvcl::Skeleton        g_skeleton;   // node graph, animations and skins of the scene (flattened)
+kmuvcl::AnimationPlayer g_animation;  // one animated copy of the scene per synthetic scene copy
+bool  g_skeletal_animation = true;    // play the current clip
+
+kmuvcl::normal_bits g_normal_bits = kmuvcl::knormal16;
+
+bool  g_meshlet_culling = true;       // per-meshlet frustum and backface cone culling
+bool  g_print_cull_stats = true;      // print the culling result of the next frame
+
+kmuvcl::CullStats           g_cull_stats;
+std::vector<GLsizei>        g_draw_counts;
+std::vector<const GLvoid*>  g_draw_offsets;
+std::vector<GLint>          g_draw_base_vertices;
+
+kmuvcl::BVH g_bvh;                    // picking / ray queries in scene space
+
+kmuvcl::ShadowMap g_shadow_map;
+GLsizei g_shadow_size = kmuvcl::ShadowMap::kdefault_resolution;
+bool    g_shadows = true;
+
+kmuvcl::FrameTimers g_timers;         // per pass CPU/GPU times, printed once per second
+
+// light 0 is the light of light_position_wc (moved by the keys, casts the shadow),
+// the others are random point lights around the model
+std::vector<kmuvcl::PointLight> g_lights;
+unsigned int g_num_extra_lights = 0;
+const float  kextra_light_radius = 0.15f;     // relative to the scene diagonal
+
+kmuvcl::ClusterGrid     g_clusters;
+kmuvcl::ClusterBuffers  g_cluster_buffers;
+
+// forward: Phong per fragment, deferred: G-buffer + screen space lighting,
+// compare: both every frame (deferred result shown) for the frame timers
+enum render_path {kforward, kdeferred, kcompare};
+render_path g_render_path = kforward;
+
+kmuvcl::GBuffer g_gbuffer;
+GLuint  g_quad_buffer;                // full screen quad (triangle strip)
+
+const MeshProgram* g_mesh_program = &forward_program;   // program of the current pass
+
+// 프레임마다 그릴 메쉬 목록 (render queue), 각 pass 에서 sort key 순서로 그림
+struct DrawItem
+{
+  unsigned int  mesh_index;
+  aiMatrix4x4   mat_model;
+  float         depth;        // view space depth of the mesh center
+  uint64_t      key;          // kmuvcl::make_sort_key() of the current pass
+  GLint         draw_offset;  // first texel of the per-draw data in g_draw_stream
+
+  const aiMatrix4x4* skin = NULL;   // skinning matrices of the instance (g_animation), NULL: rigid
+  unsigned int  num_bones = 0;
+};
+std::vector<DrawItem> g_draw_list;
+
+// per-draw matrices of the frame, written once and read by every pass
+const unsigned int    kdraw_texels = 21;        // see shader/vertex.glsl
+const unsigned int    kdraw_stream_draws = 1024;
+kmuvcl::StreamBuffer  g_draw_stream;
+const unsigned int    kshadow_draw_texels = 5;  // see shader/shadow_vertex.glsl
+kmuvcl::StreamBuffer  g_shadow_stream;    // per-draw data of the shadow pass
+
+// one glMultiDrawElementsIndirect per texture group instead of a draw per mesh
+bool  g_multidraw = false;
+kmuvcl::IndirectBuffer  g_indirect_buffer;
+kmuvcl::DrawIdBuffer    g_draw_ids;
+std::vector<kmuvcl::DrawElementsIndirectCommand> g_commands;
+
+// > 0: the draw list is a grid of this many copies of the scene meshes (benchmark)
+unsigned int g_synthetic_instances = 0;
+
+kmuvcl::GLStateCache g_state;         // redundant bind filter of the draw list passes
+
+bool  g_depth_prepass = false;        // depth only pass, then shading with GL_EQUAL
+bool  g_overdraw = false;             // show the number of shaded fragments per pixel
+
+kmuvcl::OcclusionCuller g_occlusion;  // software HiZ, runs on its job thread
+bool  g_occlusion_culling = true;
 
 GLuint create_shader_from_file(const std::string& filename, GLuint shader_type);
+GLuint create_shader_from_files(const std::vector<std::string>& filenames, GLuint shader_type);
 void init_shader_program();
 ////////////////////////////////////////////////////////////////////////////////
 
@@ -102,34 +243,46 @@ void set_transform();
 // ////////////////////////////////////////////////////////////////////////////////
 // /// 렌더링 관련 변수 및 함수
 // ////////////////////////////////////////////////////////////////////////////////
-const aiScene* scene;
-
-std::string basepath;
-
 std::map<std::string, GLuint> texture_map;
 
 aiVector3D view_position_wc;
-aiVector3D light_position_wc = aiVector3D(1.0f, 10.0f, 10.0f);
 
-aiColor4D light_ambient      = aiColor4D(1.0f, 1.0f, 1.0f, 1.0f);
-aiColor4D light_diffuse      = aiColor4D(1.0f, 1.0f, 1.0f, 1.0f);
-aiColor4D light_specular     = aiColor4D(0.5f, 0.5f, 0.5f, 1.0f);
-
-aiColor4D material_ambient   = aiColor4D(0.0f, 0.0f, 0.0f, 1.0f);
-aiColor4D material_specular  = aiColor4D(0.5f, 0.5f, 0.5f, 1.0f);
-float     material_shininess = 60.0f;
-
-bool load_asset(const std::string& filename);
 void print_scene_info(const aiScene* scene);
 void print_mesh_info(const aiMesh* mesh);
 
 void init();
 void init_texture_object();
 void init_buffer_objects();     
+void defragment_mesh_pool();
+void print_mesh_pool_stats();
 
 void draw_scene();
-void draw_node_recursive(const aiNode* node, const aiMatrix4x4t<float>& mat_model);
-void draw_mesh(const aiMesh* mesh, const aiMatrix4x4t<float>& mat_model);         
+void draw_forward();
+void draw_deferred();
+void set_lighting_uniforms(const LightingProgram& lighting);
+void build_draw_list();
+void begin_occlusion_culling();
+void end_occlusion_culling();
+void collect_instances(const aiMatrix4x4t<float>& mat_model);
+aiMatrix4x4 instance_matrix(unsigned int instance, unsigned int copy);
+void set_skin(DrawItem& item, unsigned int instance, unsigned int copy);
+void update_animation(float elapsed_seconds);
+void build_synthetic_draw_list(unsigned int n);
+void sort_draw_list(GLuint program);
+void draw_list();
+void draw_list_indirect();
+void write_draw_data();
+void draw_depth_prepass();
+void draw_mesh(const DrawItem& item);
+void draw_mesh_elements(const kmuvcl::Mesh& mesh, const aiMatrix4x4t<float>& mat_model, kmuvcl::CullStats& stats,
+                        bool skinned = false);
+void print_overdraw_stats();
+
+void update_lights();
+void update_clusters();
+
+void draw_shadow_map();
+void draw_shadow_mesh(const DrawItem& item, GLint draw_offset);
 
 ////////////////////////////////////////////////////////////////////////////////
 
@@ -143,102 +296,199 @@ void init()
   
   glFrontFace(GL_CCW); 
 
-  camera.mPosition = aiVector3D(0.0f, 0.5f, 1.0f);
-
-  camera.mClipPlaneNear = 0.1f;
-  camera.mClipPlaneFar = 100.0f; 
-  camera.mHorizontalFOV = pi/2.0f; // 90 degree
-  camera.mAspect = 1.0f;
+  init_camera();
 }
 
 // GLSL 파일을 읽어서 컴파일한 후 쉐이더 객체를 생성하는 함수
 GLuint create_shader_from_file(const std::string& filename, GLuint shader_type)
+{
+  return create_shader_from_files(std::vector<std::string>(1, filename), shader_type);
+}
+
+// 여러 GLSL 파일을 순서대로 이어서 하나의 쉐이더로 컴파일 (e.g. lighting.glsl + fragment.glsl)
+GLuint create_shader_from_files(const std::vector<std::string>& filenames, GLuint shader_type)
 {
   GLuint shader = 0;
 
   shader = glCreateShader(shader_type);
 
-  std::ifstream shader_file(filename.c_str());
-  std::string shader_string;
+  std::vector<std::string> shader_strings(filenames.size());
+  std::vector<const GLchar*> shader_src(filenames.size());
+
+  for (int i = 0; i < filenames.size(); ++i)
+  {
+    std::ifstream shader_file(filenames[i].c_str());
 
-  shader_string.assign(
-    (std::istreambuf_iterator<char>(shader_file)),
-     std::istreambuf_iterator<char>());
+    shader_strings[i].assign(
+      (std::istreambuf_iterator<char>(shader_file)),
+       std::istreambuf_iterator<char>());
+    shader_src[i] = shader_strings[i].c_str();
+  }
 
-  const GLchar* shader_src = shader_string.c_str();
-  glShaderSource(shader, 1, (const GLchar**)&shader_src, NULL);
+  glShaderSource(shader, shader_src.size(), shader_src.data(), NULL);
   glCompileShader(shader);
 
   return shader;
 }
 
+GLuint link_program(GLuint vertex_shader, GLuint fragment_shader)
+{
+  GLuint program = glCreateProgram();
+  glAttachShader(program, vertex_shader);
+  glAttachShader(program, fragment_shader);
+  glLinkProgram(program);
+
+  return program;
+}
+
+void get_mesh_program_locations(MeshProgram& p)
+{
+  p.loc_u_draw_buffer = glGetUniformLocation(p.program, "u_draw_buffer");
+  p.loc_u_draw_offset = glGetUniformLocation(p.program, "u_draw_offset");
+
+  p.loc_u_diffuse_texture    = glGetUniformLocation(p.program, "u_diffuse_texture");
+  p.loc_u_material_specular  = glGetUniformLocation(p.program, "u_material_specular");
+  p.loc_u_material_shininess = glGetUniformLocation(p.program, "u_material_shininess");
+
+  p.loc_a_position = glGetAttribLocation(p.program, "a_position");
+  p.loc_a_normal   = glGetAttribLocation(p.program, "a_normal");
+  p.loc_a_texcoord = glGetAttribLocation(p.program, "a_texcoord");
+  p.loc_a_draw_id  = glGetAttribLocation(p.program, "a_draw_id");
+  p.loc_a_bone_indices = glGetAttribLocation(p.program, "a_bone_indices");
+  p.loc_a_bone_weights = glGetAttribLocation(p.program, "a_bone_weights");
+}
+
+void get_lighting_locations(GLuint program, LightingProgram& l)
+{
+  l.loc_u_view_position_wc = glGetUniformLocation(program, "u_view_position_wc");
+  
+  l.loc_u_light_ambient    = glGetUniformLocation(program, "u_light_ambient");
+  l.loc_u_material_ambient = glGetUniformLocation(program, "u_material_ambient");
+
+  l.loc_u_light_buffer       = glGetUniformLocation(program, "u_light_buffer");
+  l.loc_u_cluster_buffer     = glGetUniformLocation(program, "u_cluster_buffer");
+  l.loc_u_light_index_buffer = glGetUniformLocation(program, "u_light_index_buffer");
+  l.loc_u_cluster_dims       = glGetUniformLocation(program, "u_cluster_dims");
+  l.loc_u_cluster_z          = glGetUniformLocation(program, "u_cluster_z");
+  l.loc_u_viewport_size      = glGetUniformLocation(program, "u_viewport_size");
+
+  l.loc_u_shadow_map        = glGetUniformLocation(program, "u_shadow_map");
+  l.loc_u_shadow_enabled    = glGetUniformLocation(program, "u_shadow_enabled");
+  l.loc_u_shadow_texel_size = glGetUniformLocation(program, "u_shadow_texel_size");
+}
+
 // vertex shader와 fragment shader를 링크시켜 program을 생성하는 함수
 void init_shader_program()
 {
+  std::vector<std::string> lighting_files(1, "./shader/lighting.glsl");
+
   GLuint vertex_shader
     = create_shader_from_file("./shader/vertex.glsl", GL_VERTEX_SHADER);
 
   std::cout << "vertex_shader id: " << vertex_shader << std::endl;
   assert(vertex_shader != 0);
 
+  std::vector<std::string> fragment_files = lighting_files;
+  fragment_files.push_back("./shader/fragment.glsl");
   GLuint fragment_shader
-    = create_shader_from_file("./shader/fragment.glsl", GL_FRAGMENT_SHADER);
+    = create_shader_from_files(fragment_files, GL_FRAGMENT_SHADER);
 
   std::cout << "fragment_shader id: " << fragment_shader << std::endl;
   assert(fragment_shader != 0);
 
-  program = glCreateProgram();
-  glAttachShader(program, vertex_shader);
-  glAttachShader(program, fragment_shader);
-  glLinkProgram(program);
+  forward_program.program = link_program(vertex_shader, fragment_shader);
 
-  std::cout << "program id: " << program << std::endl;
-  assert(program != 0);
+  std::cout << "program id: " << forward_program.program << std::endl;
+  assert(forward_program.program != 0);
 
-  loc_u_PVM = glGetUniformLocation(program, "u_PVM");  
-  loc_u_M   = glGetUniformLocation(program, "u_M");
+  get_mesh_program_locations(forward_program);
+  get_lighting_locations(forward_program.program, forward_lighting);
 
-  
-  loc_u_view_position_wc = glGetUniformLocation(program, "u_view_position_wc");
-  loc_u_light_position_wc = glGetUniformLocation(program, "u_light_position_wc");
-  
-  loc_u_light_ambient     = glGetUniformLocation(program, "u_light_ambient");
-  loc_u_light_diffuse     = glGetUniformLocation(program, "u_light_diffuse");
-  loc_u_light_specular    = glGetUniformLocation(program, "u_light_specular");
+  // G-buffer 생성용 program
+  GLuint gbuffer_fragment_shader
+    = create_shader_from_file("./shader/gbuffer_fragment.glsl", GL_FRAGMENT_SHADER);
+  assert(gbuffer_fragment_shader != 0);
 
-  loc_u_material_ambient   = glGetUniformLocation(program, "u_material_ambient");
-  loc_u_material_specular  = glGetUniformLocation(program, "u_material_specular");
-  loc_u_material_shininess = glGetUniformLocation(program, "u_material_shininess");
+  gbuffer_program.program = link_program(vertex_shader, gbuffer_fragment_shader);
 
-  loc_u_diffuse_texture    = glGetUniformLocation(program, "u_diffuse_texture");
+  std::cout << "G-buffer program id: " << gbuffer_program.program << std::endl;
+  assert(gbuffer_program.program != 0);
 
-  loc_a_position = glGetAttribLocation(program, "a_position");
-  loc_a_normal   = glGetAttribLocation(program, "a_normal");
-  loc_a_texcoord = glGetAttribLocation(program, "a_texcoord");
+  get_mesh_program_locations(gbuffer_program);
 
-}
+  // overdraw 시각화용 program
+  GLuint overdraw_fragment_shader
+    = create_shader_from_file("./shader/overdraw_fragment.glsl", GL_FRAGMENT_SHADER);
+  assert(overdraw_fragment_shader != 0);
 
-bool load_asset(const std::string& filename)
-{
-  std::cout << "load asset: " << filename << std::endl;
+  overdraw_program.program = link_program(vertex_shader, overdraw_fragment_shader);
 
-  
-  size_t pos = filename.rfind("/");
-  basepath = filename.substr(0, pos + 1);
+  std::cout << "overdraw program id: " << overdraw_program.program << std::endl;
+  assert(overdraw_program.program != 0);
 
+  get_mesh_program_locations(overdraw_program);
 
-  // Assimp::Importer importer;
-  // scene = importer.ReadFile(filename, aiProcessPreset_TargetRealtime_MaxQuality);
-  scene = aiImportFile(filename.c_str(), 
-                       aiProcessPreset_TargetRealtime_MaxQuality);
-  if (scene != NULL)
-  {
-    return true;
-  }
-  else
-  {
-    return false;
-  }
+  // depth pre-pass: the same vertex shader as the main pass for GL_EQUAL
+  GLuint depth_fragment_shader
+    = create_shader_from_file("./shader/shadow_fragment.glsl", GL_FRAGMENT_SHADER);
+  assert(depth_fragment_shader != 0);
+
+  depth_program.program = link_program(vertex_shader, depth_fragment_shader);
+
+  std::cout << "depth program id: " << depth_program.program << std::endl;
+  assert(depth_program.program != 0);
+
+  get_mesh_program_locations(depth_program);
+
+  // deferred 조명 계산용 program
+  GLuint deferred_vertex_shader
+    = create_shader_from_file("./shader/deferred_vertex.glsl", GL_VERTEX_SHADER);
+
+  std::vector<std::string> deferred_files = lighting_files;
+  deferred_files.push_back("./shader/deferred_fragment.glsl");
+  GLuint deferred_fragment_shader
+    = create_shader_from_files(deferred_files, GL_FRAGMENT_SHADER);
+  assert(deferred_vertex_shader != 0 && deferred_fragment_shader != 0);
+
+  deferred_program = link_program(deferred_vertex_shader, deferred_fragment_shader);
+
+  std::cout << "deferred program id: " << deferred_program << std::endl;
+  assert(deferred_program != 0);
+
+  get_lighting_locations(deferred_program, deferred_lighting);
+
+  const char* gbuffer_names[kmuvcl::GBuffer::knum_targets] = {
+    "u_gbuffer_position", "u_gbuffer_normal", "u_gbuffer_albedo", "u_gbuffer_specular"
+  };
+  for (int i = 0; i < kmuvcl::GBuffer::knum_targets; ++i)
+    loc_deferred_u_gbuffer[i] = glGetUniformLocation(deferred_program, gbuffer_names[i]);
+
+  loc_deferred_u_shadow_matrix = glGetUniformLocation(deferred_program, "u_shadow_matrix");
+  loc_deferred_a_position      = glGetAttribLocation(deferred_program, "a_position");
+
+  // 그림자 맵 생성용 program
+  GLuint shadow_vertex_shader
+    = create_shader_from_file("./shader/shadow_vertex.glsl", GL_VERTEX_SHADER);
+  GLuint shadow_fragment_shader
+    = create_shader_from_file("./shader/shadow_fragment.glsl", GL_FRAGMENT_SHADER);
+  assert(shadow_vertex_shader != 0 && shadow_fragment_shader != 0);
+
+  shadow_program = link_program(shadow_vertex_shader, shadow_fragment_shader);
+
+  std::cout << "shadow program id: " << shadow_program << std::endl;
+  assert(shadow_program != 0);
+
+  loc_shadow_u_draw_buffer    = glGetUniformLocation(shadow_program, "u_draw_buffer");
+  loc_shadow_u_draw_offset    = glGetUniformLocation(shadow_program, "u_draw_offset");
+  loc_shadow_a_position       = glGetAttribLocation(shadow_program, "a_position");
+  loc_shadow_a_bone_indices   = glGetAttribLocation(shadow_program, "a_bone_indices");
+  loc_shadow_a_bone_weights   = glGetAttribLocation(shadow_program, "a_bone_weights");
+
+  // deferred pass 의 full screen quad
+  const GLfloat quad[8] = { -1.0f, -1.0f,  1.0f, -1.0f,  -1.0f, 1.0f,  1.0f, 1.0f };
+  glGenBuffers(1, &g_quad_buffer);
+  glBindBuffer(GL_ARRAY_BUFFER, g_quad_buffer);
+  glBufferData(GL_ARRAY_BUFFER, sizeof(quad), quad, GL_STATIC_DRAW);
 }
 
 void print_mesh_info(const aiMesh* mesh)
@@ -261,14 +511,7 @@ void print_mesh_info(const aiMesh* mesh)
 
     if (mesh->mTextureCoords[0] != NULL)
     {
-
-
       aiVector3D texcoord = mesh->mTextureCoords[0][i];
-
-      texture1.texture[i*3] = texcoord.x;
-      texture1.texture[1 + (i*3)] = texcoord.y;
-      texture1.texture[2 + (i*3)] = texcoord.z;
-      
       // std::cout << "  texcoord  (" << texcoord.x << ", " <<  texcoord.y << ", " << texcoord.z << ")" << std::endl;
     }
   }
@@ -324,8 +567,7 @@ void print_material_info(const aiMaterial* material)
       if (AI_SUCCESS == scene->mMaterials[i]->GetTexture(aiTextureType_DIFFUSE, 
           j, &textureFilePath)) 
       {
-        basepath = basepath + textureFilePath.data;
-        std::cout << "Diffuse Texture file: " << basepath << std::endl;
+        std::cout << "Diffuse Texture file: " << basepath + textureFilePath.data << std::endl;
       }
       else 
       {
@@ -353,83 +595,115 @@ void print_scene_info(const aiScene* scene)
   }
 }
 
+// every mesh gets a range of g_mesh_pool, sized to fit the scene
 void init_buffer_objects()
 {
-  // TODO: Fill this function to render the scene
-   for (int i = 0; i < scene->mNumMeshes; ++i)
+  GLuint num_vertices = 0, num_indices = 0;
+  for (int i = 0; i < scene->mNumMeshes; ++i)
+  {
+    num_vertices += scene->mMeshes[i]->mNumVertices;
+    num_indices  += 3*scene->mMeshes[i]->mNumFaces;
+  }
+
+  GLenum normal_type = (g_normal_bits == kmuvcl::knormal8) ? GL_UNSIGNED_BYTE : GL_UNSIGNED_SHORT;
+  g_mesh_pool.init(normal_type, num_vertices, num_indices);
+
+  for (int i = 0; i < scene->mNumMeshes; ++i)
   {
     const aiMesh* mesh = scene->mMeshes[i];
 
     kmuvcl::Mesh mesh_object;
+    kmuvcl::QuantizedMesh q;
 
-    glGenBuffers(1, &mesh_object.position_buffer);
-    glBindBuffer(GL_ARRAY_BUFFER, mesh_object.position_buffer);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(mesh->mVertices[0]) * mesh->mNumVertices, &mesh->mVertices[0].x, GL_STATIC_DRAW);
+    kmuvcl::quantize_mesh(mesh, q, g_normal_bits);
 
-    glGenBuffers(1, &mesh_object.normal_buffer);
-    glBindBuffer(GL_ARRAY_BUFFER, mesh_object.normal_buffer);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(mesh->mNormals[0]) * mesh->mNumVertices, &mesh->mNormals[0].x, GL_STATIC_DRAW);
+    kmuvcl::QuantizationError err = kmuvcl::validate_quantization(mesh, q);
+    if (!err.ok())
+    {
+      std::cerr << "mesh " << i << ": quantization error exceeds bound (pos "
+                << err.max_position_error << ", normal " << err.max_normal_error 
+                << " deg, uv " << err.max_texcoord_error << ")" << std::endl;
+    }
 
-/*
-// material_index
-    glGenBuffers(1, &mesh_object.material_index);
-    glBindBuffer(GL_ARRAY_BUFFER, mesh_object.material_index);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(mesh->mTextureCoords[0][0]) * mesh->mNumVertices , &mesh->mTextureCoords[0][0].x, GL_STATIC_DRAW);
-*/
-    
+    mesh_object.mat_dequant = q.mat_dequant;
+    std::copy(q.texcoord_dequant, q.texcoord_dequant + 4, mesh_object.texcoord_dequant);
+    mesh_object.material_index = mesh->mMaterialIndex;
+    mesh_object.has_texture = q.has_texcoords;
 
-    glGenBuffers(1, &mesh_object.texcoord_buffer);
-    glBindBuffer(GL_ARRAY_BUFFER, mesh_object.texcoord_buffer);
+    std::vector<GLuint> indices;
+    kmuvcl::build_meshlets(mesh, indices, mesh_object.meshlets);
 
-    if (mesh->mTextureCoords[0] != NULL)
-    {
-      glBufferData(GL_ARRAY_BUFFER, sizeof(mesh->mTextureCoords[0][0]) * mesh->mNumVertices * 4 , &mesh->mTextureCoords[0][0].x, GL_STATIC_DRAW);
-      mesh_object.has_texture = true;
-    }    
+    std::vector<GLubyte> bones;
+    mesh_object.skinned = kmuvcl::build_vertex_bones(mesh, bones);
 
-    for (int i = 0; i < mesh->mNumFaces; ++i)
-    {
-      const aiFace& face = mesh->mFaces[i];
-      
-      kmuvcl::Face face_object;
-      face_object.num_indices = face.mNumIndices;
-
-      glGenBuffers(1, &face_object.index_buffer);
-      glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, face_object.index_buffer);
-      glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(face.mIndices[0]) * face.mNumIndices, &face.mIndices[0], GL_STATIC_DRAW);
-      
-      mesh_object.faces.push_back(face_object);
-    }
+    mesh_object.num_indices = indices.size();
+    mesh_object.pool_range = g_mesh_pool.add(mesh->mNumVertices, q.positions.data(), q.normals.data(),
+                                             q.has_texcoords ? q.texcoords.data() : NULL,
+                                             indices.size(), indices.data(),
+                                             mesh_object.skinned ? bones.data() : NULL);
+
+    const kmuvcl::PoolRange& r = g_mesh_pool.range(mesh_object.pool_range);
+    mesh_object.base_vertex = r.base_vertex;
+    mesh_object.first_index = r.first_index;
+
+    std::cout << "mesh " << i << ": " << mesh_object.meshlets.size() << " meshlets, "
+              << indices.size()/3 << " triangles";
+    if (mesh_object.skinned)
+      std::cout << ", " << mesh->mNumBones << " bones";
+    std::cout << std::endl;
 
     meshes.push_back(mesh_object);
   }  
+
+  print_mesh_pool_stats();
 }
 
-void init_texture_objects()
+// packs the pool and refreshes the ranges cached in the meshes
+void defragment_mesh_pool()
 {
-  // TODO: Fill this function to render the scene
-
-  int width, height, channels;
-  unsigned char* image;
-
-  // 향후, 원점 위치를 좌*상*단에서 좌*하*단으로 이동시킨 효과가 나도록 영상을 로딩함.
-    stbi_set_flip_vertically_on_load(true);
+  if (!g_mesh_pool.defragment())
+  {
+    std::cout << "mesh pool: already packed" << std::endl;
+    return;
+  }
 
-  // 파일로부터 영상을 이루는 픽셀들을 메인메모리로 로딩
-    image = stbi_load(basepath.c_str(), &width, &height, &channels, STBI_rgb);
+  for (int i = 0; i < meshes.size(); ++i)
+  {
+    const kmuvcl::PoolRange& r = g_mesh_pool.range(meshes[i].pool_range);
+    meshes[i].base_vertex = r.base_vertex;
+    meshes[i].first_index = r.first_index;
+  }
+  print_mesh_pool_stats();
+}
 
-  glGenTextures(1, &tex_id);
-  glBindTexture(GL_TEXTURE_2D, tex_id);
-  glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, image);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+void print_mesh_pool_stats()
+{
+  const kmuvcl::MeshPoolStats s = g_mesh_pool.stats();
+  std::cout << "mesh pool: " << s.ranges << " meshes, vertices " << s.vertices << "/" << s.vertex_capacity
+            << " (" << s.free_vertex_ranges << " free ranges), indices " << s.indices << "/" << s.index_capacity
+            << " (" << s.free_index_ranges << " free ranges), grown " << s.grows << " times" << std::endl;
+}
 
+// diffuse texture of every material through the cache, shared by the meshes using it
+void init_texture_objects()
+{
+  std::vector<GLuint> material_textures(scene->mNumMaterials, 0);
+  for (int i = 0; i < scene->mNumMaterials; ++i)
+  {
+    aiString path;
+    if (AI_SUCCESS == scene->mMaterials[i]->GetTexture(aiTextureType_DIFFUSE, 0, &path))
+      material_textures[i] = g_texture_cache.get(basepath + path.data);
+  }
 
-  // 메인메모리로 로딩된 영상데이터 메모리 해제
-  stbi_image_free(image);
+  for (int i = 0; i < meshes.size(); ++i)
+  {
+    meshes[i].texture = material_textures[meshes[i].material_index];
+    meshes[i].has_texture = meshes[i].has_texture && meshes[i].texture != 0;
+  }
 
+  std::cout << "textures: " << g_texture_cache.requests() << " requests, " << g_texture_cache.paths() 
+            << " files, " << g_texture_cache.uploads() << " uploaded (" 
+            << g_texture_cache.bytes()/(1024*1024) << " MB)" << std::endl;
 }
 
 void print_matrix(const std::string& log, const aiMatrix4x4& m)
@@ -486,6 +760,62 @@ void key_callback(GLFWwindow * window, int key, int scancode, int action, int mo
   {
     set_mode(mode() == kortho ? kperspective : kortho);    
   }
+  else if (key == GLFW_KEY_K && action == GLFW_PRESS)
+  {
+    g_meshlet_culling = !g_meshlet_culling;
+    std::cout << (g_meshlet_culling ? "meshlet culling" : "no meshlet culling") << std::endl;
+  }
+  else if (key == GLFW_KEY_H && action == GLFW_PRESS)
+  {
+    g_shadows = !g_shadows;
+    g_shadow_map.invalidate();
+    std::cout << (g_shadows ? "shadows" : "no shadows") << std::endl;
+  }
+  else if (key == GLFW_KEY_G && action == GLFW_PRESS)
+  {
+    g_render_path = (render_path)((g_render_path + 1) % 3);
+    const char* names[3] = { "forward", "deferred", "forward + deferred (compare)" };
+    std::cout << "render path: " << names[g_render_path] << std::endl;
+  }
+  else if (key == GLFW_KEY_V && action == GLFW_PRESS)
+  {
+    g_occlusion_culling = !g_occlusion_culling;
+    std::cout << (g_occlusion_culling ? "occlusion culling" : "no occlusion culling") << std::endl;
+  }
+  else if (key == GLFW_KEY_E && action == GLFW_PRESS)
+  {
+    g_depth_prepass = !g_depth_prepass;
+    std::cout << (g_depth_prepass ? "depth pre-pass" : "no depth pre-pass") << std::endl;
+  }
+  else if (key == GLFW_KEY_I && action == GLFW_PRESS)
+  {
+    g_multidraw = !g_multidraw;
+    if (g_multidraw && !kmuvcl::multi_draw_indirect_supported())
+      std::cout << "multi draw indirect not supported, drawing per mesh" << std::endl;
+    else
+      std::cout << (g_multidraw ? "multi draw indirect" : "draw per mesh") << std::endl;
+  }
+  else if (key == GLFW_KEY_F && action == GLFW_PRESS)
+  {
+    defragment_mesh_pool();
+  }
+  else if (key == GLFW_KEY_O && action == GLFW_PRESS)
+  {
+    g_overdraw = !g_overdraw;
+    std::cout << (g_overdraw ? "overdraw visualization (forward pass)" : "no overdraw visualization") << std::endl;
+  }
+  else if (key == GLFW_KEY_T && action == GLFW_PRESS)
+  {
+    g_timers.enabled = !g_timers.enabled;
+  }
+  else if (key == GLFW_KEY_L && action == GLFW_PRESS)
+  {
+    // 0, 1, 2, 4, ..., 1024 extra lights
+    g_num_extra_lights = (g_num_extra_lights == 0) ? 1 : 2*g_num_extra_lights;
+    if (g_num_extra_lights > 1024)
+      g_num_extra_lights = 0;
+    std::cout << "lights: " << 1 + g_num_extra_lights << std::endl;
+  }
 
   else if (key == GLFW_KEY_P && action == GLFW_PRESS)
   {
@@ -493,6 +823,26 @@ void key_callback(GLFWwindow * window, int key, int scancode, int action, int mo
     std::cout << (g_is_animation ? "animation" : "no animation") << std::endl;
 
   }
+  else if (key == GLFW_KEY_J && action == GLFW_PRESS)
+  {
+    g_skeletal_animation = !g_skeletal_animation;
+    std::cout << (g_skeletal_animation ? "skeletal animation" : "skeletal animation paused") << std::endl;
+  }
+  else if (key == GLFW_KEY_U && action == GLFW_PRESS && g_animation.animated())
+  {
+    g_animation.next_clip();
+    g_shadow_map.invalidate();
+    for (unsigned int g = 0; g < g_animation.num_groups(); ++g)
+    {
+      if (g_animation.clip(g) >= 0)
+        std::cout << "clip " << g_animation.clip(g) << ": " << g_skeleton.clip(g_animation.clip(g)).name << std::endl;
+    }
+  }
+
+  // 새로운 뷰: 다음 프레임의 컬링 결과 출력
+  if (action == GLFW_PRESS)
+    g_print_cull_stats = true;
+
   // {
   //   const aiVector3D& v = light_position_wc;
   //   std::cout << "light position: " <<  v[0] << ", " << v[1] << ", " << v[2] << std::endl;
@@ -514,6 +864,57 @@ void set_mode(proj_mode _mode)
   mode_ = _mode;
 }
 
+// 마우스 클릭 위치의 삼각형 선택 (picking)
+void mouse_button_callback(GLFWwindow* window, int button, int action, int mods)
+{
+  if (button != GLFW_MOUSE_BUTTON_LEFT || action != GLFW_PRESS)
+    return;
+
+  double x, y;
+  int width, height;
+  glfwGetCursorPos(window, &x, &y);
+  glfwGetWindowSize(window, &width, &height);
+
+  // cursor -> NDC, then unproject the near and far points into the scene space
+  // of the BVH (before the model rotation of mat_model)
+  float ndc_x = 2.0f*(float)x/(float)width - 1.0f;
+  float ndc_y = 1.0f - 2.0f*(float)y/(float)height;
+
+  aiMatrix4x4 mat_inv = mat_proj*mat_view*mat_model;
+  mat_inv.Inverse();
+
+  aiVector3D p[2];
+  for (int i = 0; i < 2; ++i)
+  {
+    float z = (i == 0) ? -1.0f : 1.0f;
+    float w = mat_inv.d1*ndc_x + mat_inv.d2*ndc_y + mat_inv.d3*z + mat_inv.d4;
+    p[i] = (mat_inv * aiVector3D(ndc_x, ndc_y, z)) / w;
+  }
+
+  aiVector3D dir = p[1] - p[0];
+  float len = dir.Length();
+  dir /= len;
+
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+  kmuvcl::RayHit hit;
+  g_bvh.intersect(p[0], dir, hit, len);
+
+  float us = std::chrono::duration<float, std::micro>(std::chrono::steady_clock::now() - start).count();
+
+  if (hit.hit)
+  {
+    aiVector3D pos = p[0] + dir*hit.t;
+    std::cout << "pick: mesh " << hit.mesh_index << ", face " << hit.face_index 
+              << ", position (" << pos.x << ", " << pos.y << ", " << pos.z << ")"
+              << " [" << us << " us]" << std::endl;
+  }
+  else
+  {
+    std::cout << "pick: nothing [" << us << " us]" << std::endl;
+  }
+}
+
 void frambuffer_size_callback(GLFWwindow* window, int width, int height)
 {
   glViewport(0, 0, width, height);
@@ -523,137 +924,1130 @@ void frambuffer_size_callback(GLFWwindow* window, int width, int height)
 
 void draw_scene()
 {
-  const aiNode* node = scene->mRootNode;
-  draw_node_recursive(node, mat_model);
-  
+  g_cull_stats.reset();
+  g_state.reset_stats();
+
+  // the occlusion job overlaps with the shadow and cluster passes
+  build_draw_list();
+  begin_occlusion_culling();
+
+  draw_shadow_map();
+  update_clusters();
+
+  end_occlusion_culling();
+  write_draw_data();
+
+  // the overdraw visualization is a forward pass
+  if (g_render_path == kforward || g_render_path == kcompare || g_overdraw)
+    draw_forward();
+
+  if ((g_render_path == kdeferred || g_render_path == kcompare) && !g_overdraw)
+  {
+    g_cull_stats.reset();
+    draw_deferred();
+  }
+
+  // the per-draw data of this frame may be overwritten once the GPU passed here
+  g_draw_stream.fence();
+
+  if (g_print_cull_stats)
+  {
+    if (g_overdraw)
+      print_overdraw_stats();
+
+    const kmuvcl::CullStats& s = g_cull_stats;
+    std::cout << "meshlets " << s.meshlets_visible << "/" << s.meshlets
+              << ", triangles " << s.triangles_visible << "/" << s.triangles
+              << " (culled " << s.culled_percentage() << "%: frustum " << s.triangles_frustum_culled
+              << ", backface " << s.triangles_backface_culled << ")" << std::endl;
+
+    const kmuvcl::StateStats& st = g_state.stats();
+    std::cout << "state changes: " << st.issued << " issued, " << st.avoided << " avoided" << std::endl;
+
+    std::cout << "per-draw data: " << g_draw_list.size() << " draws, " 
+              << g_draw_list.size()*kdraw_texels*kmuvcl::StreamBuffer::ktexel_size << " bytes "
+              << (g_draw_stream.persistent() ? "(persistent map)" : "(glBufferSubData)")
+              << ", fence wait " << g_draw_stream.wait_ms() << " ms" << std::endl;
+    g_draw_stream.reset_wait();
+
+    if (g_occlusion_culling)
+    {
+      const kmuvcl::OcclusionStats& o = g_occlusion.stats();
+      std::cout << "occlusion: culled " << o.culled << "/" << o.tested << " meshes, " 
+                << o.occluders << " occluders (" << o.occluder_triangles << " triangles), "
+                << "raster " << o.raster_ms << " ms, test " << o.test_ms << " ms" << std::endl;
+    }
+    g_print_cull_stats = false;
+  }
+}
+
+// light, cluster and shadow uniforms of lighting.glsl, once per pass
+void set_lighting_uniforms(const LightingProgram& l)
+{
+  glUniform3fv(l.loc_u_view_position_wc, 1, (float*)&camera.mPosition);   // view position
+
+  glUniform4fv(l.loc_u_light_ambient, 1, (float*)&light_ambient);
+  glUniform4fv(l.loc_u_material_ambient, 1, (float*)&material_ambient);
+
+  // light clusters on texture units 2, 3, 4
+  GLint viewport[4];
+  glGetIntegerv(GL_VIEWPORT, viewport);
+  glUniform2f(l.loc_u_viewport_size, (float)viewport[2], (float)viewport[3]);
+  glUniform3f(l.loc_u_cluster_dims, kmuvcl::kcluster_x, kmuvcl::kcluster_y, kmuvcl::kcluster_z);
+  glUniform2f(l.loc_u_cluster_z, g_clusters.z_scale(), g_clusters.z_bias());
+  glUniform1i(l.loc_u_light_buffer, 2);
+  glUniform1i(l.loc_u_cluster_buffer, 3);
+  glUniform1i(l.loc_u_light_index_buffer, 4);
+  g_cluster_buffers.bind(GL_TEXTURE2);
+
+  // shadow map on texture unit 1
+  glUniform1i(l.loc_u_shadow_enabled, g_shadows);
+  glUniform1f(l.loc_u_shadow_texel_size, 1.0f / g_shadow_map.resolution());
+  glUniform1i(l.loc_u_shadow_map, 1);
+  glActiveTexture(GL_TEXTURE1);
+  glBindTexture(GL_TEXTURE_2D, g_shadow_map.texture());
+  glActiveTexture(GL_TEXTURE0);
 }
 
-void draw_node_recursive(const aiNode* node, const aiMatrix4x4& mat_parent)
+void draw_forward()
 {
-  aiMatrix4x4 mat_curr = mat_parent*node->mTransformation; 
+  if (g_depth_prepass)
+    draw_depth_prepass();
+
+  g_timers.begin("forward");
+
+  if (g_overdraw)
+  {
+    // count from 0 on a black background
+    glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+    glClear(GL_COLOR_BUFFER_BIT);
+    glClearColor(0.5f, 0.5f, 0.5f, 1.0f);
+
+    glEnable(GL_BLEND);
+    glBlendFunc(GL_ONE, GL_ONE);
 
-  // draw node
-  for (int i = 0; i < node->mNumMeshes; ++i)
+    g_mesh_program = &overdraw_program;
+  }
+  else
   {
-    draw_mesh(scene->mMeshes[node->mMeshes[i]], mat_curr);
+    // 특정 쉐이더 프로그램 사용
+    glUseProgram(forward_program.program); 
+    set_lighting_uniforms(forward_lighting);
+    g_mesh_program = &forward_program;
   }
-  
-  // draw all node
-  for (int i = 0; i < node->mNumChildren; ++i)
+
+  // depth is final after the pre-pass: shade only the visible fragment
+  if (g_depth_prepass)
   {
-    draw_node_recursive(node->mChildren[i], mat_curr);
+    glDepthFunc(GL_EQUAL);
+    glDepthMask(GL_FALSE);
   }
+
+  draw_list();
+
+  glDepthFunc(GL_LESS);
+  glDepthMask(GL_TRUE);
+  glDisable(GL_BLEND);
+  glUseProgram(0);
+
+  g_timers.end("forward");
 }
 
-void draw_mesh(const aiMesh* mesh, const aiMatrix4x4& mat_model)
+// depth only pass with the same meshes and the same transforms as the main pass
+void draw_depth_prepass()
 {
+  g_timers.begin("depth");
 
-  // TODO: Fill this function to render the scene
+  glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
 
-  glClearColor(0.5f, 0.5f, 0.5f, 1.0f);
-  glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-  // 특정 쉐이더 프로그램 사용
-  glUseProgram(program); 
-    
-  aiMatrix4x4 mat_PVM = mat_proj*mat_view*mat_model;
-  glUniformMatrix4fv(loc_u_PVM, 1, GL_FALSE, (float*)&mat_PVM.Transpose());
+  // meshlets already counted by the main pass
+  kmuvcl::CullStats stats = g_cull_stats;
 
-  aiMatrix4x4 m = mat_model;
-  glUniformMatrix4fv(loc_u_M, 1, GL_FALSE, (float*)&m.Transpose());
-  
-  glUniform3fv(loc_u_light_position_wc, 1, (float*)&light_position_wc);   // light position
+  g_mesh_program = &depth_program;
+  draw_list();
 
-  glUniform4f(loc_u_light_ambient, 1.0f, 1.0f, 1.0f, 1.0f);
-  glUniform4f(loc_u_light_diffuse, 1.0f, 1.0f, 1.0f, 1.0f);
-  glUniform4f(loc_u_light_specular, 1.0f, 1.0f, 1.0f, 1.0f);
+  g_cull_stats = stats;
+  g_state.use_program(0);
 
-  glUniform3fv(loc_u_view_position_wc, 1, (float*)&camera.mPosition);   // view position
+  glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
 
-  glUniform4f(loc_u_material_ambient, 0.0f, 0.0f, 0.0f, 1.0f);
-  glUniform4f(loc_u_material_specular, 1.0f, 1.0f, 1.0f, 1.0f);
-  glUniform1f(loc_u_material_shininess, 100.0f);
+  g_timers.end("depth");
+}
 
-  glUniform4f(loc_u_diffuse_texture, 1.0f, 0.0f, 0.0f, 1.0f);
+// shaded fragments per pixel from the red channel (+1 per fragment, see overdraw_fragment.glsl)
+void print_overdraw_stats()
+{
+  GLint viewport[4];
+  glGetIntegerv(GL_VIEWPORT, viewport);
 
-  // Select active texture unit
-  
-  // Bind a texture w/ the following OpenGL texture functions
+  std::vector<GLubyte> counts(viewport[2]*viewport[3]);
+  glPixelStorei(GL_PACK_ALIGNMENT, 1);
+  glReadPixels(viewport[0], viewport[1], viewport[2], viewport[3], GL_RED, GL_UNSIGNED_BYTE, counts.data());
 
-  for (int i = 0; i < meshes.size(); ++i)
+  unsigned int covered = 0, fragments = 0, max_count = 0;
+  for (int i = 0; i < counts.size(); ++i)
   {
-    const kmuvcl::Mesh& mesh = meshes[i];
+    if (counts[i] == 0)
+      continue;
+    covered++;
+    fragments += counts[i];
+    max_count = std::max(max_count, (unsigned int)counts[i]);
+  }
 
-    glBindBuffer(GL_ARRAY_BUFFER, mesh.position_buffer);
-    glEnableVertexAttribArray(loc_a_position);
-    glVertexAttribPointer(loc_a_position, 3, GL_FLOAT, GL_FALSE, 0, (void*)0);
+  std::cout << "overdraw" << (g_depth_prepass ? " (depth pre-pass)" : "") << ": " 
+            << fragments << " fragments shaded on " << covered << " pixels, " 
+            << (covered ? (float)fragments/covered : 0.0f) << " per pixel, max " << max_count 
+            << (max_count == 255 ? " (saturated)" : "") << std::endl;
+}
 
-    glBindBuffer(GL_ARRAY_BUFFER, mesh.normal_buffer);
-    glEnableVertexAttribArray(loc_a_normal);
-    glVertexAttribPointer(loc_a_normal, 3, GL_FLOAT, GL_FALSE, 0, (void*)0);
+void draw_deferred()
+{
+  GLint viewport[4];
+  glGetIntegerv(GL_VIEWPORT, viewport);
+  g_gbuffer.resize(viewport[2], viewport[3]);
 
+  // 1. surface attributes into the G-buffer
+  g_timers.begin("gbuffer");
 
-    if (mesh.has_texture)
-    {
-      glUniform1i(loc_a_texcoord, 0);
-      glActiveTexture(GL_TEXTURE0);
-      glBindTexture(GL_TEXTURE_2D, tex_id);
-      glBindBuffer(GL_ARRAY_BUFFER, mesh.texcoord_buffer);
-      glEnableVertexAttribArray(loc_a_texcoord);
-      glVertexAttribPointer(loc_a_texcoord, 2, GL_FLOAT, GL_FALSE, 4, texture1.texture);
-    }
-    
+  g_gbuffer.begin();
 
+  g_mesh_program = &gbuffer_program;
+  draw_list();
 
-    for (int j = 0; j < mesh.faces.size(); ++j)
-    {
-      const kmuvcl::Face& face = mesh.faces[j];
-      
-      glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, face.index_buffer);
-      glDrawElements(GL_TRIANGLES, face.num_indices, GL_UNSIGNED_INT, (void*)0);
-    }    
+  g_gbuffer.end();
 
-    glDisableVertexAttribArray(loc_a_position);
-    glDisableVertexAttribArray(loc_a_normal);
+  g_timers.end("gbuffer");
 
-    if (mesh.has_texture)
-    {
-      glDisableVertexAttribArray(loc_a_texcoord);
-    }
-  }
+  // 2. Phong lighting once per covered pixel
+  g_timers.begin("lighting");
 
+  glUseProgram(deferred_program);
+  set_lighting_uniforms(deferred_lighting);
+
+  aiMatrix4x4 mat_shadow = g_shadow_map.mat_texture();
+  glUniformMatrix4fv(loc_deferred_u_shadow_matrix, 1, GL_FALSE, (float*)&mat_shadow.Transpose());
+
+  // G-buffer on texture units 5 .. 8
+  for (int i = 0; i < kmuvcl::GBuffer::knum_targets; ++i)
+    glUniform1i(loc_deferred_u_gbuffer[i], 5 + i);
+  g_gbuffer.bind(GL_TEXTURE5);
+
+  glDisable(GL_DEPTH_TEST);
+
+  glBindBuffer(GL_ARRAY_BUFFER, g_quad_buffer);
+  glEnableVertexAttribArray(loc_deferred_a_position);
+  glVertexAttribPointer(loc_deferred_a_position, 2, GL_FLOAT, GL_FALSE, 0, (void*)0);
+  glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+  glDisableVertexAttribArray(loc_deferred_a_position);
+
+  glEnable(GL_DEPTH_TEST);
   glUseProgram(0);
+
+  g_timers.end("lighting");
 }
 
-int main(int argc, char* argv[])
+// meshes of the scene graph with their view depth, sorted later by sort_draw_list()
+void build_draw_list()
 {
-  if (argc < 2)
+  g_draw_list.clear();
+
+  if (g_synthetic_instances == 0)
+    collect_instances(mat_model);
+  else
+    build_synthetic_draw_list(g_synthetic_instances);
+
+  for (int i = 0; i < g_draw_list.size(); ++i)
   {
-    std::cerr << "neeed model filepath!" << std::endl;
-    std::cerr << "usage: ./viewer [model_filepath]" << std::endl;
-    return -1;
+    DrawItem& item = g_draw_list[i];
+    const kmuvcl::Mesh& mesh = meshes[item.mesh_index];
+
+    // quantized positions are in [0,1]^3, the center of the mesh AABB is 0.5
+    aiVector3D center = mat_view*(item.mat_model*(mesh.mat_dequant*aiVector3D(0.5f, 0.5f, 0.5f)));
+    item.depth = -center.z;
   }
-  
-  GLFWwindow* window;
 
-  // Initialize GLFW library
-  if (!glfwInit())
-    return -1;
+}
 
-  // Create a GLFW window containing a OpenGL context
-  window = glfwCreateWindow(500, 500, "Assimp Viewer", NULL, NULL);
-  if (!window)
+// n copies of the scene meshes on a side^3 grid filling the scene bounds,
+// each scaled down to one grid cell (benchmark scene); every copy of the
+// whole scene has its own animation state
+void build_synthetic_draw_list(unsigned int n)
+{
+  const unsigned int num_instances = g_scene_mirror.instances().size();
+  if (num_instances == 0)
+    return;
+
+  aiVector3D bmin, bmax;
+  g_bvh.bounds(bmin, bmax);
+  const aiVector3D center = (bmin + bmax) * 0.5f;
+  const aiVector3D size = bmax - bmin;
+
+  unsigned int side = 1;
+  while (side*side*side < n)
+    ++side;
+
+  aiMatrix4x4 mat_scale, mat_center;
+  aiMatrix4x4::Scaling(aiVector3D(1.0f/side, 1.0f/side, 1.0f/side), mat_scale);
+  aiMatrix4x4::Translation(-center, mat_center);
+
+  g_draw_list.resize(n);
+  for (unsigned int k = 0; k < n; ++k)
   {
-    glfwTerminate();
-    return -1;
+    unsigned int x = k % side, y = (k / side) % side, z = k / (side*side);
+    aiVector3D cell((x + 0.5f)/side, (y + 0.5f)/side, (z + 0.5f)/side);
+    aiVector3D position(bmin.x + cell.x*size.x, bmin.y + cell.y*size.y, bmin.z + cell.z*size.z);
+
+    aiMatrix4x4 mat_position;
+    aiMatrix4x4::Translation(position, mat_position);
+
+    const unsigned int instance = k % num_instances, copy = k / num_instances;
+    g_draw_list[k].mesh_index = g_scene_mirror.instances()[instance].mesh_index;
+    g_draw_list[k].mat_model  = mat_model*mat_position*mat_scale*mat_center*instance_matrix(instance, copy);
+    set_skin(g_draw_list[k], instance, copy);
   }
+}
 
-  // Make the current OpenGL context as one in the window
-  glfwMakeContextCurrent(window);
+// draw list index of each occlusion item: skinned draws are neither tested nor occluders
+// (the culler only has their bind pose)
+std::vector<unsigned int> g_occlusion_draws;
 
-  // Initialize GLEW library
-  if (glewInit() != GLEW_OK)
+// starts the occlusion test of the draw list on the worker thread
+void begin_occlusion_culling()
+{
+  if (!g_occlusion_culling)
+    return;
+
+  std::vector<kmuvcl::OcclusionItem> items;
+  g_occlusion_draws.clear();
+  for (int i = 0; i < g_draw_list.size(); ++i)
   {
-    std::cout << "GLEW Init Error!" << std::endl;
+    if (g_draw_list[i].skin)
+      continue;
+
+    kmuvcl::OcclusionItem item;
+    item.mesh_index = g_draw_list[i].mesh_index;
+    item.mat_PVM = mat_proj*mat_view*g_draw_list[i].mat_model;
+    items.push_back(item);
+    g_occlusion_draws.push_back(i);
+  }
+  g_occlusion.begin(items);
+}
+
+// waits for the occlusion job and removes the hidden meshes from the draw list
+void end_occlusion_culling()
+{
+  if (!g_occlusion_culling)
+    return;
+
+  g_timers.begin("occlusion wait");
+  const std::vector<unsigned char>& visible = g_occlusion.wait();
+  g_timers.end("occlusion wait");
+
+  std::vector<unsigned char> keep(g_draw_list.size(), 1);
+  for (int i = 0; i < g_occlusion_draws.size(); ++i)
+    keep[g_occlusion_draws[i]] = visible[i];
+
+  unsigned int n = 0;
+  for (int i = 0; i < g_draw_list.size(); ++i)
+  {
+    if (keep[i])
+      g_draw_list[n++] = g_draw_list[i];
+  }
+  g_draw_list.resize(n);
+}
+
+// scene graph 의 메쉬 (node 순서대로), 애니메이션 포즈 적용
+void collect_instances(const aiMatrix4x4& mat_model)
+{
+  const std::vector<kmuvcl::MeshInstance>& instances = g_scene_mirror.instances();
+  for (int i = 0; i < instances.size(); ++i)
+  {
+    DrawItem item;
+    item.mesh_index = instances[i].mesh_index;
+    item.mat_model  = mat_model*instance_matrix(i, 0);
+    set_skin(item, i, 0);
+    g_draw_list.push_back(item);
+  }
+}
+
+// node transform of a mesh instance in animated scene copy `copy` (the bind pose without clips)
+aiMatrix4x4 instance_matrix(unsigned int instance, unsigned int copy)
+{
+  if (!g_animation.animated())
+    return g_scene_mirror.instances()[instance].mat_node;
+
+  const kmuvcl::AnimationState& state = g_animation.state(copy % g_animation.count());
+  return state.global[g_skeleton.instance_node(instance)];
+}
+
+void set_skin(DrawItem& item, unsigned int instance, unsigned int copy)
+{
+  if (!meshes[item.mesh_index].skinned || !g_skeleton.skinned(instance))
+    return;
+
+  const kmuvcl::Skin& skin = g_skeleton.skin(instance);
+  const kmuvcl::AnimationState& state = g_animation.state(copy % g_animation.count());
+  item.skin = &state.skin_matrices[skin.first_matrix];
+  item.num_bones = skin.bone_nodes.size();
+}
+
+// advances the clip of every animated scene copy (many copies: in parallel)
+void update_animation(float elapsed_seconds)
+{
+  if (!g_animation.animated() || !g_skeletal_animation)
+    return;
+
+  g_timers.begin("animation");
+  g_animation.update(elapsed_seconds);
+  g_timers.end("animation");
+
+  // the animated meshes moved: their shadows too
+  g_shadow_map.invalidate();
+}
+
+// per-draw data of the whole draw list in one pass over the frame's stream region,
+// already in column major order, followed by the skin palettes of the skinned draws
+void write_draw_data()
+{
+  size_t palette_texels = 0;
+  for (int i = 0; i < g_draw_list.size(); ++i)
+  {
+    if (g_draw_list[i].skin)
+      palette_texels += kmuvcl::skin_palette_texels(g_draw_list[i].num_bones);
+  }
+
+  float* dst = (float*)g_draw_stream.map(
+    (std::max<size_t>(1, g_draw_list.size()) * kdraw_texels + palette_texels) * kmuvcl::StreamBuffer::ktexel_size);
+  GLint offset = g_draw_stream.texel_offset();
+
+  GLint palette = offset + g_draw_list.size()*kdraw_texels;
+  float* palette_dst = dst + g_draw_list.size()*kdraw_texels*4;
+
+  const aiMatrix4x4 mat_PV = mat_proj*mat_view;
+  const aiMatrix4x4 mat_shadow = g_shadow_map.mat_texture();
+
+  for (int i = 0; i < g_draw_list.size(); ++i)
+  {
+    DrawItem& item = g_draw_list[i];
+    const kmuvcl::Mesh& mesh = meshes[item.mesh_index];
+
+    item.draw_offset = offset + i*kdraw_texels;
+
+    // dequantization of the positions is folded into PVM and M (skinned: into the palette)
+    const aiMatrix4x4 m = item.skin ? item.mat_model : item.mat_model*mesh.mat_dequant;
+    dst = kmuvcl::write_mat4(dst, mat_PV*m);
+    dst = kmuvcl::write_mat4(dst, m);
+    dst = kmuvcl::write_mat4(dst, mat_view*m);
+    dst = kmuvcl::write_mat4(dst, mat_shadow*m);
+
+    // N = (M^-1)^T
+    aiMatrix3x3 n = aiMatrix3x3(item.mat_model);
+    n.Inverse().Transpose();
+    dst = kmuvcl::write_mat3(dst, n);
+
+    for (int k = 0; k < 4; ++k)
+      *dst++ = mesh.texcoord_dequant[k];
+
+    *dst++ = item.skin ? (float)palette : -1.0f;
+    *dst++ = 0.0f;
+    *dst++ = 0.0f;
+    *dst++ = 0.0f;
+
+    if (item.skin)
+    {
+      palette_dst = kmuvcl::write_skin_palette(palette_dst, mesh.mat_dequant, item.skin, item.num_bones);
+      palette += kmuvcl::skin_palette_texels(item.num_bones);
+    }
+  }
+
+  g_draw_stream.unmap();
+}
+
+// sort keys of the draw list for the pass drawn with program
+void sort_draw_list(GLuint program)
+{
+  const float near = camera.mClipPlaneNear, far = camera.mClipPlaneFar;
+
+  for (int i = 0; i < g_draw_list.size(); ++i)
+  {
+    DrawItem& item = g_draw_list[i];
+    const kmuvcl::Mesh& mesh = meshes[item.mesh_index];
+
+    GLuint texture = (mesh.has_texture && program != depth_program.program) ? mesh.texture : 0;
+    // one vertex buffer set (the mesh pool) for every mesh: depth orders a group
+    item.key = kmuvcl::make_sort_key(program, texture, 0, 
+                                     (item.depth - near)/(far - near));
+  }
+
+  std::sort(g_draw_list.begin(), g_draw_list.end(), 
+    [](const DrawItem& a, const DrawItem& b) { return a.key < b.key; });
+}
+
+// the draw list with g_mesh_program, through the state cache
+void draw_list()
+{
+  sort_draw_list(g_mesh_program->program);
+
+  // the passes outside of the queue bind directly
+  g_state.invalidate();
+  g_state.use_program(g_mesh_program->program);
+
+  // per pass: uniforms that are the same for every mesh
+  const MeshProgram& p = *g_mesh_program;
+
+  glUniform1i(p.loc_u_draw_buffer, 9);
+  glActiveTexture(GL_TEXTURE9);
+  glBindTexture(GL_TEXTURE_BUFFER, g_draw_stream.texture());
+  glActiveTexture(GL_TEXTURE0);
+
+  glUniform1i(p.loc_u_diffuse_texture, 0);
+  glUniform4fv(p.loc_u_material_specular, 1, (float*)&material_specular);
+  glUniform1f(p.loc_u_material_shininess, material_shininess);
+
+  // every mesh is in the pool buffers: the pointers are set once per pass,
+  // the draws select the mesh with base vertex / first index
+  g_state.vertex_attrib_pointer(p.loc_a_position, g_mesh_pool.position_buffer(), 
+                                3, GL_UNSIGNED_SHORT, GL_TRUE, 4*sizeof(GLushort));
+  g_state.enable_vertex_attrib(p.loc_a_position);
+
+  g_state.vertex_attrib_pointer(p.loc_a_normal, g_mesh_pool.normal_buffer(), 
+                                2, g_mesh_pool.normal_type(), GL_TRUE, 0);
+  g_state.enable_vertex_attrib(p.loc_a_normal);
+
+  g_state.vertex_attrib_pointer(p.loc_a_texcoord, g_mesh_pool.texcoord_buffer(), 
+                                2, GL_UNSIGNED_SHORT, GL_TRUE, 0);
+
+  // bone indices and weights interleaved, zeros for meshes without bones
+  g_state.vertex_attrib_pointer(p.loc_a_bone_indices, g_mesh_pool.bone_buffer(),
+                                4, GL_UNSIGNED_BYTE, GL_FALSE, 8, 0);
+  g_state.enable_vertex_attrib(p.loc_a_bone_indices);
+  g_state.vertex_attrib_pointer(p.loc_a_bone_weights, g_mesh_pool.bone_buffer(),
+                                4, GL_UNSIGNED_BYTE, GL_TRUE, 8, 4);
+  g_state.enable_vertex_attrib(p.loc_a_bone_weights);
+
+  g_state.bind_buffer(GL_ELEMENT_ARRAY_BUFFER, g_mesh_pool.index_buffer());
+
+  if (g_multidraw && kmuvcl::multi_draw_indirect_supported())
+  {
+    draw_list_indirect();
+    return;
+  }
+
+  // one draw per item: u_draw_offset selects the data, the draw id stays 0
+  g_state.disable_vertex_attrib(p.loc_a_draw_id);
+  if (p.loc_a_draw_id >= 0)
+    glVertexAttrib1f(p.loc_a_draw_id, 0.0f);
+
+  for (int i = 0; i < g_draw_list.size(); ++i)
+  {
+    draw_mesh(g_draw_list[i]);
+  }
+
+  g_state.disable_vertex_attribs();
+}
+
+// the sorted draw list as one command buffer, one glMultiDrawElementsIndirect per texture.
+// u_draw_offset is the start of the frame's region, the draw id attribute (fed by
+// base_instance) selects the draw's data in it
+void draw_list_indirect()
+{
+  const MeshProgram& p = *g_mesh_program;
+  const GLint base = g_draw_stream.texel_offset();
+
+  glUniform1i(p.loc_u_draw_offset, base);
+
+  g_draw_ids.reserve(g_draw_list.size());
+  g_state.vertex_attrib_pointer(p.loc_a_draw_id, g_draw_ids.buffer(), 1, GL_FLOAT, GL_FALSE, 0);
+  g_state.enable_vertex_attrib(p.loc_a_draw_id);
+  if (p.loc_a_draw_id >= 0)
+    glVertexAttribDivisor(p.loc_a_draw_id, 1);
+
+  // culling writes the commands, a group ends where the texture changes (to or from 0 too)
+  std::vector<unsigned int> group_first;
+  std::vector<GLuint> group_texture;
+
+  g_commands.clear();
+  for (int i = 0; i < g_draw_list.size(); ++i)
+  {
+    const DrawItem& item = g_draw_list[i];
+    const kmuvcl::Mesh& mesh = meshes[item.mesh_index];
+
+    GLuint texture = (mesh.has_texture && p.program != depth_program.program) ? mesh.texture : 0;
+    if (group_texture.empty() || group_texture.back() != texture)
+    {
+      group_first.push_back(g_commands.size());
+      group_texture.push_back(texture);
+    }
+
+    GLuint draw_index = (item.draw_offset - base) / kdraw_texels;
+
+    // meshlet bounds and cones are of the bind pose
+    if (g_meshlet_culling && !item.skin)
+    {
+      kmuvcl::CullView view;
+      kmuvcl::make_cull_view(mat_proj*mat_view*item.mat_model, mat_view*item.mat_model, 
+                             mode() == kperspective, view);
+      kmuvcl::cull_meshlets(mesh.meshlets, view, true, g_draw_counts, g_draw_offsets, g_cull_stats);
+    }
+    else
+    {
+      g_cull_stats.meshlets += mesh.meshlets.size();
+      g_cull_stats.meshlets_visible += mesh.meshlets.size();
+      g_cull_stats.triangles += mesh.num_indices/3;
+      g_cull_stats.triangles_visible += mesh.num_indices/3;
+
+      g_draw_counts.assign(1, mesh.num_indices);
+      g_draw_offsets.assign(1, (const GLvoid*)0);
+    }
+
+    kmuvcl::append_commands(g_draw_counts, g_draw_offsets, mesh.first_index, mesh.base_vertex,
+                            draw_index, g_commands);
+  }
+
+  g_indirect_buffer.upload(g_commands);
+
+  for (int g = 0; g < group_first.size(); ++g)
+  {
+    unsigned int last = (g + 1 < group_first.size()) ? group_first[g + 1] : g_commands.size();
+
+    // untextured groups leave the unit as it is and read the constant texcoord
+    // of the disabled array, the same as the per-draw path
+    if (group_texture[g] != 0)
+    {
+      g_state.bind_texture(GL_TEXTURE0, group_texture[g]);
+      g_state.enable_vertex_attrib(p.loc_a_texcoord);
+    }
+    else
+    {
+      g_state.disable_vertex_attrib(p.loc_a_texcoord);
+    }
+
+    g_indirect_buffer.draw(group_first[g], last - group_first[g]);
+  }
+
+  g_indirect_buffer.unbind();
+
+  if (p.loc_a_draw_id >= 0)
+    glVertexAttribDivisor(p.loc_a_draw_id, 0);
+  g_state.disable_vertex_attribs();
+}
+
+void draw_mesh(const DrawItem& item)
+{
+  const kmuvcl::Mesh& mesh = meshes[item.mesh_index];
+  const MeshProgram& p = *g_mesh_program;
+
+  // matrices are in g_draw_stream already (write_draw_data())
+  glUniform1i(p.loc_u_draw_offset, item.draw_offset);
+
+  if (mesh.has_texture)
+  {
+    // Bind a texture w/ the following OpenGL texture functions
+    g_state.bind_texture(GL_TEXTURE0, mesh.texture);
+    g_state.enable_vertex_attrib(p.loc_a_texcoord);
+  }
+  else
+  {
+    g_state.disable_vertex_attrib(p.loc_a_texcoord);
+  }
+
+  draw_mesh_elements(mesh, item.mat_model, g_cull_stats, item.skin != NULL);
+}
+
+// index range of the mesh in the pool, only the meshlets that survive culling
+// (every meshlet of a skinned draw: the meshlet bounds and cones are of the bind pose)
+void draw_mesh_elements(const kmuvcl::Mesh& mesh, const aiMatrix4x4& mat_model, kmuvcl::CullStats& stats, bool skinned)
+{
+  if (g_meshlet_culling && !skinned)
+  {
+    kmuvcl::CullView view;
+    kmuvcl::make_cull_view(mat_proj*mat_view*mat_model, mat_view*mat_model, 
+                           mode() == kperspective, view);
+    kmuvcl::cull_meshlets(mesh.meshlets, view, true, g_draw_counts, g_draw_offsets, stats);
+
+    // meshlet offsets are relative to the mesh's first index
+    for (int i = 0; i < g_draw_offsets.size(); ++i)
+      g_draw_offsets[i] = (const char*)g_draw_offsets[i] + mesh.first_index*sizeof(GLuint);
+
+    if (!g_draw_counts.empty())
+    {
+      g_draw_base_vertices.assign(g_draw_counts.size(), mesh.base_vertex);
+      glMultiDrawElementsBaseVertex(GL_TRIANGLES, g_draw_counts.data(), GL_UNSIGNED_INT, 
+                                    (GLvoid* const*)g_draw_offsets.data(), g_draw_counts.size(), 
+                                    g_draw_base_vertices.data());
+    }
+  }
+  else
+  {
+    stats.meshlets += mesh.meshlets.size();
+    stats.meshlets_visible += mesh.meshlets.size();
+    stats.triangles += mesh.num_indices/3;
+    stats.triangles_visible += mesh.num_indices/3;
+
+    glDrawElementsBaseVertex(GL_TRIANGLES, mesh.num_indices, GL_UNSIGNED_INT, 
+                             (void*)(mesh.first_index*sizeof(GLuint)), mesh.base_vertex);
+  }
+}
+
+// light 0 follows the light globals, the extra lights are regenerated when their number changes
+void update_lights()
+{
+  if (g_lights.size() != 1 + g_num_extra_lights)
+  {
+    aiVector3D bmin, bmax;
+    g_bvh.bounds(bmin, bmax);
+
+    g_lights.resize(1);
+    kmuvcl::generate_lights(g_num_extra_lights, bmin, bmax, kextra_light_radius, g_lights);
+  }
+
+  kmuvcl::PointLight& l = g_lights[0];
+  l.position = light_position_wc;
+  l.radius   = 0.0f;
+  l.diffuse  = light_diffuse;
+  l.specular = light_specular;
+}
+
+// 광원들을 화면 클러스터 (froxel) 에 배정하고 GPU 로 업로드
+void update_clusters()
+{
+  g_timers.begin("cluster");
+
+  update_lights();
+  g_clusters.build(g_lights, mat_view, mat_proj, camera.mClipPlaneNear, camera.mClipPlaneFar);
+  g_cluster_buffers.upload(g_lights, g_clusters);
+
+  g_timers.end("cluster");
+}
+
+// native obj loader (1 thread, all cores) vs assimp with the --pp profile (no window)
+void run_obj_benchmark(const std::vector<std::string>& filepaths)
+{
+  const int kruns = 20;
+  const unsigned int threads = std::max(1u, std::thread::hardware_concurrency());
+
+  std::cout << "file\tbytes\t1 thread (ms)\t" << threads << " threads (ms)\tMB/s\tassimp (ms)\tspeedup" << std::endl;
+  for (int i = 0; i < filepaths.size(); ++i)
+  {
+    const std::string& filename = filepaths[i];
+    kmuvcl::ObjStats stats;
+    double native_ms[2] = { 0.0, 0.0 }, assimp_ms = 0.0;
+
+    for (int r = 0; r < kruns; ++r)
+    {
+      for (int t = 0; t < 2; ++t)
+      {
+        aiScene* s = kmuvcl::load_obj(filename, t == 0 ? 1 : threads, &stats);
+        if (!s)
+          return;
+        native_ms[t] += stats.total_ms;
+        delete s;
+      }
+
+      Assimp::Importer importer;
+      kmuvcl::ImportReport report;
+      if (!kmuvcl::import_asset(importer, filename, g_load_options, report))
+        return;
+      assimp_ms += report.total_ms;
+    }
+
+    native_ms[0] /= kruns;
+    native_ms[1] /= kruns;
+    assimp_ms /= kruns;
+    const double mb = stats.bytes / (1024.0*1024.0);
+
+    std::cout << filename << "\t" << stats.bytes << "\t" << native_ms[0] << "\t" << native_ms[1] << "\t" 
+              << mb/(native_ms[1]/1000.0) << "\t" << assimp_ms << "\t" << assimp_ms/native_ms[1] << "x" << std::endl;
+  }
+}
+
+// light binning cost for 1 .. 1024 lights, single thread vs all cores (no window)
+void run_cluster_benchmark()
+{
+  aiVector3D bmin, bmax;
+  g_bvh.bounds(bmin, bmax);
+
+  init_camera();
+  camera.GetCameraMatrix(mat_view);
+
+  const unsigned int kruns = 50;
+  const unsigned int threads = std::max(1u, std::thread::hardware_concurrency());
+
+  for (int m = 0; m < 2; ++m)
+  {
+    if (m == 0)
+      kmuvcl::ortho(-1, 1, -1, 1, mat_proj);
+    else
+      kmuvcl::perspective(mat_proj);
+
+    std::cout << (m == 0 ? "ortho" : "perspective") << std::endl;
+    std::cout << "lights\t1 thread (ms)\t" << threads << " threads (ms)\tavg/cluster\tmax/cluster\toverflow" << std::endl;
+
+    for (unsigned int n = 1; n <= 1024; n *= 2)
+    {
+      g_num_extra_lights = n - 1;
+      g_lights.clear();
+      update_lights();
+
+      double ms[2] = { 0.0, 0.0 };
+      for (int t = 0; t < 2; ++t)
+      {
+        for (unsigned int r = 0; r < kruns; ++r)
+        {
+          g_clusters.build(g_lights, mat_view, mat_proj, camera.mClipPlaneNear, camera.mClipPlaneFar,
+                           t == 0 ? 1 : threads);
+          ms[t] += g_clusters.stats().build_ms;
+        }
+      }
+
+      const kmuvcl::ClusterStats& s = g_clusters.stats();
+      std::cout << n << "\t" << ms[0]/kruns << "\t" << ms[1]/kruns << "\t" 
+                << s.average_lights() << "\t" << s.max_lights << "\t" << s.overflow << std::endl;
+    }
+  }
+}
+
+// pose evaluation of n animated scene copies per frame, single thread vs all cores (no window)
+void run_animation_benchmark(unsigned int n)
+{
+  const unsigned int kframes = 100;
+  const unsigned int threads = std::max(1u, std::thread::hardware_concurrency());
+
+  if (!g_animation.animated())
+  {
+    std::cout << "the scene has no animations" << std::endl;
+    return;
+  }
+
+  std::cout << "nodes: " << g_skeleton.num_nodes() << ", skinning matrices: " << g_skeleton.num_skin_matrices()
+            << ", clips: " << g_skeleton.num_clips() << ", copies: " << n << std::endl;
+
+  double ms[2] = { 0.0, 0.0 };
+  for (int t = 0; t < 2; ++t)
+  {
+    g_animation.init(&g_skeleton, n, 0.37);
+    for (unsigned int f = 0; f < kframes; ++f)
+    {
+      g_animation.update(1.0/60.0, t == 0 ? 1 : threads);
+      ms[t] += g_animation.update_ms();
+    }
+    ms[t] /= kframes;
+  }
+
+  std::cout << "1 thread:   " << ms[0] << " ms/frame (" << 1000.0*ms[0]/n << " us/copy)" << std::endl;
+  std::cout << threads << " threads: " << ms[1] << " ms/frame (" << 1000.0*ms[1]/n << " us/copy)" << std::endl;
+  std::cout << "speedup: " << ms[0]/ms[1] << "x" << std::endl;
+}
+
+// CPU cost of draw_scene() per mesh vs multi draw indirect on the synthetic scene
+void run_multidraw_benchmark(GLFWwindow* window)
+{
+  const unsigned int kwarmup = 10, kframes = 100;
+
+  if (!kmuvcl::multi_draw_indirect_supported())
+    std::cout << "multi draw indirect not supported, both runs draw per mesh" << std::endl;
+
+  g_timers.enabled = false;
+  std::cout << "objects: " << g_synthetic_instances << ", frames: " << kframes << std::endl;
+
+  double ms[2] = { 0.0, 0.0 };
+  for (int m = 0; m < 2; ++m)
+  {
+    g_multidraw = (m == 1);
+
+    for (unsigned int f = 0; f < kwarmup + kframes; ++f)
+    {
+      glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+      set_transform();
+      g_print_cull_stats = false;
+
+      std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+      draw_scene();
+      std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+
+      if (f >= kwarmup)
+        ms[m] += std::chrono::duration<double, std::milli>(end - start).count();
+
+      glfwSwapBuffers(window);
+      glfwPollEvents();
+    }
+    ms[m] /= kframes;
+  }
+
+  std::cout << "draw per mesh:       " << ms[0] << " ms/frame (CPU)" << std::endl;
+  std::cout << "multi draw indirect: " << ms[1] << " ms/frame (CPU)" << std::endl;
+  std::cout << "speedup: " << ms[0]/ms[1] << "x" << std::endl;
+}
+
+// 광원 위치에서 본 깊이 맵 생성 (light, model transform 이 바뀌었거나 애니메이션이 진행된 경우에만)
+void draw_shadow_map()
+{
+  if (!g_shadows || !g_shadow_map.needs_update(light_position_wc, mat_model))
+    return;
+
+  g_timers.begin("shadow");
+
+  // bounding sphere of the scene, scene space -> world space
+  aiVector3D bmin, bmax;
+  g_bvh.bounds(bmin, bmax);
+  aiVector3D center = mat_model * ((bmin + bmax) * 0.5f);
+  float radius = (bmax - bmin).Length() * 0.5f;
+
+  g_shadow_map.set_light(light_position_wc, mat_model, center, radius);
+  g_shadow_map.begin();
+
+  // per draw the light PVM and the palette offset, followed by the skin palettes
+  // of the skinned draws (same layout as in write_draw_data())
+  size_t palette_texels = 0;
+  for (int i = 0; i < g_draw_list.size(); ++i)
+  {
+    if (g_draw_list[i].skin)
+      palette_texels += kmuvcl::skin_palette_texels(g_draw_list[i].num_bones);
+  }
+
+  float* dst = (float*)g_shadow_stream.map(
+    (std::max<size_t>(1, g_draw_list.size()) * kshadow_draw_texels + palette_texels) * kmuvcl::StreamBuffer::ktexel_size);
+  GLint offset = g_shadow_stream.texel_offset();
+
+  GLint palette = offset + g_draw_list.size()*kshadow_draw_texels;
+  float* palette_dst = dst + g_draw_list.size()*kshadow_draw_texels*4;
+
+  const aiMatrix4x4 mat_PV = g_shadow_map.mat_PV();
+
+  for (int i = 0; i < g_draw_list.size(); ++i)
+  {
+    const DrawItem& item = g_draw_list[i];
+    const kmuvcl::Mesh& mesh = meshes[item.mesh_index];
+
+    // skinned: the dequantization is in the palette
+    const aiMatrix4x4 m = item.skin ? item.mat_model : item.mat_model*mesh.mat_dequant;
+    dst = kmuvcl::write_mat4(dst, mat_PV*m);
+
+    *dst++ = item.skin ? (float)palette : -1.0f;
+    *dst++ = 0.0f;
+    *dst++ = 0.0f;
+    *dst++ = 0.0f;
+
+    if (item.skin)
+    {
+      palette_dst = kmuvcl::write_skin_palette(palette_dst, mesh.mat_dequant, item.skin, item.num_bones);
+      palette += kmuvcl::skin_palette_texels(item.num_bones);
+    }
+  }
+
+  g_shadow_stream.unmap();
+
+  glUseProgram(shadow_program);
+
+  glUniform1i(loc_shadow_u_draw_buffer, 9);
+  glActiveTexture(GL_TEXTURE9);
+  glBindTexture(GL_TEXTURE_BUFFER, g_shadow_stream.texture());
+  glActiveTexture(GL_TEXTURE0);
+
+  glBindBuffer(GL_ARRAY_BUFFER, g_mesh_pool.position_buffer());
+  glVertexAttribPointer(loc_shadow_a_position, 3, GL_UNSIGNED_SHORT, GL_TRUE, 4*sizeof(GLushort), (void*)0);
+  glEnableVertexAttribArray(loc_shadow_a_position);
+
+  // bone indices and weights interleaved, zeros for meshes without bones
+  glBindBuffer(GL_ARRAY_BUFFER, g_mesh_pool.bone_buffer());
+  glVertexAttribPointer(loc_shadow_a_bone_indices, 4, GL_UNSIGNED_BYTE, GL_FALSE, 8, (void*)0);
+  glVertexAttribPointer(loc_shadow_a_bone_weights, 4, GL_UNSIGNED_BYTE, GL_TRUE, 8, (void*)4);
+  glEnableVertexAttribArray(loc_shadow_a_bone_indices);
+  glEnableVertexAttribArray(loc_shadow_a_bone_weights);
+
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, g_mesh_pool.index_buffer());
+
+  // the draw list before occlusion culling: the same meshes and placements as the
+  // camera passes (the grid of --instances), hidden ones still cast shadows
+  for (int i = 0; i < g_draw_list.size(); ++i)
+    draw_shadow_mesh(g_draw_list[i], offset + i*kshadow_draw_texels);
+
+  glDisableVertexAttribArray(loc_shadow_a_position);
+  glDisableVertexAttribArray(loc_shadow_a_bone_indices);
+  glDisableVertexAttribArray(loc_shadow_a_bone_weights);
+  glUseProgram(0);
+
+  // the draw data of this pass may be overwritten once the GPU passed here
+  g_shadow_stream.fence();
+
+  g_shadow_map.end();
+
+  g_timers.end("shadow");
+}
+
+// draw_offset: first texel of the draw's data in g_shadow_stream (draw_shadow_map())
+void draw_shadow_mesh(const DrawItem& item, GLint draw_offset)
+{
+  const kmuvcl::Mesh& mesh = meshes[item.mesh_index];
+
+  glUniform1i(loc_shadow_u_draw_offset, draw_offset);
+
+  // the camera frustum does not apply to the light view: draw every meshlet
+  glDrawElementsBaseVertex(GL_TRIANGLES, mesh.num_indices, GL_UNSIGNED_INT, 
+                           (void*)(mesh.first_index*sizeof(GLuint)), mesh.base_vertex);
+}
+
+// GL objects of the stream buffers, while the context still exists
+void release_streams()
+{
+  g_draw_stream.release();
+  g_shadow_stream.release();
+}
+
+int main(int argc, char* argv[])
+{
+  std::vector<std::string> filepaths;
+  bool quant_report = false;
+  bool cluster_bench = false;
+  bool mdi_bench = false;
+  bool obj_bench = false;
+  unsigned int anim_bench = 0;
+
+  for (int i = 1; i < argc; ++i)
+  {
+    std::string arg = argv[i];
+
+    if (arg == "--normal8")
+      g_normal_bits = kmuvcl::knormal8;
+    else if (arg == "--quant-report")
+      quant_report = true;
+    else if (arg == "--shadow-size" && i + 1 < argc)
+      g_shadow_size = std::atoi(argv[++i]);
+    else if (arg == "--lights" && i + 1 < argc)
+      g_num_extra_lights = std::max(1, std::atoi(argv[++i])) - 1;
+    else if (arg == "--cluster-bench")
+      cluster_bench = true;
+    else if (arg == "--deferred")
+      g_render_path = kdeferred;
+    else if (arg == "--depth-prepass")
+      g_depth_prepass = true;
+    else if (arg == "--multidraw")
+      g_multidraw = true;
+    else if (arg == "--instances" && i + 1 < argc)
+      g_synthetic_instances = std::max(0, std::atoi(argv[++i]));
+    else if (arg == "--assimp")
+      g_load_options.native_obj = false;
+    else if (arg == "--pp" && i + 1 < argc)
+    {
+      if (!g_load_options.set_profile(argv[++i]))
+      {
+        kmuvcl::print_post_process_steps(std::cerr);
+        return -1;
+      }
+    }
+    else if (arg == "--import-report")
+      g_load_options.report = true;
+    else if (arg == "--no-mmap")
+      g_load_options.mapped_io = false;
+    else if (arg == "--keep-scene")
+      g_keep_scene = true;
+    else if (arg == "--obj-bench")
+      obj_bench = true;
+    else if (arg == "--anim-bench")
+    {
+      anim_bench = 1000;
+      if (i + 1 < argc && std::atoi(argv[i + 1]) > 0)
+        anim_bench = std::atoi(argv[++i]);
+    }
+    else if (arg == "--mdi-bench")
+    {
+      mdi_bench = true;
+      g_synthetic_instances = 10000;
+      if (i + 1 < argc && std::atoi(argv[i + 1]) > 0)
+        g_synthetic_instances = std::atoi(argv[++i]);
+    }
+    else
+      filepaths.push_back(arg);
+  }
+
+  if (filepaths.empty())
+  {
+    std::cerr << "neeed model filepath!" << std::endl;
+    std::cerr << "usage: ./viewer [--normal8] [--shadow-size n] [--lights n] [--deferred] [--depth-prepass]" << std::endl;
+    std::cerr << "                [--multidraw] [--instances n]" << std::endl;
+    std::cerr << "                [--assimp] [--pp fast|balanced|quality|step,...] [--import-report]" << std::endl;
+    std::cerr << "                [--no-mmap] [--keep-scene] [model_filepath ... | scene.scene]" << std::endl;
+    std::cerr << "       ./viewer [--normal8] --quant-report [model_filepath ...]" << std::endl;
+    std::cerr << "       ./viewer --cluster-bench [model_filepath ...]" << std::endl;
+    std::cerr << "       ./viewer --mdi-bench [n] [model_filepath ...]" << std::endl;
+    std::cerr << "       ./viewer --obj-bench [model_filepath ...]" << std::endl;
+    std::cerr << "       ./viewer --anim-bench [n] [model_filepath ...]" << std::endl;
+    return -1;
+  }
+
+  // obj 로딩 속도 비교만 출력 (no window)
+  if (obj_bench)
+  {
+    run_obj_benchmark(filepaths);
+    return 0;
+  }
+
+  // 양자화 오차 및 메모리 비교만 출력 (no window)
+  if (quant_report)
+  {
+    for (int i = 0; i < filepaths.size(); ++i)
+    {
+      if (!load_asset(filepaths[i]))
+      {
+        std::cout << "Failed to load a asset file" << std::endl;
+        continue;
+      }
+      kmuvcl::print_quantization_report(scene, g_normal_bits);
+      release_asset();
+    }
+    return 0;
+  }
+
+  // 애니메이션 포즈 계산 성능 측정 (no window)
+  if (anim_bench > 0)
+  {
+    if (!load_assets(filepaths))
+    {
+      std::cout << "Failed to load a asset file" << std::endl;
+      return -1;
+    }
+    g_skeleton.build(scene, &scene_files);
+    g_animation.init(&g_skeleton, 1);
+    run_animation_benchmark(anim_bench);
+    release_asset();
+    return 0;
+  }
+
+  // 광원 클러스터링 성능 측정 (no window)
+  if (cluster_bench)
+  {
+    if (!load_assets(filepaths))
+    {
+      std::cout << "Failed to load a asset file" << std::endl;
+      return -1;
+    }
+    g_bvh.build(scene);
+    run_cluster_benchmark();
+    release_asset();
+    return 0;
+  }
+  
+  GLFWwindow* window;
+
+  // Initialize GLFW library
+  if (!glfwInit())
+    return -1;
+
+  // Create a GLFW window containing a OpenGL context
+  window = glfwCreateWindow(500, 500, "Assimp Viewer", NULL, NULL);
+  if (!window)
+  {
+    glfwTerminate();
+    return -1;
+  }
+
+  // Make the current OpenGL context as one in the window
+  glfwMakeContextCurrent(window);
+
+  // Initialize GLEW library
+  if (glewInit() != GLEW_OK)
+  {
+    std::cout << "GLEW Init Error!" << std::endl;
   }
 
   // Print out the OpenGL version supported by the graphics card in my PC
@@ -662,7 +2056,7 @@ int main(int argc, char* argv[])
   init();
   init_shader_program();
 
-  if (!load_asset(argv[1]))
+  if (!load_assets(filepaths))
   {
     std::cout << "Failed to load a asset file" << std::endl;
     return -1;
@@ -672,11 +2066,62 @@ int main(int argc, char* argv[])
 
   init_buffer_objects();
   init_texture_objects();
+
+  g_occlusion.init(scene);
+
+  g_bvh.build(scene);
+  std::cout << "bvh: " << g_bvh.num_triangles() << " triangles, " << g_bvh.num_nodes() 
+            << " nodes, built in " << g_bvh.build_time() << " ms" << std::endl;
+
+  // 업로드가 끝난 aiScene 해제: draw list 는 g_scene_mirror, picking 은 g_bvh 의 사본을 사용
+  g_scene_mirror.build(scene);
+  g_skeleton.build(scene, &scene_files);
+
+  // one animated copy of the scene, or one per copy of the synthetic scene
+  const unsigned int num_instances = std::max<size_t>(1, g_scene_mirror.instances().size());
+  g_animation.init(&g_skeleton, (g_synthetic_instances + num_instances - 1) / num_instances, 0.37);
+  if (g_animation.animated())
+  {
+    std::cout << "animation: " << g_skeleton.num_clips() << " clips, " << g_skeleton.num_nodes() << " nodes, " 
+              << g_skeleton.num_skin_matrices() << " skinning matrices, " << g_animation.count() << " copies"
+              << " (J: play/pause, U: next clip)" << std::endl;
+  }
+  kmuvcl::MemoryUsage loaded = kmuvcl::MemoryUsage::current();
+  if (!g_keep_scene)
+  {
+    release_asset();
+    kmuvcl::MemoryUsage::trim();
+  }
+  kmuvcl::MemoryUsage released = kmuvcl::MemoryUsage::current();
+  std::cout << "memory: " << loaded.rss_kb/1024 << " MB resident after upload (peak " << loaded.peak_kb/1024 
+            << " MB), " << released.rss_kb/1024 << " MB " << (g_keep_scene ? "with the scene kept" : "after releasing the scene")
+            << " (mirror " << g_scene_mirror.bytes()/1024 << " KB, skeleton " << g_skeleton.bytes()/1024 << " KB)" << std::endl;
+
+  if (!g_shadow_map.init(g_shadow_size))
+    g_shadows = false;
+
+  g_cluster_buffers.init();
+  g_draw_stream.init(kdraw_stream_draws * kdraw_texels * kmuvcl::StreamBuffer::ktexel_size);
+  g_shadow_stream.init(kdraw_stream_draws * kshadow_draw_texels * kmuvcl::StreamBuffer::ktexel_size);
+  g_indirect_buffer.init();
+  g_draw_ids.init();
+  g_gbuffer.init(500, 500);
+  std::cout << "shadow map: " << g_shadow_map.resolution() << "x" << g_shadow_map.resolution() << std::endl;
   
   glfwSetKeyCallback(window, key_callback);
+  glfwSetMouseButtonCallback(window, mouse_button_callback);
   
   glfwSetFramebufferSizeCallback(window, frambuffer_size_callback);
 
+  // 멀티 드로우 성능 측정 (draw per mesh vs multi draw indirect)
+  if (mdi_bench)
+  {
+    run_multidraw_benchmark(window);
+    release_streams();
+    glfwTerminate();
+    return 0;
+  }
+
   prev = curr = std::chrono::system_clock::now();
 
   // Loop until the user closes the window
@@ -685,13 +2130,17 @@ int main(int argc, char* argv[])
     glClearColor(0.5f, 0.5f, 0.5f, 1.0f);
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-    set_transform();
-    draw_scene();
-
     curr = std::chrono::system_clock::now();
     std::chrono::duration<float> elaped_seconds = (curr - prev);
     prev = curr;
 
+    update_animation(elaped_seconds.count());
+
+    set_transform();
+    draw_scene();
+
+    g_timers.end_frame();
+
     if (g_is_animation)
     {
       g_angle += 30.0f * elaped_seconds.count();
@@ -706,6 +2155,7 @@ int main(int argc, char* argv[])
     glfwPollEvents();
   }
 
+  release_streams();
   glfwTerminate();
   return 0;
 }
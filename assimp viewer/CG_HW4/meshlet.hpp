@@ -0,0 +1,360 @@
+#pragma once
+
+#include <vector>
+#include <cmath>
+#include <algorithm>
+
+#include <GL/glew.h>
+
+#include <assimp/scene.h>
+
+////////////////////////////////////////////////////////////////////////////////
+/// 메쉬렛 (meshlet / cluster) 생성 및 컬링
+///
+/// Each triangle mesh is split into meshlets of at most kmeshlet_max_vertices
+/// unique vertices and kmeshlet_max_triangles triangles. The index buffer of
+/// the mesh is reordered meshlet by meshlet, so a meshlet is a contiguous
+/// index range and the visible ones can be drawn with one glMultiDrawElements.
+////////////////////////////////////////////////////////////////////////////////
+namespace kmuvcl
+{
+  const unsigned int kmeshlet_max_vertices  = 64;
+  const unsigned int kmeshlet_max_triangles = 124;
+
+  struct Meshlet
+  {
+    GLuint      index_offset;     // first index in the mesh index buffer
+    GLuint      index_count;
+
+    aiVector3D  center;           // bounding sphere (object space)
+    float       radius;
+
+    aiVector3D  cone_axis;        // normal cone
+    float       cone_cutoff;      // sin(cone half angle), >= 1 if the cone is not usable
+  };
+
+  struct CullStats
+  {
+    unsigned int meshlets = 0;
+    unsigned int meshlets_visible = 0;
+    unsigned int triangles = 0;
+    unsigned int triangles_visible = 0;
+    unsigned int triangles_frustum_culled = 0;
+    unsigned int triangles_backface_culled = 0;
+
+    void reset() { *this = CullStats(); }
+
+    float culled_percentage() const
+    {
+      return triangles ? 100.0f * (float)(triangles - triangles_visible) / (float)triangles : 0.0f;
+    }
+  };
+
+  // object space view used for culling a single mesh instance
+  struct CullView
+  {
+    float       planes[6][4];     // left, right, bottom, top, near, far
+    aiVector3D  eye;              // camera position (perspective)
+    aiVector3D  forward;          // view direction (orthographic)
+    bool        perspective;
+  };
+
+  // bounding sphere and normal cone of a set of triangles
+  inline void compute_meshlet_bounds(const aiMesh* mesh, const std::vector<GLuint>& indices,
+                                     Meshlet& m)
+  {
+    const GLuint* idx = &indices[m.index_offset];
+    const unsigned int num_tris = m.index_count / 3;
+
+    // sphere: aabb center, then the farthest vertex
+    aiVector3D bmin( 1e30f,  1e30f,  1e30f);
+    aiVector3D bmax(-1e30f, -1e30f, -1e30f);
+    for (unsigned int i = 0; i < m.index_count; ++i)
+    {
+      const aiVector3D& p = mesh->mVertices[idx[i]];
+      bmin.x = std::min(bmin.x, p.x); bmax.x = std::max(bmax.x, p.x);
+      bmin.y = std::min(bmin.y, p.y); bmax.y = std::max(bmax.y, p.y);
+      bmin.z = std::min(bmin.z, p.z); bmax.z = std::max(bmax.z, p.z);
+    }
+    m.center = (bmin + bmax) * 0.5f;
+    m.radius = 0.0f;
+    for (unsigned int i = 0; i < m.index_count; ++i)
+      m.radius = std::max(m.radius, (mesh->mVertices[idx[i]] - m.center).Length());
+
+    // cone: average of the face normals, cutoff from the widest one
+    std::vector<aiVector3D> normals;
+    normals.reserve(num_tris);
+
+    aiVector3D axis(0.0f, 0.0f, 0.0f);
+    for (unsigned int t = 0; t < num_tris; ++t)
+    {
+      const aiVector3D& p0 = mesh->mVertices[idx[3*t + 0]];
+      const aiVector3D& p1 = mesh->mVertices[idx[3*t + 1]];
+      const aiVector3D& p2 = mesh->mVertices[idx[3*t + 2]];
+
+      aiVector3D n = (p1 - p0) ^ (p2 - p0);
+      float len = n.Length();
+      if (len == 0.0f)
+        continue;   // degenerate triangles are never rasterized
+
+      n /= len;
+      normals.push_back(n);
+      axis += n;
+    }
+
+    m.cone_axis   = aiVector3D(0.0f, 0.0f, 1.0f);
+    m.cone_cutoff = 1.0f;
+
+    float axis_len = axis.Length();
+    if (normals.empty() || axis_len < 1e-6f)
+      return;
+
+    axis /= axis_len;
+
+    float min_dp = 1.0f;
+    for (unsigned int i = 0; i < normals.size(); ++i)
+      min_dp = std::min(min_dp, normals[i] * axis);
+
+    m.cone_axis = axis;
+
+    // a cone wider than a hemisphere can never be entirely back facing
+    if (min_dp <= 0.0f)
+      return;
+
+    m.cone_cutoff = std::sqrt(1.0f - min_dp*min_dp);
+  }
+
+  // greedy meshlet build: grow the current meshlet with the adjacent triangle
+  // that adds the fewest new vertices, start a new one when a limit is hit.
+  inline void build_meshlets(const aiMesh* mesh,
+                             std::vector<GLuint>& indices,
+                             std::vector<Meshlet>& meshlets)
+  {
+    indices.clear();
+    meshlets.clear();
+
+    // triangle list
+    std::vector<GLuint> tris;
+    tris.reserve(mesh->mNumFaces * 3);
+    for (unsigned int i = 0; i < mesh->mNumFaces; ++i)
+    {
+      const aiFace& face = mesh->mFaces[i];
+      if (face.mNumIndices != 3)
+        continue;
+
+      tris.push_back(face.mIndices[0]);
+      tris.push_back(face.mIndices[1]);
+      tris.push_back(face.mIndices[2]);
+    }
+
+    const unsigned int num_tris = tris.size() / 3;
+    const unsigned int num_verts = mesh->mNumVertices;
+
+    // vertex -> triangle adjacency (CSR)
+    std::vector<unsigned int> adj_offset(num_verts + 1, 0);
+    for (unsigned int i = 0; i < tris.size(); ++i)
+      adj_offset[tris[i] + 1]++;
+    for (unsigned int v = 0; v < num_verts; ++v)
+      adj_offset[v + 1] += adj_offset[v];
+
+    std::vector<unsigned int> adj(tris.size());
+    std::vector<unsigned int> fill(adj_offset.begin(), adj_offset.end() - 1);
+    for (unsigned int t = 0; t < num_tris; ++t)
+      for (unsigned int k = 0; k < 3; ++k)
+        adj[fill[tris[3*t + k]]++] = t;
+
+    std::vector<bool>  emitted(num_tris, false);
+    std::vector<int>   local(num_verts, -1);     // vertex -> slot in the current meshlet
+    std::vector<GLuint> verts;                   // vertices of the current meshlet
+
+    unsigned int next_seed = 0;
+    unsigned int emitted_count = 0;
+
+    indices.reserve(tris.size());
+
+    while (emitted_count < num_tris)
+    {
+      Meshlet m;
+      m.index_offset = indices.size();
+      m.index_count  = 0;
+
+      verts.clear();
+
+      while (m.index_count/3 < kmeshlet_max_triangles)
+      {
+        // best adjacent candidate
+        int best = -1;
+        unsigned int best_new = 4;
+        for (unsigned int i = 0; i < verts.size() && best_new > 0; ++i)
+        {
+          GLuint v = verts[i];
+          for (unsigned int a = adj_offset[v]; a < adj_offset[v + 1]; ++a)
+          {
+            unsigned int t = adj[a];
+            if (emitted[t])
+              continue;
+
+            unsigned int added = 0;
+            for (unsigned int k = 0; k < 3; ++k)
+              added += (local[tris[3*t + k]] < 0) ? 1 : 0;
+
+            if (added < best_new)
+            {
+              best_new = added;
+              best = t;
+            }
+          }
+        }
+
+        // no neighbour: continue from the next unused triangle in index order
+        if (best < 0)
+        {
+          while (next_seed < num_tris && emitted[next_seed])
+            next_seed++;
+          if (next_seed == num_tris)
+            break;
+
+          best = next_seed;
+          best_new = 0;
+          for (unsigned int k = 0; k < 3; ++k)
+            best_new += (local[tris[3*best + k]] < 0) ? 1 : 0;
+        }
+
+        if (verts.size() + best_new > kmeshlet_max_vertices)
+          break;
+
+        for (unsigned int k = 0; k < 3; ++k)
+        {
+          GLuint v = tris[3*best + k];
+          if (local[v] < 0)
+          {
+            local[v] = verts.size();
+            verts.push_back(v);
+          }
+          indices.push_back(v);
+        }
+
+        emitted[best] = true;
+        emitted_count++;
+        m.index_count += 3;
+      }
+
+      for (unsigned int i = 0; i < verts.size(); ++i)
+        local[verts[i]] = -1;
+
+      compute_meshlet_bounds(mesh, indices, m);
+      meshlets.push_back(m);
+    }
+  }
+
+  // extract the object space frustum planes (Gribb & Hartmann) from P*V*M
+  // and the object space camera from (V*M)^-1.
+  inline void make_cull_view(const aiMatrix4x4& mat_PVM, const aiMatrix4x4& mat_VM,
+                             bool perspective, CullView& view)
+  {
+    const aiMatrix4x4& m = mat_PVM;
+    const float rows[4][4] = {
+      { m.a1, m.a2, m.a3, m.a4 },
+      { m.b1, m.b2, m.b3, m.b4 },
+      { m.c1, m.c2, m.c3, m.c4 },
+      { m.d1, m.d2, m.d3, m.d4 },
+    };
+
+    for (unsigned int i = 0; i < 3; ++i)
+    {
+      for (unsigned int k = 0; k < 4; ++k)
+      {
+        view.planes[2*i + 0][k] = rows[3][k] + rows[i][k];
+        view.planes[2*i + 1][k] = rows[3][k] - rows[i][k];
+      }
+    }
+
+    for (unsigned int p = 0; p < 6; ++p)
+    {
+      float len = std::sqrt(view.planes[p][0]*view.planes[p][0]
+                          + view.planes[p][1]*view.planes[p][1]
+                          + view.planes[p][2]*view.planes[p][2]);
+      if (len > 0.0f)
+        for (unsigned int k = 0; k < 4; ++k)
+          view.planes[p][k] /= len;
+    }
+
+    aiMatrix4x4 inv = mat_VM;
+    inv.Inverse();
+
+    view.eye     = aiVector3D(inv.a4, inv.b4, inv.c4);
+    view.forward = aiVector3D(-inv.a3, -inv.b3, -inv.c3).Normalize();
+    view.perspective = perspective;
+  }
+
+  inline bool sphere_outside_frustum(const CullView& view, const aiVector3D& c, float r)
+  {
+    for (unsigned int p = 0; p < 6; ++p)
+    {
+      const float* pl = view.planes[p];
+      if (pl[0]*c.x + pl[1]*c.y + pl[2]*c.z + pl[3] < -r)
+        return true;
+    }
+    return false;
+  }
+
+  inline bool cone_backfacing(const CullView& view, const Meshlet& m)
+  {
+    if (m.cone_cutoff >= 1.0f)
+      return false;
+
+    if (view.perspective)
+    {
+      aiVector3D d = m.center - view.eye;
+      return d * m.cone_axis >= m.cone_cutoff * d.Length() + m.radius;
+    }
+    return view.forward * m.cone_axis >= m.cone_cutoff;
+  }
+
+  // cull the meshlets of one mesh and append the visible index ranges,
+  // merging ranges that are adjacent in the index buffer.
+  inline void cull_meshlets(const std::vector<Meshlet>& meshlets, const CullView& view,
+                            bool backface_culling,
+                            std::vector<GLsizei>& counts, std::vector<const GLvoid*>& offsets,
+                            CullStats& stats)
+  {
+    counts.clear();
+    offsets.clear();
+
+    GLuint range_end = (GLuint)-1;
+
+    for (unsigned int i = 0; i < meshlets.size(); ++i)
+    {
+      const Meshlet& m = meshlets[i];
+      const unsigned int num_tris = m.index_count / 3;
+
+      stats.meshlets++;
+      stats.triangles += num_tris;
+
+      if (sphere_outside_frustum(view, m.center, m.radius))
+      {
+        stats.triangles_frustum_culled += num_tris;
+        continue;
+      }
+      if (backface_culling && cone_backfacing(view, m))
+      {
+        stats.triangles_backface_culled += num_tris;
+        continue;
+      }
+
+      stats.meshlets_visible++;
+      stats.triangles_visible += num_tris;
+
+      if (m.index_offset == range_end)
+      {
+        counts.back() += m.index_count;
+      }
+      else
+      {
+        counts.push_back(m.index_count);
+        offsets.push_back((const GLvoid*)(sizeof(GLuint) * m.index_offset));
+      }
+      range_end = m.index_offset + m.index_count;
+    }
+  }
+}
@@ -0,0 +1,415 @@
+#pragma once
+
+#include <vector>
+#include <map>
+#include <algorithm>
+
+#include <GL/glew.h>
+
+////////////////////////////////////////////////////////////////////////////////
+/// 메쉬 풀 (mesh pool)
+///
+/// Every mesh gets a vertex range and an index range out of five large
+/// buffers of fixed format:
+///
+///   positions  4 x GL_UNSIGNED_SHORT
+///   normals    2 x normal_type (GL_UNSIGNED_BYTE or GL_UNSIGNED_SHORT)
+///   texcoords  2 x GL_UNSIGNED_SHORT (zeros for meshes without texcoords)
+///   bones      4 x GL_UNSIGNED_BYTE bone indices, 4 x GL_UNSIGNED_BYTE unorm
+///              weights (zeros for meshes without bones)
+///   indices    GL_UNSIGNED_INT, local to the mesh
+///
+/// Indices stay mesh local and are drawn with base vertex
+/// (glDrawElementsBaseVertex), so a range can move without rewriting its
+/// indices. The ranges come from RangeAllocator free lists; when a list
+/// is full the buffers are doubled with glCopyBufferSubData. defragment()
+/// packs the live ranges to the front of fresh buffers.
+///
+/// Buffer names change on growth and defragmentation: query them per pass
+/// and refresh cached ranges with range().
+////////////////////////////////////////////////////////////////////////////////
+namespace kmuvcl
+{
+  // free list of [offset, offset + size) ranges, best fit, merged with the neighbours on free
+  class RangeAllocator
+  {
+  public:
+    static const GLuint kinvalid = ~0u;
+
+    void init(GLuint capacity)
+    {
+      by_offset_.clear();
+      by_size_.clear();
+      capacity_ = 0;
+      used_ = 0;
+      grow(capacity);
+    }
+
+    // offset of size free elements, kinvalid if no free range is large enough
+    GLuint allocate(GLuint size)
+    {
+      if (size == 0)
+        return 0;
+
+      std::multimap<GLuint, GLuint>::iterator it = by_size_.lower_bound(size);
+      if (it == by_size_.end())
+        return kinvalid;
+
+      GLuint free_size = it->first, offset = it->second;
+      by_size_.erase(it);
+      by_offset_.erase(offset);
+
+      // the rest of the range stays free
+      if (free_size > size)
+        insert(offset + size, free_size - size);
+
+      used_ += size;
+      return offset;
+    }
+
+    void free(GLuint offset, GLuint size)
+    {
+      if (size == 0)
+        return;
+
+      used_ -= size;
+
+      // merge with the free range after ...
+      std::map<GLuint, GLuint>::iterator next = by_offset_.find(offset + size);
+      if (next != by_offset_.end())
+      {
+        size += next->second;
+        erase(next);
+      }
+
+      // ... and before
+      std::map<GLuint, GLuint>::iterator prev = by_offset_.lower_bound(offset);
+      if (prev != by_offset_.begin())
+      {
+        --prev;
+        if (prev->first + prev->second == offset)
+        {
+          offset = prev->first;
+          size += prev->second;
+          erase(prev);
+        }
+      }
+
+      insert(offset, size);
+    }
+
+    // [capacity, new_capacity) becomes free
+    void grow(GLuint new_capacity)
+    {
+      if (new_capacity <= capacity_)
+        return;
+
+      GLuint old_capacity = capacity_;
+      capacity_ = new_capacity;
+
+      used_ += new_capacity - old_capacity;
+      free(old_capacity, new_capacity - old_capacity);
+    }
+
+    // no free range before the end
+    bool packed() const
+    {
+      return by_offset_.empty() 
+          || (by_offset_.size() == 1 && by_offset_.begin()->first + by_offset_.begin()->second == capacity_);
+    }
+
+    GLuint capacity() const         { return capacity_; }
+    GLuint used() const             { return used_; }
+    unsigned int num_free() const   { return by_offset_.size(); }
+    GLuint largest_free() const     { return by_size_.empty() ? 0 : by_size_.rbegin()->first; }
+
+  private:
+    void insert(GLuint offset, GLuint size)
+    {
+      by_offset_[offset] = size;
+      by_size_.insert(std::make_pair(size, offset));
+    }
+
+    void erase(std::map<GLuint, GLuint>::iterator it)
+    {
+      std::pair<std::multimap<GLuint, GLuint>::iterator, std::multimap<GLuint, GLuint>::iterator>
+        r = by_size_.equal_range(it->second);
+      for (std::multimap<GLuint, GLuint>::iterator s = r.first; s != r.second; ++s)
+      {
+        if (s->second == it->first)
+        {
+          by_size_.erase(s);
+          break;
+        }
+      }
+      by_offset_.erase(it);
+    }
+
+    std::map<GLuint, GLuint>       by_offset_;   // offset -> size
+    std::multimap<GLuint, GLuint>  by_size_;     // size -> offset
+    GLuint  capacity_ = 0;
+    GLuint  used_ = 0;
+  };
+
+  struct PoolRange
+  {
+    GLint   base_vertex = 0;
+    GLuint  first_index = 0;
+    GLuint  num_vertices = 0;
+    GLuint  num_indices = 0;
+    bool    live = false;
+  };
+
+  struct MeshPoolStats
+  {
+    GLuint        vertices = 0, vertex_capacity = 0;
+    GLuint        indices = 0, index_capacity = 0;
+    unsigned int  ranges = 0;
+    unsigned int  free_vertex_ranges = 0, free_index_ranges = 0;
+    unsigned int  grows = 0;
+  };
+
+  class MeshPool
+  {
+  public:
+    enum stream {kposition, knormal, ktexcoord, kbones, knum_vertex_streams};
+
+    void init(GLenum normal_type, GLuint vertex_capacity, GLuint index_capacity)
+    {
+      normal_type_ = normal_type;
+      vertex_size_[kposition] = 4*sizeof(GLushort);
+      vertex_size_[knormal]   = 2*((normal_type == GL_UNSIGNED_BYTE) ? sizeof(GLubyte) : sizeof(GLushort));
+      vertex_size_[ktexcoord] = 2*sizeof(GLushort);
+      vertex_size_[kbones]    = 8*sizeof(GLubyte);
+
+      vertex_capacity = std::max(1u, vertex_capacity);
+      index_capacity  = std::max(1u, index_capacity);
+
+      vertex_alloc_.init(vertex_capacity);
+      index_alloc_.init(index_capacity);
+
+      for (int s = 0; s < knum_vertex_streams; ++s)
+        vertex_buffers_[s] = create_buffer(vertex_capacity*vertex_size_[s]);
+      index_buffer_ = create_buffer(index_capacity*sizeof(GLuint));
+    }
+
+    // copies a mesh into the pool, texcoords and bones may be NULL; returns the handle of its range
+    unsigned int add(GLuint num_vertices, const GLushort* positions, const GLubyte* normals,
+                     const GLushort* texcoords, GLuint num_indices, const GLuint* indices,
+                     const GLubyte* bones = NULL)
+    {
+      PoolRange r;
+      r.num_vertices = num_vertices;
+      r.num_indices  = num_indices;
+      r.base_vertex  = allocate(vertex_alloc_, num_vertices, true);
+      r.first_index  = allocate(index_alloc_, num_indices, false);
+      r.live = true;
+
+      upload(vertex_buffers_[kposition], r.base_vertex*vertex_size_[kposition],
+             num_vertices*vertex_size_[kposition], positions);
+      upload(vertex_buffers_[knormal], r.base_vertex*vertex_size_[knormal],
+             num_vertices*vertex_size_[knormal], normals);
+
+      if (texcoords)
+      {
+        upload(vertex_buffers_[ktexcoord], r.base_vertex*vertex_size_[ktexcoord],
+               num_vertices*vertex_size_[ktexcoord], texcoords);
+      }
+      else
+      {
+        std::vector<GLushort> zeros(2*num_vertices, 0);
+        upload(vertex_buffers_[ktexcoord], r.base_vertex*vertex_size_[ktexcoord],
+               num_vertices*vertex_size_[ktexcoord], zeros.data());
+      }
+
+      if (bones)
+      {
+        upload(vertex_buffers_[kbones], r.base_vertex*vertex_size_[kbones],
+               num_vertices*vertex_size_[kbones], bones);
+      }
+      else
+      {
+        std::vector<GLubyte> zeros(8*num_vertices, 0);
+        upload(vertex_buffers_[kbones], r.base_vertex*vertex_size_[kbones],
+               num_vertices*vertex_size_[kbones], zeros.data());
+      }
+
+      upload(index_buffer_, r.first_index*sizeof(GLuint),
+             num_indices*sizeof(GLuint), indices);
+
+      ranges_.push_back(r);
+      return ranges_.size() - 1;
+    }
+
+    // the ranges become free, the handle is not reused
+    void remove(unsigned int handle)
+    {
+      PoolRange& r = ranges_[handle];
+      if (!r.live)
+        return;
+
+      vertex_alloc_.free(r.base_vertex, r.num_vertices);
+      index_alloc_.free(r.first_index, r.num_indices);
+      r.live = false;
+    }
+
+    // live ranges packed to the front of new buffers of the same capacity, in their current order;
+    // false if there was nothing to move
+    bool defragment()
+    {
+      if (vertex_alloc_.packed() && index_alloc_.packed())
+        return false;
+
+      std::vector<unsigned int> order;
+      for (unsigned int i = 0; i < ranges_.size(); ++i)
+        if (ranges_[i].live)
+          order.push_back(i);
+
+      GLuint vertex_capacity = vertex_alloc_.capacity(), index_capacity = index_alloc_.capacity();
+      vertex_alloc_.init(vertex_capacity);
+      index_alloc_.init(index_capacity);
+
+      // vertices and indices are packed independently (indices are mesh local)
+      std::sort(order.begin(), order.end(), [this](unsigned int a, unsigned int b)
+        { return ranges_[a].base_vertex < ranges_[b].base_vertex; });
+
+      for (int s = 0; s < knum_vertex_streams; ++s)
+      {
+        GLuint dst = create_buffer(vertex_capacity*vertex_size_[s]);
+        GLuint vertex = 0;
+        for (unsigned int i = 0; i < order.size(); ++i)
+        {
+          const PoolRange& r = ranges_[order[i]];
+          copy(vertex_buffers_[s], dst, r.base_vertex*vertex_size_[s], vertex*vertex_size_[s],
+               r.num_vertices*vertex_size_[s]);
+          vertex += r.num_vertices;
+        }
+        glDeleteBuffers(1, &vertex_buffers_[s]);
+        vertex_buffers_[s] = dst;
+      }
+      for (unsigned int i = 0; i < order.size(); ++i)
+      {
+        PoolRange& r = ranges_[order[i]];
+        r.base_vertex = vertex_alloc_.allocate(r.num_vertices);
+      }
+
+      std::sort(order.begin(), order.end(), [this](unsigned int a, unsigned int b)
+        { return ranges_[a].first_index < ranges_[b].first_index; });
+
+      GLuint dst = create_buffer(index_capacity*sizeof(GLuint));
+      for (unsigned int i = 0; i < order.size(); ++i)
+      {
+        PoolRange& r = ranges_[order[i]];
+        GLuint first_index = index_alloc_.allocate(r.num_indices);
+        copy(index_buffer_, dst, r.first_index*sizeof(GLuint), first_index*sizeof(GLuint),
+             r.num_indices*sizeof(GLuint));
+        r.first_index = first_index;
+      }
+      glDeleteBuffers(1, &index_buffer_);
+      index_buffer_ = dst;
+
+      return true;
+    }
+
+    const PoolRange& range(unsigned int handle) const { return ranges_[handle]; }
+
+    GLuint  position_buffer() const { return vertex_buffers_[kposition]; }
+    GLuint  normal_buffer() const   { return vertex_buffers_[knormal]; }
+    GLuint  texcoord_buffer() const { return vertex_buffers_[ktexcoord]; }
+    GLuint  bone_buffer() const     { return vertex_buffers_[kbones]; }
+    GLuint  index_buffer() const    { return index_buffer_; }
+    GLenum  normal_type() const     { return normal_type_; }
+
+    MeshPoolStats stats() const
+    {
+      MeshPoolStats s;
+      s.vertices = vertex_alloc_.used();
+      s.vertex_capacity = vertex_alloc_.capacity();
+      s.indices = index_alloc_.used();
+      s.index_capacity = index_alloc_.capacity();
+      for (unsigned int i = 0; i < ranges_.size(); ++i)
+        s.ranges += ranges_[i].live;
+      s.free_vertex_ranges = vertex_alloc_.num_free();
+      s.free_index_ranges = index_alloc_.num_free();
+      s.grows = grows_;
+      return s;
+    }
+
+  private:
+    // grows the buffers of the allocator until size fits
+    GLuint allocate(RangeAllocator& alloc, GLuint size, bool vertices)
+    {
+      GLuint offset = alloc.allocate(size);
+      while (offset == RangeAllocator::kinvalid)
+      {
+        GLuint old_capacity = alloc.capacity();
+        GLuint new_capacity = std::max(2*old_capacity, old_capacity + size);
+
+        if (vertices)
+        {
+          for (int s = 0; s < knum_vertex_streams; ++s)
+            vertex_buffers_[s] = resize(vertex_buffers_[s], old_capacity*vertex_size_[s], new_capacity*vertex_size_[s]);
+        }
+        else
+        {
+          index_buffer_ = resize(index_buffer_, old_capacity*sizeof(GLuint), new_capacity*sizeof(GLuint));
+        }
+
+        alloc.grow(new_capacity);
+        grows_++;
+        offset = alloc.allocate(size);
+      }
+      return offset;
+    }
+
+    // the copy targets leave the vertex and index bindings of the passes alone
+    static GLuint create_buffer(GLsizeiptr size)
+    {
+      GLuint buffer;
+      glGenBuffers(1, &buffer);
+      glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+      glBufferData(GL_COPY_WRITE_BUFFER, size, NULL, GL_STATIC_DRAW);
+      glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+      return buffer;
+    }
+
+    // new buffer of new_size with the old_size bytes of buffer, buffer is deleted
+    static GLuint resize(GLuint buffer, GLsizeiptr old_size, GLsizeiptr new_size)
+    {
+      GLuint dst = create_buffer(new_size);
+      copy(buffer, dst, 0, 0, old_size);
+      glDeleteBuffers(1, &buffer);
+      return dst;
+    }
+
+    static void copy(GLuint src, GLuint dst, GLintptr src_offset, GLintptr dst_offset, GLsizeiptr size)
+    {
+      if (size == 0)
+        return;
+      glBindBuffer(GL_COPY_READ_BUFFER, src);
+      glBindBuffer(GL_COPY_WRITE_BUFFER, dst);
+      glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, src_offset, dst_offset, size);
+      glBindBuffer(GL_COPY_READ_BUFFER, 0);
+      glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    }
+
+    static void upload(GLuint buffer, GLintptr offset, GLsizeiptr size, const GLvoid* data)
+    {
+      if (size == 0)
+        return;
+      glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+      glBufferSubData(GL_COPY_WRITE_BUFFER, offset, size, data);
+      glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    }
+
+    GLenum  normal_type_ = GL_UNSIGNED_SHORT;
+    GLsizeiptr vertex_size_[knum_vertex_streams];
+
+    GLuint  vertex_buffers_[knum_vertex_streams];
+    GLuint  index_buffer_ = 0;
+
+    RangeAllocator  vertex_alloc_, index_alloc_;
+    std::vector<PoolRange> ranges_;
+    unsigned int    grows_ = 0;
+  };
+}
@@ -0,0 +1,82 @@
+#pragma once
+
+#include <string>
+#include <cstring>
+#include <algorithm>
+
+#include <unistd.h>
+
+#include <assimp/IOStream.hpp>
+#include <assimp/IOSystem.hpp>
+
+#include "textparse.hpp"
+
+////////////////////////////////////////////////////////////////////////////////
+/// assimp 파일 입력을 mmap 으로 (MappedIOSystem)
+///
+/// Assimp::Importer reads every file (the model and what it refers to: .mtl,
+/// external buffers) through its IOSystem. This one maps the file read only
+/// with sequential/willneed read-ahead hints (MappedFile) and serves Read()
+/// from the mapping, instead of going through stdio buffers. Writing is not
+/// supported: Open() with a "w" mode fails.
+////////////////////////////////////////////////////////////////////////////////
+namespace kmuvcl
+{
+  class MappedIOStream : public Assimp::IOStream
+  {
+  public:
+    bool open(const std::string& filename) { return file_.open(filename); }
+
+    size_t Read(void* buffer, size_t size, size_t count)
+    {
+      if (size == 0)
+        return 0;
+      count = std::min(count, (file_.size() - position_) / size);
+      std::memcpy(buffer, file_.data() + position_, size*count);
+      position_ += size*count;
+      return count;
+    }
+
+    size_t Write(const void*, size_t, size_t) { return 0; }
+
+    aiReturn Seek(size_t offset, aiOrigin origin)
+    {
+      size_t base = (origin == aiOrigin_SET) ? 0 : (origin == aiOrigin_CUR) ? position_ : file_.size();
+      if (base + offset > file_.size())
+        return AI_FAILURE;
+      position_ = base + offset;
+      return AI_SUCCESS;
+    }
+
+    size_t Tell() const     { return position_; }
+    size_t FileSize() const { return file_.size(); }
+    void   Flush()          {}
+
+  private:
+    MappedFile  file_;
+    size_t      position_ = 0;
+  };
+
+  class MappedIOSystem : public Assimp::IOSystem
+  {
+  public:
+    bool Exists(const char* filename) const { return access(filename, R_OK) == 0; }
+    char getOsSeparator() const             { return '/'; }
+
+    Assimp::IOStream* Open(const char* filename, const char* mode = "rb")
+    {
+      if (std::strchr(mode, 'w') || std::strchr(mode, 'a'))
+        return NULL;
+
+      MappedIOStream* stream = new MappedIOStream();
+      if (!stream->open(filename))
+      {
+        delete stream;
+        return NULL;
+      }
+      return stream;
+    }
+
+    void Close(Assimp::IOStream* stream) { delete stream; }
+  };
+}
@@ -0,0 +1,121 @@
+#pragma once
+
+#include <vector>
+#include <algorithm>
+
+#include <GL/glew.h>
+
+////////////////////////////////////////////////////////////////////////////////
+/// 간접 멀티 드로우 (multi draw indirect)
+///
+/// The meshlet culling result of every draw in a pass is written as
+/// DrawElementsIndirectCommand records into one command buffer, and every run
+/// of draws sharing a texture is submitted with a single
+/// glMultiDrawElementsIndirect() call. All meshes live in shared vertex and
+/// index buffers, so a command addresses its mesh by first_index and
+/// base_vertex.
+///
+/// The shaders are GLSL 1.20 (no gl_DrawID): base_instance carries the draw
+/// index instead, read through an instanced vertex attribute (divisor 1) from
+/// DrawIdBuffer, which holds 0, 1, 2, ...
+////////////////////////////////////////////////////////////////////////////////
+namespace kmuvcl
+{
+  // layout defined by GL_DRAW_INDIRECT_BUFFER
+  struct DrawElementsIndirectCommand
+  {
+    GLuint  count;
+    GLuint  instance_count;
+    GLuint  first_index;
+    GLint   base_vertex;
+    GLuint  base_instance;
+  };
+
+  inline bool multi_draw_indirect_supported()
+  {
+    return GLEW_ARB_multi_draw_indirect || GLEW_VERSION_4_3;
+  }
+
+  // visible index ranges of cull_meshlets() (byte offsets into the mesh's indices) -> commands
+  inline void append_commands(const std::vector<GLsizei>& counts, const std::vector<const GLvoid*>& offsets,
+                              GLuint first_index, GLint base_vertex, GLuint draw_index,
+                              std::vector<DrawElementsIndirectCommand>& commands)
+  {
+    for (unsigned int i = 0; i < counts.size(); ++i)
+    {
+      DrawElementsIndirectCommand c;
+      c.count          = counts[i];
+      c.instance_count = 1;
+      c.first_index    = first_index + (GLuint)((size_t)offsets[i] / sizeof(GLuint));
+      c.base_vertex    = base_vertex;
+      c.base_instance  = draw_index;
+      commands.push_back(c);
+    }
+  }
+
+  class IndirectBuffer
+  {
+  public:
+    void init()
+    {
+      glGenBuffers(1, &buffer_);
+    }
+
+    // new store every upload, the driver orphans the one still in use
+    void upload(const std::vector<DrawElementsIndirectCommand>& commands)
+    {
+      glBindBuffer(GL_DRAW_INDIRECT_BUFFER, buffer_);
+      glBufferData(GL_DRAW_INDIRECT_BUFFER, sizeof(DrawElementsIndirectCommand) * commands.size(),
+                   commands.data(), GL_STREAM_DRAW);
+    }
+
+    // commands [first, first + count) of the last upload, buffer stays bound
+    void draw(GLsizei first, GLsizei count) const
+    {
+      if (count == 0)
+        return;
+      glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT,
+                                  (const GLvoid*)(sizeof(DrawElementsIndirectCommand) * first),
+                                  count, sizeof(DrawElementsIndirectCommand));
+    }
+
+    void unbind() const
+    {
+      glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+    }
+
+  private:
+    GLuint  buffer_ = 0;
+  };
+
+  // 0, 1, 2, ... as GL_FLOAT, grown on demand
+  class DrawIdBuffer
+  {
+  public:
+    void init()
+    {
+      glGenBuffers(1, &buffer_);
+    }
+
+    void reserve(unsigned int count)
+    {
+      if (count <= size_)
+        return;
+
+      size_ = std::max(count, 2*size_);
+      std::vector<GLfloat> ids(size_);
+      for (unsigned int i = 0; i < size_; ++i)
+        ids[i] = (GLfloat)i;
+
+      glBindBuffer(GL_ARRAY_BUFFER, buffer_);
+      glBufferData(GL_ARRAY_BUFFER, sizeof(GLfloat) * ids.size(), ids.data(), GL_STATIC_DRAW);
+      glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+
+    GLuint buffer() const { return buffer_; }
+
+  private:
+    GLuint        buffer_ = 0;
+    unsigned int  size_ = 0;
+  };
+}
@@ -0,0 +1,745 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <map>
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <thread>
+#include <atomic>
+#include <memory>
+#include <chrono>
+#include <algorithm>
+#include <cstring>
+#include <cstdint>
+
+#include <assimp/scene.h>
+
+#include "textparse.hpp"
+
+////////////////////////////////////////////////////////////////////////////////
+/// OBJ/MTL 로더 (assimp 대신 쓰는 빠른 경로)
+///
+/// load_obj() builds the same kind of aiScene the assimp importer does with
+/// the viewer's preset (triangles, one mesh per object and material, unique
+/// vertices, smooth normals where the file has none), so the rest of the
+/// viewer does not know which importer ran. The scene is allocated with new:
+/// release it with delete, not aiReleaseImport().
+///
+///  1. the mapped file is split into lines (find_line_starts()),
+///  2. threads count the v/vt/vn/o lines of their chunk of lines,
+///  3. with the prefix sums known, the chunks are parsed in parallel:
+///     attributes go straight into the shared arrays, faces into per chunk
+///     runs of (v, vt, vn) corners,
+///  4. per mesh, the corners are deduplicated in parallel through a
+///     lock free hash table (CornerTable); vertex order is the order of first
+///     use, so the result does not depend on the number of threads.
+////////////////////////////////////////////////////////////////////////////////
+namespace kmuvcl
+{
+  struct ObjStats
+  {
+    size_t        bytes = 0;
+    unsigned int  threads = 1;
+    size_t        corners = 0;      // face corners read (after triangulation)
+    size_t        vertices = 0;     // unique vertices in the scene
+    unsigned int  meshes = 0;
+    unsigned int  materials = 0;
+    double        parse_ms = 0.0;
+    double        build_ms = 0.0;   // deduplication, normals, aiScene
+    double        total_ms = 0.0;
+
+    double mb_per_s() const { return total_ms > 0.0 ? bytes / (1024.0*1024.0) / (total_ms / 1000.0) : 0.0; }
+  };
+
+  // 0 based indices of a face corner, -1 if the attribute is absent
+  struct ObjCorner
+  {
+    int v, vt, vn;
+  };
+
+  // concurrent set of corners: open addressing, keys claimed with compare-and-swap;
+  // each slot also keeps the smallest corner number that inserted its key
+  class CornerTable
+  {
+  public:
+    static const uint64_t kempty = ~0ull;
+    static const int      kbits = 21;         // per component
+    static const int      kmax_index = (1 << kbits) - 2;
+
+    static bool fits(int v, int vt, int vn)
+    {
+      return v <= kmax_index && vt <= kmax_index && vn <= kmax_index;
+    }
+
+    static uint64_t key(const ObjCorner& c)
+    {
+      return ((uint64_t)(c.v + 1) << (2*kbits)) | ((uint64_t)(c.vt + 1) << kbits) | (uint64_t)(c.vn + 1);
+    }
+
+    void init(size_t n)
+    {
+      capacity_ = 16;
+      while (capacity_ < 2*n)
+        capacity_ *= 2;
+
+      keys_.reset(new std::atomic<uint64_t>[capacity_]);
+      first_.reset(new std::atomic<uint32_t>[capacity_]);
+      for (size_t i = 0; i < capacity_; ++i)
+      {
+        keys_[i].store(kempty, std::memory_order_relaxed);
+        first_[i].store(~0u, std::memory_order_relaxed);
+      }
+    }
+
+    // slot of the key; corner becomes the slot's first corner if it is smaller
+    size_t insert(uint64_t k, uint32_t corner)
+    {
+      size_t h = hash(k) & (capacity_ - 1);
+      for (;;)
+      {
+        uint64_t current = keys_[h].load(std::memory_order_relaxed);
+        if (current == kempty)
+        {
+          if (keys_[h].compare_exchange_strong(current, k))
+            current = k;
+        }
+
+        if (current == k)
+        {
+          uint32_t first = first_[h].load(std::memory_order_relaxed);
+          while (corner < first && !first_[h].compare_exchange_weak(first, corner))
+            ;
+          return h;
+        }
+        h = (h + 1) & (capacity_ - 1);
+      }
+    }
+
+    uint32_t first(size_t slot) const { return first_[slot].load(std::memory_order_relaxed); }
+    size_t   capacity() const         { return capacity_; }
+
+  private:
+    static uint64_t hash(uint64_t k)
+    {
+      k ^= k >> 33;
+      k *= 0xff51afd7ed558ccdull;
+      k ^= k >> 33;
+      return k;
+    }
+
+    std::unique_ptr<std::atomic<uint64_t>[]> keys_;
+    std::unique_ptr<std::atomic<uint32_t>[]> first_;
+    size_t capacity_ = 0;
+  };
+
+  struct ObjMaterial
+  {
+    std::string name;
+    aiColor3D   ambient  = aiColor3D(0.0f, 0.0f, 0.0f);
+    aiColor3D   diffuse  = aiColor3D(0.6f, 0.6f, 0.6f);
+    aiColor3D   specular = aiColor3D(0.0f, 0.0f, 0.0f);
+    float       shininess = 0.0f;
+    float       opacity = 1.0f;
+    std::string diffuse_texture;
+  };
+
+  // rest of the line after the keyword, trimmed
+  inline std::string obj_line_argument(const char* p, const char* end)
+  {
+    while (p < end && (*p == ' ' || *p == '\t'))
+      ++p;
+    const char* e = p;
+    while (e < end && *e != '\n')
+      ++e;
+    while (e > p && text_is_space(e[-1]))
+      --e;
+    return std::string(p, e);
+  }
+
+  // the line at p starts with keyword followed by a space
+  inline bool obj_keyword(const char* p, const char* end, const char* keyword)
+  {
+    size_t n = std::strlen(keyword);
+    return (size_t)(end - p) > n && std::strncmp(p, keyword, n) == 0 && (p[n] == ' ' || p[n] == '\t');
+  }
+
+  inline bool load_mtl(const std::string& filename, std::vector<ObjMaterial>& materials)
+  {
+    MappedFile file;
+    if (!file.open(filename))
+    {
+      std::cerr << filename << ": cannot map the file" << std::endl;
+      return false;
+    }
+
+    const char* p = file.data();
+    const char* end = p + file.size();
+    while (p < end)
+    {
+      while (p < end && (*p == ' ' || *p == '\t'))
+        ++p;
+      const char* eol = (const char*)std::memchr(p, '\n', end - p);
+      if (!eol)
+        eol = end;
+
+      double r, g, b;
+      if (obj_keyword(p, eol, "newmtl"))
+      {
+        materials.push_back(ObjMaterial());
+        materials.back().name = obj_line_argument(p + 6, eol);
+      }
+      else if (!materials.empty())
+      {
+        ObjMaterial& m = materials.back();
+        const char* q = p + 2;
+
+        if ((obj_keyword(p, eol, "Ka") || obj_keyword(p, eol, "Kd") || obj_keyword(p, eol, "Ks"))
+            && parse_number(q, eol, r) && parse_number(q, eol, g) && parse_number(q, eol, b))
+        {
+          aiColor3D& c = (p[1] == 'a') ? m.ambient : (p[1] == 'd') ? m.diffuse : m.specular;
+          c = aiColor3D((float)r, (float)g, (float)b);
+        }
+        else if (obj_keyword(p, eol, "Ns") && parse_number(q, eol, r))
+        {
+          m.shininess = (float)r;
+        }
+        else if (obj_keyword(p, eol, "d") && (q = p + 1, parse_number(q, eol, r)))
+        {
+          m.opacity = (float)r;
+        }
+        else if (obj_keyword(p, eol, "map_Kd"))
+        {
+          // options (-bm 1 ...) come first, the file name is the last word
+          std::string arg = obj_line_argument(p + 6, eol);
+          size_t space = arg.find_last_of(" \t");
+          m.diffuse_texture = (space == std::string::npos) ? arg : arg.substr(space + 1);
+        }
+      }
+      p = eol + 1;
+    }
+    return true;
+  }
+
+  // what one chunk of lines holds
+  struct ObjChunk
+  {
+    size_t  positions = 0, texcoords = 0, normals = 0, objects = 0;
+    size_t  position_base = 0, texcoord_base = 0, normal_base = 0, object_base = 0;
+
+    // a run of faces with the same object and material; material "" with
+    // inherit = true continues the material of the previous chunk
+    struct Run
+    {
+      size_t      object;
+      std::string material;
+      bool        inherit;
+      std::vector<ObjCorner> corners;   // 3 per triangle
+    };
+    std::vector<Run> runs;
+
+    std::vector<std::string> object_names;    // in the order of the o/g lines
+    std::vector<std::string> mtllibs;
+    bool    ok = true;
+    size_t  bad_line = 0;
+  };
+
+  // "v", "v/vt", "v//vn", "v/vt/vn" at p; relative indices resolved with the counts so far
+  inline bool obj_parse_corner(const char*& p, const char* end, long nv, long nvt, long nvn, ObjCorner& c)
+  {
+    long v, vt = 0, vn = 0;
+    if (!parse_integer(p, end, v))
+      return false;
+    if (p < end && *p == '/')
+    {
+      ++p;
+      if (p < end && *p != '/' && !parse_integer(p, end, vt))
+        return false;
+      if (p < end && *p == '/')
+      {
+        ++p;
+        if (!parse_integer(p, end, vn))
+          return false;
+      }
+    }
+
+    c.v  = (int)(v  < 0 ? nv  + v  : v  - 1);
+    c.vt = (int)(vt < 0 ? nvt + vt : vt - 1);
+    c.vn = (int)(vn < 0 ? nvn + vn : vn - 1);
+    return c.v >= 0 && c.v < nv && c.vt < nvt && c.vn < nvn;
+  }
+
+  inline void obj_parse_chunk(const char* data, const char* end, const std::vector<size_t>& lines,
+                              size_t first, size_t last, ObjChunk& chunk,
+                              std::vector<aiVector3D>& positions, std::vector<aiVector3D>& texcoords,
+                              std::vector<aiVector3D>& normals)
+  {
+    size_t nv = chunk.position_base, nvt = chunk.texcoord_base, nvn = chunk.normal_base;
+    size_t object = chunk.object_base;
+
+    ObjChunk::Run* run = NULL;
+    std::vector<ObjCorner> polygon;
+
+    for (size_t l = first; l < last; ++l)
+    {
+      const char* p = data + lines[l];
+      const char* eol = (l + 1 < lines.size()) ? data + lines[l + 1] : end;
+      while (p < eol && (*p == ' ' || *p == '\t'))
+        ++p;
+      if (eol - p < 2)
+        continue;
+
+      double x, y, z;
+      if (p[0] == 'v' && (p[1] == ' ' || p[1] == '\t'))
+      {
+        const char* q = p + 1;
+        x = y = z = 0.0;
+        parse_number(q, eol, x) && parse_number(q, eol, y) && parse_number(q, eol, z);
+        positions[nv++] = aiVector3D((float)x, (float)y, (float)z);
+      }
+      else if (p[0] == 'v' && p[1] == 't')
+      {
+        const char* q = p + 2;
+        x = y = z = 0.0;
+        parse_number(q, eol, x) && parse_number(q, eol, y) && parse_number(q, eol, z);
+        texcoords[nvt++] = aiVector3D((float)x, (float)y, (float)z);
+      }
+      else if (p[0] == 'v' && p[1] == 'n')
+      {
+        const char* q = p + 2;
+        x = y = z = 0.0;
+        parse_number(q, eol, x) && parse_number(q, eol, y) && parse_number(q, eol, z);
+        normals[nvn++] = aiVector3D((float)x, (float)y, (float)z);
+      }
+      else if (p[0] == 'f' && (p[1] == ' ' || p[1] == '\t'))
+      {
+        const char* q = p + 1;
+        polygon.clear();
+
+        ObjCorner c;
+        for (;;)
+        {
+          while (q < eol && (*q == ' ' || *q == '\t'))
+            ++q;
+          if (q == eol || text_is_space(*q))
+            break;
+          if (!obj_parse_corner(q, eol, nv, nvt, nvn, c))
+          {
+            chunk.ok = false;
+            chunk.bad_line = l + 1;
+            return;
+          }
+          polygon.push_back(c);
+        }
+
+        if (polygon.size() < 3)
+          continue;
+
+        if (!run || run->object != object)
+        {
+          ObjChunk::Run r;
+          r.object = object;
+          r.inherit = run ? run->inherit : true;
+          r.material = run ? run->material : std::string();
+          chunk.runs.push_back(r);
+          run = &chunk.runs.back();
+        }
+
+        // fan
+        for (size_t k = 2; k < polygon.size(); ++k)
+        {
+          run->corners.push_back(polygon[0]);
+          run->corners.push_back(polygon[k - 1]);
+          run->corners.push_back(polygon[k]);
+        }
+      }
+      else if ((p[0] == 'o' || p[0] == 'g') && (p[1] == ' ' || p[1] == '\t'))
+      {
+        chunk.object_names.push_back(obj_line_argument(p + 1, eol));
+        object++;
+      }
+      else if (obj_keyword(p, eol, "usemtl"))
+      {
+        ObjChunk::Run r;
+        r.object = object;
+        r.material = obj_line_argument(p + 6, eol);
+        r.inherit = false;
+        chunk.runs.push_back(r);
+        run = &chunk.runs.back();
+      }
+      else if (obj_keyword(p, eol, "mtllib"))
+      {
+        chunk.mtllibs.push_back(obj_line_argument(p + 6, eol));
+      }
+    }
+  }
+
+  // unique (v, vt, vn) corners of one mesh -> aiMesh
+  inline aiMesh* obj_build_mesh(const std::vector<ObjCorner>& corners, const std::vector<aiVector3D>& positions,
+                                const std::vector<aiVector3D>& texcoords, const std::vector<aiVector3D>& normals,
+                                unsigned int threads)
+  {
+    const size_t n = corners.size();
+
+    bool has_texcoords = false, all_normals = true, fits = true;
+    for (size_t i = 0; i < n; ++i)
+    {
+      has_texcoords |= (corners[i].vt >= 0);
+      all_normals &= (corners[i].vn >= 0);
+      fits &= CornerTable::fits(corners[i].v, corners[i].vt, corners[i].vn);
+    }
+
+    // corner -> unique vertex, numbered in the order of first use
+    std::vector<uint32_t> vertex_of(n);
+    std::vector<uint32_t> first_corner;     // unique vertex -> its first corner
+
+    if (fits)
+    {
+      CornerTable table;
+      table.init(n);
+
+      std::vector<uint32_t> slot(n);
+      parallel_chunks(n, threads, 16384, [&](size_t first, size_t last, size_t)
+      {
+        for (size_t i = first; i < last; ++i)
+          slot[i] = (uint32_t)table.insert(CornerTable::key(corners[i]), (uint32_t)i);
+      });
+
+      std::vector<uint32_t> slot_vertex(table.capacity());
+      for (size_t i = 0; i < n; ++i)
+      {
+        if (table.first(slot[i]) == i)
+        {
+          slot_vertex[slot[i]] = first_corner.size();
+          first_corner.push_back(i);
+        }
+      }
+
+      parallel_chunks(n, threads, 16384, [&](size_t first, size_t last, size_t)
+      {
+        for (size_t i = first; i < last; ++i)
+          vertex_of[i] = slot_vertex[slot[i]];
+      });
+    }
+    else
+    {
+      // indices too large for the packed key
+      std::map<std::vector<int>, uint32_t> table;
+      for (size_t i = 0; i < n; ++i)
+      {
+        std::vector<int> k(3);
+        k[0] = corners[i].v; k[1] = corners[i].vt; k[2] = corners[i].vn;
+        std::map<std::vector<int>, uint32_t>::iterator it = table.find(k);
+        if (it == table.end())
+        {
+          it = table.insert(std::make_pair(k, (uint32_t)first_corner.size())).first;
+          first_corner.push_back(i);
+        }
+        vertex_of[i] = it->second;
+      }
+    }
+
+    const size_t num_vertices = first_corner.size();
+
+    aiMesh* mesh = new aiMesh();
+    mesh->mPrimitiveTypes = aiPrimitiveType_TRIANGLE;
+    mesh->mNumVertices = num_vertices;
+    mesh->mVertices = new aiVector3D[num_vertices];
+    mesh->mNormals = new aiVector3D[num_vertices];
+    if (has_texcoords)
+    {
+      mesh->mTextureCoords[0] = new aiVector3D[num_vertices];
+      mesh->mNumUVComponents[0] = 2;
+    }
+
+    parallel_chunks(num_vertices, threads, 16384, [&](size_t first, size_t last, size_t)
+    {
+      for (size_t i = first; i < last; ++i)
+      {
+        const ObjCorner& c = corners[first_corner[i]];
+        mesh->mVertices[i] = positions[c.v];
+        mesh->mNormals[i] = (c.vn >= 0) ? normals[c.vn] : aiVector3D(0.0f, 0.0f, 0.0f);
+        if (has_texcoords)
+          mesh->mTextureCoords[0][i] = (c.vt >= 0) ? texcoords[c.vt] : aiVector3D(0.0f, 0.0f, 0.0f);
+      }
+    });
+
+    mesh->mNumFaces = n/3;
+    mesh->mFaces = new aiFace[n/3];
+    for (size_t f = 0; f < n/3; ++f)
+    {
+      aiFace& face = mesh->mFaces[f];
+      face.mNumIndices = 3;
+      face.mIndices = new unsigned int[3];
+      face.mIndices[0] = vertex_of[3*f];
+      face.mIndices[1] = vertex_of[3*f + 1];
+      face.mIndices[2] = vertex_of[3*f + 2];
+    }
+
+    // smooth normals over the vertices that share a position (area weighted)
+    if (!all_normals)
+    {
+      std::map<int, aiVector3D> sums;
+      for (size_t f = 0; f < n/3; ++f)
+      {
+        const aiVector3D& a = positions[corners[3*f].v];
+        const aiVector3D& b = positions[corners[3*f + 1].v];
+        const aiVector3D& c = positions[corners[3*f + 2].v];
+        aiVector3D e1 = b - a, e2 = c - a;
+        aiVector3D fn(e1.y*e2.z - e1.z*e2.y, e1.z*e2.x - e1.x*e2.z, e1.x*e2.y - e1.y*e2.x);
+        for (int k = 0; k < 3; ++k)
+          sums[corners[3*f + k].v] += fn;
+      }
+
+      for (size_t i = 0; i < num_vertices; ++i)
+      {
+        const ObjCorner& c = corners[first_corner[i]];
+        if (c.vn >= 0)
+          continue;
+        aiVector3D s = sums[c.v];
+        mesh->mNormals[i] = (s.SquareLength() > 0.0f) ? s.Normalize() : aiVector3D(0.0f, 0.0f, 1.0f);
+      }
+    }
+
+    return mesh;
+  }
+
+  inline aiMaterial* obj_build_material(const ObjMaterial& m)
+  {
+    aiMaterial* material = new aiMaterial();
+
+    aiString name(m.name);
+    material->AddProperty(&name, AI_MATKEY_NAME);
+    material->AddProperty(&m.ambient, 1, AI_MATKEY_COLOR_AMBIENT);
+    material->AddProperty(&m.diffuse, 1, AI_MATKEY_COLOR_DIFFUSE);
+    material->AddProperty(&m.specular, 1, AI_MATKEY_COLOR_SPECULAR);
+    material->AddProperty(&m.shininess, 1, AI_MATKEY_SHININESS);
+    material->AddProperty(&m.opacity, 1, AI_MATKEY_OPACITY);
+
+    if (!m.diffuse_texture.empty())
+    {
+      aiString texture(m.diffuse_texture);
+      material->AddProperty(&texture, AI_MATKEY_TEXTURE_DIFFUSE(0));
+    }
+    return material;
+  }
+
+  // threads == 0: all cores; the reason of a failure is printed to std::cerr
+  inline aiScene* load_obj(const std::string& filename, unsigned int threads = 0, ObjStats* stats = NULL)
+  {
+    typedef std::chrono::steady_clock clock;
+    clock::time_point start = clock::now();
+
+    if (threads == 0)
+      threads = std::max(1u, std::thread::hardware_concurrency());
+
+    MappedFile file;
+    if (!file.open(filename))
+    {
+      std::cerr << filename << ": cannot map the file" << std::endl;
+      return NULL;
+    }
+
+    const char* data = file.data();
+    const char* end  = data + file.size();
+
+    std::vector<size_t> lines;
+    find_line_starts(data, end, lines);
+
+    const size_t knum_chunks = std::min<size_t>(threads, std::max<size_t>(1, lines.size() / 8192));
+    std::vector<ObjChunk> chunks(knum_chunks);
+
+    // pass 1: attribute and object counts per chunk
+    parallel_chunks(knum_chunks, knum_chunks, 1, [&](size_t first, size_t last, size_t)
+    {
+      for (size_t c = first; c < last; ++c)
+      {
+        ObjChunk& chunk = chunks[c];
+        for (size_t l = lines.size()*c/knum_chunks; l < lines.size()*(c + 1)/knum_chunks; ++l)
+        {
+          const char* p = data + lines[l];
+          const char* eol = (l + 1 < lines.size()) ? data + lines[l + 1] : end;
+          while (p < eol && (*p == ' ' || *p == '\t'))
+            ++p;
+          if (eol - p < 2)
+            continue;
+
+          if (p[0] == 'v')
+          {
+            chunk.positions += (p[1] == ' ' || p[1] == '\t');
+            chunk.texcoords += (p[1] == 't');
+            chunk.normals   += (p[1] == 'n');
+          }
+          else if ((p[0] == 'o' || p[0] == 'g') && (p[1] == ' ' || p[1] == '\t'))
+          {
+            chunk.objects++;
+          }
+        }
+      }
+    });
+
+    size_t nv = 0, nvt = 0, nvn = 0, no = 0;
+    for (size_t c = 0; c < knum_chunks; ++c)
+    {
+      chunks[c].position_base = nv;   nv  += chunks[c].positions;
+      chunks[c].texcoord_base = nvt;  nvt += chunks[c].texcoords;
+      chunks[c].normal_base   = nvn;  nvn += chunks[c].normals;
+      chunks[c].object_base   = no;   no  += chunks[c].objects;
+    }
+
+    std::vector<aiVector3D> positions(nv), texcoords(nvt), normals(nvn);
+
+    // pass 2: parse
+    parallel_chunks(knum_chunks, knum_chunks, 1, [&](size_t first, size_t last, size_t)
+    {
+      for (size_t c = first; c < last; ++c)
+        obj_parse_chunk(data, end, lines, lines.size()*c/knum_chunks, lines.size()*(c + 1)/knum_chunks,
+                        chunks[c], positions, texcoords, normals);
+    });
+
+    for (size_t c = 0; c < knum_chunks; ++c)
+    {
+      if (!chunks[c].ok)
+      {
+        std::cerr << filename << ":" << chunks[c].bad_line << ": bad face" << std::endl;
+        return NULL;
+      }
+    }
+
+    clock::time_point build_start = clock::now();
+
+    // materials of the mtllib files, next to the obj file
+    std::string basepath = filename.substr(0, filename.rfind('/') + 1);
+    std::vector<ObjMaterial> materials;
+    std::vector<std::string> object_names(1, "default");
+    for (size_t c = 0; c < knum_chunks; ++c)
+    {
+      for (unsigned int i = 0; i < chunks[c].mtllibs.size(); ++i)
+        load_mtl(basepath + chunks[c].mtllibs[i], materials);
+      object_names.insert(object_names.end(), chunks[c].object_names.begin(), chunks[c].object_names.end());
+    }
+
+    std::map<std::string, unsigned int> material_index;
+    for (unsigned int i = 0; i < materials.size(); ++i)
+      material_index[materials[i].name] = i;
+
+    // runs -> meshes, one per (object, material) in the order of first use
+    std::map<std::pair<size_t, unsigned int>, unsigned int> mesh_of;
+    std::vector<std::vector<ObjCorner> > mesh_corners;
+    std::vector<std::pair<size_t, unsigned int> > mesh_keys;
+    int default_material = -1;
+    std::string current_material;
+
+    for (size_t c = 0; c < knum_chunks; ++c)
+    {
+      for (unsigned int r = 0; r < chunks[c].runs.size(); ++r)
+      {
+        ObjChunk::Run& run = chunks[c].runs[r];
+        if (!run.inherit)
+          current_material = run.material;
+        if (run.corners.empty())
+          continue;
+
+        unsigned int m;
+        std::map<std::string, unsigned int>::iterator it = material_index.find(current_material);
+        if (it != material_index.end())
+        {
+          m = it->second;
+        }
+        else
+        {
+          if (default_material < 0)
+          {
+            default_material = materials.size();
+            materials.push_back(ObjMaterial());
+            materials.back().name = "DefaultMaterial";
+          }
+          m = default_material;
+        }
+
+        std::pair<size_t, unsigned int> k(run.object, m);
+        std::map<std::pair<size_t, unsigned int>, unsigned int>::iterator mi = mesh_of.find(k);
+        if (mi == mesh_of.end())
+        {
+          mi = mesh_of.insert(std::make_pair(k, (unsigned int)mesh_corners.size())).first;
+          mesh_corners.push_back(std::vector<ObjCorner>());
+          mesh_keys.push_back(k);
+        }
+
+        std::vector<ObjCorner>& dst = mesh_corners[mi->second];
+        if (dst.empty())
+          dst.swap(run.corners);
+        else
+          dst.insert(dst.end(), run.corners.begin(), run.corners.end());
+      }
+    }
+
+    aiScene* scene = new aiScene();
+
+    scene->mNumMaterials = materials.size();
+    scene->mMaterials = new aiMaterial*[std::max<size_t>(1, materials.size())];
+    for (unsigned int i = 0; i < materials.size(); ++i)
+      scene->mMaterials[i] = obj_build_material(materials[i]);
+
+    size_t num_corners = 0, num_vertices = 0;
+    scene->mNumMeshes = mesh_corners.size();
+    scene->mMeshes = new aiMesh*[std::max<size_t>(1, mesh_corners.size())];
+    for (unsigned int i = 0; i < mesh_corners.size(); ++i)
+    {
+      aiMesh* mesh = obj_build_mesh(mesh_corners[i], positions, texcoords, normals, threads);
+      mesh->mMaterialIndex = mesh_keys[i].second;
+      mesh->mName = aiString(object_names[mesh_keys[i].first]);
+      scene->mMeshes[i] = mesh;
+
+      num_corners += mesh_corners[i].size();
+      num_vertices += mesh->mNumVertices;
+    }
+
+    // root -> one node per object with its meshes
+    aiNode* root = new aiNode();
+    root->mName = aiString(filename.substr(basepath.size()));
+
+    std::vector<aiNode*> children;
+    for (unsigned int i = 0; i < mesh_keys.size(); )
+    {
+      unsigned int j = i;
+      while (j < mesh_keys.size() && mesh_keys[j].first == mesh_keys[i].first)
+        ++j;
+
+      aiNode* node = new aiNode();
+      node->mName = aiString(object_names[mesh_keys[i].first]);
+      node->mParent = root;
+      node->mNumMeshes = j - i;
+      node->mMeshes = new unsigned int[j - i];
+      for (unsigned int k = i; k < j; ++k)
+        node->mMeshes[k - i] = k;
+      children.push_back(node);
+      i = j;
+    }
+
+    root->mNumChildren = children.size();
+    if (!children.empty())
+    {
+      root->mChildren = new aiNode*[children.size()];
+      std::copy(children.begin(), children.end(), root->mChildren);
+    }
+    scene->mRootNode = root;
+
+    clock::time_point done = clock::now();
+
+    if (stats)
+    {
+      stats->bytes     = file.size();
+      stats->threads   = threads;
+      stats->corners   = num_corners;
+      stats->vertices  = num_vertices;
+      stats->meshes    = scene->mNumMeshes;
+      stats->materials = scene->mNumMaterials;
+      stats->parse_ms  = std::chrono::duration<double, std::milli>(build_start - start).count();
+      stats->build_ms  = std::chrono::duration<double, std::milli>(done - build_start).count();
+      stats->total_ms  = std::chrono::duration<double, std::milli>(done - start).count();
+    }
+    return scene;
+  }
+}
@@ -0,0 +1,475 @@
+#pragma once
+
+#include <vector>
+#include <cmath>
+#include <cfloat>
+#include <algorithm>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+
+#include <xmmintrin.h>
+
+#include <assimp/scene.h>
+
+#include "workerpool.hpp"
+
+////////////////////////////////////////////////////////////////////////////////
+/// 가려짐 컬링 (software hierarchical Z occlusion culling)
+///
+/// The meshes with the largest screen space bounds are rasterized as occluders
+/// into a small CPU depth buffer (4 pixels at once with SSE, bands of rows
+/// on the worker pool). A min/max depth pyramid is built on top of it, and
+/// the screen rectangle of every mesh's bounding box is tested against a
+/// single pyramid level of at most 2x2 texels. The whole job runs on a job
+/// thread that is started once and woken by begin(), so it overlaps with the
+/// shadow / cluster passes of the main thread and with the GPU work still in
+/// flight; wait() returns the result.
+///
+/// Depth is window depth in [0, 1] (near = 0). Occluder pixels are sampled at
+/// the pixel centers, triangles crossing the near plane are not rasterized and
+/// boxes crossing the near plane are always visible.
+////////////////////////////////////////////////////////////////////////////////
+namespace kmuvcl
+{
+  const int           kocclusion_width  = 256;
+  const int           kocclusion_height = 128;
+  const unsigned int  kmax_occluder_triangles = 65536;    // rasterized per frame
+
+  // one mesh instance, mat_PVM maps the aiMesh vertices to clip space
+  struct OcclusionItem
+  {
+    unsigned int  mesh_index;
+    aiMatrix4x4   mat_PVM;
+  };
+
+  struct OcclusionStats
+  {
+    unsigned int  occluders = 0;
+    unsigned int  occluder_triangles = 0;
+    unsigned int  tested = 0;
+    unsigned int  culled = 0;
+    double        raster_ms = 0.0;      // select + transform + rasterize + pyramid
+    double        test_ms = 0.0;
+  };
+
+  class OcclusionCuller
+  {
+  public:
+    ~OcclusionCuller()
+    {
+      {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_ = true;
+      }
+      wake_.notify_all();
+      if (job_.joinable())
+        job_.join();
+    }
+
+    // keeps a copy of the vertices and faces for the occluder rasterizer
+    void init(const aiScene* scene)
+    {
+      wait();
+      meshes_.resize(scene->mNumMeshes);
+      for (unsigned int m = 0; m < scene->mNumMeshes; ++m)
+      {
+        const aiMesh* mesh = scene->mMeshes[m];
+        Occluder& o = meshes_[m];
+
+        o.positions.assign(mesh->mVertices, mesh->mVertices + mesh->mNumVertices);
+        o.bmin = aiVector3D(FLT_MAX, FLT_MAX, FLT_MAX);
+        o.bmax = aiVector3D(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+        for (unsigned int v = 0; v < mesh->mNumVertices; ++v)
+        {
+          const aiVector3D& p = mesh->mVertices[v];
+          o.bmin = aiVector3D(std::min(o.bmin.x, p.x), std::min(o.bmin.y, p.y), std::min(o.bmin.z, p.z));
+          o.bmax = aiVector3D(std::max(o.bmax.x, p.x), std::max(o.bmax.y, p.y), std::max(o.bmax.z, p.z));
+        }
+        if (mesh->mNumVertices == 0)
+          o.bmin = o.bmax = aiVector3D(0.0f, 0.0f, 0.0f);
+
+        o.indices.clear();
+        for (unsigned int f = 0; f < mesh->mNumFaces; ++f)
+        {
+          const aiFace& face = mesh->mFaces[f];
+          if (face.mNumIndices != 3)
+            continue;
+          o.indices.insert(o.indices.end(), face.mIndices, face.mIndices + 3);
+        }
+      }
+
+      // pyramid levels, level 0 is the depth buffer itself
+      levels_.clear();
+      int w = kocclusion_width, h = kocclusion_height;
+      while (true)
+      {
+        Level level;
+        level.width = w;
+        level.height = h;
+        level.min_depth.resize(w*h);
+        level.max_depth.resize(w*h);
+        levels_.push_back(level);
+
+        if (w == 1 && h == 1)
+          break;
+        w = std::max(1, w/2);
+        h = std::max(1, h/2);
+      }
+    }
+
+    // starts the culling job for this frame's draw list
+    void begin(const std::vector<OcclusionItem>& items, unsigned int threads = 0)
+    {
+      wait();
+
+      // the job thread is idle until pending_ is set
+      items_ = items;
+      threads_ = (threads == 0) ? std::max(1u, std::thread::hardware_concurrency()) : threads;
+
+      {
+        std::lock_guard<std::mutex> lock(mutex_);
+        pending_ = true;
+        if (!job_.joinable())
+          job_ = std::thread([this]() { work(); });
+      }
+      wake_.notify_one();
+    }
+
+    // waits for the job, one flag per item of begin()
+    const std::vector<unsigned char>& wait()
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      done_.wait(lock, [this]() { return !pending_; });
+      return visible_;
+    }
+
+    const OcclusionStats& stats() const { return stats_; }
+
+    // level 0 depth, row 0 is the bottom of the screen
+    const std::vector<float>& depth() const { return levels_[0].min_depth; }
+
+  private:
+    struct Occluder
+    {
+      std::vector<aiVector3D>   positions;
+      std::vector<unsigned int> indices;
+      aiVector3D                bmin, bmax;
+    };
+
+    struct Level
+    {
+      int                 width, height;
+      std::vector<float>  min_depth;
+      std::vector<float>  max_depth;
+    };
+
+    // window space vertex, valid == false if it is not in front of the near plane
+    struct ScreenVertex
+    {
+      float x, y, z;
+      bool  valid;
+    };
+
+    struct ScreenRect
+    {
+      float x0, y0, x1, y1;     // pixels
+      float z0, z1;             // window depth range
+      bool  near_crossing;
+    };
+
+    // the job thread: one run() per begin()
+    void work()
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      while (true)
+      {
+        wake_.wait(lock, [this]() { return stop_ || pending_; });
+        if (stop_)
+          return;
+
+        lock.unlock();
+        run();
+        lock.lock();
+
+        pending_ = false;
+        done_.notify_all();
+      }
+    }
+
+    void run()
+    {
+      std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+      stats_ = OcclusionStats();
+      stats_.tested = items_.size();
+
+      // screen bounds of every item, the largest ones become the occluders
+      rects_.resize(items_.size());
+      std::vector<std::pair<float, unsigned int> > order;
+      for (unsigned int i = 0; i < items_.size(); ++i)
+      {
+        const Occluder& o = meshes_[items_[i].mesh_index];
+        rects_[i] = screen_rect(o.bmin, o.bmax, items_[i].mat_PVM);
+
+        const ScreenRect& r = rects_[i];
+        float area = r.near_crossing ? 0.0f
+                   : std::max(0.0f, std::min(r.x1, (float)kocclusion_width)  - std::max(r.x0, 0.0f))
+                   * std::max(0.0f, std::min(r.y1, (float)kocclusion_height) - std::max(r.y0, 0.0f));
+        if (area > 0.0f)
+          order.push_back(std::make_pair(-area, i));
+      }
+      std::sort(order.begin(), order.end());
+
+      // transform the occluders, within the triangle budget
+      vertices_.clear();
+      triangles_.clear();
+      unsigned int budget = kmax_occluder_triangles;
+      for (unsigned int k = 0; k < order.size(); ++k)
+      {
+        const OcclusionItem& item = items_[order[k].second];
+        const Occluder& o = meshes_[item.mesh_index];
+
+        unsigned int num_triangles = o.indices.size()/3;
+        if (num_triangles == 0 || num_triangles > budget)
+          continue;
+        budget -= num_triangles;
+
+        unsigned int base = vertices_.size();
+        for (unsigned int v = 0; v < o.positions.size(); ++v)
+          vertices_.push_back(to_screen(item.mat_PVM, o.positions[v]));
+        for (unsigned int t = 0; t < o.indices.size(); ++t)
+          triangles_.push_back(base + o.indices[t]);
+
+        stats_.occluders++;
+        stats_.occluder_triangles += num_triangles;
+      }
+
+      std::vector<float>& depth = levels_[0].min_depth;
+      std::fill(depth.begin(), depth.end(), 1.0f);
+
+      // rasterize, bands of at least 8 rows; waking the pool costs more than a few triangles
+      unsigned int bands = (stats_.occluder_triangles < 1024) ? 1 : threads_;
+      parallel_chunks(kocclusion_height, bands, 8, [this](size_t y0, size_t y1, size_t)
+      {
+        rasterize_rows((int)y0, (int)y1);
+      });
+
+      build_pyramid();
+
+      std::chrono::steady_clock::time_point mid = std::chrono::steady_clock::now();
+      stats_.raster_ms = std::chrono::duration<double, std::milli>(mid - start).count();
+
+      // test every item against the pyramid
+      visible_.resize(items_.size());
+      for (unsigned int i = 0; i < items_.size(); ++i)
+      {
+        visible_[i] = test(rects_[i]) ? 1 : 0;
+        if (!visible_[i])
+          stats_.culled++;
+      }
+
+      stats_.test_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - mid).count();
+    }
+
+    static ScreenVertex to_screen(const aiMatrix4x4& m, const aiVector3D& p)
+    {
+      float x = m.a1*p.x + m.a2*p.y + m.a3*p.z + m.a4;
+      float y = m.b1*p.x + m.b2*p.y + m.b3*p.z + m.b4;
+      float z = m.c1*p.x + m.c2*p.y + m.c3*p.z + m.c4;
+      float w = m.d1*p.x + m.d2*p.y + m.d3*p.z + m.d4;
+
+      ScreenVertex v;
+      v.valid = (w > 1e-6f && z >= -w);
+      if (!v.valid)
+      {
+        v.x = v.y = v.z = 0.0f;
+        return v;
+      }
+
+      float inv_w = 1.0f/w;
+      v.x = (x*inv_w*0.5f + 0.5f) * kocclusion_width;
+      v.y = (y*inv_w*0.5f + 0.5f) * kocclusion_height;
+      v.z = z*inv_w*0.5f + 0.5f;
+      return v;
+    }
+
+    static ScreenRect screen_rect(const aiVector3D& bmin, const aiVector3D& bmax, const aiMatrix4x4& m)
+    {
+      ScreenRect r;
+      r.x0 = r.y0 = r.z0 = FLT_MAX;
+      r.x1 = r.y1 = r.z1 = -FLT_MAX;
+      r.near_crossing = false;
+
+      for (int c = 0; c < 8; ++c)
+      {
+        aiVector3D p((c & 1) ? bmax.x : bmin.x, (c & 2) ? bmax.y : bmin.y, (c & 4) ? bmax.z : bmin.z);
+        ScreenVertex v = to_screen(m, p);
+        if (!v.valid)
+        {
+          r.near_crossing = true;
+          return r;
+        }
+        r.x0 = std::min(r.x0, v.x);  r.x1 = std::max(r.x1, v.x);
+        r.y0 = std::min(r.y0, v.y);  r.y1 = std::max(r.y1, v.y);
+        r.z0 = std::min(r.z0, v.z);  r.z1 = std::max(r.z1, v.z);
+      }
+      return r;
+    }
+
+    // front facing (counter clockwise) occluder triangles, rows [row0, row1)
+    void rasterize_rows(int row0, int row1)
+    {
+      float* depth = levels_[0].min_depth.data();
+      const __m128 zero = _mm_setzero_ps();
+      const __m128 offsets = _mm_set_ps(3.5f, 2.5f, 1.5f, 0.5f);
+
+      for (unsigned int t = 0; t + 2 < triangles_.size(); t += 3)
+      {
+        const ScreenVertex& v0 = vertices_[triangles_[t]];
+        const ScreenVertex& v1 = vertices_[triangles_[t + 1]];
+        const ScreenVertex& v2 = vertices_[triangles_[t + 2]];
+        if (!v0.valid || !v1.valid || !v2.valid)
+          continue;
+
+        float area = (v1.x - v0.x)*(v2.y - v0.y) - (v2.x - v0.x)*(v1.y - v0.y);
+        if (area <= 0.0f)
+          continue;       // back facing or degenerate
+
+        int x0 = std::max(0, (int)std::floor(std::min(v0.x, std::min(v1.x, v2.x))));
+        int x1 = std::min(kocclusion_width - 1, (int)std::ceil(std::max(v0.x, std::max(v1.x, v2.x))));
+        int y0 = std::max(row0, (int)std::floor(std::min(v0.y, std::min(v1.y, v2.y))));
+        int y1 = std::min(row1 - 1, (int)std::ceil(std::max(v0.y, std::max(v1.y, v2.y))));
+        if (x0 > x1 || y0 > y1)
+          continue;
+        x0 &= ~3;
+
+        // edge functions e(p) = a*px + b*py + c, e12 weights v0, e20 v1, e01 v2
+        float a12 = v1.y - v2.y, b12 = v2.x - v1.x, c12 = v1.x*v2.y - v1.y*v2.x;
+        float a20 = v2.y - v0.y, b20 = v0.x - v2.x, c20 = v2.x*v0.y - v2.y*v0.x;
+        float a01 = v0.y - v1.y, b01 = v1.x - v0.x, c01 = v0.x*v1.y - v0.y*v1.x;
+
+        float inv_area = 1.0f/area;
+        const __m128 z0 = _mm_set1_ps(v0.z*inv_area);
+        const __m128 z1 = _mm_set1_ps(v1.z*inv_area);
+        const __m128 z2 = _mm_set1_ps(v2.z*inv_area);
+
+        const __m128 step12 = _mm_set1_ps(4.0f*a12);
+        const __m128 step20 = _mm_set1_ps(4.0f*a20);
+        const __m128 step01 = _mm_set1_ps(4.0f*a01);
+
+        for (int y = y0; y <= y1; ++y)
+        {
+          float py = y + 0.5f;
+          __m128 px = _mm_add_ps(_mm_set1_ps((float)x0), offsets);
+
+          __m128 e12 = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(a12), px), _mm_set1_ps(b12*py + c12));
+          __m128 e20 = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(a20), px), _mm_set1_ps(b20*py + c20));
+          __m128 e01 = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(a01), px), _mm_set1_ps(b01*py + c01));
+
+          float* row = depth + y*kocclusion_width;
+          for (int x = x0; x <= x1; x += 4)
+          {
+            __m128 inside = _mm_and_ps(_mm_cmpge_ps(e12, zero),
+                            _mm_and_ps(_mm_cmpge_ps(e20, zero), _mm_cmpge_ps(e01, zero)));
+
+            if (_mm_movemask_ps(inside))
+            {
+              __m128 z = _mm_add_ps(_mm_add_ps(_mm_mul_ps(z0, e12), _mm_mul_ps(z1, e20)), _mm_mul_ps(z2, e01));
+              __m128 d = _mm_loadu_ps(row + x);
+              __m128 nearer = _mm_min_ps(d, z);
+              _mm_storeu_ps(row + x, _mm_or_ps(_mm_and_ps(inside, nearer), _mm_andnot_ps(inside, d)));
+            }
+
+            e12 = _mm_add_ps(e12, step12);
+            e20 = _mm_add_ps(e20, step20);
+            e01 = _mm_add_ps(e01, step01);
+          }
+        }
+      }
+    }
+
+    void build_pyramid()
+    {
+      Level& base = levels_[0];
+      base.max_depth = base.min_depth;
+
+      for (unsigned int l = 1; l < levels_.size(); ++l)
+      {
+        const Level& src = levels_[l - 1];
+        Level& dst = levels_[l];
+
+        for (int y = 0; y < dst.height; ++y)
+        {
+          int sy0 = std::min(2*y, src.height - 1), sy1 = std::min(2*y + 1, src.height - 1);
+          for (int x = 0; x < dst.width; ++x)
+          {
+            int sx0 = std::min(2*x, src.width - 1), sx1 = std::min(2*x + 1, src.width - 1);
+            int i00 = sy0*src.width + sx0, i01 = sy0*src.width + sx1;
+            int i10 = sy1*src.width + sx0, i11 = sy1*src.width + sx1;
+
+            dst.min_depth[y*dst.width + x] = std::min(std::min(src.min_depth[i00], src.min_depth[i01]),
+                                                      std::min(src.min_depth[i10], src.min_depth[i11]));
+            dst.max_depth[y*dst.width + x] = std::max(std::max(src.max_depth[i00], src.max_depth[i01]),
+                                                      std::max(src.max_depth[i10], src.max_depth[i11]));
+          }
+        }
+      }
+    }
+
+    // false if the box is behind the occluders everywhere in its screen rectangle
+    bool test(const ScreenRect& r) const
+    {
+      if (r.near_crossing)
+        return true;
+
+      // outside of the screen: left to the frustum culling
+      if (r.x1 < 0.0f || r.y1 < 0.0f || r.x0 >= kocclusion_width || r.y0 >= kocclusion_height)
+        return true;
+
+      int x0 = std::max(0, (int)r.x0), x1 = std::min(kocclusion_width - 1, (int)r.x1);
+      int y0 = std::max(0, (int)r.y0), y1 = std::min(kocclusion_height - 1, (int)r.y1);
+
+      // the coarsest level where the rectangle covers at most 2x2 texels
+      unsigned int l = 0;
+      while (l + 1 < levels_.size() && ((x1 >> l) - (x0 >> l) > 1 || (y1 >> l) - (y0 >> l) > 1))
+        l++;
+
+      const Level& level = levels_[l];
+      float max_depth = 0.0f, min_depth = 1.0f;
+      for (int y = std::min(y0 >> l, level.height - 1); y <= std::min(y1 >> l, level.height - 1); ++y)
+      {
+        for (int x = std::min(x0 >> l, level.width - 1); x <= std::min(x1 >> l, level.width - 1); ++x)
+        {
+          max_depth = std::max(max_depth, level.max_depth[y*level.width + x]);
+          min_depth = std::min(min_depth, level.min_depth[y*level.width + x]);
+        }
+      }
+
+      // entirely in front of every occluder
+      if (r.z1 < min_depth)
+        return true;
+
+      return r.z0 <= max_depth;
+    }
+
+    std::vector<Occluder>       meshes_;
+    std::vector<Level>          levels_;
+
+    std::vector<OcclusionItem>  items_;
+    std::vector<ScreenRect>     rects_;
+    std::vector<ScreenVertex>   vertices_;
+    std::vector<unsigned int>   triangles_;
+    std::vector<unsigned char>  visible_;
+
+    unsigned int    threads_ = 1;
+    std::thread     job_;
+    std::mutex      mutex_;
+    std::condition_variable wake_;
+    std::condition_variable done_;
+    bool            pending_ = false;   // guarded by mutex_
+    bool            stop_ = false;      // guarded by mutex_
+    OcclusionStats  stats_;
+  };
+}
@@ -0,0 +1,109 @@
+#include <string>
+#include <iostream>
+#include <cstdlib>
+#include <cmath>
+
+/* assimp include files. These three are usually needed. */
+#include <assimp/cimport.h>
+#include <assimp/scene.h>        
+#include <assimp/postprocess.h>
+
+#include "asset.hpp"
+#include "lighting.hpp"
+#include "projection.hpp"
+#include "bvh.hpp"
+
+#define STB_IMAGE_IMPLEMENTATION
+#include "./stb_image.h"
+#define STB_IMAGE_WRITE_IMPLEMENTATION
+#include "./stb_image_write.h"
+
+#include "pathtracer.hpp"
+
+////////////////////////////////////////////////////////////////////////////////
+/// viewer 와 같은 모델, 카메라, 조명으로 path tracing 한 기준 영상 생성
+////////////////////////////////////////////////////////////////////////////////
+int main(int argc, char* argv[])
+{
+  kmuvcl::PathTracerSettings settings;
+  bool perspective = false;       // the viewer starts in orthographic mode
+  std::vector<std::string> filepaths;
+
+  for (int i = 1; i < argc; ++i)
+  {
+    std::string arg = argv[i];
+    bool has_value = i + 1 < argc;
+
+    if (arg == "--perspective")
+      perspective = true;
+    else if (arg == "--width" && has_value)
+      settings.width = std::atoi(argv[++i]);
+    else if (arg == "--height" && has_value)
+      settings.height = std::atoi(argv[++i]);
+    else if (arg == "--spp" && has_value)
+      settings.samples_per_pass = std::atoi(argv[++i]);
+    else if (arg == "--passes" && has_value)
+      settings.passes = std::atoi(argv[++i]);
+    else if (arg == "--bounces" && has_value)
+      settings.bounces = std::atoi(argv[++i]);
+    else if (arg == "--tile" && has_value)
+      settings.tile_size = std::atoi(argv[++i]);
+    else if (arg == "--threads" && has_value)
+      settings.threads = std::atoi(argv[++i]);
+    else if (arg == "--assimp")
+      g_load_options.native_obj = false;
+    else if (arg == "--pp" && has_value)
+    {
+      if (!g_load_options.set_profile(argv[++i]))
+      {
+        kmuvcl::print_post_process_steps(std::cerr);
+        return -1;
+      }
+    }
+    else if (arg == "--import-report")
+      g_load_options.report = true;
+    else if (arg == "--no-mmap")
+      g_load_options.mapped_io = false;
+    else if (arg == "-o" && has_value)
+      settings.output = argv[++i];
+    else
+      filepaths.push_back(arg);
+  }
+
+  if (filepaths.empty())
+  {
+    std::cerr << "neeed model filepath!" << std::endl;
+    std::cerr << "usage: ./pathtrace [--perspective] [--width w] [--height h] [--spp n] [--passes n]" << std::endl;
+    std::cerr << "                   [--bounces n] [--tile n] [--threads n] [--assimp]" << std::endl;
+    std::cerr << "                   [--pp fast|balanced|quality|step,...] [--import-report] [--no-mmap]" << std::endl;
+    std::cerr << "                   [-o out.png] model_filepath ... | scene.scene" << std::endl;
+    return -1;
+  }
+
+  if (!load_assets(filepaths))
+  {
+    std::cout << "Failed to load a asset file" << std::endl;
+    return -1;
+  }
+
+  init_camera();
+
+  aiMatrix4x4 mat_view, mat_proj;
+  camera.GetCameraMatrix(mat_view);
+  if (perspective)
+    kmuvcl::perspective(mat_proj);
+  else
+    kmuvcl::ortho(-1, 1, -1, 1, mat_proj);
+
+  kmuvcl::BVH bvh;
+  bvh.build(scene);
+  std::cout << "bvh: " << bvh.num_triangles() << " triangles, " << bvh.num_nodes() 
+            << " nodes, built in " << bvh.build_time() << " ms" << std::endl;
+
+  kmuvcl::PathTracer tracer(scene, bvh, basepath);
+  tracer.set_camera(mat_proj*mat_view);
+  tracer.render(settings);
+
+  release_asset();
+  return 0;
+}
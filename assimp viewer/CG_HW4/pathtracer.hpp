@@ -0,0 +1,459 @@
+#pragma once
+
+#include <vector>
+#include <deque>
+#include <string>
+#include <iostream>
+#include <cmath>
+#include <cstdint>
+#include <algorithm>
+#include <mutex>
+#include <thread>
+#include <chrono>
+
+#include <assimp/scene.h>
+
+#include "bvh.hpp"
+#include "lighting.hpp"
+
+// stb_image.h and stb_image_write.h (with their implementations) are included by pathtrace.cpp
+
+////////////////////////////////////////////////////////////////////////////////
+/// CPU path tracer (reference renderer for the viewer)
+///
+///  - same scene, camera, light and Phong parameters as the rasterizer
+///  - direct light with shadow rays, optional diffuse (cosine weighted) bounces
+///  - image split into tiles, tiles scheduled on all cores by work stealing
+///  - progressive: every pass adds samples and rewrites the PNG
+////////////////////////////////////////////////////////////////////////////////
+namespace kmuvcl
+{
+  struct PathTracerSettings
+  {
+    unsigned int  width = 500;
+    unsigned int  height = 500;
+    unsigned int  samples_per_pass = 4;     // per pixel
+    unsigned int  passes = 16;
+    unsigned int  bounces = 0;              // 0: direct light only, like the viewer
+    unsigned int  tile_size = 16;
+    unsigned int  threads = 0;              // 0: hardware concurrency
+    std::string   output = "pathtrace.png";
+  };
+
+  // pcg32, one stream per pixel and pass so the image does not depend on scheduling
+  struct PCG32
+  {
+    uint64_t state;
+    uint64_t inc;
+
+    PCG32(uint64_t seed, uint64_t stream) : state(0), inc((stream << 1u) | 1u)
+    {
+      next();
+      state += seed;
+      next();
+    }
+
+    uint32_t next()
+    {
+      uint64_t old = state;
+      state = old * 6364136223846793005ULL + inc;
+      uint32_t xorshifted = (uint32_t)(((old >> 18u) ^ old) >> 27u);
+      uint32_t rot = (uint32_t)(old >> 59u);
+      return (xorshifted >> rot) | (xorshifted << ((-rot) & 31));
+    }
+
+    float uniform() { return (next() >> 8) * (1.0f / 16777216.0f); }   // [0, 1)
+  };
+
+  // tile indices of one worker; the owner pops from the front, thieves steal from the back
+  class TileQueue
+  {
+  public:
+    void push(unsigned int tile)
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      tiles_.push_back(tile);
+    }
+
+    bool pop(unsigned int& tile)
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (tiles_.empty())
+        return false;
+      tile = tiles_.front();
+      tiles_.pop_front();
+      return true;
+    }
+
+    bool steal(unsigned int& tile)
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (tiles_.empty())
+        return false;
+      tile = tiles_.back();
+      tiles_.pop_back();
+      return true;
+    }
+
+  private:
+    std::mutex                mutex_;
+    std::deque<unsigned int>  tiles_;
+  };
+
+  struct Texture
+  {
+    int                         width = 0;
+    int                         height = 0;
+    std::vector<unsigned char>  pixels;     // RGB, bottom row first (stbi flip, as in the viewer)
+  };
+
+  class PathTracer
+  {
+  public:
+    PathTracer(const aiScene* scene, const BVH& bvh, const std::string& basepath);
+
+    // mat_proj * mat_view of the viewer, rays are generated by unprojecting it
+    void set_camera(const aiMatrix4x4& mat_proj_view);
+    void set_background(const aiColor4D& color) { background_ = color; }
+
+    void render(const PathTracerSettings& settings);
+
+  private:
+    struct Material
+    {
+      aiColor4D     diffuse;
+      int           texture = -1;
+    };
+
+    void render_tile(unsigned int tile, unsigned int pass);
+    void worker(unsigned int id, unsigned int pass);
+    bool write_image(const std::string& filename, unsigned int num_samples) const;
+
+    aiColor4D trace(aiVector3D origin, aiVector3D dir, PCG32& rng) const;
+    aiColor4D sample_diffuse(const Material& material, float u, float v) const;
+
+    const aiScene*              scene_;
+    const BVH&                  bvh_;
+
+    std::vector<Material>       materials_;
+    std::vector<Texture>        textures_;
+    std::vector<aiMatrix3x3>    normal_matrices_;   // per BVH instance
+
+    aiMatrix4x4                 mat_inv_proj_view_;
+    aiColor4D                   background_ = aiColor4D(0.5f, 0.5f, 0.5f, 1.0f);
+
+    PathTracerSettings          settings_;
+    unsigned int                tiles_x_ = 0, tiles_y_ = 0;
+    std::vector<TileQueue>      queues_;
+    std::vector<float>          accum_;             // RGB sums
+  };
+
+  inline PathTracer::PathTracer(const aiScene* scene, const BVH& bvh, const std::string& basepath)
+    : scene_(scene), bvh_(bvh)
+  {
+    stbi_set_flip_vertically_on_load(true);
+
+    materials_.resize(scene->mNumMaterials);
+    for (unsigned int i = 0; i < scene->mNumMaterials; ++i)
+    {
+      const aiMaterial* material = scene->mMaterials[i];
+
+      aiColor3D diffuse(1.0f, 1.0f, 1.0f);
+      material->Get(AI_MATKEY_COLOR_DIFFUSE, diffuse);
+      materials_[i].diffuse = aiColor4D(diffuse.r, diffuse.g, diffuse.b, 1.0f);
+
+      aiString path;
+      if (material->GetTextureCount(aiTextureType_DIFFUSE) > 0 &&
+          material->GetTexture(aiTextureType_DIFFUSE, 0, &path) == AI_SUCCESS)
+      {
+        std::string filename = basepath + path.data;
+
+        Texture tex;
+        int channels;
+        unsigned char* image = stbi_load(filename.c_str(), &tex.width, &tex.height, &channels, STBI_rgb);
+        if (image == NULL)
+        {
+          std::cerr << "pathtrace: failed to load texture " << filename << std::endl;
+          continue;
+        }
+        tex.pixels.assign(image, image + 3*tex.width*tex.height);
+        stbi_image_free(image);
+
+        materials_[i].texture = textures_.size();
+        textures_.push_back(tex);
+      }
+    }
+  }
+
+  inline void PathTracer::set_camera(const aiMatrix4x4& mat_proj_view)
+  {
+    mat_inv_proj_view_ = mat_proj_view;
+    mat_inv_proj_view_.Inverse();
+  }
+
+  inline aiColor4D PathTracer::sample_diffuse(const Material& material, float u, float v) const
+  {
+    if (material.texture < 0)
+      return material.diffuse;
+
+    // GL_LINEAR, GL_CLAMP_TO_EDGE
+    const Texture& tex = textures_[material.texture];
+
+    float x = std::min(std::max(u, 0.0f), 1.0f) * tex.width  - 0.5f;
+    float y = std::min(std::max(v, 0.0f), 1.0f) * tex.height - 0.5f;
+    int x0 = (int)std::floor(x), y0 = (int)std::floor(y);
+    float fx = x - x0, fy = y - y0;
+
+    float c[3] = { 0.0f, 0.0f, 0.0f };
+    for (int j = 0; j < 2; ++j)
+    {
+      for (int i = 0; i < 2; ++i)
+      {
+        int px = std::min(std::max(x0 + i, 0), tex.width - 1);
+        int py = std::min(std::max(y0 + j, 0), tex.height - 1);
+        float w = (i ? fx : 1.0f - fx) * (j ? fy : 1.0f - fy);
+
+        const unsigned char* p = &tex.pixels[3*(py*tex.width + px)];
+        for (int k = 0; k < 3; ++k)
+          c[k] += w * p[k];
+      }
+    }
+    return aiColor4D(c[0]/255.0f, c[1]/255.0f, c[2]/255.0f, 1.0f);
+  }
+
+  inline aiColor4D PathTracer::trace(aiVector3D origin, aiVector3D dir, PCG32& rng) const
+  {
+    const float eps = 1e-4f;
+
+    aiColor4D radiance(0.0f, 0.0f, 0.0f, 1.0f);
+    aiColor4D throughput(1.0f, 1.0f, 1.0f, 1.0f);
+
+    for (unsigned int depth = 0; depth <= settings_.bounces; ++depth)
+    {
+      RayHit hit;
+      if (!bvh_.intersect(origin, dir, hit))
+      {
+        if (depth == 0)
+          radiance = background_;
+        break;
+      }
+
+      const aiMesh* mesh = scene_->mMeshes[hit.mesh_index];
+      const aiFace& face = mesh->mFaces[hit.face_index];
+      const Material& material = materials_[mesh->mMaterialIndex];
+
+      const float b0 = 1.0f - hit.u - hit.v;
+      const unsigned int i0 = face.mIndices[0], i1 = face.mIndices[1], i2 = face.mIndices[2];
+
+      aiVector3D position = origin + dir*hit.t;
+
+      // shading normal, in world space and facing the ray
+      aiVector3D normal;
+      if (mesh->HasNormals())
+      {
+        normal = mesh->mNormals[i0]*b0 + mesh->mNormals[i1]*hit.u + mesh->mNormals[i2]*hit.v;
+      }
+      else
+      {
+        normal = (mesh->mVertices[i1] - mesh->mVertices[i0]) ^ (mesh->mVertices[i2] - mesh->mVertices[i0]);
+      }
+      normal = (normal_matrices_[hit.instance_index] * normal).Normalize();
+      if (normal * dir > 0.0f)
+        normal = -normal;
+
+      aiColor4D material_diffuse = material.diffuse;
+      if (mesh->HasTextureCoords(0))
+      {
+        aiVector3D uv = mesh->mTextureCoords[0][i0]*b0 + mesh->mTextureCoords[0][i1]*hit.u
+                      + mesh->mTextureCoords[0][i2]*hit.v;
+        material_diffuse = sample_diffuse(material, uv.x, uv.y);
+      }
+
+      // ambient + shadowed diffuse/specular (calc_color() in the fragment shader)
+      aiColor4D c = material_ambient * light_ambient;
+
+      aiVector3D to_light = light_position_wc - position;
+      float light_dist = to_light.Length();
+      aiVector3D l = to_light / light_dist;
+
+      if (!bvh_.occluded(position + normal*eps, l, light_dist))
+      {
+        aiColor4D d = phong_direct(normal, l, -dir, material_diffuse);
+        c.r += d.r; c.g += d.g; c.b += d.b;
+      }
+
+      radiance.r += throughput.r * c.r;
+      radiance.g += throughput.g * c.g;
+      radiance.b += throughput.b * c.b;
+
+      if (depth == settings_.bounces)
+        break;
+
+      // cosine weighted hemisphere sample: pdf = cos/pi, lambert brdf = albedo/pi
+      throughput = throughput * material_diffuse;
+
+      float r1 = 2.0f * 3.14159265358979323846f * rng.uniform();
+      float r2 = rng.uniform();
+      float r2s = std::sqrt(r2);
+
+      aiVector3D w = normal;
+      aiVector3D a = (std::fabs(w.x) > 0.1f) ? aiVector3D(0.0f, 1.0f, 0.0f) : aiVector3D(1.0f, 0.0f, 0.0f);
+      aiVector3D u = (a ^ w).Normalize();
+      aiVector3D v = w ^ u;
+
+      dir = (u*(std::cos(r1)*r2s) + v*(std::sin(r1)*r2s) + w*std::sqrt(1.0f - r2)).Normalize();
+      origin = position + normal*eps;
+    }
+
+    return radiance;
+  }
+
+  inline void PathTracer::render_tile(unsigned int tile, unsigned int pass)
+  {
+    const unsigned int ts = settings_.tile_size;
+    const unsigned int x0 = (tile % tiles_x_) * ts;
+    const unsigned int y0 = (tile / tiles_x_) * ts;
+    const unsigned int x1 = std::min(x0 + ts, settings_.width);
+    const unsigned int y1 = std::min(y0 + ts, settings_.height);
+
+    const aiMatrix4x4& m = mat_inv_proj_view_;
+
+    for (unsigned int y = y0; y < y1; ++y)
+    {
+      for (unsigned int x = x0; x < x1; ++x)
+      {
+        const unsigned int pixel = y*settings_.width + x;
+        PCG32 rng(pass, pixel);
+
+        float sum[3] = { 0.0f, 0.0f, 0.0f };
+        for (unsigned int s = 0; s < settings_.samples_per_pass; ++s)
+        {
+          // jittered pixel position -> NDC (image row 0 is the top)
+          float ndc_x = 2.0f*(x + rng.uniform())/settings_.width - 1.0f;
+          float ndc_y = 1.0f - 2.0f*(y + rng.uniform())/settings_.height;
+
+          aiVector3D p[2];
+          for (int i = 0; i < 2; ++i)
+          {
+            float z = (i == 0) ? -1.0f : 1.0f;
+            float w = m.d1*ndc_x + m.d2*ndc_y + m.d3*z + m.d4;
+            p[i] = (m * aiVector3D(ndc_x, ndc_y, z)) / w;
+          }
+
+          aiVector3D dir = (p[1] - p[0]).Normalize();
+          aiColor4D c = trace(p[0], dir, rng);
+
+          sum[0] += c.r;
+          sum[1] += c.g;
+          sum[2] += c.b;
+        }
+
+        for (int k = 0; k < 3; ++k)
+          accum_[3*pixel + k] += sum[k];
+      }
+    }
+  }
+
+  inline void PathTracer::worker(unsigned int id, unsigned int pass)
+  {
+    const unsigned int n = queues_.size();
+    unsigned int tile;
+
+    while (true)
+    {
+      if (queues_[id].pop(tile))
+      {
+        render_tile(tile, pass);
+        continue;
+      }
+
+      // own queue is empty: steal from the others, starting with the next worker
+      bool stolen = false;
+      for (unsigned int k = 1; k < n && !stolen; ++k)
+        stolen = queues_[(id + k) % n].steal(tile);
+
+      if (!stolen)
+        break;
+
+      render_tile(tile, pass);
+    }
+  }
+
+  inline bool PathTracer::write_image(const std::string& filename, unsigned int num_samples) const
+  {
+    std::vector<unsigned char> image(3 * settings_.width * settings_.height);
+
+    // no tone mapping or gamma, the viewer writes the shader color as is
+    const float scale = 255.0f / num_samples;
+    for (unsigned int i = 0; i < image.size(); ++i)
+      image[i] = (unsigned char)std::min(std::max(accum_[i] * scale + 0.5f, 0.0f), 255.0f);
+
+    return stbi_write_png(filename.c_str(), settings_.width, settings_.height, 3,
+                          image.data(), 3 * settings_.width) != 0;
+  }
+
+  inline void PathTracer::render(const PathTracerSettings& settings)
+  {
+    settings_ = settings;
+    settings_.tile_size = std::max(1u, settings_.tile_size);
+
+    unsigned int num_threads = settings_.threads;
+    if (num_threads == 0)
+      num_threads = std::max(1u, std::thread::hardware_concurrency());
+
+    // normal matrix of every instance, (M^-1)^T
+    normal_matrices_.clear();
+    for (unsigned int i = 0; i < bvh_.num_instances(); ++i)
+    {
+      aiMatrix3x3 n(bvh_.instance_transform(i));
+      n.Inverse().Transpose();
+      normal_matrices_.push_back(n);
+    }
+
+    tiles_x_ = (settings_.width  + settings_.tile_size - 1) / settings_.tile_size;
+    tiles_y_ = (settings_.height + settings_.tile_size - 1) / settings_.tile_size;
+    const unsigned int num_tiles = tiles_x_ * tiles_y_;
+
+    accum_.assign(3 * settings_.width * settings_.height, 0.0f);
+    queues_ = std::vector<TileQueue>(num_threads);
+
+    std::cout << "pathtrace: " << settings_.width << "x" << settings_.height << ", "
+              << num_tiles << " tiles, " << num_threads << " threads, "
+              << settings_.bounces << " bounces" << std::endl;
+
+    double total_seconds = 0.0;
+    for (unsigned int pass = 0; pass < settings_.passes; ++pass)
+    {
+      std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+      // round robin so every worker starts with tiles spread over the image
+      for (unsigned int t = 0; t < num_tiles; ++t)
+        queues_[t % num_threads].push(t);
+
+      std::vector<std::thread> threads;
+      for (unsigned int i = 0; i < num_threads; ++i)
+        threads.push_back(std::thread(&PathTracer::worker, this, i, pass));
+      for (unsigned int i = 0; i < num_threads; ++i)
+        threads[i].join();
+
+      double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+      total_seconds += seconds;
+
+      const unsigned int num_samples = (pass + 1) * settings_.samples_per_pass;
+      const double samples = (double)settings_.width * settings_.height * settings_.samples_per_pass;
+
+      write_image(settings_.output, num_samples);
+
+      std::cout << "pass " << pass + 1 << "/" << settings_.passes << ": "
+                << num_samples << " spp, " << seconds*1000.0 << " ms, "
+                << samples / seconds / 1e6 << " Msamples/s ("
+                << samples / seconds / 1e6 / num_threads << " per thread)" << std::endl;
+    }
+
+    const double total_samples = (double)settings_.width * settings_.height
+                               * settings_.samples_per_pass * settings_.passes;
+    std::cout << "pathtrace: " << total_seconds << " s, "
+              << total_samples / total_seconds / 1e6 << " Msamples/s, wrote "
+              << settings_.output << std::endl;
+  }
+}
@@ -2,6 +2,16 @@
 
 aiCamera camera;
 
+void init_camera()
+{
+  camera.mPosition = aiVector3D(0.0f, 0.5f, 1.0f);
+
+  camera.mClipPlaneNear = 0.1f;
+  camera.mClipPlaneFar = 100.0f; 
+  camera.mHorizontalFOV = 3.14159265358979323846f/2.0f; // 90 degree
+  camera.mAspect = 1.0f;
+}
+
 namespace kmuvcl
 {
   float left;
@@ -0,0 +1,368 @@
+#pragma once
+
+#include <vector>
+#include <cmath>
+#include <algorithm>
+#include <iostream>
+
+#include <GL/glew.h>
+
+#include <assimp/scene.h>
+
+////////////////////////////////////////////////////////////////////////////////
+/// 정점 속성 양자화 (vertex attribute quantization)
+///
+///  position : 3 x unorm16 (+1 padding) relative to the mesh AABB.
+///             dequantization matrix is folded into u_PVM / u_M.
+///  normal   : octahedral encoding, 2 x unorm16 (or 2 x unorm8)
+///  texcoord : 2 x unorm16 relative to the mesh UV bounds (u_texcoord_dequant)
+///
+/// Only unsigned normalized integers are used, so that the decoded value is
+/// c / (2^b - 1) regardless of the GL version's snorm conversion rule.
+////////////////////////////////////////////////////////////////////////////////
+namespace kmuvcl
+{
+  enum normal_bits { knormal8 = 8, knormal16 = 16 };
+
+  struct QuantizedMesh
+  {
+    std::vector<GLushort> positions;    // 4 per vertex (x, y, z, pad)
+    std::vector<GLubyte>  normals;      // 2 per vertex, 1 or 2 bytes each
+    std::vector<GLushort> texcoords;    // 2 per vertex
+
+    normal_bits  nbits = knormal16;
+    bool         has_texcoords = false;
+
+    aiVector3D   aabb_min, aabb_max;
+    aiVector2D   uv_min, uv_max;
+
+    aiMatrix4x4  mat_dequant;           // quantized position -> object space
+    GLfloat      texcoord_dequant[4];   // (scale.u, scale.v, bias.u, bias.v)
+  };
+
+  struct QuantizationError
+  {
+    float max_position_error  = 0.0f;   // object space units
+    float position_bound      = 0.0f;
+    float max_normal_error    = 0.0f;   // degrees
+    float normal_bound        = 0.0f;
+    float max_texcoord_error  = 0.0f;   // uv units
+    float texcoord_bound      = 0.0f;
+
+    bool ok() const
+    {
+      return max_position_error <= position_bound
+          && max_normal_error   <= normal_bound
+          && max_texcoord_error <= texcoord_bound;
+    }
+  };
+
+  inline GLuint quantize_unorm(float v, unsigned int bits)
+  {
+    const float scale = (float)((1u << bits) - 1);
+    v = std::min(std::max(v, 0.0f), 1.0f);
+    return (GLuint)std::floor(v*scale + 0.5f);
+  }
+
+  inline float dequantize_unorm(GLuint c, unsigned int bits)
+  {
+    return (float)c / (float)((1u << bits) - 1);
+  }
+
+  // unit vector -> octahedron -> [-1,1]^2
+  inline aiVector2D oct_encode(const aiVector3D& n)
+  {
+    float l1 = std::fabs(n.x) + std::fabs(n.y) + std::fabs(n.z);
+    if (l1 == 0.0f)
+      return aiVector2D(0.0f, 0.0f);
+
+    float x = n.x / l1;
+    float y = n.y / l1;
+
+    if (n.z < 0.0f)
+    {
+      float ox = (1.0f - std::fabs(y)) * (x >= 0.0f ? 1.0f : -1.0f);
+      float oy = (1.0f - std::fabs(x)) * (y >= 0.0f ? 1.0f : -1.0f);
+      x = ox;
+      y = oy;
+    }
+    return aiVector2D(x, y);
+  }
+
+  // same as oct_decode() in shader/vertex.glsl
+  inline aiVector3D oct_decode(const aiVector2D& e)
+  {
+    aiVector3D n(e.x, e.y, 1.0f - std::fabs(e.x) - std::fabs(e.y));
+    if (n.z < 0.0f)
+    {
+      float ox = (1.0f - std::fabs(n.y)) * (n.x >= 0.0f ? 1.0f : -1.0f);
+      float oy = (1.0f - std::fabs(n.x)) * (n.y >= 0.0f ? 1.0f : -1.0f);
+      n.x = ox;
+      n.y = oy;
+    }
+    return n.Normalize();
+  }
+
+  // atan2 instead of acos: acos(dot) cannot resolve angles below ~0.02 degree in float
+  inline float angle_between(const aiVector3D& a, const aiVector3D& b)
+  {
+    return std::atan2((a ^ b).Length(), a * b) * 180.0f / 3.14159265358979323846f;
+  }
+
+  // encode with the closest of the four neighbouring grid points, which
+  // roughly halves the worst-case angular error compared to plain rounding.
+  inline void quantize_normal(const aiVector3D& n, unsigned int bits,
+                              GLuint& qx, GLuint& qy)
+  {
+    aiVector2D e = oct_encode(n);
+    float u = e.x*0.5f + 0.5f;
+    float v = e.y*0.5f + 0.5f;
+    float scale = (float)((1u << bits) - 1);
+
+    GLuint bx = (GLuint)std::floor(std::min(std::max(u, 0.0f), 1.0f) * scale);
+    GLuint by = (GLuint)std::floor(std::min(std::max(v, 0.0f), 1.0f) * scale);
+
+    float best = -2.0f;
+    for (GLuint dy = 0; dy < 2; ++dy)
+    {
+      for (GLuint dx = 0; dx < 2; ++dx)
+      {
+        GLuint cx = std::min(bx + dx, (GLuint)scale);
+        GLuint cy = std::min(by + dy, (GLuint)scale);
+        aiVector3D d = oct_decode(aiVector2D(dequantize_unorm(cx, bits)*2.0f - 1.0f,
+                                             dequantize_unorm(cy, bits)*2.0f - 1.0f));
+        float c = d * n;
+        if (c > best)
+        {
+          best = c;
+          qx = cx;
+          qy = cy;
+        }
+      }
+    }
+  }
+
+  inline aiVector3D decode_normal(const QuantizedMesh& q, unsigned int i)
+  {
+    GLuint cx, cy;
+    if (q.nbits == knormal8)
+    {
+      cx = q.normals[2*i + 0];
+      cy = q.normals[2*i + 1];
+    }
+    else
+    {
+      const GLushort* n16 = (const GLushort*)&q.normals[0];
+      cx = n16[2*i + 0];
+      cy = n16[2*i + 1];
+    }
+    return oct_decode(aiVector2D(dequantize_unorm(cx, q.nbits)*2.0f - 1.0f,
+                                 dequantize_unorm(cy, q.nbits)*2.0f - 1.0f));
+  }
+
+  inline void quantize_mesh(const aiMesh* mesh, QuantizedMesh& q,
+                            normal_bits nbits = knormal16)
+  {
+    const unsigned int n = mesh->mNumVertices;
+
+    q.nbits = nbits;
+
+    // position: AABB
+    q.aabb_min = aiVector3D( 1e30f,  1e30f,  1e30f);
+    q.aabb_max = aiVector3D(-1e30f, -1e30f, -1e30f);
+    for (unsigned int i = 0; i < n; ++i)
+    {
+      const aiVector3D& p = mesh->mVertices[i];
+      q.aabb_min.x = std::min(q.aabb_min.x, p.x);
+      q.aabb_min.y = std::min(q.aabb_min.y, p.y);
+      q.aabb_min.z = std::min(q.aabb_min.z, p.z);
+      q.aabb_max.x = std::max(q.aabb_max.x, p.x);
+      q.aabb_max.y = std::max(q.aabb_max.y, p.y);
+      q.aabb_max.z = std::max(q.aabb_max.z, p.z);
+    }
+    if (n == 0)
+      q.aabb_min = q.aabb_max = aiVector3D(0.0f, 0.0f, 0.0f);
+
+    aiVector3D extent = q.aabb_max - q.aabb_min;
+    for (unsigned int k = 0; k < 3; ++k)
+      if (extent[k] <= 0.0f)
+        extent[k] = 1.0f;
+
+    // p = aabb_min + extent * c/65535
+    aiMatrix4x4 mat_t, mat_s;
+    aiMatrix4x4::Translation(q.aabb_min, mat_t);
+    aiMatrix4x4::Scaling(extent, mat_s);
+    q.mat_dequant = mat_t * mat_s;
+
+    q.positions.resize(4*n);
+    for (unsigned int i = 0; i < n; ++i)
+    {
+      const aiVector3D& p = mesh->mVertices[i];
+      for (unsigned int k = 0; k < 3; ++k)
+        q.positions[4*i + k] = (GLushort)quantize_unorm((p[k] - q.aabb_min[k]) / extent[k], 16);
+      q.positions[4*i + 3] = 0;
+    }
+
+    // normal: octahedral
+    q.normals.resize(2*n*(nbits/8));
+    for (unsigned int i = 0; i < n; ++i)
+    {
+      aiVector3D nrm = (mesh->mNormals != NULL) ? mesh->mNormals[i] : aiVector3D(0.0f, 0.0f, 1.0f);
+      if (nrm.SquareLength() == 0.0f)
+        nrm = aiVector3D(0.0f, 0.0f, 1.0f);
+      nrm.Normalize();
+
+      GLuint qx = 0, qy = 0;
+      quantize_normal(nrm, nbits, qx, qy);
+
+      if (nbits == knormal8)
+      {
+        q.normals[2*i + 0] = (GLubyte)qx;
+        q.normals[2*i + 1] = (GLubyte)qy;
+      }
+      else
+      {
+        GLushort* n16 = (GLushort*)&q.normals[0];
+        n16[2*i + 0] = (GLushort)qx;
+        n16[2*i + 1] = (GLushort)qy;
+      }
+    }
+
+    // texcoord: uv bounds (texcoords may lie outside [0,1] for tiled textures)
+    q.has_texcoords = (mesh->mTextureCoords[0] != NULL);
+    q.uv_min = aiVector2D(0.0f, 0.0f);
+    q.uv_max = aiVector2D(1.0f, 1.0f);
+    q.texcoords.clear();
+
+    if (q.has_texcoords)
+    {
+      q.uv_min = aiVector2D( 1e30f,  1e30f);
+      q.uv_max = aiVector2D(-1e30f, -1e30f);
+      for (unsigned int i = 0; i < n; ++i)
+      {
+        const aiVector3D& t = mesh->mTextureCoords[0][i];
+        q.uv_min.x = std::min(q.uv_min.x, t.x);
+        q.uv_min.y = std::min(q.uv_min.y, t.y);
+        q.uv_max.x = std::max(q.uv_max.x, t.x);
+        q.uv_max.y = std::max(q.uv_max.y, t.y);
+      }
+      if (n == 0)
+      {
+        q.uv_min = aiVector2D(0.0f, 0.0f);
+        q.uv_max = aiVector2D(1.0f, 1.0f);
+      }
+    }
+
+    float su = std::max(q.uv_max.x - q.uv_min.x, 1e-6f);
+    float sv = std::max(q.uv_max.y - q.uv_min.y, 1e-6f);
+
+    q.texcoord_dequant[0] = su;
+    q.texcoord_dequant[1] = sv;
+    q.texcoord_dequant[2] = q.uv_min.x;
+    q.texcoord_dequant[3] = q.uv_min.y;
+
+    if (q.has_texcoords)
+    {
+      q.texcoords.resize(2*n);
+      for (unsigned int i = 0; i < n; ++i)
+      {
+        const aiVector3D& t = mesh->mTextureCoords[0][i];
+        q.texcoords[2*i + 0] = (GLushort)quantize_unorm((t.x - q.uv_min.x) / su, 16);
+        q.texcoords[2*i + 1] = (GLushort)quantize_unorm((t.y - q.uv_min.y) / sv, 16);
+      }
+    }
+  }
+
+  // decode every attribute exactly as the vertex shader does and compare it
+  // against the source mesh.
+  inline QuantizationError validate_quantization(const aiMesh* mesh, const QuantizedMesh& q)
+  {
+    QuantizationError err;
+
+    aiVector3D extent = q.aabb_max - q.aabb_min;
+    float max_extent = std::max(extent.x, std::max(extent.y, extent.z));
+
+    // half a quantization step per axis, plus float round-off of the dequant matrix
+    err.position_bound = 0.5f * std::sqrt(3.0f) * max_extent / 65535.0f
+                       + 4.0f * 1.1920929e-7f * (max_extent + std::fabs(q.aabb_min.x)
+                                                 + std::fabs(q.aabb_min.y) + std::fabs(q.aabb_min.z));
+
+    // worst case of the octahedral grid with nearest-neighbour search
+    err.normal_bound = (q.nbits == knormal8) ? 0.7f : 0.008f;
+
+    err.texcoord_bound = 0.5f * std::sqrt(2.0f) * std::max(q.texcoord_dequant[0], q.texcoord_dequant[1]) / 65535.0f
+                       + 1e-6f;
+
+    for (unsigned int i = 0; i < mesh->mNumVertices; ++i)
+    {
+      aiVector3D c(dequantize_unorm(q.positions[4*i + 0], 16),
+                   dequantize_unorm(q.positions[4*i + 1], 16),
+                   dequantize_unorm(q.positions[4*i + 2], 16));
+      aiVector3D p = q.mat_dequant * c;
+      err.max_position_error = std::max(err.max_position_error, (p - mesh->mVertices[i]).Length());
+
+      if (mesh->mNormals != NULL && mesh->mNormals[i].SquareLength() > 0.0f)
+      {
+        aiVector3D nrm = mesh->mNormals[i];
+        nrm.Normalize();
+        err.max_normal_error = std::max(err.max_normal_error, angle_between(nrm, decode_normal(q, i)));
+      }
+
+      if (q.has_texcoords)
+      {
+        float u = dequantize_unorm(q.texcoords[2*i + 0], 16)*q.texcoord_dequant[0] + q.texcoord_dequant[2];
+        float v = dequantize_unorm(q.texcoords[2*i + 1], 16)*q.texcoord_dequant[1] + q.texcoord_dequant[3];
+        float du = u - mesh->mTextureCoords[0][i].x;
+        float dv = v - mesh->mTextureCoords[0][i].y;
+        err.max_texcoord_error = std::max(err.max_texcoord_error, std::sqrt(du*du + dv*dv));
+      }
+    }
+
+    return err;
+  }
+
+  // bytes per vertex fetched by the vertex shader
+  inline unsigned int float_vertex_size(const aiMesh* mesh)
+  {
+    // position, normal and the 3-component aiVector3D texcoord
+    return sizeof(aiVector3D) * (2 + (mesh->mTextureCoords[0] != NULL ? 1 : 0));
+  }
+
+  inline unsigned int quantized_vertex_size(const QuantizedMesh& q)
+  {
+    return 4*sizeof(GLushort) + 2*(q.nbits/8) + (q.has_texcoords ? 2*sizeof(GLushort) : 0);
+  }
+
+  inline void print_quantization_report(const aiScene* scene, normal_bits nbits = knormal16)
+  {
+    size_t float_bytes = 0, quant_bytes = 0;
+    bool all_ok = true;
+
+    for (unsigned int i = 0; i < scene->mNumMeshes; ++i)
+    {
+      const aiMesh* mesh = scene->mMeshes[i];
+
+      QuantizedMesh q;
+      quantize_mesh(mesh, q, nbits);
+      QuantizationError err = validate_quantization(mesh, q);
+
+      size_t fb = (size_t)float_vertex_size(mesh) * mesh->mNumVertices;
+      size_t qb = (size_t)quantized_vertex_size(q) * mesh->mNumVertices;
+      float_bytes += fb;
+      quant_bytes += qb;
+      all_ok = all_ok && err.ok();
+
+      std::cout << "  mesh " << i << " (" << mesh->mNumVertices << " vertices): "
+                << fb << " -> " << qb << " bytes"
+                << ", pos err " << err.max_position_error << " (<= " << err.position_bound << ")"
+                << ", normal err " << err.max_normal_error << " deg (<= " << err.normal_bound << ")"
+                << ", uv err " << err.max_texcoord_error << " (<= " << err.texcoord_bound << ")"
+                << (err.ok() ? "" : "  ** EXCEEDS BOUND **") << std::endl;
+    }
+
+    std::cout << "  vertex memory (= bandwidth per frame): " << float_bytes << " -> " << quant_bytes << " bytes";
+    if (float_bytes > 0)
+      std::cout << " (" << 100.0 * (double)quant_bytes / (double)float_bytes << "%)";
+    std::cout << (all_ok ? ", all within bounds" : ", ERROR BOUND VIOLATED") << std::endl;
+  }
+}
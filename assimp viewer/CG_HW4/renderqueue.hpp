@@ -0,0 +1,207 @@
+#pragma once
+
+#include <cstdint>
+#include <algorithm>
+
+#include <GL/glew.h>
+
+////////////////////////////////////////////////////////////////////////////////
+/// 렌더 큐 정렬 키 + GL 상태 캐시
+///
+/// Draws are sorted by a 64 bit key, most significant field first:
+///
+///   | program 8 | texture 16 | vertex buffer 16 | depth 24 |
+///
+/// so submissions with the same program, texture and vertex buffers end up
+/// next to each other (front to back inside a group), and GLStateCache skips
+/// the binds that would set the state already current. The cache only knows
+/// the state it has set itself: call invalidate() after GL calls that bypass
+/// it.
+////////////////////////////////////////////////////////////////////////////////
+namespace kmuvcl
+{
+  // depth in [0, 1], clamped
+  inline uint64_t make_sort_key(GLuint program, GLuint texture, GLuint vertex_buffer, float depth)
+  {
+    const uint64_t kdepth_max = (1u << 24) - 1;
+    uint64_t d = (uint64_t)(std::min(std::max(depth, 0.0f), 1.0f) * kdepth_max);
+
+    return ((uint64_t)(program & 0xff) << 56)
+         | ((uint64_t)(texture & 0xffff) << 40)
+         | ((uint64_t)(vertex_buffer & 0xffff) << 24)
+         | d;
+  }
+
+  struct StateStats
+  {
+    unsigned int  issued = 0;     // GL calls made
+    unsigned int  avoided = 0;    // redundant calls skipped
+
+    void reset() { *this = StateStats(); }
+  };
+
+  class GLStateCache
+  {
+  public:
+    static const unsigned int kmax_attribs = 16;
+    static const unsigned int kmax_texture_units = 16;
+
+    GLStateCache() { invalidate(); }
+
+    // forget everything, the next call of each kind is issued
+    void invalidate()
+    {
+      program_ = kunknown;
+      active_texture_ = kunknown;
+      array_buffer_ = kunknown;
+      element_buffer_ = kunknown;
+
+      for (unsigned int i = 0; i < kmax_texture_units; ++i)
+        textures_[i] = kunknown;
+
+      for (unsigned int i = 0; i < kmax_attribs; ++i)
+      {
+        enabled_[i] = kunknown_enabled;
+        pointers_[i].valid = false;
+      }
+    }
+
+    void use_program(GLuint program)
+    {
+      if (program == program_)
+      {
+        stats_.avoided++;
+        return;
+      }
+      glUseProgram(program);
+      program_ = program;
+      stats_.issued++;
+    }
+
+    // GL_TEXTURE_2D on texture unit (GL_TEXTURE0 + i)
+    void bind_texture(GLenum unit, GLuint texture)
+    {
+      unsigned int i = unit - GL_TEXTURE0;
+      if (i < kmax_texture_units && textures_[i] == texture)
+      {
+        stats_.avoided++;
+        return;
+      }
+
+      if (unit != active_texture_)
+      {
+        glActiveTexture(unit);
+        active_texture_ = unit;
+        stats_.issued++;
+      }
+      glBindTexture(GL_TEXTURE_2D, texture);
+      if (i < kmax_texture_units)
+        textures_[i] = texture;
+      stats_.issued++;
+    }
+
+    // GL_ARRAY_BUFFER or GL_ELEMENT_ARRAY_BUFFER
+    void bind_buffer(GLenum target, GLuint buffer)
+    {
+      GLuint& current = (target == GL_ELEMENT_ARRAY_BUFFER) ? element_buffer_ : array_buffer_;
+      if (current == buffer)
+      {
+        stats_.avoided++;
+        return;
+      }
+      glBindBuffer(target, buffer);
+      current = buffer;
+      stats_.issued++;
+    }
+
+    void enable_vertex_attrib(GLint loc)  { set_vertex_attrib(loc, 1); }
+    void disable_vertex_attrib(GLint loc) { set_vertex_attrib(loc, 0); }
+
+    // disables the arrays enabled through the cache (end of a pass)
+    void disable_vertex_attribs()
+    {
+      for (unsigned int i = 0; i < kmax_attribs; ++i)
+        if (enabled_[i] == 1)
+          set_vertex_attrib(i, 0);
+    }
+
+    // array starting at byte offset of buffer
+    void vertex_attrib_pointer(GLint loc, GLuint buffer, GLint size, GLenum type,
+                               GLboolean normalized, GLsizei stride, GLintptr offset = 0)
+    {
+      if (loc < 0)
+        return;
+
+      if (loc < (GLint)kmax_attribs)
+      {
+        const Pointer& p = pointers_[loc];
+        if (p.valid && p.buffer == buffer && p.size == size && p.type == type
+            && p.normalized == normalized && p.stride == stride && p.offset == offset)
+        {
+          stats_.avoided++;
+          return;
+        }
+      }
+
+      bind_buffer(GL_ARRAY_BUFFER, buffer);
+      glVertexAttribPointer(loc, size, type, normalized, stride, (void*)offset);
+      stats_.issued++;
+
+      if (loc < (GLint)kmax_attribs)
+      {
+        Pointer p = { true, buffer, size, type, normalized, stride, offset };
+        pointers_[loc] = p;
+      }
+    }
+
+    const StateStats& stats() const { return stats_; }
+    void reset_stats()              { stats_.reset(); }
+
+  private:
+    static const GLuint kunknown = ~0u;
+    static const int    kunknown_enabled = -1;
+
+    struct Pointer
+    {
+      bool      valid;
+      GLuint    buffer;
+      GLint     size;
+      GLenum    type;
+      GLboolean normalized;
+      GLsizei   stride;
+      GLintptr  offset;
+    };
+
+    void set_vertex_attrib(GLint loc, int enabled)
+    {
+      if (loc < 0)
+        return;
+
+      if (loc < (GLint)kmax_attribs && enabled_[loc] == enabled)
+      {
+        stats_.avoided++;
+        return;
+      }
+
+      if (enabled)
+        glEnableVertexAttribArray(loc);
+      else
+        glDisableVertexAttribArray(loc);
+      stats_.issued++;
+
+      if (loc < (GLint)kmax_attribs)
+        enabled_[loc] = enabled;
+    }
+
+    GLuint      program_;
+    GLenum      active_texture_;
+    GLuint      array_buffer_;
+    GLuint      element_buffer_;
+    GLuint      textures_[kmax_texture_units];
+
+    int         enabled_[kmax_attribs];
+    Pointer     pointers_[kmax_attribs];
+
+    StateStats  stats_;
+  };
+}
@@ -0,0 +1,318 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <map>
+#include <fstream>
+#include <sstream>
+#include <iostream>
+#include <algorithm>
+#include <cmath>
+#include <cfloat>
+
+#include <assimp/scene.h>
+#include <assimp/material.h>
+
+////////////////////////////////////////////////////////////////////////////////
+/// 여러 모델 파일을 하나의 scene 으로 합성
+///
+/// A scene is a list of entries (file + placement), given on the command line
+/// or in a manifest (*.scene):
+///
+///   # file                 placement (optional, applied as T * Rz * Ry * Rx * S)
+///   01_Duck/duck.obj       translate 1 0 0  rotate 0 90 0  scale 0.5
+///   03_Bird/bird.obj
+///
+/// Paths are relative to the manifest. Entries without a placement are laid
+/// out on a grid in the x-z plane around the origin, each scaled to the size
+/// of the first of them.
+///
+/// compose_scenes() merges one imported scene per distinct file into a single
+/// aiScene: every entry becomes a transform node under the root whose subtree
+/// is a copy of its file's node graph. A file listed several times is
+/// imported once and its meshes are shared by all its nodes. Diffuse texture
+/// paths are rewritten to include the file's directory, so the composite is
+/// used with an empty basepath. The animations of every file are moved into
+/// the composite and SceneFiles records the file of every animation and of
+/// every entry, so a file's clips only drive the copies of that file even
+/// when files share node names (e.g. "Armature", "Hips").
+////////////////////////////////////////////////////////////////////////////////
+namespace kmuvcl
+{
+  struct SceneEntry
+  {
+    std::string   filename;
+    bool          placed = false;     // transform given in the manifest
+    aiMatrix4x4   transform;
+  };
+
+  // files of a composite scene: an animation drives only the entries of its file
+  struct SceneFiles
+  {
+    std::vector<unsigned int> animation_file;   // per aiScene::mAnimations
+    std::vector<unsigned int> entry_file;       // per child of aiScene::mRootNode
+  };
+
+  inline bool is_scene_manifest(const std::string& filename)
+  {
+    const std::string ext = ".scene";
+    return filename.size() > ext.size() && filename.compare(filename.size() - ext.size(), ext.size(), ext) == 0;
+  }
+
+  inline bool read_scene_manifest(const std::string& filename, std::vector<SceneEntry>& entries)
+  {
+    std::ifstream file(filename.c_str());
+    if (!file)
+    {
+      std::cerr << filename << ": cannot open the manifest" << std::endl;
+      return false;
+    }
+
+    const std::string dir = filename.substr(0, filename.rfind('/') + 1);
+    std::string line;
+    for (int number = 1; std::getline(file, line); ++number)
+    {
+      line = line.substr(0, line.find('#'));
+      std::istringstream in(line);
+
+      SceneEntry entry;
+      if (!(in >> entry.filename))
+        continue;
+      if (entry.filename[0] != '/')
+        entry.filename = dir + entry.filename;
+
+      aiVector3D t(0.0f, 0.0f, 0.0f), r(0.0f, 0.0f, 0.0f), s(1.0f, 1.0f, 1.0f);
+      std::string key;
+      while (in >> key)
+      {
+        if (key == "translate")
+          in >> t.x >> t.y >> t.z;
+        else if (key == "rotate")
+          in >> r.x >> r.y >> r.z;
+        else if (key == "scale")
+        {
+          in >> s.x;
+          s.y = s.z = s.x;
+        }
+        else
+        {
+          std::cerr << filename << ":" << number << ": unknown placement " << key << std::endl;
+          return false;
+        }
+
+        if (!in)
+        {
+          std::cerr << filename << ":" << number << ": bad " << key << " values" << std::endl;
+          return false;
+        }
+        entry.placed = true;
+      }
+
+      const float deg = 3.14159265358979323846f/180.0f;
+      aiMatrix4x4 mt, mx, my, mz, ms;
+      aiMatrix4x4::Translation(t, mt);
+      aiMatrix4x4::RotationX(r.x*deg, mx);
+      aiMatrix4x4::RotationY(r.y*deg, my);
+      aiMatrix4x4::RotationZ(r.z*deg, mz);
+      aiMatrix4x4::Scaling(s, ms);
+      entry.transform = mt*mz*my*mx*ms;
+
+      entries.push_back(entry);
+    }
+    return true;
+  }
+
+  // scene space AABB of the meshes placed by the node graph
+  inline void scene_bounds(const aiScene* scene, const aiNode* node, const aiMatrix4x4& mat_parent,
+                           aiVector3D& bmin, aiVector3D& bmax)
+  {
+    aiMatrix4x4 mat_curr = mat_parent*node->mTransformation;
+    for (unsigned int i = 0; i < node->mNumMeshes; ++i)
+    {
+      const aiMesh* mesh = scene->mMeshes[node->mMeshes[i]];
+      for (unsigned int v = 0; v < mesh->mNumVertices; ++v)
+      {
+        aiVector3D p = mat_curr*mesh->mVertices[v];
+        bmin = aiVector3D(std::min(bmin.x, p.x), std::min(bmin.y, p.y), std::min(bmin.z, p.z));
+        bmax = aiVector3D(std::max(bmax.x, p.x), std::max(bmax.y, p.y), std::max(bmax.z, p.z));
+      }
+    }
+    for (unsigned int i = 0; i < node->mNumChildren; ++i)
+      scene_bounds(scene, node->mChildren[i], mat_curr, bmin, bmax);
+  }
+
+  // grid placement of the entries without one; scenes[file_of[i]] is the scene of entry i
+  inline void layout_scene_entries(std::vector<SceneEntry>& entries, const std::vector<unsigned int>& file_of,
+                                   const std::vector<aiScene*>& scenes)
+  {
+    std::vector<unsigned int> free_entries;
+    for (unsigned int i = 0; i < entries.size(); ++i)
+    {
+      if (!entries[i].placed)
+        free_entries.push_back(i);
+    }
+    if (free_entries.size() < 2)
+      return;
+
+    const unsigned int side = (unsigned int)std::ceil(std::sqrt((double)free_entries.size()));
+    const unsigned int rows = (free_entries.size() + side - 1) / side;
+    float reference = 0.0f, cell = 0.0f;
+
+    for (unsigned int k = 0; k < free_entries.size(); ++k)
+    {
+      SceneEntry& entry = entries[free_entries[k]];
+      const aiScene* scene = scenes[file_of[free_entries[k]]];
+
+      aiVector3D bmin(FLT_MAX, FLT_MAX, FLT_MAX), bmax(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+      scene_bounds(scene, scene->mRootNode, aiMatrix4x4(), bmin, bmax);
+      if (bmin.x > bmax.x)
+        bmin = bmax = aiVector3D(0.0f, 0.0f, 0.0f);
+
+      aiVector3D extent = bmax - bmin;
+      float size = std::max(extent.x, std::max(extent.y, extent.z));
+      if (k == 0)
+      {
+        reference = (size > 0.0f) ? size : 1.0f;
+        cell = 1.25f*reference;
+      }
+
+      aiVector3D center = (bmin + bmax)*0.5f;
+      aiVector3D position(((k % side) - 0.5f*(side - 1))*cell, 0.0f, ((k / side) - 0.5f*(rows - 1))*cell);
+      float scale = (size > 0.0f) ? reference/size : 1.0f;
+
+      aiMatrix4x4 mt, ms, mc;
+      aiMatrix4x4::Translation(position, mt);
+      aiMatrix4x4::Scaling(aiVector3D(scale, scale, scale), ms);
+      aiMatrix4x4::Translation(-center, mc);
+      entry.transform = mt*ms*mc;
+    }
+  }
+
+  inline aiNode* copy_scene_node(const aiNode* src, unsigned int mesh_offset, aiNode* parent)
+  {
+    aiNode* node = new aiNode();
+    node->mName = src->mName;
+    node->mTransformation = src->mTransformation;
+    node->mParent = parent;
+
+    node->mNumMeshes = src->mNumMeshes;
+    if (src->mNumMeshes > 0)
+    {
+      node->mMeshes = new unsigned int[src->mNumMeshes];
+      for (unsigned int i = 0; i < src->mNumMeshes; ++i)
+        node->mMeshes[i] = src->mMeshes[i] + mesh_offset;
+    }
+
+    node->mNumChildren = src->mNumChildren;
+    if (src->mNumChildren > 0)
+    {
+      node->mChildren = new aiNode*[src->mNumChildren];
+      for (unsigned int i = 0; i < src->mNumChildren; ++i)
+        node->mChildren[i] = copy_scene_node(src->mChildren[i], mesh_offset, node);
+    }
+    return node;
+  }
+
+  // takes the meshes, materials and animations of scenes (one per file) and deletes them
+  inline aiScene* compose_scenes(const std::vector<SceneEntry>& entries, const std::vector<unsigned int>& file_of,
+                                 const std::vector<std::string>& files, std::vector<aiScene*>& scenes,
+                                 SceneFiles& scene_files)
+  {
+    aiScene* composite = new aiScene();
+
+    std::vector<unsigned int> mesh_offset(scenes.size()), material_offset(scenes.size());
+    for (unsigned int f = 0; f < scenes.size(); ++f)
+    {
+      mesh_offset[f] = composite->mNumMeshes;
+      material_offset[f] = composite->mNumMaterials;
+      composite->mNumMeshes += scenes[f]->mNumMeshes;
+      composite->mNumMaterials += scenes[f]->mNumMaterials;
+    }
+
+    composite->mMeshes = new aiMesh*[std::max(1u, composite->mNumMeshes)];
+    composite->mMaterials = new aiMaterial*[std::max(1u, composite->mNumMaterials)];
+
+    for (unsigned int f = 0; f < scenes.size(); ++f)
+      composite->mNumAnimations += scenes[f]->mNumAnimations;
+    if (composite->mNumAnimations > 0)
+    {
+      composite->mAnimations = new aiAnimation*[composite->mNumAnimations];
+      unsigned int a = 0;
+      for (unsigned int f = 0; f < scenes.size(); ++f)
+        for (unsigned int i = 0; i < scenes[f]->mNumAnimations; ++i)
+          composite->mAnimations[a++] = scenes[f]->mAnimations[i];
+    }
+
+    scene_files.animation_file.clear();
+    for (unsigned int f = 0; f < scenes.size(); ++f)
+      scene_files.animation_file.insert(scene_files.animation_file.end(), scenes[f]->mNumAnimations, f);
+    scene_files.entry_file = file_of;
+
+    for (unsigned int f = 0; f < scenes.size(); ++f)
+    {
+      aiScene* scene = scenes[f];
+      const std::string dir = files[f].substr(0, files[f].rfind('/') + 1);
+
+      for (unsigned int i = 0; i < scene->mNumMeshes; ++i)
+      {
+        scene->mMeshes[i]->mMaterialIndex += material_offset[f];
+        composite->mMeshes[mesh_offset[f] + i] = scene->mMeshes[i];
+      }
+
+      for (unsigned int i = 0; i < scene->mNumMaterials; ++i)
+      {
+        aiMaterial* material = scene->mMaterials[i];
+        for (unsigned int t = 0; t < material->GetTextureCount(aiTextureType_DIFFUSE); ++t)
+        {
+          aiString path;
+          if (material->GetTexture(aiTextureType_DIFFUSE, t, &path) != AI_SUCCESS)
+            continue;
+          // embedded ("*0") and absolute paths stay as they are
+          if (path.length > 0 && path.data[0] != '*' && path.data[0] != '/')
+          {
+            aiString resolved(dir + path.data);
+            material->AddProperty(&resolved, AI_MATKEY_TEXTURE_DIFFUSE(t));
+          }
+        }
+        composite->mMaterials[material_offset[f] + i] = material;
+      }
+    }
+
+    aiNode* root = new aiNode();
+    root->mName = aiString("composite");
+    root->mNumChildren = entries.size();
+    root->mChildren = new aiNode*[std::max<size_t>(1, entries.size())];
+    for (unsigned int i = 0; i < entries.size(); ++i)
+    {
+      const unsigned int f = file_of[i];
+
+      aiNode* node = new aiNode();
+      node->mName = aiString(entries[i].filename.substr(entries[i].filename.rfind('/') + 1));
+      node->mTransformation = entries[i].transform;
+      node->mParent = root;
+      node->mNumChildren = 1;
+      node->mChildren = new aiNode*[1];
+      node->mChildren[0] = copy_scene_node(scenes[f]->mRootNode, mesh_offset[f], node);
+      root->mChildren[i] = node;
+    }
+    composite->mRootNode = root;
+
+    // the composite owns the meshes, materials and animations now
+    for (unsigned int f = 0; f < scenes.size(); ++f)
+    {
+      delete[] scenes[f]->mMeshes;
+      delete[] scenes[f]->mMaterials;
+      delete[] scenes[f]->mAnimations;
+      scenes[f]->mMeshes = NULL;
+      scenes[f]->mMaterials = NULL;
+      scenes[f]->mAnimations = NULL;
+      scenes[f]->mNumMeshes = 0;
+      scenes[f]->mNumMaterials = 0;
+      scenes[f]->mNumAnimations = 0;
+      delete scenes[f];
+    }
+    scenes.clear();
+
+    return composite;
+  }
+}
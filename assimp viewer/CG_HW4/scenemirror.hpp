@@ -0,0 +1,93 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <fstream>
+#include <sstream>
+
+#include <malloc.h>
+
+#include <assimp/scene.h>
+
+////////////////////////////////////////////////////////////////////////////////
+/// aiScene 해제 후 남기는 CPU 사본 및 메모리 사용량
+///
+/// After the upload the viewer needs only the placement of the meshes: the
+/// vertices live in the mesh pool, the materials in the texture objects, and
+/// picking/shadow rays use the BVH's own triangle copy. SceneMirror flattens
+/// the node graph into (mesh, node transform) instances in the order of the
+/// old recursive traversal, so the aiScene can be released right away.
+///
+/// MemoryUsage reads the resident set and its peak (VmRSS, VmHWM) from
+/// /proc/self/status.
+////////////////////////////////////////////////////////////////////////////////
+namespace kmuvcl
+{
+  struct MeshInstance
+  {
+    unsigned int  mesh_index;
+    aiMatrix4x4   mat_node;       // product of the node transforms from the root
+  };
+
+  class SceneMirror
+  {
+  public:
+    void build(const aiScene* scene)
+    {
+      instances_.clear();
+      num_meshes_ = scene->mNumMeshes;
+      collect(scene->mRootNode, aiMatrix4x4());
+    }
+
+    const std::vector<MeshInstance>& instances() const { return instances_; }
+    unsigned int num_meshes() const                    { return num_meshes_; }
+    size_t bytes() const { return instances_.capacity() * sizeof(MeshInstance); }
+
+  private:
+    void collect(const aiNode* node, const aiMatrix4x4& mat_parent)
+    {
+      aiMatrix4x4 mat_curr = mat_parent*node->mTransformation;
+
+      for (unsigned int i = 0; i < node->mNumMeshes; ++i)
+      {
+        MeshInstance instance;
+        instance.mesh_index = node->mMeshes[i];
+        instance.mat_node = mat_curr;
+        instances_.push_back(instance);
+      }
+
+      for (unsigned int i = 0; i < node->mNumChildren; ++i)
+        collect(node->mChildren[i], mat_curr);
+    }
+
+    std::vector<MeshInstance> instances_;
+    unsigned int              num_meshes_ = 0;
+  };
+
+  struct MemoryUsage
+  {
+    size_t rss_kb = 0;
+    size_t peak_kb = 0;
+
+    static MemoryUsage current()
+    {
+      MemoryUsage usage;
+      std::ifstream status("/proc/self/status");
+      std::string line;
+      while (std::getline(status, line))
+      {
+        std::istringstream in(line);
+        std::string key;
+        in >> key;
+        if (key == "VmRSS:")
+          in >> usage.rss_kb;
+        else if (key == "VmHWM:")
+          in >> usage.peak_kb;
+      }
+      return usage;
+    }
+
+    // hand the freed heap pages back, so VmRSS shows the release
+    static void trim() { malloc_trim(0); }
+  };
+}
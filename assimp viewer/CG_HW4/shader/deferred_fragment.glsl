@@ -0,0 +1,26 @@
+// deferred lighting pass over the G-buffer, compiled after lighting.glsl
+
+uniform sampler2D u_gbuffer_position;   // position (wc), view space depth
+uniform sampler2D u_gbuffer_normal;     // normal (wc), coverage
+uniform sampler2D u_gbuffer_albedo;
+uniform sampler2D u_gbuffer_specular;   // specular color, shininess
+
+uniform mat4 u_shadow_matrix;           // world -> shadow map texture space
+
+void main()
+{
+  vec2 uv = gl_FragCoord.xy / u_viewport_size;
+
+  vec4 normal = texture2D(u_gbuffer_normal, uv);
+  if (normal.w == 0.0)
+    discard;                            // background
+
+  vec4 position = texture2D(u_gbuffer_position, uv);
+  vec4 albedo   = texture2D(u_gbuffer_albedo, uv);
+  vec4 specular = texture2D(u_gbuffer_specular, uv);
+
+  vec4 shadow_coord = u_shadow_matrix * vec4(position.xyz, 1.0);
+
+  gl_FragColor = calc_color(position.xyz, normal.xyz, position.w, shadow_coord,
+                            albedo, vec4(specular.rgb, 1.0), specular.a);
+}
@@ -0,0 +1,8 @@
+#version 120                  // GLSL 1.20
+
+attribute vec2 a_position;    // full screen quad in NDC
+
+void main()
+{
+  gl_Position = vec4(a_position, 0.0, 1.0);
+}
@@ -1,47 +1,21 @@
-#version 120                  // GLSL 1.20
+// forward pass, compiled after lighting.glsl
 
 uniform sampler2D u_diffuse_texture;
 
-uniform vec3 u_view_position_wc;
-uniform vec3 u_light_position_wc;
-
-uniform vec4 u_light_ambient;
-uniform vec4 u_light_diffuse;
-uniform vec4 u_light_specular;
-
-uniform vec4 u_material_ambient;
 uniform vec4 u_material_specular;
 uniform float u_material_shininess;
 
 varying vec3 v_position_wc;
 varying vec3 v_normal_wc;
 varying vec2 v_texcoord;
+varying vec4 v_shadow_coord;
+varying float v_depth_vc;     // view space distance along the view direction
 
-vec4 calc_color()
+void main()
 {
-  vec4 color = vec4(0, 0, 0, 0);
-
-  vec3 n_wc = normalize(v_normal_wc);
-  vec3 l_wc = normalize(u_light_position_wc - v_position_wc);
-  vec3 r_wc = reflect(-l_wc, n_wc);
-  vec3 v_wc = u_view_position_wc;
-
-  color += u_material_ambient * u_light_ambient;
-  
   vec4 material_diffuse = texture2D(u_diffuse_texture, v_texcoord);  
-  // return material_diffuse;
-        
-  float ndotl = max(0.0, dot(n_wc, l_wc));
-  color += (ndotl * u_light_diffuse * material_diffuse);
-  
-  float rdotv = max(0.0, dot(r_wc, v_wc) );
-  color += (pow(rdotv, u_material_shininess)*u_light_specular*u_material_specular);
-  // color = clamp(color,0,1);
-
-  return color;  
-}
+  // gl_FragColor = material_diffuse;
 
-void main()
-{
-    gl_FragColor = calc_color();	
+  gl_FragColor = calc_color(v_position_wc, v_normal_wc, v_depth_vc, v_shadow_coord,
+                            material_diffuse, u_material_specular, u_material_shininess);
 }
\ No newline at end of file
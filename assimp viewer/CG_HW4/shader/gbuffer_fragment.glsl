@@ -0,0 +1,26 @@
+#version 120                  // GLSL 1.20
+
+// G-buffer pass: surface attributes only, lit later by deferred_fragment.glsl
+//   gl_FragData[0]: position (wc), view space depth
+//   gl_FragData[1]: normal (wc), 1 = covered
+//   gl_FragData[2]: diffuse albedo
+//   gl_FragData[3]: specular color, shininess
+
+uniform sampler2D u_diffuse_texture;
+
+uniform vec4 u_material_specular;
+uniform float u_material_shininess;
+
+varying vec3 v_position_wc;
+varying vec3 v_normal_wc;
+varying vec2 v_texcoord;
+varying vec4 v_shadow_coord;
+varying float v_depth_vc;
+
+void main()
+{
+  gl_FragData[0] = vec4(v_position_wc, v_depth_vc);
+  gl_FragData[1] = vec4(normalize(v_normal_wc), 1.0);
+  gl_FragData[2] = texture2D(u_diffuse_texture, v_texcoord);
+  gl_FragData[3] = vec4(u_material_specular.rgb, u_material_shininess);
+}
@@ -0,0 +1,104 @@
+#version 120                  // GLSL 1.20
+#extension GL_EXT_gpu_shader4 : require   // texture buffers, integer textures
+
+// Phong lighting shared by the forward (fragment.glsl) and the deferred
+// (deferred_fragment.glsl) pass; the main file is compiled after this one.
+
+uniform sampler2DShadow u_shadow_map;
+uniform bool  u_shadow_enabled;
+uniform float u_shadow_texel_size;    // 1 / shadow map resolution
+
+uniform vec3 u_view_position_wc;
+
+uniform vec4 u_light_ambient;
+uniform vec4 u_material_ambient;
+
+// clustered lights (kmuvcl::ClusterGrid), light 0 casts the shadow
+uniform samplerBuffer  u_light_buffer;        // 3 texels per light: position + radius, diffuse, specular
+uniform usamplerBuffer u_cluster_buffer;      // (offset, count) per cluster
+uniform usamplerBuffer u_light_index_buffer;  // light indices
+uniform vec3 u_cluster_dims;                  // tiles x, tiles y, depth slices
+uniform vec2 u_cluster_z;                     // slice = log(depth) * z.x + z.y
+uniform vec2 u_viewport_size;
+
+// fraction of the light reaching the fragment, 3x3 PCF
+// (every shadow2D() tap is a bilinear 2x2 compare)
+float calc_shadow(vec4 shadow_coord)
+{
+  if (!u_shadow_enabled)
+    return 1.0;
+
+  vec3 coord = shadow_coord.xyz / shadow_coord.w;
+  if (shadow_coord.w <= 0.0 || coord.z > 1.0)
+    return 1.0;
+
+  float lit = 0.0;
+  for (int y = -1; y <= 1; ++y)
+  {
+    for (int x = -1; x <= 1; ++x)
+    {
+      vec2 offset = vec2(float(x), float(y)) * u_shadow_texel_size;
+      lit += shadow2D(u_shadow_map, vec3(coord.xy + offset, coord.z)).r;
+    }
+  }
+  return lit / 9.0;
+}
+
+int cluster_index(float depth_vc)
+{
+  vec2  tile  = floor(gl_FragCoord.xy / u_viewport_size * u_cluster_dims.xy);
+  float slice = floor(log(max(depth_vc, 1e-6)) * u_cluster_z.x + u_cluster_z.y);
+
+  tile  = clamp(tile, vec2(0.0), u_cluster_dims.xy - 1.0);
+  slice = clamp(slice, 0.0, u_cluster_dims.z - 1.0);
+
+  return int(tile.x + u_cluster_dims.x * (tile.y + u_cluster_dims.y * slice));
+}
+
+vec4 calc_color(vec3 position_wc, vec3 normal_wc, float depth_vc, vec4 shadow_coord,
+                vec4 material_diffuse, vec4 material_specular, float material_shininess)
+{
+  vec4 color = vec4(0, 0, 0, 0);
+
+  vec3 n_wc = normalize(normal_wc);
+  vec3 v_wc = normalize(u_view_position_wc - position_wc);
+
+  color += u_material_ambient * u_light_ambient;
+
+  uvec2 cluster = texelFetchBuffer(u_cluster_buffer, cluster_index(depth_vc)).xy;
+  int offset = int(cluster.x);
+  int count  = int(cluster.y);
+
+  for (int i = 0; i < count; ++i)
+  {
+    int light = int(texelFetchBuffer(u_light_index_buffer, offset + i).x);
+
+    vec4 light_position = texelFetchBuffer(u_light_buffer, 3*light);
+    vec4 light_diffuse  = texelFetchBuffer(u_light_buffer, 3*light + 1);
+    vec4 light_specular = texelFetchBuffer(u_light_buffer, 3*light + 2);
+
+    vec3  l_wc = light_position.xyz - position_wc;
+    float dist = length(l_wc);
+    l_wc /= dist;
+    vec3  r_wc = reflect(-l_wc, n_wc);
+
+    // smooth falloff to zero at the radius, radius <= 0: no falloff
+    float attenuation = 1.0;
+    if (light_position.w > 0.0)
+    {
+      float x = clamp(1.0 - (dist*dist)/(light_position.w*light_position.w), 0.0, 1.0);
+      attenuation = x*x;
+    }
+    if (light == 0)
+      attenuation *= calc_shadow(shadow_coord);
+        
+    float ndotl = max(0.0, dot(n_wc, l_wc));
+    color += (attenuation * ndotl * light_diffuse * material_diffuse);
+  
+    float rdotv = max(0.0, dot(r_wc, v_wc) );
+    color += (attenuation * pow(rdotv, material_shininess)*light_specular*material_specular);
+  }
+  // color = clamp(color,0,1);
+
+  return color;  
+}
@@ -0,0 +1,9 @@
+#version 120                  // GLSL 1.20
+
+// overdraw visualization, drawn with additive blending (GL_ONE, GL_ONE)
+//  r    : +1/255 per shaded fragment, the exact count for the readback
+//  g, b : brighter ramp for the screen, saturates at 16 fragments
+void main()
+{
+  gl_FragColor = vec4(1.0/255.0, 16.0/255.0, 16.0/255.0, 1.0);
+}
@@ -0,0 +1,7 @@
+#version 120                  // GLSL 1.20
+
+// depth only pass, the color is not written (glDrawBuffer(GL_NONE))
+void main()
+{
+  gl_FragColor = vec4(1.0);
+}
@@ -0,0 +1,53 @@
+#version 120                  // GLSL 1.20
+#extension GL_EXT_gpu_shader4 : require   // texture buffers
+
+// per-draw data of the shadow pass (g_shadow_stream), 5 texels from u_draw_offset:
+//   0 PVM   LightProj * LightView * Model * Dequant (skinned: without Dequant)
+//   4 skin  x: first texel of the skin palette, -1 if the mesh is not skinned
+// the skin palettes follow the draws, same layout as in vertex.glsl
+uniform samplerBuffer u_draw_buffer;
+uniform int u_draw_offset;
+
+attribute vec3 a_position;    // per-vertex position, unorm16 in the mesh AABB
+attribute vec4 a_bone_indices;  // per-vertex palette entries of the 4 influences (bytes)
+attribute vec4 a_bone_weights;  // per-vertex weights of the 4 influences, unorm8
+
+// weighted sum of the skinning matrix rows of one influence
+void add_influence(int palette, float bone, float weight, inout vec4 r0, inout vec4 r1, inout vec4 r2)
+{
+  if (weight <= 0.0)
+    return;
+
+  int i = palette + 2 + 3 * int(bone);
+  r0 += weight * texelFetchBuffer(u_draw_buffer, i);
+  r1 += weight * texelFetchBuffer(u_draw_buffer, i + 1);
+  r2 += weight * texelFetchBuffer(u_draw_buffer, i + 2);
+}
+
+void main()
+{
+  mat4 PVM      = mat4(texelFetchBuffer(u_draw_buffer, u_draw_offset),
+                       texelFetchBuffer(u_draw_buffer, u_draw_offset + 1),
+                       texelFetchBuffer(u_draw_buffer, u_draw_offset + 2),
+                       texelFetchBuffer(u_draw_buffer, u_draw_offset + 3));
+  float palette = texelFetchBuffer(u_draw_buffer, u_draw_offset + 4).x;
+
+  vec4 position = vec4(a_position, 1.0);
+
+  if (palette >= 0.0)
+  {
+    int p = int(palette);
+    position.xyz = a_position * texelFetchBuffer(u_draw_buffer, p).xyz
+                 + texelFetchBuffer(u_draw_buffer, p + 1).xyz;
+
+    vec4 r0 = vec4(0.0), r1 = vec4(0.0), r2 = vec4(0.0);
+    add_influence(p, a_bone_indices.x, a_bone_weights.x, r0, r1, r2);
+    add_influence(p, a_bone_indices.y, a_bone_weights.y, r0, r1, r2);
+    add_influence(p, a_bone_indices.z, a_bone_weights.z, r0, r1, r2);
+    add_influence(p, a_bone_indices.w, a_bone_weights.w, r0, r1, r2);
+
+    position = vec4(dot(r0, position), dot(r1, position), dot(r2, position), 1.0);
+  }
+
+  gl_Position = PVM * position;
+}
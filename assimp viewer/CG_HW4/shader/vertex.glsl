@@ -1,22 +1,114 @@
 #version 120                  // GLSL 1.20
+#extension GL_EXT_gpu_shader4 : require   // texture buffers
 
-uniform mat4 u_PVM;
-uniform mat4 u_M;
+// per-draw data (kmuvcl::StreamBuffer), 21 texels from u_draw_offset + 21 * a_draw_id:
+//   0 PVM       Proj * View * Model * Dequant
+//   4 M         Model * Dequant
+//   8 VM        View * Model * Dequant
+//  12 shadow    Bias * LightProj * LightView * Model * Dequant
+//  16 N         normal matrix, (Model^-1)^T, 3 columns
+//  19 texcoord  dequantization (scale.u, scale.v, bias.u, bias.v)
+//  20 skin      x: first texel of the skin palette, -1 if the mesh is not skinned
+//
+// skinned draws leave Dequant out of the matrices above, their palette is
+//   0 position dequantization scale.xyz, 1 bias.xyz,
+//   2 + 3 * bone  rows of the mesh space skinning matrix (kmuvcl::AnimationState)
+uniform samplerBuffer u_draw_buffer;
+uniform int u_draw_offset;
 
-attribute vec3 a_position;    // per-vertex position (per-vertex input)
-attribute vec3 a_normal;      // per-vertex color (per-vertex input)
-attribute vec2 a_texcoord;    // per-vertex color (per-vertex input)
+// index of the draw in a multi draw indirect call (instanced, from base_instance),
+// 0 when every draw sets u_draw_offset
+attribute float a_draw_id;
+
+attribute vec3 a_position;    // per-vertex position, unorm16 in the mesh AABB
+attribute vec2 a_normal;      // per-vertex normal, octahedral encoded unorm
+attribute vec2 a_texcoord;    // per-vertex texcoord, unorm16 in the mesh uv bounds
+attribute vec4 a_bone_indices;  // per-vertex palette entries of the 4 influences (bytes)
+attribute vec4 a_bone_weights;  // per-vertex weights of the 4 influences, unorm8
 
 varying vec3 v_position_wc;
 varying vec3 v_normal_wc;
 varying vec2 v_texcoord;
+varying vec4 v_shadow_coord;  // shadow map texture space (projective)
+varying float v_depth_vc;     // view space depth, selects the light cluster
+
+// same transform as the depth pre-pass, required for GL_EQUAL depth testing
+invariant gl_Position;
+
+// [0,1]^2 -> unit vector (same as kmuvcl::oct_decode())
+vec3 oct_decode(vec2 e)
+{
+  e = e*2.0 - 1.0;
+
+  vec3 n = vec3(e.xy, 1.0 - abs(e.x) - abs(e.y));
+  if (n.z < 0.0)
+  {
+    vec2 s = vec2(n.x >= 0.0 ? 1.0 : -1.0, n.y >= 0.0 ? 1.0 : -1.0);
+    n.xy = (1.0 - abs(n.yx)) * s;
+  }
+  return normalize(n);
+}
+
+mat4 fetch_mat4(int i)
+{
+  return mat4(texelFetchBuffer(u_draw_buffer, i),
+              texelFetchBuffer(u_draw_buffer, i + 1),
+              texelFetchBuffer(u_draw_buffer, i + 2),
+              texelFetchBuffer(u_draw_buffer, i + 3));
+}
+
+// weighted sum of the skinning matrix rows of one influence
+void add_influence(int palette, float bone, float weight, inout vec4 r0, inout vec4 r1, inout vec4 r2)
+{
+  if (weight <= 0.0)
+    return;
+
+  int i = palette + 2 + 3 * int(bone);
+  r0 += weight * texelFetchBuffer(u_draw_buffer, i);
+  r1 += weight * texelFetchBuffer(u_draw_buffer, i + 1);
+  r2 += weight * texelFetchBuffer(u_draw_buffer, i + 2);
+}
 
 void main()
 {
-  gl_Position   = u_PVM * vec4(a_position, 1.0f);
-  
-  v_position_wc = (u_M * vec4(a_position, 1)).xyz;;
-  v_normal_wc   = normalize((u_M * vec4(a_normal, 0)).xyz);;
-  
-  v_texcoord    = a_texcoord;
-}
\ No newline at end of file
+  int offset = u_draw_offset + int(a_draw_id) * 21;
+
+  mat4 PVM        = fetch_mat4(offset);
+  mat4 M          = fetch_mat4(offset + 4);
+  mat4 VM         = fetch_mat4(offset + 8);
+  mat4 shadow_PVM = fetch_mat4(offset + 12);
+  mat3 N          = mat3(texelFetchBuffer(u_draw_buffer, offset + 16).xyz,
+                         texelFetchBuffer(u_draw_buffer, offset + 17).xyz,
+                         texelFetchBuffer(u_draw_buffer, offset + 18).xyz);
+  vec4 texcoord_dequant = texelFetchBuffer(u_draw_buffer, offset + 19);
+  float palette         = texelFetchBuffer(u_draw_buffer, offset + 20).x;
+
+  vec4 position = vec4(a_position, 1.0);
+  vec3 normal   = oct_decode(a_normal);
+
+  if (palette >= 0.0)
+  {
+    int p = int(palette);
+    position.xyz = a_position * texelFetchBuffer(u_draw_buffer, p).xyz
+                 + texelFetchBuffer(u_draw_buffer, p + 1).xyz;
+
+    vec4 r0 = vec4(0.0), r1 = vec4(0.0), r2 = vec4(0.0);
+    add_influence(p, a_bone_indices.x, a_bone_weights.x, r0, r1, r2);
+    add_influence(p, a_bone_indices.y, a_bone_weights.y, r0, r1, r2);
+    add_influence(p, a_bone_indices.z, a_bone_weights.z, r0, r1, r2);
+    add_influence(p, a_bone_indices.w, a_bone_weights.w, r0, r1, r2);
+
+    position = vec4(dot(r0, position), dot(r1, position), dot(r2, position), 1.0);
+    normal   = vec3(dot(r0.xyz, normal), dot(r1.xyz, normal), dot(r2.xyz, normal));
+  }
+
+  gl_Position   = PVM * position;
+
+  v_position_wc = (M * position).xyz;
+  v_normal_wc   = normalize(N * normal);
+
+  v_texcoord    = a_texcoord * texcoord_dequant.xy + texcoord_dequant.zw;
+
+  v_shadow_coord = shadow_PVM * position;
+  v_depth_vc     = -(VM * position).z;
+}
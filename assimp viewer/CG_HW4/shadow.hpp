@@ -0,0 +1,185 @@
+#pragma once
+
+#include <cmath>
+#include <algorithm>
+#include <iostream>
+
+#include <GL/glew.h>
+
+#include <assimp/scene.h>
+
+////////////////////////////////////////////////////////////////////////////////
+/// 그림자 맵 (shadow map) for the point light
+///
+/// A single perspective depth map rendered from the light position, with the
+/// frustum fitted to the bounding sphere of the scene. The depth texture uses
+/// GL_COMPARE_R_TO_TEXTURE, so each shadow2D() lookup in the fragment shader
+/// is already a bilinear 2x2 PCF tap. The map is only re-rendered when the
+/// light, the model transform or the resolution changed.
+////////////////////////////////////////////////////////////////////////////////
+namespace kmuvcl
+{
+  // view matrix looking from eye to center (gluLookAt)
+  inline void look_at(const aiVector3D& eye, const aiVector3D& center, const aiVector3D& up,
+                      aiMatrix4x4& out)
+  {
+    aiVector3D f = (center - eye).Normalize();
+    aiVector3D s = (f ^ up).Normalize();
+    aiVector3D u = s ^ f;
+
+    out = aiMatrix4x4(
+       s.x,  s.y,  s.z, -(s * eye),
+       u.x,  u.y,  u.z, -(u * eye),
+      -f.x, -f.y, -f.z,  (f * eye),
+       0.0f, 0.0f, 0.0f, 1.0f);
+  }
+
+  class ShadowMap
+  {
+  public:
+    static const GLsizei kdefault_resolution = 2048;
+
+    bool init(GLsizei resolution = kdefault_resolution)
+    {
+      glGenFramebuffers(1, &fbo_);
+      glGenTextures(1, &texture_);
+      resize(resolution);
+
+      glBindFramebuffer(GL_FRAMEBUFFER, fbo_);
+      glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, texture_, 0);
+      glDrawBuffer(GL_NONE);
+      glReadBuffer(GL_NONE);
+
+      GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+      glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+      if (status != GL_FRAMEBUFFER_COMPLETE)
+      {
+        std::cerr << "shadow map: incomplete framebuffer (0x" << std::hex << status << std::dec << ")" << std::endl;
+        return false;
+      }
+      return true;
+    }
+
+    void resize(GLsizei resolution)
+    {
+      resolution_ = std::max(16, (int)resolution);
+
+      const GLfloat border[4] = { 1.0f, 1.0f, 1.0f, 1.0f };   // outside the map: lit
+
+      glBindTexture(GL_TEXTURE_2D, texture_);
+      glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT24, resolution_, resolution_, 0,
+                   GL_DEPTH_COMPONENT, GL_UNSIGNED_INT, NULL);
+      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
+      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
+      glTexParameterfv(GL_TEXTURE_2D, GL_TEXTURE_BORDER_COLOR, border);
+      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_R_TO_TEXTURE);
+      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+      glBindTexture(GL_TEXTURE_2D, 0);
+
+      valid_ = false;
+    }
+
+    // true if the map has to be re-rendered for this light and model transform
+    bool needs_update(const aiVector3D& light_position_wc, const aiMatrix4x4& mat_model) const
+    {
+      return !valid_ || light_position_wc != light_position_ || mat_model != mat_model_;
+    }
+
+    void invalidate() { valid_ = false; }
+
+    // light frustum through the bounding sphere (center, radius) of the scene in world space
+    void set_light(const aiVector3D& light_position_wc, const aiMatrix4x4& mat_model,
+                   const aiVector3D& center, float radius)
+    {
+      light_position_ = light_position_wc;
+      mat_model_ = mat_model;
+
+      aiVector3D to_center = center - light_position_wc;
+      float dist = to_center.Length();
+
+      // up vector must not be parallel to the view direction
+      aiVector3D up(0.0f, 1.0f, 0.0f);
+      if (dist > 0.0f && std::fabs(to_center.y / dist) > 0.99f)
+        up = aiVector3D(0.0f, 0.0f, 1.0f);
+
+      look_at(light_position_wc, center, up, mat_view_);
+
+      float near, fovy;
+      if (dist > radius * 1.01f)
+      {
+        near = dist - radius;
+        fovy = 2.0f * std::asin(radius / dist);
+      }
+      else
+      {
+        // light inside the bounds: wide frustum, part of the scene is not covered
+        near = 0.01f * radius;
+        fovy = 2.0f * std::atan(1.7320508f);    // 120 degree
+      }
+      float far = dist + radius;
+
+      float top = near * std::tan(fovy / 2.0f);
+      mat_proj_ = aiMatrix4x4(
+        near/top, 0.0f,     0.0f,                       0.0f,
+        0.0f,     near/top, 0.0f,                       0.0f,
+        0.0f,     0.0f,     -(far + near)/(far - near), -2.0f*far*near/(far - near),
+        0.0f,     0.0f,     -1.0f,                      0.0f);
+
+      mat_PV_ = mat_proj_ * mat_view_;
+    }
+
+    // binds the shadow framebuffer; the caller draws the depth only geometry
+    void begin()
+    {
+      glGetIntegerv(GL_VIEWPORT, saved_viewport_);
+
+      glBindFramebuffer(GL_FRAMEBUFFER, fbo_);
+      glViewport(0, 0, resolution_, resolution_);
+      glClear(GL_DEPTH_BUFFER_BIT);
+
+      // slope scaled depth bias against shadow acne
+      glEnable(GL_POLYGON_OFFSET_FILL);
+      glPolygonOffset(2.0f, 4.0f);
+    }
+
+    void end()
+    {
+      glDisable(GL_POLYGON_OFFSET_FILL);
+
+      glBindFramebuffer(GL_FRAMEBUFFER, 0);
+      glViewport(saved_viewport_[0], saved_viewport_[1], saved_viewport_[2], saved_viewport_[3]);
+
+      valid_ = true;
+    }
+
+    // world space -> shadow map texture space [0,1]^3
+    aiMatrix4x4 mat_texture() const
+    {
+      const aiMatrix4x4 bias(
+        0.5f, 0.0f, 0.0f, 0.5f,
+        0.0f, 0.5f, 0.0f, 0.5f,
+        0.0f, 0.0f, 0.5f, 0.5f,
+        0.0f, 0.0f, 0.0f, 1.0f);
+      return bias * mat_PV_;
+    }
+
+    const aiMatrix4x4& mat_PV() const { return mat_PV_; }
+    GLuint  texture() const           { return texture_; }
+    GLsizei resolution() const        { return resolution_; }
+
+  private:
+    GLuint        fbo_ = 0;
+    GLuint        texture_ = 0;
+    GLsizei       resolution_ = 0;
+    bool          valid_ = false;
+
+    aiVector3D    light_position_;
+    aiMatrix4x4   mat_model_;
+    aiMatrix4x4   mat_view_, mat_proj_, mat_PV_;
+
+    GLint         saved_viewport_[4];
+  };
+}
@@ -0,0 +1,214 @@
+#pragma once
+
+#include <vector>
+#include <cstring>
+#include <algorithm>
+#include <chrono>
+
+#include <GL/glew.h>
+
+#include <assimp/scene.h>
+
+////////////////////////////////////////////////////////////////////////////////
+/// 스트리밍 버퍼 (per-draw data ring buffer)
+///
+/// One buffer of kregions equal regions, read by the shaders as a GL_RGBA32F
+/// texture buffer. Each frame the CPU writes the next region and fences it
+/// after the last draw that reads it; before a region is written again its
+/// fence is waited for, so with three regions the CPU can run two frames
+/// ahead of the GPU without overwriting data in use.
+///
+/// With ARB_buffer_storage the buffer is mapped once, persistent and
+/// coherent, and map() returns a pointer into it. Without it map() returns a
+/// staging copy that unmap() uploads with glBufferSubData.
+///
+/// The GL objects are deleted by release(), which needs the context: call it
+/// before the context is destroyed.
+////////////////////////////////////////////////////////////////////////////////
+namespace kmuvcl
+{
+  // column major 4x4 from the row major aiMatrix4x4, 4 texels
+  inline float* write_mat4(float* dst, const aiMatrix4x4& m)
+  {
+    for (int c = 0; c < 4; ++c)
+      for (int r = 0; r < 4; ++r)
+        *dst++ = m[r][c];
+    return dst;
+  }
+
+  // column major 3x3 with the columns padded to vec4, 3 texels
+  inline float* write_mat3(float* dst, const aiMatrix3x3& m)
+  {
+    for (int c = 0; c < 3; ++c)
+    {
+      for (int r = 0; r < 3; ++r)
+        *dst++ = m[r][c];
+      *dst++ = 0.0f;
+    }
+    return dst;
+  }
+
+  class StreamBuffer
+  {
+  public:
+    static const unsigned int kregions = 3;     // frames in flight
+    static const GLsizeiptr   ktexel_size = 4*sizeof(float);
+
+    void init(GLsizeiptr region_size)
+    {
+      persistent_ = (GLEW_ARB_buffer_storage || GLEW_VERSION_4_4) && (GLEW_ARB_sync || GLEW_VERSION_3_2);
+
+      glGenTextures(1, &texture_);
+      allocate(region_size);
+    }
+
+    // write pointer for size bytes of the next region
+    void* map(GLsizeiptr size)
+    {
+      if (size > region_size_)
+      {
+        // grow: wait until the GPU is done with every region
+        for (unsigned int i = 0; i < kregions; ++i)
+          wait(i);
+        allocate(std::max(size, 2*region_size_));
+      }
+
+      region_ = (region_ + 1) % kregions;
+      wait(region_);
+      size_ = size;
+
+      if (persistent_)
+        return mapped_ + offset();
+
+      staging_.resize(size);
+      return staging_.data();
+    }
+
+    void unmap()
+    {
+      if (persistent_ || size_ == 0)
+        return;
+
+      glBindBuffer(GL_TEXTURE_BUFFER, buffer_);
+      glBufferSubData(GL_TEXTURE_BUFFER, offset(), size_, staging_.data());
+      glBindBuffer(GL_TEXTURE_BUFFER, 0);
+    }
+
+    // call after the last draw that reads the current region
+    void fence()
+    {
+      if (persistent_)
+        fences_[region_] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    }
+
+    // fences, buffer and texture; init() may be called again afterwards
+    void release()
+    {
+      for (unsigned int i = 0; i < kregions; ++i)
+      {
+        if (fences_[i])
+          glDeleteSync(fences_[i]);
+        fences_[i] = 0;
+      }
+
+      if (buffer_)
+      {
+        if (mapped_)
+        {
+          glBindBuffer(GL_TEXTURE_BUFFER, buffer_);
+          glUnmapBuffer(GL_TEXTURE_BUFFER);
+          glBindBuffer(GL_TEXTURE_BUFFER, 0);
+          mapped_ = NULL;
+        }
+        glDeleteBuffers(1, &buffer_);
+        buffer_ = 0;
+      }
+
+      if (texture_)
+        glDeleteTextures(1, &texture_);
+      texture_ = 0;
+
+      region_size_ = 0;
+      region_ = 0;
+      size_ = 0;
+    }
+
+    // current region in bytes / in texels of the texture buffer
+    GLintptr offset() const       { return region_*region_size_; }
+    GLint    texel_offset() const { return (GLint)(offset()/ktexel_size); }
+
+    GLuint  texture() const     { return texture_; }
+    bool    persistent() const  { return persistent_; }
+
+    // time blocked on fences since the last reset
+    double  wait_ms() const     { return wait_ms_; }
+    void    reset_wait()        { wait_ms_ = 0.0; }
+
+  private:
+    void allocate(GLsizeiptr region_size)
+    {
+      // whole texels per region
+      region_size_ = (region_size + ktexel_size - 1) / ktexel_size * ktexel_size;
+
+      if (buffer_)
+      {
+        if (mapped_)
+        {
+          glBindBuffer(GL_TEXTURE_BUFFER, buffer_);
+          glUnmapBuffer(GL_TEXTURE_BUFFER);
+          mapped_ = NULL;
+        }
+        glDeleteBuffers(1, &buffer_);
+      }
+
+      glGenBuffers(1, &buffer_);
+      glBindBuffer(GL_TEXTURE_BUFFER, buffer_);
+
+      if (persistent_)
+      {
+        const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        glBufferStorage(GL_TEXTURE_BUFFER, kregions*region_size_, NULL, flags);
+        mapped_ = (char*)glMapBufferRange(GL_TEXTURE_BUFFER, 0, kregions*region_size_, flags);
+      }
+      else
+      {
+        glBufferData(GL_TEXTURE_BUFFER, kregions*region_size_, NULL, GL_STREAM_DRAW);
+      }
+
+      glBindTexture(GL_TEXTURE_BUFFER, texture_);
+      glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, buffer_);
+      glBindTexture(GL_TEXTURE_BUFFER, 0);
+      glBindBuffer(GL_TEXTURE_BUFFER, 0);
+    }
+
+    void wait(unsigned int i)
+    {
+      if (!fences_[i])
+        return;
+
+      std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+      GLenum result = glClientWaitSync(fences_[i], 0, 0);
+      while (result == GL_TIMEOUT_EXPIRED)
+        result = glClientWaitSync(fences_[i], GL_SYNC_FLUSH_COMMANDS_BIT, 1000000);   // 1 ms
+
+      glDeleteSync(fences_[i]);
+      fences_[i] = 0;
+
+      wait_ms_ += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    GLuint      buffer_ = 0;
+    GLuint      texture_ = 0;
+    char*       mapped_ = NULL;
+    bool        persistent_ = false;
+
+    GLsizeiptr  region_size_ = 0;
+    unsigned int region_ = 0;
+    GLsizeiptr  size_ = 0;
+    GLsync      fences_[kregions] = { 0, 0, 0 };
+
+    std::vector<char> staging_;
+    double      wait_ms_ = 0.0;
+  };
+}
@@ -0,0 +1,253 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <thread>
+#include <algorithm>
+#include <cstring>
+#include <cstdlib>
+#include <cstdint>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <emmintrin.h>
+
+#include "workerpool.hpp"
+
+////////////////////////////////////////////////////////////////////////////////
+/// 텍스트 모델 파일 파싱 도구
+///
+/// MappedFile maps a whole file read only. find_line_starts() splits a text
+/// body into lines with SSE2 compares (16 bytes per step), so the lines can be
+/// handed to threads in chunks. parse_number() converts 8 digits per step
+/// (SWAR) and is exact for the values that fit a double with |exponent| <= 22;
+/// everything else goes through strtod.
+////////////////////////////////////////////////////////////////////////////////
+namespace kmuvcl
+{
+  class MappedFile
+  {
+  public:
+    ~MappedFile() { close(); }
+
+    bool open(const std::string& filename)
+    {
+      close();
+
+      int fd = ::open(filename.c_str(), O_RDONLY);
+      if (fd < 0)
+        return false;
+
+      struct stat st;
+      if (fstat(fd, &st) != 0 || st.st_size == 0)
+      {
+        ::close(fd);
+        return false;
+      }
+
+      void* p = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+      ::close(fd);
+      if (p == MAP_FAILED)
+        return false;
+
+      // read front to back
+      madvise(p, st.st_size, MADV_SEQUENTIAL);
+      madvise(p, st.st_size, MADV_WILLNEED);
+
+      data_ = (const char*)p;
+      size_ = st.st_size;
+      return true;
+    }
+
+    void close()
+    {
+      if (data_)
+        munmap((void*)data_, size_);
+      data_ = NULL;
+      size_ = 0;
+    }
+
+    const char* data() const { return data_; }
+    size_t      size() const { return size_; }
+
+  private:
+    const char* data_ = NULL;
+    size_t      size_ = 0;
+  };
+
+  inline bool text_is_space(char c) { return c == ' ' || c == '\t' || c == '\r' || c == '\n'; }
+  inline bool text_is_digit(char c) { return (unsigned char)(c - '0') < 10; }
+
+  // the 8 bytes at p are all ascii digits
+  inline bool text_is_eight_digits(const char* p, const char* end)
+  {
+    if (end - p < 8)
+      return false;
+    uint64_t v;
+    std::memcpy(&v, p, 8);
+    return (((v & 0xF0F0F0F0F0F0F0F0ull) | (((v + 0x0606060606060606ull) & 0xF0F0F0F0F0F0F0F0ull) >> 4))
+            == 0x3333333333333333ull);
+  }
+
+  // 8 ascii digits -> value, 3 multiplies instead of 8 (little endian)
+  inline uint32_t text_parse_eight_digits(const char* p)
+  {
+    uint64_t v;
+    std::memcpy(&v, p, 8);
+    v -= 0x3030303030303030ull;
+    v = (v * 10) + (v >> 8);
+    v = (((v & 0x000000FF000000FFull) * (100 + (1000000ull << 32)))
+       + (((v >> 16) & 0x000000FF000000FFull) * (1 + (10000ull << 32)))) >> 32;
+    return (uint32_t)v;
+  }
+
+  // digits at p into m; at most 19 significant digits are kept, the number of dropped ones is returned
+  inline int text_parse_digits(const char*& p, const char* end, uint64_t& m, int& digits)
+  {
+    int dropped = 0;
+    while (digits <= 11 && text_is_eight_digits(p, end))
+    {
+      m = m*100000000ull + text_parse_eight_digits(p);
+      p += 8;
+      digits += 8;
+    }
+    while (p < end && text_is_digit(*p))
+    {
+      if (digits < 19)
+      {
+        m = m*10 + (*p - '0');
+        digits += (m != 0);   // leading zeros do not count
+      }
+      else
+      {
+        dropped++;
+      }
+      ++p;
+    }
+    return dropped;
+  }
+
+  // number at p (after spaces and tabs), p is moved past it; false if there is none
+  inline bool parse_number(const char*& p, const char* end, double& value)
+  {
+    static const double kpow10[] = {
+      1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+      1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+    };
+
+    while (p < end && (*p == ' ' || *p == '\t'))
+      ++p;
+    if (p == end)
+      return false;
+
+    const char* start = p;
+    bool negative = (*p == '-');
+    p += (*p == '-' || *p == '+');
+
+    uint64_t m = 0;
+    int digits = 0, exponent = 0;
+    const char* first_digit = p;
+
+    exponent += text_parse_digits(p, end, m, digits);
+    if (p < end && *p == '.')
+    {
+      ++p;
+      const char* fraction = p;
+      int dropped = text_parse_digits(p, end, m, digits);
+      exponent -= (int)(p - fraction) - dropped;
+    }
+
+    // no digits: nan, inf, garbage
+    if (p == first_digit || (p == first_digit + 1 && *first_digit == '.'))
+    {
+      char* e;
+      value = std::strtod(start, &e);
+      p = e;
+      return e != start;
+    }
+
+    if (p < end && (*p == 'e' || *p == 'E'))
+    {
+      const char* e = p + 1;
+      bool e_negative = (e < end && *e == '-');
+      e += (e < end && (*e == '-' || *e == '+'));
+      int x = 0;
+      while (e < end && text_is_digit(*e))
+      {
+        x = std::min(x*10 + (*e - '0'), 100000);
+        ++e;
+      }
+      if (e > p + 1 && text_is_digit(e[-1]))
+      {
+        exponent += e_negative ? -x : x;
+        p = e;
+      }
+    }
+
+    // exact in double (m < 2^53, |exponent| <= 22), else strtod on the token
+    if (m < (1ull << 53) && exponent >= -22 && exponent <= 22)
+    {
+      double d = (double)m;
+      d = (exponent < 0) ? d / kpow10[-exponent] : d * kpow10[exponent];
+      value = negative ? -d : d;
+    }
+    else
+    {
+      value = std::strtod(start, NULL);
+    }
+    return true;
+  }
+
+  // signed integer at p (after spaces and tabs)
+  inline bool parse_integer(const char*& p, const char* end, long& value)
+  {
+    while (p < end && (*p == ' ' || *p == '\t'))
+      ++p;
+
+    bool negative = (p < end && *p == '-');
+    p += (p < end && (*p == '-' || *p == '+'));
+
+    const char* start = p;
+    long v = 0;
+    while (p < end && text_is_digit(*p))
+    {
+      v = v*10 + (*p - '0');
+      ++p;
+    }
+    value = negative ? -v : v;
+    return p != start;
+  }
+
+  // offsets of the line starts in [begin, end), 16 bytes per step
+  inline void find_line_starts(const char* begin, const char* end, std::vector<size_t>& lines)
+  {
+    lines.clear();
+    lines.push_back(0);
+
+    const __m128i newline = _mm_set1_epi8('\n');
+    const char* p = begin;
+    for (; p + 16 <= end; p += 16)
+    {
+      __m128i chunk = _mm_loadu_si128((const __m128i*)p);
+      unsigned int mask = _mm_movemask_epi8(_mm_cmpeq_epi8(chunk, newline));
+      while (mask)
+      {
+        int bit = __builtin_ctz(mask);
+        lines.push_back(p - begin + bit + 1);
+        mask &= mask - 1;
+      }
+    }
+    for (; p < end; ++p)
+    {
+      if (*p == '\n')
+        lines.push_back(p - begin + 1);
+    }
+
+    // no empty last line
+    if (lines.back() == (size_t)(end - begin) && lines.size() > 1)
+      lines.pop_back();
+  }
+}
@@ -0,0 +1,127 @@
+#pragma once
+
+#include <string>
+#include <map>
+#include <iostream>
+#include <cstdint>
+#include <cstdlib>
+#include <climits>
+
+#include <GL/glew.h>
+
+#include "textparse.hpp"
+
+// stb_image.h (with its implementation) is included by main.cpp
+
+////////////////////////////////////////////////////////////////////////////////
+/// 텍스처 캐시 (여러 모델이 같은 이미지를 공유)
+///
+/// get() returns one texture object per image: requests are matched first by
+/// the canonical path (realpath) and then by the content of the file (size and
+/// FNV-1a hash of the bytes), so the copies of an image in several model
+/// directories (05_animals and 01_Duck, 02_Cat, 03_Bird) are decoded and
+/// uploaded once.
+////////////////////////////////////////////////////////////////////////////////
+namespace kmuvcl
+{
+  class TextureCache
+  {
+  public:
+    // 0 if the image cannot be loaded
+    GLuint get(const std::string& filename)
+    {
+      requests_++;
+
+      char resolved[PATH_MAX];
+      const std::string path = realpath(filename.c_str(), resolved) ? std::string(resolved) : filename;
+
+      std::map<std::string, GLuint>::iterator it = by_path_.find(path);
+      if (it != by_path_.end())
+        return it->second;
+
+      MappedFile file;
+      if (!file.open(path))
+      {
+        std::cerr << filename << ": cannot read the texture" << std::endl;
+        return by_path_[path] = 0;
+      }
+
+      ContentKey key(file.size(), fnv1a(file.data(), file.size()));
+      std::map<ContentKey, GLuint>::iterator same = by_content_.find(key);
+      if (same != by_content_.end())
+        return by_path_[path] = same->second;
+
+      GLuint texture = upload(file, filename);
+      by_content_[key] = texture;
+      return by_path_[path] = texture;
+    }
+
+    void clear()
+    {
+      for (std::map<ContentKey, GLuint>::iterator it = by_content_.begin(); it != by_content_.end(); ++it)
+      {
+        if (it->second != 0)
+          glDeleteTextures(1, &it->second);
+      }
+      by_path_.clear();
+      by_content_.clear();
+      requests_ = uploads_ = bytes_ = 0;
+    }
+
+    unsigned int requests() const { return requests_; }
+    unsigned int paths() const    { return by_path_.size(); }
+    unsigned int uploads() const  { return uploads_; }
+    size_t       bytes() const    { return bytes_; }     // texels uploaded
+
+  private:
+    typedef std::pair<size_t, uint64_t> ContentKey;
+
+    static uint64_t fnv1a(const char* data, size_t size)
+    {
+      uint64_t h = 0xcbf29ce484222325ull;
+      for (size_t i = 0; i < size; ++i)
+      {
+        h ^= (unsigned char)data[i];
+        h *= 0x100000001b3ull;
+      }
+      return h;
+    }
+
+    GLuint upload(const MappedFile& file, const std::string& filename)
+    {
+      int width, height, channels;
+
+      // 원점 위치를 좌*상*단에서 좌*하*단으로 이동시킨 효과가 나도록 영상을 로딩함.
+      stbi_set_flip_vertically_on_load(true);
+      unsigned char* image = stbi_load_from_memory((const stbi_uc*)file.data(), (int)file.size(),
+                                                   &width, &height, &channels, STBI_rgb);
+      if (!image)
+      {
+        std::cerr << filename << ": " << stbi_failure_reason() << std::endl;
+        return 0;
+      }
+
+      GLuint texture;
+      glGenTextures(1, &texture);
+      glBindTexture(GL_TEXTURE_2D, texture);
+      glPixelStorei(GL_UNPACK_ALIGNMENT, 1);    // RGB rows are not 4 byte aligned
+      glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, image);
+      glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+      stbi_image_free(image);
+
+      uploads_++;
+      bytes_ += (size_t)width*height*4;
+      return texture;
+    }
+
+    std::map<std::string, GLuint> by_path_;
+    std::map<ContentKey, GLuint>  by_content_;
+    unsigned int requests_ = 0, uploads_ = 0;
+    size_t       bytes_ = 0;
+  };
+}
@@ -0,0 +1,194 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <iostream>
+#include <chrono>
+
+#include <GL/glew.h>
+
+////////////////////////////////////////////////////////////////////////////////
+/// 프레임 타이머 (CPU + GPU 시간 측정)
+///
+/// GPU time comes from GL_TIME_ELAPSED queries (ARB_timer_query). Results are
+/// read a few frames later from a small ring of query objects, so measuring
+/// never stalls the pipeline. Totals are averaged and printed once per report
+/// interval.
+////////////////////////////////////////////////////////////////////////////////
+namespace kmuvcl
+{
+  class GpuTimer
+  {
+  public:
+    static const unsigned int kmax_pending = 4;
+
+    void init()
+    {
+      supported_ = GLEW_ARB_timer_query || GLEW_VERSION_3_3;
+      if (supported_)
+        glGenQueries(kmax_pending, queries_);
+    }
+
+    void begin()
+    {
+      if (!supported_)
+        return;
+
+      // the slot is still in flight after kmax_pending uses: wait for it
+      if (pending_[next_])
+        collect(next_, true);
+
+      glBeginQuery(GL_TIME_ELAPSED, queries_[next_]);
+    }
+
+    void end()
+    {
+      if (!supported_)
+        return;
+
+      glEndQuery(GL_TIME_ELAPSED);
+      pending_[next_] = true;
+      next_ = (next_ + 1) % kmax_pending;
+    }
+
+    // adds the finished queries to the total, returns the number collected
+    unsigned int poll()
+    {
+      unsigned int n = 0;
+      for (unsigned int i = 0; i < kmax_pending; ++i)
+        if (pending_[i] && collect(i, false))
+          n++;
+      return n;
+    }
+
+    bool    supported() const { return supported_; }
+
+    double  total_ms() const  { return total_ms_; }
+    unsigned int count() const { return count_; }
+    void    reset()           { total_ms_ = 0.0; count_ = 0; }
+
+  private:
+    bool collect(unsigned int i, bool wait)
+    {
+      if (!wait)
+      {
+        GLint available = 0;
+        glGetQueryObjectiv(queries_[i], GL_QUERY_RESULT_AVAILABLE, &available);
+        if (!available)
+          return false;
+      }
+
+      GLuint64 ns = 0;
+      glGetQueryObjectui64v(queries_[i], GL_QUERY_RESULT, &ns);
+      pending_[i] = false;
+
+      total_ms_ += ns * 1e-6;
+      count_++;
+      return true;
+    }
+
+    GLuint        queries_[kmax_pending];
+    bool          pending_[kmax_pending] = { false, false, false, false };
+    unsigned int  next_ = 0;
+    bool          supported_ = false;
+
+    double        total_ms_ = 0.0;
+    unsigned int  count_ = 0;
+  };
+
+  // named CPU/GPU timers of the frame, e.g. begin("shadow") ... end("shadow")
+  class FrameTimers
+  {
+  public:
+    bool enabled = true;
+    double report_interval = 1.0;     // seconds
+
+    void begin(const std::string& name)
+    {
+      Timer& t = find(name);
+      t.gpu.begin();
+      t.start = std::chrono::steady_clock::now();
+    }
+
+    void end(const std::string& name)
+    {
+      Timer& t = find(name);
+      t.gpu.end();
+      t.cpu_ms += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t.start).count();
+      t.runs++;
+    }
+
+    // call once per frame after the last end()
+    void end_frame()
+    {
+      frames_++;
+      for (unsigned int i = 0; i < timers_.size(); ++i)
+        timers_[i].gpu.poll();
+
+      std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+      if (frames_ == 1)
+        last_report_ = now;
+
+      double elapsed = std::chrono::duration<double>(now - last_report_).count();
+      if (elapsed < report_interval)
+        return;
+
+      if (enabled)
+        print(elapsed);
+
+      for (unsigned int i = 0; i < timers_.size(); ++i)
+      {
+        timers_[i].cpu_ms = 0.0;
+        timers_[i].runs = 0;
+        timers_[i].gpu.reset();
+      }
+      frames_ = 0;
+      last_report_ = now;
+    }
+
+  private:
+    struct Timer
+    {
+      std::string   name;
+      GpuTimer      gpu;
+      double        cpu_ms = 0.0;
+      unsigned int  runs = 0;
+      std::chrono::steady_clock::time_point start;
+    };
+
+    Timer& find(const std::string& name)
+    {
+      for (unsigned int i = 0; i < timers_.size(); ++i)
+        if (timers_[i].name == name)
+          return timers_[i];
+
+      timers_.push_back(Timer());
+      timers_.back().name = name;
+      timers_.back().gpu.init();
+      return timers_.back();
+    }
+
+    void print(double elapsed) const
+    {
+      std::cout << "frame " << elapsed * 1000.0 / frames_ << " ms (" << frames_ << " frames)";
+      for (unsigned int i = 0; i < timers_.size(); ++i)
+      {
+        const Timer& t = timers_[i];
+        std::cout << " | " << t.name << ": ";
+        if (t.runs == 0)
+        {
+          std::cout << "skipped";
+          continue;
+        }
+        if (t.gpu.count() > 0)
+          std::cout << "gpu " << t.gpu.total_ms() / t.gpu.count() << " ms, ";
+        std::cout << "cpu " << t.cpu_ms / t.runs << " ms x" << t.runs;
+      }
+      std::cout << std::endl;
+    }
+
+    std::vector<Timer>  timers_;
+    unsigned int        frames_ = 0;
+    std::chrono::steady_clock::time_point last_report_;
+  };
+}
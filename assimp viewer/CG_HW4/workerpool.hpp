@@ -0,0 +1,146 @@
+#pragma once
+
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <algorithm>
+
+////////////////////////////////////////////////////////////////////////////////
+/// 작업 스레드 풀 (persistent worker pool)
+///
+/// The workers are started once and wait for tasks, so per frame jobs (the
+/// occlusion rasterizer bands, the animation update) do not create threads.
+/// run() queues a batch of tasks and the calling thread works on the queue
+/// until its own batch is done, so a task may run a nested batch and several
+/// threads (the asset loaders, the occlusion job) may share the pool.
+////////////////////////////////////////////////////////////////////////////////
+namespace kmuvcl
+{
+  class WorkerPool
+  {
+  public:
+    explicit WorkerPool(unsigned int threads)
+    {
+      for (unsigned int i = 0; i < threads; ++i)
+        workers_.push_back(std::thread([this]() { work(); }));
+    }
+
+    ~WorkerPool()
+    {
+      {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_ = true;
+      }
+      wake_.notify_all();
+      for (unsigned int i = 0; i < workers_.size(); ++i)
+        workers_[i].join();
+    }
+
+    unsigned int size() const { return workers_.size(); }
+
+    // task(i) for i in [0, n), returns when every one has finished
+    void run(size_t n, const std::function<void(size_t)>& task)
+    {
+      if (n == 0)
+        return;
+
+      Batch batch;
+      batch.task = &task;
+      batch.remaining = n;
+      {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (size_t i = 1; i < n; ++i)
+          queue_.push_back(Item{ &batch, i });
+      }
+      wake_.notify_all();
+
+      execute(Item{ &batch, 0 });
+
+      std::unique_lock<std::mutex> lock(mutex_);
+      while (batch.remaining > 0)
+      {
+        if (queue_.empty())
+        {
+          done_.wait(lock);
+          continue;
+        }
+        Item item = queue_.front();
+        queue_.pop_front();
+        lock.unlock();
+        execute(item);
+        lock.lock();
+      }
+    }
+
+  private:
+    struct Batch
+    {
+      const std::function<void(size_t)>*  task;
+      size_t                              remaining;    // guarded by mutex_
+    };
+
+    struct Item
+    {
+      Batch*  batch;
+      size_t  index;
+    };
+
+    void execute(const Item& item)
+    {
+      (*item.batch->task)(item.index);
+
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (--item.batch->remaining == 0)
+        done_.notify_all();
+    }
+
+    void work()
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      while (true)
+      {
+        wake_.wait(lock, [this]() { return stop_ || !queue_.empty(); });
+        if (stop_)
+          return;
+
+        Item item = queue_.front();
+        queue_.pop_front();
+        lock.unlock();
+        execute(item);
+        lock.lock();
+      }
+    }
+
+    std::vector<std::thread>  workers_;
+    std::deque<Item>          queue_;
+    std::mutex                mutex_;
+    std::condition_variable   wake_;
+    std::condition_variable   done_;
+    bool                      stop_ = false;
+  };
+
+  // one worker per core besides the calling thread. Never destroyed: jobs of
+  // global objects (the occlusion culler) may still use it during exit
+  inline WorkerPool& worker_pool()
+  {
+    static WorkerPool* pool = new WorkerPool(std::max(1u, std::thread::hardware_concurrency()) - 1);
+    return *pool;
+  }
+
+  // job(first, last, chunk) for [0, n) in at most threads chunks of at least min_chunk
+  template <typename Job>
+  void parallel_chunks(size_t n, unsigned int threads, size_t min_chunk, Job job)
+  {
+    size_t chunks = std::max<size_t>(1, std::min<size_t>(threads, n / std::max<size_t>(1, min_chunk)));
+    if (chunks == 1)
+    {
+      job(0, n, 0);
+      return;
+    }
+
+    worker_pool().run(chunks, [&](size_t c) { job(n*c/chunks, n*(c + 1)/chunks, c); });
+  }
+}